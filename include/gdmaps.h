@@ -24,6 +24,7 @@
 #include <gdnsd/net.h>
 
 #include <inttypes.h>
+#include <stdbool.h>
 
 typedef struct gdmaps_t gdmaps_t;
 
@@ -31,6 +32,11 @@ typedef unsigned(*monreg_func_t)(const char* desc);
 
 F_NONNULLX(1) F_WUNUSED F_RETNN
 gdmaps_t* gdmaps_new(const vscf_data_t* maps_cfg, monreg_func_t mrf);
+// Enables caching of compiled maps in dir, which is created if necessary.
+// Must be called before gdmaps_load_databases().  New caches are written
+// from the thread started by gdmaps_setup_watchers().
+F_NONNULL
+void gdmaps_set_cache_dir(gdmaps_t* gdmaps, const char* dir);
 F_NONNULL
 void gdmaps_load_databases(const gdmaps_t* gdmaps);
 F_NONNULL F_PURE
@@ -50,4 +56,13 @@ const uint8_t* gdmaps_lookup(const gdmaps_t* gdmaps, const unsigned gdmap_idx, c
 F_NONNULL
 void gdmaps_setup_watchers(gdmaps_t* gdmaps);
 
+// A map's generation changes whenever its lookup data is updated at runtime.
+// Lookup results may be cached under the generation read before the lookup.
+F_NONNULL
+unsigned gdmaps_get_gen(const gdmaps_t* gdmaps, const unsigned gdmap_idx);
+// Whether a map's lookups use the client's DNS source address even when
+// there is EDNS Client Subnet data
+F_NONNULL F_PURE
+bool gdmaps_ignores_ecs(const gdmaps_t* gdmaps, const unsigned gdmap_idx);
+
 #endif // GDMAPS_H
@@ -27,7 +27,7 @@
 #include <math.h>
 
 F_NONNULL
-static unsigned dcinfo_init_auto(const dcinfo_t* info, const vscf_data_t* dc_auto_cfg, const char* map_name)
+static unsigned dcinfo_init_auto(dcinfo_t* info, const vscf_data_t* dc_auto_cfg, const char* map_name)
 {
     if (!vscf_is_hash(dc_auto_cfg))
         log_fatal("plugin_geoip: map '%s': auto_dc_coords must be a key-value hash", map_name);
@@ -76,6 +76,26 @@ static unsigned dcinfo_init_auto(const dcinfo_t* info, const vscf_data_t* dc_aut
         info->dcs[dcidx].coords.cos_lat = cos(lat * DEG2RAD);
     }
 
+    dcinfo_trig_t* trig = xcalloc(sizeof(*trig));
+    trig->sin_hlat = xmalloc_n(num_dcs, sizeof(*trig->sin_hlat));
+    trig->cos_hlat = xmalloc_n(num_dcs, sizeof(*trig->cos_hlat));
+    trig->sin_hlon = xmalloc_n(num_dcs, sizeof(*trig->sin_hlon));
+    trig->cos_hlon = xmalloc_n(num_dcs, sizeof(*trig->cos_hlon));
+    trig->cos_lat = xmalloc_n(num_dcs, sizeof(*trig->cos_lat));
+    for (unsigned i = 0; i < num_dcs; i++) {
+        const dcinfo_coords_t* coords = &info->dcs[i].coords;
+        GDNSD_DIAG_PUSH_IGNORED("-Wdouble-promotion")
+        if (isnan(coords->lat))
+            trig->missing = true;
+        GDNSD_DIAG_POP
+        trig->sin_hlat[i] = sin(coords->lat * 0.5);
+        trig->cos_hlat[i] = cos(coords->lat * 0.5);
+        trig->sin_hlon[i] = sin(coords->lon * 0.5);
+        trig->cos_hlon[i] = cos(coords->lon * 0.5);
+        trig->cos_lat[i] = coords->cos_lat;
+    }
+    info->trig = trig;
+
     return num_auto;
 }
 
@@ -134,10 +154,10 @@ unsigned dcinfo_get_limit(const dcinfo_t* info)
     return info->auto_limit;
 }
 
-const dcinfo_coords_t* dcinfo_get_coords(const dcinfo_t* info, const unsigned dcnum)
+const dcinfo_trig_t* dcinfo_get_trig(const dcinfo_t* info)
 {
-    gdnsd_assert(dcnum < info->num_dcs);
-    return &info->dcs[dcnum].coords;
+    gdnsd_assert(info->trig);
+    return info->trig;
 }
 
 unsigned dcinfo_name2num(const dcinfo_t* info, const char* dcname)
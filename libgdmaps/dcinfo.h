@@ -56,6 +56,18 @@ typedef struct {
     double cos_lat;
 } dcinfo_coords_t;
 
+// The terms of the distance calculation in dclists_city_auto_map() which
+//  depend only on the datacenters, as flat arrays indexed by dcnum - 1.
+//  Datacenters without coordinates have NaNs here.
+typedef struct {
+    double* sin_hlat; // sin(lat / 2)
+    double* cos_hlat; // cos(lat / 2)
+    double* sin_hlon; // sin(lon / 2)
+    double* cos_hlon; // cos(lon / 2)
+    double* cos_lat;
+    bool missing; // any datacenters without coordinates?
+} dcinfo_trig_t;
+
 typedef struct {
     char* name;
     dcinfo_coords_t coords;
@@ -66,6 +78,7 @@ typedef struct {
     unsigned num_dcs;    // count of datacenters
     unsigned auto_limit; // lesser of num_dcs and dc_auto_limit cfg
     dci_t* dcs;          // ordered list of datacenters, #num_dcs
+    dcinfo_trig_t* trig; // only with auto_dc_coords
 } dcinfo_t;
 
 F_NONNULLX(1, 2, 5)
@@ -75,7 +88,7 @@ unsigned dcinfo_get_count(const dcinfo_t* info);
 F_NONNULL F_PURE
 unsigned dcinfo_get_limit(const dcinfo_t* info);
 F_NONNULL F_PURE F_RETNN
-const dcinfo_coords_t* dcinfo_get_coords(const dcinfo_t* info, const unsigned dcnum);
+const dcinfo_trig_t* dcinfo_get_trig(const dcinfo_t* info);
 F_NONNULLX(1) F_PURE
 unsigned dcinfo_name2num(const dcinfo_t* info, const char* dcname);
 F_NONNULL F_PURE
@@ -25,8 +25,10 @@
 #include <gdnsd/alloc.h>
 #include <gdnsd/log.h>
 #include <gdnsd/vscf.h>
+#include <gdnsd/mm3.h>
 
 #include <math.h>
+#include <string.h>
 
 /***************************************
  * dclists_t and related methods
@@ -59,6 +61,49 @@
 //  be aborted, and the destruct-all-strings form is
 //  used on true shutdown of the whole gdmap (only debug
 //  mode for the real plugin).
+// Lists are interned through a hash index of list numbers, so that
+//  city-auto mode's many lookups don't scan every existing list.
+
+// Initial index size, power of two.  The index doubles whenever it would
+//  become more than half full.
+#define DCLISTS_INDEX_INIT 64U
+
+F_NONNULL F_PURE
+static unsigned dclists_hash(const uint8_t* list)
+{
+    return (unsigned)hash_mm3_sz(list, strlen((const char*)list));
+}
+
+// Adds list idx to the index, unless an equal list is already there (only
+//  possible if the config repeats a list as the default), in which case the
+//  lower index keeps winning lookups, as with the linear search this replaced
+F_NONNULL
+static void dclists_index_add(dclists_t* lists, const uint32_t idx)
+{
+    const uint8_t* list = lists->list[idx];
+    unsigned slot = dclists_hash(list) & lists->index_mask;
+    while (lists->index[slot]) {
+        if (!strcmp((const char*)list, (const char*)lists->list[lists->index[slot] - 1U]))
+            return;
+        slot = (slot + 1U) & lists->index_mask;
+    }
+    lists->index[slot] = idx + 1U;
+}
+
+// (Re-)builds the index for the current lists, at whatever size keeps it at
+//  most half full
+F_NONNULL
+static void dclists_index_build(dclists_t* lists)
+{
+    unsigned size = DCLISTS_INDEX_INIT;
+    while (size < (lists->count * 2U))
+        size <<= 1U;
+    free(lists->index);
+    lists->index = xcalloc_n(size, sizeof(*lists->index));
+    lists->index_mask = size - 1U;
+    for (uint32_t i = 0; i < lists->count; i++)
+        dclists_index_add(lists, i);
+}
 
 dclists_t* dclists_new(const dcinfo_t* info)
 {
@@ -68,12 +113,14 @@ dclists_t* dclists_new(const dcinfo_t* info)
         deflist[i] = i + 1;
     deflist[num_dcs] = 0;
 
-    dclists_t* newdcl = xmalloc(sizeof(*newdcl));
+    dclists_t* newdcl = xcalloc(sizeof(*newdcl));
     newdcl->count = 1;
     newdcl->old_count = 0;
+    newdcl->alloc = 1;
     newdcl->list = xmalloc(sizeof(*newdcl->list));
     newdcl->list[0] = deflist;
     newdcl->info = info;
+    dclists_index_build(newdcl);
 
     return newdcl;
 }
@@ -84,11 +131,66 @@ dclists_t* dclists_clone(const dclists_t* old)
     dcl_clone->info = old->info;
     dcl_clone->count = old->count;
     dcl_clone->old_count = old->count;
+    dcl_clone->alloc = old->count;
     dcl_clone->list = xmalloc_n(dcl_clone->count, sizeof(*dcl_clone->list));
     memcpy(dcl_clone->list, old->list, dcl_clone->count * sizeof(*dcl_clone->list));
+    // The indices of existing lists don't change, so the index is copied as-is
+    dcl_clone->index_mask = old->index_mask;
+    dcl_clone->index = xmalloc_n(old->index_mask + 1U, sizeof(*dcl_clone->index));
+    memcpy(dcl_clone->index, old->index, (old->index_mask + 1U) * sizeof(*dcl_clone->index));
     return dcl_clone;
 }
 
+dclists_t* dclists_load(const dcinfo_t* info, const uint8_t* data, const size_t len, const unsigned count)
+{
+    const unsigned num_dcs = dcinfo_get_count(info);
+    if (!count || count > (DCLIST_MAX + 1U))
+        return NULL;
+
+    dclists_t* newdcl = xcalloc(sizeof(*newdcl));
+    newdcl->count = 0;
+    newdcl->old_count = 0;
+    newdcl->alloc = count;
+    newdcl->list = xmalloc_n(count, sizeof(*newdcl->list));
+    newdcl->info = info;
+
+    // Each list is a NUL-terminated string of at most num_dcs dc numbers,
+    //   which must all be valid for this map
+    size_t pos = 0;
+    while (newdcl->count < count) {
+        const size_t start = pos;
+        while (pos < len && data[pos]) {
+            if (data[pos] > num_dcs || pos - start >= num_dcs)
+                break;
+            pos++;
+        }
+        if (pos >= len || data[pos]) {
+            dclists_destroy(newdcl, KILL_ALL_LISTS);
+            return NULL;
+        }
+        newdcl->list[newdcl->count++] = (uint8_t*)xstrdup((const char*)&data[start]);
+        pos++;
+    }
+
+    if (pos != len) {
+        dclists_destroy(newdcl, KILL_ALL_LISTS);
+        return NULL;
+    }
+
+    dclists_index_build(newdcl);
+    return newdcl;
+}
+
+bool dclists_extends(const dclists_t* lists, const dclists_t* base)
+{
+    if (lists->count < base->count)
+        return false;
+    for (unsigned i = 0; i < base->count; i++)
+        if (strcmp((const char*)lists->list[i], (const char*)base->list[i]))
+            return false;
+    return true;
+}
+
 unsigned dclists_get_count(const dclists_t* lists)
 {
     gdnsd_assert(lists->count <= (DCLIST_MAX + 1U));
@@ -104,34 +206,42 @@ const uint8_t* dclists_get_list(const dclists_t* lists, const uint32_t idx)
 
 // Locates an existing dclist that matches newlist and returns its index, or if no match
 //  it copies newlist to the storage area and returns the new index.
-// If someone complains about load-time performance with large datecenter sets, this func
-//  will probably be a profiling hotspot.  It could use a hashtable rather than linear
-//  search for comparisons, and it could realloc the list by doubling instead of 1-at-a-time.
-// Not terribly worried about this unless someone complains first.
-F_NONNULL
-static uint32_t dclists_find_or_add_raw(dclists_t* lists, const uint8_t* newlist, const char* map_name)
+uint32_t dclists_find_or_add_raw(dclists_t* lists, const uint8_t* newlist, const char* map_name)
 {
-    for (uint32_t i = 0; i < lists->count; i++)
+    unsigned slot = dclists_hash(newlist) & lists->index_mask;
+    while (lists->index[slot]) {
+        const uint32_t i = lists->index[slot] - 1U;
         if (!strcmp((const char*)newlist, (const char*)(lists->list[i])))
             return i;
+        slot = (slot + 1U) & lists->index_mask;
+    }
 
     if (lists->count > DCLIST_MAX)
         log_fatal("plugin_geoip: map '%s': too many unique dclists (>%u)", map_name, lists->count);
 
     const uint32_t newidx = lists->count;
+    if (newidx == lists->alloc) {
+        lists->alloc = lists->alloc ? lists->alloc * 2U : 1U;
+        lists->list = xrealloc_n(lists->list, lists->alloc, sizeof(*lists->list));
+    }
     lists->count++;
-    lists->list = xrealloc_n(lists->list, lists->count, sizeof(*lists->list));
     lists->list[newidx] = (uint8_t*)xstrdup((const char*)newlist);
 
+    if (lists->count * 2U > lists->index_mask + 1U)
+        dclists_index_build(lists);
+    else
+        lists->index[slot] = newidx + 1U;
+
     gdnsd_assert(newidx <= DCLIST_MAX);
     return newidx;
 }
 
 // replace the first (default) dclist...
-void dclists_replace_list0(const dclists_t* lists, uint8_t* newlist)
+void dclists_replace_list0(dclists_t* lists, uint8_t* newlist)
 {
     free(lists->list[0]);
     lists->list[0] = newlist;
+    dclists_index_build(lists);
 }
 
 // We should probably check for dupes in these map dclists, but really the fallout
@@ -168,66 +278,66 @@ uint32_t dclists_find_or_add_vscf(dclists_t* lists, vscf_data_t* vscf_list, cons
     return dclists_find_or_add_raw(lists, newlist, map_name);
 }
 
-// "Distance" between two lat/long points.  Inputs should be pre-converted to
-// radians.  Because we only care about rough distance comparison between
-// outputs of this function for sorting purposes, it does not matter what the
-// output units are.  This is the haversine method, but we cut the calculation
-// short before the pointless (for our purposes) unit/arc conversions, and thus
-// the answer is in units of the square of half the chord length (intuitively,
-// sorting by chord or arc lengths would come out the same).
-// cos_dc_lat == cos(dc_lat), but the cos operation is precached since we'll
-// re-use the same DC coordinates here many times.
-F_CONST
-static double geodist(double lat, double lon, double dc_lat, double dc_lon, double cos_dc_lat)
-{
-    const double sin_half_dlat = sin((dc_lat - lat) * 0.5);
-    const double sin_half_dlon = sin((dc_lon - lon) * 0.5);
-    return sin_half_dlat * sin_half_dlat + cos(lat) * cos_dc_lat * sin_half_dlon * sin_half_dlon;
-}
-
 uint32_t dclists_city_auto_map(dclists_t* lists, const char* map_name, const double lat, const double lon)
 {
-    const double lat_rad = lat * DEG2RAD;
-    const double lon_rad = lon * DEG2RAD;
-
-    // Copy the default datacenter list to local storage for sorting
     const unsigned num_dcs = dcinfo_get_count(lists->info);
     gdnsd_assert(num_dcs <= MAX_NUM_DCS);
 
-    const unsigned store_len = num_dcs + 1;
-    uint8_t sortlist[MAX_NUM_DCS + 1];
-    memcpy(sortlist, lists->list[0], store_len);
-
-    // calculate the target's distance from each datacenter.
+    // "Distance" from the target to each datacenter.  Because we only care
+    // about rough distance comparison for sorting purposes, it does not
+    // matter what the units are.  This is the haversine method, but we cut
+    // the calculation short before the pointless (for our purposes)
+    // unit/arc conversions, and thus the answer is in units of the square
+    // of half the chord length (intuitively, sorting by chord or arc lengths
+    // would come out the same).  The sines of the half-differences come from
+    // the angle-difference identity, using the trig of the datacenters'
+    // half-angles from dcinfo, so that the per-datacenter loop is just
+    // arithmetic over flat arrays, which the compiler can vectorize.
     // note the first element of 'dists' is unused, and
     //  storage is offset by one.  This is so that the actual
-    //  1-based dcnums in 'sortlist' can be used as direct
+    //  1-based dcnums in the lists can be used as direct
     //  indices into 'dists'
+    const dcinfo_trig_t* trig = dcinfo_get_trig(lists->info);
+    const double lat_half = lat * (DEG2RAD * 0.5);
+    const double lon_half = lon * (DEG2RAD * 0.5);
+    const double sin_hlat = sin(lat_half);
+    const double cos_hlat = cos(lat_half);
+    const double sin_hlon = sin(lon_half);
+    const double cos_hlon = cos(lon_half);
+    const double cos_lat = cos(lat * DEG2RAD);
     double dists[MAX_NUM_DCS + 1];
     for (unsigned i = 0; i < num_dcs; i++) {
-        const dcinfo_coords_t* coords = dcinfo_get_coords(lists->info, i);
-        GDNSD_DIAG_PUSH_IGNORED("-Wdouble-promotion")
-        if (!isnan(coords->lat))
-            dists[i + 1] = geodist(lat_rad, lon_rad, coords->lat, coords->lon, coords->cos_lat);
-        else
-            dists[i + 1] = (double) + INFINITY;
-        GDNSD_DIAG_POP
+        const double sin_half_dlat = trig->sin_hlat[i] * cos_hlat - trig->cos_hlat[i] * sin_hlat;
+        const double sin_half_dlon = trig->sin_hlon[i] * cos_hlon - trig->cos_hlon[i] * sin_hlon;
+        dists[i + 1] = sin_half_dlat * sin_half_dlat + cos_lat * trig->cos_lat[i] * sin_half_dlon * sin_half_dlon;
+    }
+    // Datacenters without coordinates sort last
+    if (trig->missing) {
+        for (unsigned i = 0; i < num_dcs; i++)
+            if (isnan(dists[i + 1]))
+                dists[i + 1] = (double)INFINITY;
     }
 
-    // Given the relatively small num_dcs of most configs,
-    //  this simple insertion sort is probably reasonably quick
-    for (unsigned i = 1; i < num_dcs; i++) {
-        unsigned temp = sortlist[i];
-        unsigned j = i - 1U;
-        while (j < i && dists[temp] < dists[sortlist[j]]) {
-            sortlist[j + 1U] = sortlist[j];
+    // Only the first auto_limit entries of the ordering are kept, so this
+    //  is an insertion sort of each datacenter (in default order, so ties
+    //  keep that order) into a sorted list of at most that many entries
+    const unsigned limit = dcinfo_get_limit(lists->info);
+    const uint8_t* deflist = lists->list[0];
+    uint8_t sortlist[MAX_NUM_DCS + 1];
+    unsigned sorted = 0;
+    for (unsigned i = 0; i < num_dcs && deflist[i]; i++) {
+        const unsigned dcnum = deflist[i];
+        const double dist = dists[dcnum];
+        if (sorted == limit && (!limit || !(dist < dists[sortlist[limit - 1U]])))
+            continue;
+        unsigned j = sorted < limit ? sorted++ : limit - 1U;
+        while (j && dist < dists[sortlist[j - 1U]]) {
+            sortlist[j] = sortlist[j - 1U];
             j--;
         }
-        sortlist[j + 1U] = temp;
+        sortlist[j] = (uint8_t)dcnum;
     }
-
-    // Cap the list at the auto_limit
-    sortlist[dcinfo_get_limit(lists->info)] = 0;
+    sortlist[sorted] = 0;
 
     return dclists_find_or_add_raw(lists, sortlist, map_name);
 }
@@ -249,6 +359,7 @@ void dclists_destroy(dclists_t* lists, dclists_destroy_depth_t depth)
     default:
         gdnsd_assert(0); // unreachable
     }
+    free(lists->index);
     free(lists->list);
     free(lists);
 }
@@ -31,7 +31,10 @@
 struct dclists {
     unsigned count; // count of unique result lists
     unsigned old_count; // count from object we cloned from
+    unsigned alloc; // allocated size of ->list
     uint8_t** list;    // strings of dc numbers
+    uint32_t* index; // hash index of ->list, entries are list number + 1, 0 is empty
+    unsigned index_mask; // index size - 1
     const dcinfo_t* info; // dclists_t doesn't own "info", just uses it for reference a lot
 };
 
@@ -65,12 +68,19 @@ F_NONNULL F_WUNUSED F_RETNN
 dclists_t* dclists_new(const dcinfo_t* info);
 F_NONNULL F_WUNUSED F_RETNN
 dclists_t* dclists_clone(const dclists_t* old);
+// Re-creates lists from "count" NUL-terminated lists packed into data,
+//   as saved from dclists_get_list(), or returns NULL if they're invalid
+F_NONNULL F_WUNUSED
+dclists_t* dclists_load(const dcinfo_t* info, const uint8_t* data, const size_t len, const unsigned count);
+// True if lists starts with exactly the lists in base
+F_NONNULL F_PURE
+bool dclists_extends(const dclists_t* lists, const dclists_t* base);
 F_NONNULL F_PURE
 unsigned dclists_get_count(const dclists_t* lists);
 F_NONNULL F_PURE F_RETNN
 const uint8_t* dclists_get_list(const dclists_t* lists, const uint32_t idx);
 F_NONNULL
-void dclists_replace_list0(const dclists_t* lists, uint8_t* newlist);
+void dclists_replace_list0(dclists_t* lists, uint8_t* newlist);
 
 // retval here: true -> "auto", false -> normal list
 F_NONNULL
@@ -79,6 +89,8 @@ bool dclists_xlate_vscf(const dclists_t* lists, vscf_data_t* vscf_list, const ch
 F_NONNULL
 uint32_t dclists_find_or_add_vscf(dclists_t* lists, vscf_data_t* vscf_list, const char* map_name, const bool allow_auto);
 F_NONNULL
+uint32_t dclists_find_or_add_raw(dclists_t* lists, const uint8_t* newlist, const char* map_name);
+F_NONNULL
 uint32_t dclists_city_auto_map(dclists_t* lists, const char* map_name, const double lat, const double lon);
 F_NONNULL
 void dclists_destroy(dclists_t* lists, dclists_destroy_depth_t depth);
@@ -27,6 +27,7 @@
 
 #include <gdnsd/alloc.h>
 #include <gdnsd/log.h>
+#include <gdnsd/misc.h>
 
 #include <inttypes.h>
 #include <stdbool.h>
@@ -36,16 +37,49 @@
 #include <unistd.h>
 #include <time.h>
 #include <setjmp.h>
+#include <signal.h>
+#include <pthread.h>
 
 #ifdef HAVE_GEOIP2
 
 #include <maxminddb.h>
+#include <urcu/uatomic.h>
+
+// The tree walk is cut into independent subtrees, which are translated in
+//   parallel by up to XLATE_MAX_THREADS threads.  The cut is made at prefix
+//   length XLATE_SPLIT_BITS, and also XLATE_SPLIT_BITS below the start of
+//   the IPv4 space at ::/96, which holds most of the data in real databases.
+#define XLATE_SPLIT_BITS 8U
+#define XLATE_MAX_THREADS 8U
+
+// Each thread caches the dclist of every data record offset it has resolved,
+//   in an open-addressed table which doubles when half full
+#define OFFSET_CACHE_INIT 4096U // power of two
 
 typedef struct {
-    unsigned offset; // cppcheck-suppress unusedStructMember
+    uint32_t offset; // cppcheck-suppress unusedStructMember
     uint32_t dclist; // cppcheck-suppress unusedStructMember
 } offset_cache_item_t;
-#define OFFSET_CACHE_SIZE 129113 // prime
+
+typedef struct {
+    offset_cache_item_t* items;
+    unsigned mask;
+    unsigned count;
+} offset_cache_t;
+
+// City-auto mode also caches the dclist computed for each distinct pair of
+//   coordinates, as many records (e.g. postal codes) share their city's
+typedef struct {
+    uint64_t lat; // cppcheck-suppress unusedStructMember
+    uint64_t lon; // cppcheck-suppress unusedStructMember
+    uint32_t dclist; // cppcheck-suppress unusedStructMember
+} coords_cache_item_t;
+
+typedef struct {
+    coords_cache_item_t* items;
+    unsigned mask;
+    unsigned count;
+} coords_cache_t;
 
 typedef struct {
     MMDB_s mmdb;
@@ -56,10 +90,39 @@ typedef struct {
     bool is_city;
     bool is_v4;
     bool city_auto_mode;
-    sigjmp_buf jbuf;
-    offset_cache_item_t* offset_cache[OFFSET_CACHE_SIZE];
+    pthread_mutex_t dclists_lock; // city-auto adds to ->dclists from all threads
 } geoip2_t;
 
+// One record of the top of the tree, which is either a leaf or the root of
+//   a subtree, along with the list its translation is appended to
+typedef struct {
+    struct in6_addr ip;
+    unsigned depth;
+    uint32_t record;
+    MMDB_entry_s entry;
+    uint8_t type;
+    bool right;
+    uint32_t parent;
+    nlist_t* nl;
+} xlate_task_t;
+
+typedef struct {
+    xlate_task_t* tasks;
+    unsigned count;
+    unsigned alloc;
+    unsigned next; // next task to hand out, atomic
+    bool failed; // atomic
+} xlate_work_t;
+
+typedef struct {
+    geoip2_t* db;
+    xlate_work_t* work;
+    offset_cache_t cache;
+    coords_cache_t coords;
+    pthread_t tid;
+    sigjmp_buf jbuf;
+} geoip2_thr_t;
+
 F_NONNULL
 static bool geoip2_mmdb_log_meta(const MMDB_metadata_s* meta, const char* map_name, const char* pathname)
 {
@@ -100,10 +163,9 @@ F_NONNULL
 static void geoip2_destroy(geoip2_t* db)
 {
     MMDB_close(&db->mmdb);
+    pthread_mutex_destroy(&db->dclists_lock);
     free(db->map_name);
     free(db->pathname);
-    for (unsigned i = 0; i < OFFSET_CACHE_SIZE; i++)
-        free(db->offset_cache[i]);
     free(db);
 }
 
@@ -118,6 +180,7 @@ static geoip2_t* geoip2_new(const char* pathname, const char* map_name, dclists_
         free(db);
         return NULL;
     }
+    pthread_mutex_init(&db->dclists_lock, NULL);
 
     const MMDB_metadata_s* meta = &db->mmdb.metadata;
     if (!geoip2_mmdb_log_meta(meta, map_name, pathname)) {
@@ -204,12 +267,13 @@ static const char* GEOIP2_PATH_CITY[] = { "city", "names", "en", NULL };
     } else if (mmrv_ != MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR) {\
         log_err("plugin_geoip: map %s: Unexpected error fetching GeoIP2 data (%s)",\
             state->db->map_name, MMDB_strerror(mmrv_));\
-        siglongjmp(state->db->jbuf, 1);\
+        siglongjmp(state->thr->jbuf, 1);\
     }\
 } while (0)
 
 typedef struct {
-    geoip2_t* db;
+    const geoip2_t* db;
+    geoip2_thr_t* thr;
     MMDB_entry_s* entry;
     bool out_of_data;
 } geoip2_dcmap_cb_data_t;
@@ -271,7 +335,7 @@ static void geoip2_dcmap_cb(void* data, char* lookup, const unsigned level)
     } else {
         log_err("plugin_geoip: map %s: Unexpected error fetching GeoIP2City subdivision data (%s)",
                 state->db->map_name, MMDB_strerror(mmrv));
-        siglongjmp(state->db->jbuf, 1);
+        siglongjmp(state->thr->jbuf, 1);
     }
 }
 
@@ -286,18 +350,81 @@ static const char* GEOIP2_PATH_LON[] = { "location", "longitude", NULL };
     } else if(mmrv_ != MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR) {\
         log_err("plugin_geoip: map %s: Unexpected error fetching GeoIP2City location data (%s)",\
             state.db->map_name, MMDB_strerror(mmrv_));\
-        siglongjmp(state.db->jbuf, 1);\
+        siglongjmp(state.thr->jbuf, 1);\
     }\
 } while (0)
 
+F_CONST
+static unsigned coords_cache_hash(const uint64_t lat, const uint64_t lon)
+{
+    const uint64_t h = (lat ^ (lon * 0x9E3779B97F4A7C15ULL)) * 0xC2B2AE3D27D4EB4FULL;
+    return (unsigned)(h ^ (h >> 32));
+}
+
+F_NONNULL
+static void coords_cache_grow(coords_cache_t* cc)
+{
+    const unsigned old_size = cc->items ? cc->mask + 1U : 0;
+    const unsigned new_size = old_size ? old_size << 1 : OFFSET_CACHE_INIT;
+    coords_cache_item_t* old_items = cc->items;
+    cc->items = xmalloc_n(new_size, sizeof(*cc->items));
+    memset(cc->items, 0xFF, new_size * sizeof(*cc->items));
+    cc->mask = new_size - 1U;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_items[i].dclist != UINT32_MAX) {
+            unsigned slot = coords_cache_hash(old_items[i].lat, old_items[i].lon) & cc->mask;
+            while (cc->items[slot].dclist != UINT32_MAX)
+                slot = (slot + 1U) & cc->mask;
+            cc->items[slot] = old_items[i];
+        }
+    }
+    free(old_items);
+}
+
+// The table is only allocated on first use, as most maps aren't city-auto
+F_NONNULL
+static uint32_t geoip2_city_auto_cached(geoip2_thr_t* thr, const double lat, const double lon)
+{
+    coords_cache_t* cc = &thr->coords;
+    if (!cc->items)
+        coords_cache_grow(cc);
+
+    uint64_t lat_bits;
+    uint64_t lon_bits;
+    memcpy(&lat_bits, &lat, sizeof(lat_bits));
+    memcpy(&lon_bits, &lon, sizeof(lon_bits));
+
+    unsigned slot = coords_cache_hash(lat_bits, lon_bits) & cc->mask;
+    while (cc->items[slot].dclist != UINT32_MAX) {
+        if (cc->items[slot].lat == lat_bits && cc->items[slot].lon == lon_bits)
+            return cc->items[slot].dclist;
+        slot = (slot + 1U) & cc->mask;
+    }
+
+    geoip2_t* db = thr->db;
+    pthread_mutex_lock(&db->dclists_lock);
+    const uint32_t dclist = dclists_city_auto_map(db->dclists, db->map_name, lat, lon);
+    pthread_mutex_unlock(&db->dclists_lock);
+
+    cc->items[slot].lat = lat_bits;
+    cc->items[slot].lon = lon_bits;
+    cc->items[slot].dclist = dclist;
+    if (++cc->count > (cc->mask >> 1))
+        coords_cache_grow(cc);
+    return dclist;
+}
+
 F_NONNULL
-static unsigned geoip2_get_dclist(geoip2_t* db, MMDB_entry_s* db_entry)
+static unsigned geoip2_get_dclist(geoip2_thr_t* thr, MMDB_entry_s* db_entry)
 {
+    geoip2_t* db = thr->db;
+
     // lack of both would be pointless, and is checked at outer scope
     gdnsd_assert(db->dcmap || db->city_auto_mode);
 
     geoip2_dcmap_cb_data_t state = {
         .db = db,
+        .thr = thr,
         .entry = db_entry,
         .out_of_data = false,
     };
@@ -321,8 +448,9 @@ static unsigned geoip2_get_dclist(geoip2_t* db, MMDB_entry_s* db_entry)
             double lon = 0.0;
             bool lon_set = false;
             mmdb_lookup_double_(lon, lon_set, GEOIP2_PATH_LON);
-            if (lon_set)
-                dclist = dclists_city_auto_map(db->dclists, db->map_name, lat, lon);
+            if (lon_set) {
+                dclist = geoip2_city_auto_cached(thr, lat, lon);
+            }
         }
     }
 
@@ -331,115 +459,309 @@ static unsigned geoip2_get_dclist(geoip2_t* db, MMDB_entry_s* db_entry)
     return dclist;
 }
 
+F_CONST
+static unsigned offset_cache_hash(const uint32_t offset)
+{
+    const uint32_t h = offset * 0x9E3779B1U;
+    return h ^ (h >> 16);
+}
+
 F_NONNULL
-static uint32_t geoip2_get_dclist_cached(geoip2_t* db, MMDB_entry_s* db_entry)
+static void offset_cache_init(offset_cache_t* oc)
 {
-    const uint32_t offset = db_entry->offset;
+    oc->items = xmalloc_n(OFFSET_CACHE_INIT, sizeof(*oc->items));
+    memset(oc->items, 0xFF, OFFSET_CACHE_INIT * sizeof(*oc->items));
+    oc->mask = OFFSET_CACHE_INIT - 1U;
+    oc->count = 0;
+}
 
-    unsigned bucket_size = 0;
-    const unsigned ndx = offset % OFFSET_CACHE_SIZE;
+F_NONNULL
+static void offset_cache_grow(offset_cache_t* oc)
+{
+    const unsigned old_size = oc->mask + 1U;
+    const unsigned new_size = old_size << 1;
+    offset_cache_item_t* old_items = oc->items;
+    oc->items = xmalloc_n(new_size, sizeof(*oc->items));
+    memset(oc->items, 0xFF, new_size * sizeof(*oc->items));
+    oc->mask = new_size - 1U;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_items[i].dclist != UINT32_MAX) {
+            unsigned slot = offset_cache_hash(old_items[i].offset) & oc->mask;
+            while (oc->items[slot].dclist != UINT32_MAX)
+                slot = (slot + 1U) & oc->mask;
+            oc->items[slot] = old_items[i];
+        }
+    }
+    free(old_items);
+}
+
+F_NONNULL
+static uint32_t geoip2_get_dclist_cached(geoip2_thr_t* thr, MMDB_entry_s* db_entry)
+{
+    offset_cache_t* oc = &thr->cache;
+    const uint32_t offset = db_entry->offset;
 
-    if (db->offset_cache[ndx]) {
-        for (bucket_size = 0; db->offset_cache[ndx][bucket_size].dclist != UINT32_MAX; bucket_size++)
-            if (db->offset_cache[ndx][bucket_size].offset == offset)
-                return db->offset_cache[ndx][bucket_size].dclist;
+    unsigned slot = offset_cache_hash(offset) & oc->mask;
+    while (oc->items[slot].dclist != UINT32_MAX) {
+        if (oc->items[slot].offset == offset)
+            return oc->items[slot].dclist;
+        slot = (slot + 1U) & oc->mask;
     }
 
-    const uint32_t dclist = geoip2_get_dclist(db, db_entry);
-    db->offset_cache[ndx] = xrealloc_n(db->offset_cache[ndx], bucket_size + 2, sizeof(*db->offset_cache[ndx]));
-    gdnsd_assert(db->offset_cache[ndx]);
-    db->offset_cache[ndx][bucket_size].offset = offset;
-    db->offset_cache[ndx][bucket_size].dclist = dclist;
-    db->offset_cache[ndx][bucket_size + 1].dclist = UINT32_MAX;
+    const uint32_t dclist = geoip2_get_dclist(thr, db_entry);
     gdnsd_assert(dclist <= DCLIST_MAX); // auto not allowed here, should have been resolved earlier
+    oc->items[slot].offset = offset;
+    oc->items[slot].dclist = dclist;
+    if (++oc->count > (oc->mask >> 1))
+        offset_cache_grow(oc);
     return dclist;
 }
 
+// skip v4-like spaces other than canonical compat area
+F_NONNULL F_PURE
+static bool geoip2_skip_space(const struct in6_addr* ip, const unsigned depth)
+{
+    return (depth == 32 && (!memcmp(ip->s6_addr, start_v4mapped, 12U)
+                            || !memcmp(ip->s6_addr, start_siit, 12U)
+                            || !memcmp(ip->s6_addr, start_wkp, 12U)))
+           || (depth == 96U && !memcmp(ip->s6_addr, start_teredo, 4U))
+           || (depth == 112U && !memcmp(ip->s6_addr, start_6to4, 2U));
+}
+
 F_NONNULL
-static void geoip2_list_xlate_recurse(geoip2_t* db, nlist_t* nl, struct in6_addr ip, unsigned depth, const uint32_t node_num)
+static void geoip2_read_node(geoip2_thr_t* thr, const unsigned depth, const uint32_t node_num, MMDB_search_node_s* node)
 {
-    gdnsd_assert(depth < 129U);
+    const geoip2_t* db = thr->db;
 
     if (!depth) {
         log_err("plugin_geoip: map '%s': GeoIP2 database '%s': Error while traversing tree nodes: depth too low", db->map_name, db->pathname);
-        siglongjmp(db->jbuf, 1);
+        siglongjmp(thr->jbuf, 1);
     }
 
-    // skip v4-like spaces other than canonical compat area
-    if (
-        (depth == 32 && (!memcmp(ip.s6_addr, start_v4mapped, 12U)
-                         || !memcmp(ip.s6_addr, start_siit, 12U)
-                         || !memcmp(ip.s6_addr, start_wkp, 12U)))
-        || (depth == 96U && !memcmp(ip.s6_addr, start_teredo, 4U))
-        || (depth == 112U && !memcmp(ip.s6_addr, start_6to4, 2U))
-    )
-        return;
-
-    MMDB_search_node_s node;
-    int read_rv = MMDB_read_node(&db->mmdb, node_num, &node);
+    int read_rv = MMDB_read_node(&db->mmdb, node_num, node);
     if (read_rv != MMDB_SUCCESS) {
         log_err("plugin_geoip: map '%s': GeoIP2 database '%s': Error while traversing tree nodes: %s",
                 db->map_name, db->pathname, MMDB_strerror(read_rv));
-        siglongjmp(db->jbuf, 1);
+        siglongjmp(thr->jbuf, 1);
     }
+}
 
-    const unsigned new_depth = depth - 1U;
-    const unsigned mask = 128U - new_depth;
+F_NONNULL
+static void geoip2_list_xlate_recurse(geoip2_thr_t* thr, nlist_t* nl, struct in6_addr ip, unsigned depth, const uint32_t node_num);
+
+// Translates one record of node_num, at the given depth of the record itself
+F_NONNULL
+static void geoip2_list_xlate_record(geoip2_thr_t* thr, nlist_t* nl, const struct in6_addr ip, const unsigned depth, const uint8_t type, const uint32_t record, MMDB_entry_s* entry, const uint32_t node_num, const bool right)
+{
+    const unsigned mask = 128U - depth;
 
-    switch (node.left_record_type) {
+    switch (type) {
     case MMDB_RECORD_TYPE_SEARCH_NODE:
-        geoip2_list_xlate_recurse(db, nl, ip, new_depth, node.left_record);
+        geoip2_list_xlate_recurse(thr, nl, ip, depth, record);
         break;
     case MMDB_RECORD_TYPE_EMPTY:
         nlist_append(nl, ip.s6_addr, mask, 0);
         break;
     case MMDB_RECORD_TYPE_DATA:
-        nlist_append(nl, ip.s6_addr, mask,
-                     geoip2_get_dclist_cached(db, &node.left_record_entry));
+        nlist_append(nl, ip.s6_addr, mask, geoip2_get_dclist_cached(thr, entry));
         break;
     default:
-        log_err("plugin_geoip: map %s: GeoIP2 data invalid left of node %u", db->map_name, node_num);
-        siglongjmp(db->jbuf, 1);
+        log_err("plugin_geoip: map %s: GeoIP2 data invalid %s of node %u", thr->db->map_name, right ? "right" : "left", node_num);
+        siglongjmp(thr->jbuf, 1);
     }
+}
+
+F_NONNULL
+static void geoip2_list_xlate_recurse(geoip2_thr_t* thr, nlist_t* nl, struct in6_addr ip, unsigned depth, const uint32_t node_num)
+{
+    gdnsd_assert(depth < 129U);
 
-    SETBIT_v6(ip.s6_addr, mask - 1U);
+    if (geoip2_skip_space(&ip, depth))
+        return;
 
-    switch (node.right_record_type) {
-    case MMDB_RECORD_TYPE_SEARCH_NODE:
-        geoip2_list_xlate_recurse(db, nl, ip, new_depth, node.right_record);
-        break;
-    case MMDB_RECORD_TYPE_EMPTY:
-        nlist_append(nl, ip.s6_addr, mask, 0);
-        break;
-    case MMDB_RECORD_TYPE_DATA:
-        nlist_append(nl, ip.s6_addr, mask,
-                     geoip2_get_dclist_cached(db, &node.right_record_entry));
-        break;
-    default:
-        log_err("plugin_geoip: map %s: GeoIP2 data invalid right of node %u", db->map_name, node_num);
-        siglongjmp(db->jbuf, 1);
+    MMDB_search_node_s node;
+    geoip2_read_node(thr, depth, node_num, &node);
+
+    const unsigned new_depth = depth - 1U;
+    geoip2_list_xlate_record(thr, nl, ip, new_depth, node.left_record_type,
+                             node.left_record, &node.left_record_entry, node_num, false);
+    SETBIT_v6(ip.s6_addr, 127U - new_depth);
+    geoip2_list_xlate_record(thr, nl, ip, new_depth, node.right_record_type,
+                             node.right_record, &node.right_record_entry, node_num, true);
+}
+
+// Whether a search node record at prefix length mask is above the cut, and
+//   should be split further rather than becoming a task.  Bits past the mask
+//   are always clear here, so the all-zeros test is just for the prefix.
+F_NONNULL F_PURE
+static bool geoip2_xlate_above_cut(const struct in6_addr* ip, const unsigned mask)
+{
+    return mask < XLATE_SPLIT_BITS
+           || (mask < 96U + XLATE_SPLIT_BITS && !memcmp(ip->s6_addr, ip6_zero.s6_addr, 16U));
+}
+
+F_NONNULL
+static void geoip2_xlate_split(geoip2_thr_t* thr, struct in6_addr ip, unsigned depth, const uint32_t node_num);
+
+F_NONNULL
+static void geoip2_xlate_split_record(geoip2_thr_t* thr, const struct in6_addr ip, const unsigned depth, const uint8_t type, const uint32_t record, const MMDB_entry_s* entry, const uint32_t node_num, const bool right)
+{
+    if (type == MMDB_RECORD_TYPE_SEARCH_NODE && geoip2_xlate_above_cut(&ip, 128U - depth)) {
+        geoip2_xlate_split(thr, ip, depth, record);
+        return;
+    }
+
+    xlate_work_t* work = thr->work;
+    if (work->count == work->alloc) {
+        work->alloc = work->alloc ? work->alloc << 1 : 256U;
+        work->tasks = xrealloc_n(work->tasks, work->alloc, sizeof(*work->tasks));
     }
+    xlate_task_t* task = &work->tasks[work->count++];
+    task->ip = ip;
+    task->depth = depth;
+    task->record = record;
+    task->entry = *entry;
+    task->type = type;
+    task->right = right;
+    task->parent = node_num;
+    task->nl = nlist_new(thr->db->map_name, true);
+}
+
+// Mirrors geoip2_list_xlate_recurse(), but queues tasks in address order
+F_NONNULL
+static void geoip2_xlate_split(geoip2_thr_t* thr, struct in6_addr ip, unsigned depth, const uint32_t node_num)
+{
+    gdnsd_assert(depth < 129U);
+
+    if (geoip2_skip_space(&ip, depth))
+        return;
+
+    MMDB_search_node_s node;
+    geoip2_read_node(thr, depth, node_num, &node);
+
+    const unsigned new_depth = depth - 1U;
+    geoip2_xlate_split_record(thr, ip, new_depth, node.left_record_type,
+                              node.left_record, &node.left_record_entry, node_num, false);
+    SETBIT_v6(ip.s6_addr, 127U - new_depth);
+    geoip2_xlate_split_record(thr, ip, new_depth, node.right_record_type,
+                              node.right_record, &node.right_record_entry, node_num, true);
 }
 
 F_NONNULL
-static void geoip2_list_xlate(geoip2_t* db, nlist_t* nl)
+static void geoip2_xlate_split_root(geoip2_thr_t* thr)
 {
-    const unsigned start_depth = db->is_v4 ? 32U : 128U;
-    geoip2_list_xlate_recurse(db, nl, ip6_zero, start_depth, 0U);
+    const unsigned start_depth = thr->db->is_v4 ? 32U : 128U;
+    geoip2_xlate_split(thr, ip6_zero, start_depth, 0U);
 }
 
-typedef void (*ij_func_t)(geoip2_t*, nlist_t**);
+F_NONNULL
+static void geoip2_xlate_tasks(geoip2_thr_t* thr)
+{
+    xlate_work_t* work = thr->work;
+    while (!uatomic_read(&work->failed)) {
+        const unsigned i = uatomic_add_return(&work->next, 1U) - 1U;
+        if (i >= work->count)
+            break;
+        xlate_task_t* task = &work->tasks[i];
+        geoip2_list_xlate_record(thr, task->nl, task->ip, task->depth, task->type,
+                                 task->record, &task->entry, task->parent, task->right);
+    }
+}
+
+// Runs func with thr's jump buffer set, and returns true if it failed
+typedef bool (*ij_func_t)(geoip2_thr_t*, void (*)(geoip2_thr_t*));
 F_NONNULL F_NOINLINE
-static void isolate_jmp(geoip2_t* db, nlist_t** nl)
+static bool isolate_jmp(geoip2_thr_t* thr, void (*func)(geoip2_thr_t*))
+{
+    if (!sigsetjmp(thr->jbuf, 0)) {
+        func(thr);
+        return false;
+    }
+    return true;
+}
+
+F_NONNULL
+static void* geoip2_xlate_thread(void* arg)
+{
+    gdnsd_thread_setname("gdnsd-geoip-xl");
+    geoip2_thr_t* thr = arg;
+    ij_func_t ij = &isolate_jmp;
+    if (ij(thr, geoip2_xlate_tasks))
+        uatomic_set(&thr->work->failed, true);
+    return NULL;
+}
+
+static unsigned geoip2_xlate_nthreads(void)
 {
-    *nl = nlist_new(db->map_name, true);
-    if (!sigsetjmp(db->jbuf, 0)) {
-        geoip2_list_xlate(db, *nl);
-        nlist_finish(*nl);
+    const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < 1)
+        return 1U;
+    if (ncpus > (long)XLATE_MAX_THREADS)
+        return XLATE_MAX_THREADS;
+    return (unsigned)ncpus;
+}
+
+F_NONNULL
+static nlist_t* geoip2_list_xlate(geoip2_t* db)
+{
+    xlate_work_t work = { 0 };
+    const unsigned nthreads = geoip2_xlate_nthreads();
+    geoip2_thr_t* thrs = xcalloc_n(nthreads, sizeof(*thrs));
+    for (unsigned i = 0; i < nthreads; i++) {
+        thrs[i].db = db;
+        thrs[i].work = &work;
+        offset_cache_init(&thrs[i].cache);
+    }
+
+    ij_func_t ij = &isolate_jmp;
+    if (ij(&thrs[0], geoip2_xlate_split_root)) {
+        work.failed = true;
     } else {
-        nlist_destroy(*nl);
-        *nl = NULL;
+        // The extra threads are spawned with all signals blocked, and this
+        //   thread translates tasks alongside them.
+        sigset_t sigmask_all;
+        sigfillset(&sigmask_all);
+        sigset_t sigmask_prev;
+        sigemptyset(&sigmask_prev);
+        if (pthread_sigmask(SIG_SETMASK, &sigmask_all, &sigmask_prev))
+            log_fatal("pthread_sigmask() failed");
+        for (unsigned i = 1; i < nthreads; i++) {
+            int pthread_err = pthread_create(&thrs[i].tid, NULL, geoip2_xlate_thread, &thrs[i]);
+            if (pthread_err)
+                log_fatal("plugin_geoip: map '%s': failed to create GeoIP2 translation thread: %s", db->map_name, logf_strerror(pthread_err));
+        }
+        if (pthread_sigmask(SIG_SETMASK, &sigmask_prev, NULL))
+            log_fatal("pthread_sigmask() failed");
+
+        if (ij(&thrs[0], geoip2_xlate_tasks))
+            uatomic_set(&work.failed, true);
+        for (unsigned i = 1; i < nthreads; i++)
+            pthread_join(thrs[i].tid, NULL);
     }
+
+    for (unsigned i = 0; i < nthreads; i++) {
+        free(thrs[i].cache.items);
+        free(thrs[i].coords.items);
+    }
+    free(thrs);
+
+    // Each task's list is normalized on its own, and appending them in order
+    //   merges any adjacent networks across their edges
+    nlist_t* nl = NULL;
+    if (!work.failed) {
+        nl = nlist_new(db->map_name, true);
+        for (unsigned i = 0; i < work.count; i++)
+            nlist_append_list(nl, work.tasks[i].nl);
+        nlist_finish(nl);
+        log_debug("plugin_geoip: map '%s': GeoIP2 tree translated in %u subtrees by %u threads",
+                  db->map_name, work.count, nthreads);
+    }
+
+    for (unsigned i = 0; i < work.count; i++)
+        nlist_destroy(work.tasks[i].nl);
+    free(work.tasks);
+
+    return nl;
 }
 
 nlist_t* gdgeoip2_make_list(const char* pathname, const char* map_name, dclists_t* dclists, const dcmap_t* dcmap, const bool city_auto_mode)
@@ -448,12 +770,10 @@ nlist_t* gdgeoip2_make_list(const char* pathname, const char* map_name, dclists_
 
     geoip2_t* db = geoip2_new(pathname, map_name, dclists, dcmap, city_auto_mode);
     if (db) {
-        if (!city_auto_mode && !dcmap) {
+        if (!city_auto_mode && !dcmap)
             log_warn("plugin_geoip: map %s: not processing GeoIP2 database '%s': no auto_dc_coords and no actual 'map', therefore nothing to do", map_name, pathname);
-        } else {
-            ij_func_t ij = &isolate_jmp;
-            ij(db, &nl);
-        }
+        else
+            nl = geoip2_list_xlate(db);
         geoip2_destroy(db);
     }
 
@@ -29,18 +29,21 @@
 #include "ntree.h"
 #include "nets.h"
 #include "gdgeoip2.h"
+#include "mapcache.h"
 
 #include <gdnsd/alloc.h>
 #include <gdnsd/log.h>
 #include <gdnsd/vscf.h>
 #include <gdnsd/paths.h>
 #include <gdnsd/misc.h>
+#include <gdnsd/mm3.h>
 
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -50,6 +53,8 @@
 
 #include <ev.h>
 #include <urcu-qsbr.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
 
 // When an input file change is detected, we wait this long
 //  for a followup change notification before processing.  Every time we get
@@ -64,10 +69,32 @@
 //   swap of the data for the runtime lookup threads.
 #define ALL_RELOAD_WAIT 7.0
 
+// Identifies the version of a file which some data was loaded from.  The
+//   full-resolution mtime and ctime are both used, so that a same-sized
+//   rewrite in place within the same second still counts as a new version.
 typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+} gdmap_file_id_t;
+
+typedef struct gdmap {
     char* name;
     char* geoip_path;
     char* nets_path;
+    char* geoip_share_key; // config which determines the content of ->geoip_list
+    struct gdmap** geoip_peers; // NULL-terminated, other maps which can share ->geoip_list
+    gdmap_file_id_t geoip_id; // version of ->geoip_path that ->geoip_list is from
+    bool geoip_id_valid;
+    char* cache_path; // compiled map cache file, NULL if not caching
+    uint64_t cfg_hash; // of the whole map config
+    uint64_t geoip_hash; // contents of ->geoip_path that ->geoip_list (or a cached ->tree) is from
+    uint64_t nets_hash; // likewise for ->nets_path
+    bool geoip_hash_valid;
+    bool nets_hash_valid;
+    bool cache_dirty; // ->tree was built at startup, and not yet saved to ->cache_path
     dcinfo_t dcinfo; // basic datacenter list/info
     dcmap_t* dcmap; // map of locinfo -> dclist
     dclists_t* dclists; // corresponds to ->tree
@@ -77,6 +104,7 @@ typedef struct {
     nlist_t* geoip_list; // optional main geoip db
     nlist_t* nets_list; // net overrides, optional
     ntree_t* tree; // merged->translated from the lists above
+    unsigned gen; // bumped after every update of ->tree, see gdmaps_get_gen()
     ev_stat geoip_stat_watcher;
     ev_stat nets_stat_watcher;
     ev_timer geoip_reload_timer;
@@ -93,8 +121,47 @@ static bool gdmap_badkey(const char* key, unsigned klen V_UNUSED, vscf_data_t* v
     log_fatal("plugin_geoip: map '%s': invalid config key '%s'", mapname, key);
 }
 
+F_NONNULL
+static void gdmap_key_cat(char** key, size_t* len, const char* str, const size_t slen)
+{
+    *key = xrealloc(*key, *len + slen + 1U);
+    memcpy(&(*key)[*len], str, slen);
+    *len += slen;
+    (*key)[*len] = '\0';
+}
+
+// Appends an unambiguous serialization of cfg (or of its absence) to *key
+F_NONNULLX(1, 2)
+static void gdmap_key_add(char** key, size_t* len, vscf_data_t* cfg)
+{
+    char buf[32];
+    if (!cfg) {
+        gdmap_key_cat(key, len, "-", 1U);
+    } else if (vscf_is_simple(cfg)) {
+        const unsigned vlen = vscf_simple_get_len(cfg);
+        gdmap_key_cat(key, len, buf, (size_t)snprintf(buf, sizeof(buf), "s%u:", vlen));
+        gdmap_key_cat(key, len, vscf_simple_get_data(cfg), vlen);
+    } else if (vscf_is_array(cfg)) {
+        const unsigned alen = vscf_array_get_len(cfg);
+        gdmap_key_cat(key, len, buf, (size_t)snprintf(buf, sizeof(buf), "a%u:", alen));
+        for (unsigned i = 0; i < alen; i++)
+            gdmap_key_add(key, len, vscf_array_get_data(cfg, i));
+    } else {
+        gdnsd_assert(vscf_is_hash(cfg));
+        const unsigned hlen = vscf_hash_get_len(cfg);
+        gdmap_key_cat(key, len, buf, (size_t)snprintf(buf, sizeof(buf), "h%u:", hlen));
+        for (unsigned i = 0; i < hlen; i++) {
+            unsigned klen;
+            const char* k = vscf_hash_get_key_byindex(cfg, i, &klen);
+            gdmap_key_cat(key, len, buf, (size_t)snprintf(buf, sizeof(buf), "k%u:", klen));
+            gdmap_key_cat(key, len, k, klen);
+            gdmap_key_add(key, len, vscf_hash_get_data_byindex(cfg, i));
+        }
+    }
+}
+
 F_NONNULLX(1, 2, 3)
-static void gdmap_init(gdmap_t* gdmap, const char* name, const vscf_data_t* map_cfg, monreg_func_t mrf)
+static void gdmap_init(gdmap_t* gdmap, const char* name, vscf_data_t* map_cfg, monreg_func_t mrf)
 {
     // basics
     gdmap->name = xstrdup(name);
@@ -105,7 +172,7 @@ static void gdmap_init(gdmap_t* gdmap, const char* name, const vscf_data_t* map_
     vscf_data_t* dc_cfg = vscf_hash_get_data_byconstkey(map_cfg, "datacenters", true);
     if (!dc_cfg)
         log_fatal("plugin_geoip: map '%s': missing required 'datacenters' array", name);
-    const vscf_data_t* dc_auto_cfg = vscf_hash_get_data_byconstkey(map_cfg, "auto_dc_coords", true);
+    vscf_data_t* dc_auto_cfg = vscf_hash_get_data_byconstkey(map_cfg, "auto_dc_coords", true);
     vscf_data_t* dc_auto_limit_cfg = vscf_hash_get_data_byconstkey(map_cfg, "auto_dc_limit", true);
     gdmap->city_auto_mode = dc_auto_cfg ? true : false;
     dcinfo_init(&gdmap->dcinfo, dc_cfg, dc_auto_cfg, dc_auto_limit_cfg, name, mrf);
@@ -125,7 +192,7 @@ static void gdmap_init(gdmap_t* gdmap, const char* name, const vscf_data_t* map_
     }
 
     // map config
-    const vscf_data_t* map_map = vscf_hash_get_data_byconstkey(map_cfg, "map", true);
+    vscf_data_t* map_map = vscf_hash_get_data_byconstkey(map_cfg, "map", true);
     if (map_map) {
         if (!vscf_is_hash(map_map))
             log_fatal("plugin_geoip: map '%s': 'map' stanza must be a hash", name);
@@ -134,6 +201,16 @@ static void gdmap_init(gdmap_t* gdmap, const char* name, const vscf_data_t* map_
         gdmap->dcmap = dcmap_new(map_map, gdmap->dclists_pend, 0, 0, name, gdmap->city_auto_mode);
     }
 
+    // The GeoIP2 translation depends only on the file and these settings, so
+    //   maps with identical ones can share the work of loading it
+    if (gdmap->geoip_path) {
+        size_t klen = 0;
+        gdmap_key_add(&gdmap->geoip_share_key, &klen, dc_cfg);
+        gdmap_key_add(&gdmap->geoip_share_key, &klen, dc_auto_cfg);
+        gdmap_key_add(&gdmap->geoip_share_key, &klen, dc_auto_limit_cfg);
+        gdmap_key_add(&gdmap->geoip_share_key, &klen, map_map);
+    }
+
     // nets config
     vscf_data_t* nets_cfg = vscf_hash_get_data_byconstkey(map_cfg, "nets", true);
     if (!nets_cfg || vscf_is_hash(nets_cfg)) {
@@ -150,26 +227,28 @@ static void gdmap_init(gdmap_t* gdmap, const char* name, const vscf_data_t* map_
 
     // check for invalid keys
     vscf_hash_iterate_const(map_cfg, true, gdmap_badkey, name);
+
+    // Any change to the config invalidates a cached compiled map
+    char* cfg_key = NULL;
+    size_t cfg_klen = 0;
+    gdmap_key_add(&cfg_key, &cfg_klen, map_cfg);
+    gdmap->cfg_hash = hash_mm3_sz((const uint8_t*)cfg_key, cfg_klen);
+    free(cfg_key);
 }
 
+// Publishes merged along with ->dclists_pend to the lookup threads
 F_NONNULL
-static void gdmap_tree_update(gdmap_t* gdmap)
+static void gdmap_tree_swap(gdmap_t* gdmap, ntree_t* merged)
 {
     gdnsd_assert(gdmap->dclists_pend);
 
-    ntree_t* merged;
-
-    if (gdmap->geoip_list) {
-        merged = nlist_merge2_tree(gdmap->geoip_list, gdmap->nets_list);
-    } else {
-        merged = nlist_xlate_tree(gdmap->nets_list);
-    }
-
     ntree_t* old_tree = gdmap->tree;
     dclists_t* old_lists = gdmap->dclists;
 
     rcu_assign_pointer(gdmap->dclists, gdmap->dclists_pend);
     rcu_assign_pointer(gdmap->tree, merged);
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(gdmap->gen, gdmap->gen + 1U);
     synchronize_rcu();
 
     gdmap->dclists_pend = NULL;
@@ -181,6 +260,169 @@ static void gdmap_tree_update(gdmap_t* gdmap)
     log_info("plugin_geoip: map '%s' runtime db updated. nets: %u dclists: %u", gdmap->name, gdmap->tree->count + 1, dclists_get_count(gdmap->dclists));
 }
 
+F_NONNULL
+static void gdmap_tree_update(gdmap_t* gdmap)
+{
+    gdnsd_assert(gdmap->dclists_pend);
+    gdnsd_assert(gdmap->nets_list);
+    gdnsd_assert(!gdmap->geoip_path || gdmap->geoip_list);
+
+    ntree_t* merged;
+
+    if (gdmap->geoip_list) {
+        merged = nlist_merge2_tree(gdmap->geoip_list, gdmap->nets_list);
+    } else {
+        merged = nlist_xlate_tree(gdmap->nets_list);
+    }
+
+    gdmap_tree_swap(gdmap, merged);
+}
+
+F_NONNULL
+static void gdmap_file_id_set(gdmap_file_id_t* id, const struct stat* st)
+{
+    memset(id, 0, sizeof(*id));
+    id->dev = st->st_dev;
+    id->ino = st->st_ino;
+    id->size = st->st_size;
+    id->mtime = st->st_mtim;
+    id->ctime = st->st_ctim;
+}
+
+F_NONNULL
+static bool gdmap_file_id(const char* path, gdmap_file_id_t* id)
+{
+    struct stat st;
+    if (stat(path, &st))
+        return false;
+    gdmap_file_id_set(id, &st);
+    return true;
+}
+
+F_NONNULL F_PURE
+static bool gdmap_file_id_eq(const gdmap_file_id_t* a, const gdmap_file_id_t* b)
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+           && a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec
+           && a->ctime.tv_sec == b->ctime.tv_sec && a->ctime.tv_nsec == b->ctime.tv_nsec;
+}
+
+// Hashes the contents of path for the cache key, and also gets its file id
+F_NONNULL
+static bool gdmap_hash_file(const char* path, uint64_t* hash, gdmap_file_id_t* id)
+{
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    bool rv = false;
+    struct stat st;
+    if (!fstat(fd, &st)) {
+        gdmap_file_id_set(id, &st);
+        const size_t len = (size_t)st.st_size;
+        if (!len) {
+            static const uint8_t empty[1] = { 0 };
+            *hash = hash_mm3_sz(empty, 0);
+            rv = true;
+        } else {
+            void* mapped = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) {
+                *hash = hash_mm3_sz(mapped, len);
+                munmap(mapped, len);
+                rv = true;
+            }
+        }
+    }
+    close(fd);
+    return rv;
+}
+
+// Whether path is still the version identified by id, so that a hash taken
+//   before loading it also describes what was loaded
+F_NONNULL
+static bool gdmap_file_unchanged(const char* path, const gdmap_file_id_t* id)
+{
+    gdmap_file_id_t now;
+    return gdmap_file_id(path, &now) && gdmap_file_id_eq(&now, id);
+}
+
+// The cache key covers everything a compiled map is built from: the map
+//   config and the contents of its geoip and nets files
+F_NONNULL
+static bool gdmap_cache_key(const gdmap_t* gdmap, uint64_t* key)
+{
+    if ((gdmap->geoip_path && !gdmap->geoip_hash_valid)
+            || (gdmap->nets_path && !gdmap->nets_hash_valid))
+        return false;
+    const uint64_t parts[3] = {
+        gdmap->cfg_hash,
+        gdmap->geoip_path ? gdmap->geoip_hash : 0,
+        gdmap->nets_path ? gdmap->nets_hash : 0,
+    };
+    *key = hash_mm3_sz((const uint8_t*)parts, sizeof(parts));
+    return true;
+}
+
+F_NONNULL
+static void gdmap_cache_save(gdmap_t* gdmap)
+{
+    gdmap->cache_dirty = false;
+    if (!gdmap->cache_path)
+        return;
+    uint64_t key;
+    if (!gdmap_cache_key(gdmap, &key)) {
+        log_info("plugin_geoip: map '%s': not saving cache file '%s': input files changed while loading", gdmap->name, gdmap->cache_path);
+        return;
+    }
+    mapcache_save(gdmap->cache_path, gdmap->name, key, gdmap->tree, gdmap->dclists);
+}
+
+// Finds a peer map whose current geoip_list came from this version of the file
+F_NONNULL
+static const gdmap_t* gdmap_geoip_peer(const gdmap_t* gdmap, const gdmap_file_id_t* id)
+{
+    for (gdmap_t** peer = gdmap->geoip_peers; *peer; peer++)
+        if ((*peer)->geoip_list && (*peer)->geoip_id_valid && gdmap_file_id_eq(&(*peer)->geoip_id, id))
+            return *peer;
+    return NULL;
+}
+
+typedef struct {
+    const dclists_t* from;
+    dclists_t* to;
+    uint32_t* xlate; // UINT32_MAX until looked up
+    const char* map_name;
+} gdmap_share_t;
+
+static uint32_t gdmap_share_xlate_dclist(const uint32_t dclist, void* data)
+{
+    gdmap_share_t* share = data;
+    if (share->xlate[dclist] == UINT32_MAX)
+        share->xlate[dclist] = dclists_find_or_add_raw(share->to, dclists_get_list(share->from, dclist), share->map_name);
+    return share->xlate[dclist];
+}
+
+// Copies a peer's geoip_list, re-indexing its dclists for our own, which may
+//   have been numbered differently due to other config (e.g. nets)
+F_NONNULL
+static nlist_t* gdmap_geoip_share(const gdmap_t* gdmap, const gdmap_t* peer, dclists_t* update_dclists)
+{
+    // The peer's newest lists are a superset of those its geoip_list uses
+    gdmap_share_t share = {
+        .from = peer->dclists_pend ? peer->dclists_pend : peer->dclists,
+        .to = update_dclists,
+        .map_name = gdmap->name,
+    };
+    const unsigned from_count = dclists_get_count(share.from);
+    share.xlate = xmalloc_n(from_count, sizeof(*share.xlate));
+    memset(share.xlate, 0xFF, from_count * sizeof(*share.xlate));
+    nlist_t* new_list = nlist_clone_xlate(peer->geoip_list, gdmap->name, gdmap_share_xlate_dclist, &share);
+    free(share.xlate);
+    log_info("plugin_geoip: map '%s': Sharing GeoIP2 database '%s' as already loaded by map '%s'",
+             gdmap->name, gdmap->geoip_path, peer->name);
+    return new_list;
+}
+
 F_NONNULL
 static bool gdmap_update_geoip(gdmap_t* gdmap, const char* path, nlist_t** out_list_ptr)
 {
@@ -193,13 +435,24 @@ static bool gdmap_update_geoip(gdmap_t* gdmap, const char* path, nlist_t** out_l
         update_dclists = gdmap->dclists_pend;
     }
 
-    nlist_t* new_list = gdgeoip2_make_list(
-                            path,
-                            gdmap->name,
-                            update_dclists,
-                            gdmap->dcmap,
-                            gdmap->city_auto_mode
-                        );
+    gdmap_file_id_t id;
+    uint64_t hash = 0;
+    const bool id_valid = gdmap->cache_path
+                          ? gdmap_hash_file(path, &hash, &id)
+                          : gdmap_file_id(path, &id);
+    const gdmap_t* peer = id_valid ? gdmap_geoip_peer(gdmap, &id) : NULL;
+
+    nlist_t* new_list;
+    if (peer)
+        new_list = gdmap_geoip_share(gdmap, peer, update_dclists);
+    else
+        new_list = gdgeoip2_make_list(
+                       path,
+                       gdmap->name,
+                       update_dclists,
+                       gdmap->dcmap,
+                       gdmap->city_auto_mode
+                   );
 
     bool rv = false;
 
@@ -214,6 +467,12 @@ static bool gdmap_update_geoip(gdmap_t* gdmap, const char* path, nlist_t** out_l
         if (*out_list_ptr)
             nlist_destroy(*out_list_ptr);
         *out_list_ptr = new_list;
+        gdmap->geoip_id = id;
+        gdmap->geoip_id_valid = id_valid;
+        if (gdmap->cache_path) {
+            gdmap->geoip_hash = hash;
+            gdmap->geoip_hash_valid = id_valid && gdmap_file_unchanged(path, &id);
+        }
     }
 
     return rv;
@@ -233,6 +492,11 @@ static bool gdmap_update_nets(gdmap_t* gdmap)
         update_dclists = gdmap->dclists_pend;
     }
 
+    gdmap_file_id_t id;
+    uint64_t hash = 0;
+    const bool hash_valid = gdmap->cache_path
+                            && gdmap_hash_file(gdmap->nets_path, &hash, &id);
+
     vscf_data_t* nets_cfg = vscf_scan_filename(gdmap->nets_path);
     nlist_t* new_list = NULL;
     if (nets_cfg) {
@@ -261,17 +525,80 @@ static bool gdmap_update_nets(gdmap_t* gdmap)
         if (gdmap->nets_list)
             nlist_destroy(gdmap->nets_list);
         gdmap->nets_list = new_list;
+        if (gdmap->cache_path) {
+            gdmap->nets_hash = hash;
+            gdmap->nets_hash_valid = hash_valid && gdmap_file_unchanged(gdmap->nets_path, &id);
+        }
     }
 
     return rv;
 }
 
+// Tries to start with the compiled map from ->cache_path.  On success the
+//   geoip and nets lists are left unloaded until some runtime update needs
+//   them, see gdmap_load_deferred().
+F_NONNULL
+static bool gdmap_cache_load(gdmap_t* gdmap)
+{
+    gdnsd_assert(gdmap->cache_path);
+    gdnsd_assert(gdmap->dclists_pend);
+
+    gdmap_file_id_t id;
+    if (gdmap->geoip_path)
+        gdmap->geoip_hash_valid = gdmap_hash_file(gdmap->geoip_path, &gdmap->geoip_hash, &id);
+    if (gdmap->nets_path)
+        gdmap->nets_hash_valid = gdmap_hash_file(gdmap->nets_path, &gdmap->nets_hash, &id);
+
+    uint64_t key;
+    if (!gdmap_cache_key(gdmap, &key))
+        return false;
+
+    ntree_t* tree;
+    dclists_t* dclists;
+    if (!mapcache_load(gdmap->cache_path, gdmap->name, key, &gdmap->dcinfo, &tree, &dclists))
+        return false;
+
+    // The lists already indexed by the dcmap and any direct nets must have
+    // kept their indices, which holds whenever the key matches, but is cheap
+    // to double-check
+    if (!dclists_extends(dclists, gdmap->dclists_pend)) {
+        log_info("plugin_geoip: map '%s': not using cache file '%s': datacenter lists do not match the config", gdmap->name, gdmap->cache_path);
+        ntree_destroy(tree);
+        dclists_destroy(dclists, KILL_ALL_LISTS);
+        return false;
+    }
+
+    dclists_destroy(gdmap->dclists_pend, KILL_ALL_LISTS);
+    gdmap->dclists_pend = dclists;
+    gdmap_tree_swap(gdmap, tree);
+    return true;
+}
+
+// Loads whichever of the lists were skipped by gdmap_cache_load(), before
+//   a runtime update merges them into a new tree
+F_NONNULL
+static bool gdmap_load_deferred(gdmap_t* gdmap)
+{
+    if (gdmap->geoip_path && !gdmap->geoip_list
+            && gdmap_update_geoip(gdmap, gdmap->geoip_path, &gdmap->geoip_list))
+        return true;
+    if (!gdmap->nets_list) {
+        gdnsd_assert(gdmap->nets_path);
+        if (gdmap_update_nets(gdmap))
+            return true;
+    }
+    return false;
+}
+
 F_NONNULL
 static void gdmap_initial_load_all(gdmap_t* gdmap)
 {
     gdnsd_assert(gdmap->dclists_pend);
     gdnsd_assert(!gdmap->geoip_list);
 
+    if (gdmap->cache_path && gdmap_cache_load(gdmap))
+        return;
+
     if (gdmap->geoip_path && gdmap_update_geoip(gdmap, gdmap->geoip_path, &gdmap->geoip_list))
         log_fatal("plugin_geoip: map '%s': cannot continue initial load", gdmap->name);
 
@@ -282,6 +609,7 @@ static void gdmap_initial_load_all(gdmap_t* gdmap)
     }
 
     gdmap_tree_update(gdmap);
+    gdmap->cache_dirty = !!gdmap->cache_path;
 }
 
 F_NONNULL
@@ -306,7 +634,8 @@ static void gdmap_geoip_reload_timer_cb(struct ev_loop* loop, ev_timer* w V_UNUS
 
     ev_timer_stop(loop, w);
 
-    if (!gdmap_update_geoip(gdmap, gdmap->geoip_path, &gdmap->geoip_list)) {
+    if (!gdmap_update_geoip(gdmap, gdmap->geoip_path, &gdmap->geoip_list)
+            && !gdmap_load_deferred(gdmap)) {
         gdnsd_assert(gdmap->dclists_pend);
         gdmap_kick_tree_update(gdmap, loop);
     }
@@ -323,7 +652,7 @@ static void gdmap_nets_reload_timer_cb(struct ev_loop* loop, ev_timer* w V_UNUSE
 
     ev_timer_stop(loop, w);
 
-    if (!gdmap_update_nets(gdmap)) {
+    if (!gdmap_update_nets(gdmap) && !gdmap_load_deferred(gdmap)) {
         gdnsd_assert(gdmap->dclists_pend);
         gdmap_kick_tree_update(gdmap, loop);
     }
@@ -388,6 +717,7 @@ static void gdmap_tree_update_cb(struct ev_loop* loop, ev_timer* w, int revents
     gdnsd_assert(gdmap);
     ev_timer_stop(loop, w);
     gdmap_tree_update(gdmap);
+    gdmap_cache_save(gdmap);
 }
 
 F_NONNULL
@@ -481,10 +811,33 @@ struct gdmaps_t {
     bool reload_thread_spawned;
     unsigned count;
     struct ev_loop* reload_loop;
+    char* cache_dir;
     gdmap_t* maps;
     monreg_func_t mrf;
 };
 
+// Sets up the list of maps which load the same GeoIP2 file with the same
+//   settings as map idx
+F_NONNULL
+static void gdmap_find_peers(gdmap_t* maps, const unsigned count, const unsigned idx)
+{
+    gdmap_t* gdmap = &maps[idx];
+    unsigned npeers = 0;
+    gdmap->geoip_peers = xmalloc(sizeof(*gdmap->geoip_peers));
+    if (gdmap->geoip_path) {
+        for (unsigned i = 0; i < count; i++) {
+            gdmap_t* other = &maps[i];
+            if (i != idx && other->geoip_path
+                    && !strcmp(gdmap->geoip_path, other->geoip_path)
+                    && !strcmp(gdmap->geoip_share_key, other->geoip_share_key)) {
+                gdmap->geoip_peers = xrealloc_n(gdmap->geoip_peers, npeers + 2U, sizeof(*gdmap->geoip_peers));
+                gdmap->geoip_peers[npeers++] = other;
+            }
+        }
+    }
+    gdmap->geoip_peers[npeers] = NULL;
+}
+
 F_NONNULL
 static bool gdmaps_new_iter(const char* key, unsigned klen V_UNUSED, vscf_data_t* val, void* data)
 {
@@ -503,6 +856,9 @@ gdmaps_t* gdmaps_new(const vscf_data_t* maps_cfg, monreg_func_t mrf)
     gdmaps->maps = xcalloc_n(num_maps, sizeof(*gdmaps->maps));
     vscf_hash_iterate(maps_cfg, true, gdmaps_new_iter, gdmaps);
     gdnsd_assert(num_maps == gdmaps->count);
+
+    for (unsigned i = 0; i < num_maps; i++)
+        gdmap_find_peers(gdmaps->maps, num_maps, i);
     return gdmaps;
 }
 
@@ -600,6 +956,33 @@ const uint8_t* gdmaps_lookup(const gdmaps_t* gdmaps, const unsigned gdmap_idx, c
     return gdmap_lookup(&gdmaps->maps[gdmap_idx], client, scope_mask);
 }
 
+unsigned gdmaps_get_gen(const gdmaps_t* gdmaps, const unsigned gdmap_idx)
+{
+    gdnsd_assert(gdmap_idx < gdmaps->count);
+    const unsigned rv = CMM_LOAD_SHARED(gdmaps->maps[gdmap_idx].gen);
+    cmm_smp_rmb(); // pairs with the wmb in gdmap_tree_update()
+    return rv;
+}
+
+bool gdmaps_ignores_ecs(const gdmaps_t* gdmaps, const unsigned gdmap_idx)
+{
+    gdnsd_assert(gdmap_idx < gdmaps->count);
+    return gdmaps->maps[gdmap_idx].ignore_ecs;
+}
+
+void gdmaps_set_cache_dir(gdmaps_t* gdmaps, const char* dir)
+{
+    gdnsd_assert(!gdmaps->cache_dir);
+    gdmaps->cache_dir = xstrdup(dir);
+    for (unsigned i = 0; i < gdmaps->count; i++) {
+        gdmap_t* gdmap = &gdmaps->maps[i];
+        // Map names are arbitrary strings, so the filename uses a hash
+        char fname[32];
+        snprintf(fname, sizeof(fname), "map.%016" PRIx64, (uint64_t)hash_mm3_sz((const uint8_t*)gdmap->name, strlen(gdmap->name)));
+        gdmap->cache_path = gdnsd_str_combine_n(3, dir, "/", fname);
+    }
+}
+
 void gdmaps_load_databases(const gdmaps_t* gdmaps)
 {
     for (unsigned i = 0; i < gdmaps->count; i++)
@@ -616,6 +999,16 @@ static void* gdmaps_reload_thread(void* arg)
     gdmaps_t* gdmaps = arg;
     gdnsd_assert(gdmaps);
 
+    // Compiled maps built during startup are saved here rather than at
+    // load time, which also happens for checkconf
+    if (gdmaps->cache_dir) {
+        if (mkdir(gdmaps->cache_dir, 0755) && errno != EEXIST)
+            log_err("plugin_geoip: cannot create map cache directory '%s': %s", gdmaps->cache_dir, logf_errno());
+        for (unsigned i = 0; i < gdmaps->count; i++)
+            if (gdmaps->maps[i].cache_dirty)
+                gdmap_cache_save(&gdmaps->maps[i]);
+    }
+
     gdmaps->reload_loop = ev_loop_new(EVFLAG_AUTO);
     for (unsigned i = 0; i < gdmaps->count; i++)
         gdmap_setup_watchers(&gdmaps->maps[i], gdmaps->reload_loop);
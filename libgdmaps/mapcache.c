@@ -0,0 +1,241 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd-plugin-geoip is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd-plugin-geoip is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "mapcache.h"
+
+#include <gdnsd/alloc.h>
+#include <gdnsd/log.h>
+#include <gdnsd/misc.h>
+#include <gdnsd/mm3.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// The file is this header, followed directly by the tree's node array, leaf
+// array, and ipv4 direct table, and then the dclists packed as consecutive
+// NUL-terminated strings.  The header's size keeps the arrays aligned.
+#define MAPCACHE_MAGIC "gdmapc\n"
+#define MAPCACHE_FORMAT 1U
+
+// Differs between builds with a different tree layout, and between hosts of
+// different byte order
+#define MAPCACHE_LAYOUT ((NT_STRIDE << 24) | (NT_V4_DIRECT << 16) \
+    | ((unsigned)sizeof(npnode_t) << 8) | (unsigned)sizeof(nleaf_t))
+
+#define V4DIRECT_BYTES ((1U << NT_V4_DIRECT) * sizeof(uint32_t))
+
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t layout;
+    uint64_t key;
+    uint64_t sum; // of everything after the header, see mapcache_sum()
+    uint32_t ipv4;
+    uint32_t count;
+    uint32_t nodes_count;
+    uint32_t leaves_count;
+    uint32_t dclists_count;
+    uint32_t dclists_len;
+} mapcache_hdr_t;
+
+_Static_assert(sizeof(mapcache_hdr_t) % 8U == 0, "Map cache header keeps 8-byte alignment");
+
+F_NONNULL
+static uint64_t mapcache_sum(const void* nodes, const size_t nodes_len, const void* leaves, const size_t leaves_len, const void* v4direct, const void* dclists, const size_t dclists_len)
+{
+    const uint64_t sums[4] = {
+        hash_mm3_sz(nodes, nodes_len),
+        hash_mm3_sz(leaves, leaves_len),
+        hash_mm3_sz(v4direct, V4DIRECT_BYTES),
+        hash_mm3_sz(dclists, dclists_len),
+    };
+    return hash_mm3_sz((const uint8_t*)sums, sizeof(sums));
+}
+
+F_NONNULL
+static bool write_all(const int fd, const void* buf, size_t len)
+{
+    const uint8_t* p = buf;
+    while (len) {
+        const ssize_t rv = write(fd, p, len);
+        if (rv < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += rv;
+        len -= (size_t)rv;
+    }
+    return true;
+}
+
+bool mapcache_save(const char* path, const char* map_name, const uint64_t key, const ntree_t* tree, const dclists_t* dclists)
+{
+    gdnsd_assert(!tree->alloc); // ntree_finish() was called
+
+    const unsigned dclists_count = dclists_get_count(dclists);
+    size_t dclists_len = 0;
+    for (unsigned i = 0; i < dclists_count; i++)
+        dclists_len += strlen((const char*)dclists_get_list(dclists, i)) + 1U;
+    uint8_t* dclists_buf = xmalloc(dclists_len);
+    size_t pos = 0;
+    for (unsigned i = 0; i < dclists_count; i++) {
+        const char* list = (const char*)dclists_get_list(dclists, i);
+        const size_t len = strlen(list) + 1U;
+        memcpy(&dclists_buf[pos], list, len);
+        pos += len;
+    }
+
+    const size_t nodes_len = tree->nodes_count * sizeof(*tree->nodes);
+    const size_t leaves_len = tree->leaves_count * sizeof(*tree->leaves);
+
+    mapcache_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MAPCACHE_MAGIC, sizeof(hdr.magic));
+    hdr.format = MAPCACHE_FORMAT;
+    hdr.layout = MAPCACHE_LAYOUT;
+    hdr.key = key;
+    hdr.sum = mapcache_sum(tree->nodes, nodes_len, tree->leaves, leaves_len,
+                           tree->v4direct, dclists_buf, dclists_len);
+    hdr.ipv4 = tree->ipv4;
+    hdr.count = tree->count;
+    hdr.nodes_count = tree->nodes_count;
+    hdr.leaves_count = tree->leaves_count;
+    hdr.dclists_count = dclists_count;
+    hdr.dclists_len = (uint32_t)dclists_len;
+
+    char* tmp_path = gdnsd_str_combine_n(2, path, ".tmp");
+    bool ok = false;
+    const int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        ok = write_all(fd, &hdr, sizeof(hdr))
+             && write_all(fd, tree->nodes, nodes_len)
+             && write_all(fd, tree->leaves, leaves_len)
+             && write_all(fd, tree->v4direct, V4DIRECT_BYTES)
+             && write_all(fd, dclists_buf, dclists_len);
+        if (close(fd))
+            ok = false;
+        if (ok && rename(tmp_path, path))
+            ok = false;
+    }
+
+    if (ok) {
+        log_info("plugin_geoip: map '%s': saved compiled map to cache file '%s'", map_name, path);
+    } else {
+        log_err("plugin_geoip: map '%s': failed to write cache file '%s': %s", map_name, path, logf_errno());
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(dclists_buf);
+    return ok;
+}
+
+bool mapcache_load(const char* path, const char* map_name, const uint64_t key, const dcinfo_t* info, ntree_t** tree_out, dclists_t** dclists_out)
+{
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            log_info("plugin_geoip: map '%s': no cache file '%s' yet", map_name, path);
+        else
+            log_err("plugin_geoip: map '%s': cannot open cache file '%s': %s", map_name, path, logf_errno());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(mapcache_hdr_t)) {
+        log_info("plugin_geoip: map '%s': not using cache file '%s': too short", map_name, path);
+        close(fd);
+        return false;
+    }
+
+    const size_t map_len = (size_t)st.st_size;
+    void* map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_err("plugin_geoip: map '%s': cannot mmap cache file '%s': %s", map_name, path, logf_errno());
+        return false;
+    }
+
+    const char* why = NULL;
+    const mapcache_hdr_t* hdr = map;
+    const uint8_t* payload = (const uint8_t*)map + sizeof(*hdr);
+    const size_t nodes_len = (size_t)hdr->nodes_count * sizeof(npnode_t);
+    const size_t leaves_len = (size_t)hdr->leaves_count * sizeof(nleaf_t);
+    dclists_t* dclists = NULL;
+    ntree_t* tree = NULL;
+
+    if (memcmp(hdr->magic, MAPCACHE_MAGIC, sizeof(hdr->magic)) || hdr->format != MAPCACHE_FORMAT || hdr->layout != MAPCACHE_LAYOUT)
+        why = "not from this version of gdnsd";
+    else if (hdr->key != key)
+        why = "inputs have changed";
+    else if (map_len != sizeof(*hdr) + nodes_len + leaves_len + V4DIRECT_BYTES + hdr->dclists_len)
+        why = "wrong size";
+    else if (hdr->sum != mapcache_sum(payload, nodes_len, &payload[nodes_len], leaves_len,
+                                      &payload[nodes_len + leaves_len],
+                                      &payload[nodes_len + leaves_len + V4DIRECT_BYTES], hdr->dclists_len))
+        why = "checksum mismatch";
+
+    if (!why) {
+        dclists = dclists_load(info, &payload[nodes_len + leaves_len + V4DIRECT_BYTES], hdr->dclists_len, hdr->dclists_count);
+        if (!dclists)
+            why = "invalid dclists";
+    }
+
+    if (!why) {
+        tree = xcalloc(sizeof(*tree));
+        tree->ipv4 = hdr->ipv4;
+        tree->count = hdr->count;
+        // The mapping is read-only, these are only cast for ntree_t's sake
+        tree->nodes = (npnode_t*)(uintptr_t)payload;
+        tree->leaves = (nleaf_t*)(uintptr_t)&payload[nodes_len];
+        tree->v4direct = (uint32_t*)(uintptr_t)&payload[nodes_len + leaves_len];
+        tree->nodes_count = hdr->nodes_count;
+        tree->leaves_count = hdr->leaves_count;
+        tree->mapped = map;
+        tree->mapped_len = map_len;
+        if (!ntree_check_compiled(tree, hdr->dclists_count))
+            why = "invalid tree";
+    }
+
+    if (why) {
+        log_info("plugin_geoip: map '%s': not using cache file '%s': %s", map_name, path, why);
+        if (dclists)
+            dclists_destroy(dclists, KILL_ALL_LISTS);
+        if (tree)
+            ntree_destroy(tree); // unmaps
+        else
+            munmap(map, map_len);
+        return false;
+    }
+
+    log_info("plugin_geoip: map '%s': loaded compiled map from cache file '%s'", map_name, path);
+    *tree_out = tree;
+    *dclists_out = dclists;
+    return true;
+}
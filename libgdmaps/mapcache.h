@@ -0,0 +1,46 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd-plugin-geoip is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd-plugin-geoip is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MAPCACHE_H
+#define MAPCACHE_H
+
+#include "dcinfo.h"
+#include "dclists.h"
+#include "ntree.h"
+
+#include <gdnsd/compiler.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// A map cache file holds a map's compiled ntree_t and its dclists_t, as they
+// were built from inputs (database files, nets, and config) which hash to
+// "key".  Files are only usable by the same build on the same host.
+
+// Writes the file atomically (via a temporary file and rename())
+F_NONNULL
+bool mapcache_save(const char* path, const char* map_name, const uint64_t key, const ntree_t* tree, const dclists_t* dclists);
+
+// Maps the file and validates it against the key and in general, then
+// returns a tree whose arrays point into the mapping, and a copy of the
+// dclists.  Returns false, logging why, if the file is missing or unusable.
+F_NONNULL
+bool mapcache_load(const char* path, const char* map_name, const uint64_t key, const dcinfo_t* info, ntree_t** tree_out, dclists_t** dclists_out);
+
+#endif // MAPCACHE_H
@@ -217,6 +217,25 @@ void nlist_append(nlist_t* nl, const uint8_t* ipv6, const unsigned mask, const u
     }
 }
 
+void nlist_append_list(nlist_t* nl, const nlist_t* src)
+{
+    for (unsigned i = 0; i < src->count; i++)
+        nlist_append(nl, src->nets[i].ipv6, src->nets[i].mask, src->nets[i].dclist);
+}
+
+nlist_t* nlist_clone_xlate(const nlist_t* nl, const char* map_name, nlist_xlate_dclist_t xlate, void* data)
+{
+    // Two of the original's dclists may translate to the same one, so this
+    //   goes through nlist_append() for its merging of adjacent networks
+    nlist_t* nlc = nlist_new(map_name, nl->normalized);
+    for (unsigned i = 0; i < nl->count; i++) {
+        const net_t* net = &nl->nets[i];
+        nlist_append(nlc, net->ipv6, net->mask, xlate(net->dclist, data));
+    }
+    nlist_finish(nlc);
+    return nlc;
+}
+
 F_NONNULL F_PURE
 static bool net_eq(const net_t* na, const net_t* nb)
 {
@@ -474,12 +493,12 @@ ntree_t* nlist_xlate_tree(const nlist_t* nl)
     // assert that the whole list was consumed
     gdnsd_assert(nlnet == nlnet_end);
 
-    // finalize the tree
-    ntree_finish(nt);
-
     // make sure all our logic worked out sanely
     ntree_assert_optimal(nt);
 
+    // finalize the tree
+    ntree_finish(nt);
+
     return nt;
 }
 
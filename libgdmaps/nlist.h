@@ -44,6 +44,18 @@ void nlist_destroy(nlist_t* nl);
 F_NONNULL
 void nlist_append(nlist_t* nl, const uint8_t* ipv6, const unsigned mask, const unsigned dclist);
 
+// Appends all of src's networks to nl, as if by nlist_append() in order.
+//   For "pre_norm" lists, src's networks must all follow nl's.
+F_NONNULL
+void nlist_append_list(nlist_t* nl, const nlist_t* src);
+
+// Returns a finished copy of a finished list for use by another map, with
+//   each network's dclist index replaced by the return value of xlate().
+//   The copy is "pre_norm" if the original was.
+typedef uint32_t (*nlist_xlate_dclist_t)(const uint32_t dclist, void* data);
+F_NONNULLX(1, 2, 3) F_WUNUSED F_RETNN
+nlist_t* nlist_clone_xlate(const nlist_t* nl, const char* map_name, nlist_xlate_dclist_t xlate, void* data);
+
 // Call this when all nlist_append() are complete.  For lists
 //   which are not "pre_norm", this does a bunch of normalization
 //   transformations on the data first (which can fail, hence
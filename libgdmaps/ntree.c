@@ -23,6 +23,8 @@
 #include <gdnsd/alloc.h>
 #include <gdnsd/log.h>
 
+#include <sys/mman.h>
+
 // Initial node allocation count,
 //   must be power of two due to alloc code,
 #define NT_SIZE_INIT 128U
@@ -33,12 +35,26 @@ ntree_t* ntree_new(void)
     newtree->store = xmalloc_n(NT_SIZE_INIT, sizeof(*newtree->store));
     newtree->count = 0;
     newtree->alloc = NT_SIZE_INIT; // set to zero on fixation
+    newtree->nodes = NULL;
+    newtree->leaves = NULL;
+    newtree->v4direct = NULL;
+    newtree->nodes_count = 0;
+    newtree->leaves_count = 0;
+    newtree->mapped = NULL;
+    newtree->mapped_len = 0;
     return newtree;
 }
 
 void ntree_destroy(ntree_t* tree)
 {
     free(tree->store);
+    if (tree->mapped) {
+        munmap(tree->mapped, tree->mapped_len);
+    } else {
+        free(tree->nodes);
+        free(tree->leaves);
+        free(tree->v4direct);
+    }
     free(tree);
 }
 
@@ -73,11 +89,174 @@ static unsigned ntree_find_v4root(const ntree_t* tree)
     return offset;
 }
 
+/*
+ * Compilation of the binary trie into the multi-bit lookup structure
+ */
+
+#define NT_FANOUT (1U << NT_STRIDE)
+
+typedef struct {
+    unsigned nodes_alloc;
+    unsigned leaves_alloc;
+} nt_compile_t;
+
+// Reserves n contiguous npnode_t, returning the index of the first
+F_NONNULL
+static unsigned nt_add_pnodes(ntree_t* tree, nt_compile_t* ctx, const unsigned n)
+{
+    while (tree->nodes_count + n > ctx->nodes_alloc) {
+        ctx->nodes_alloc <<= 1;
+        tree->nodes = xrealloc_n(tree->nodes, ctx->nodes_alloc, sizeof(*tree->nodes));
+    }
+    const unsigned rv = tree->nodes_count;
+    tree->nodes_count += n;
+    gdnsd_assert(tree->nodes_count < (1U << 31));
+    return rv;
+}
+
+F_NONNULL
+static unsigned nt_add_leaf(ntree_t* tree, nt_compile_t* ctx, const nleaf_t* leaf)
+{
+    if (tree->leaves_count == ctx->leaves_alloc) {
+        ctx->leaves_alloc <<= 1;
+        tree->leaves = xrealloc_n(tree->leaves, ctx->leaves_alloc, sizeof(*tree->leaves));
+    }
+    const unsigned rv = tree->leaves_count++;
+    gdnsd_assert(rv < (1U << 31)); // for NN_SET_DCLIST() in v4direct
+    tree->leaves[rv] = *leaf;
+    return rv;
+}
+
+// Walks the binary trie down from the interior node at "offset", following
+// the low "bits" bits of "path" from the most significant, until it reaches a
+// terminal or has consumed all of them.  Returns the terminal or the interior
+// node it stopped at, and sets *steps to the number of bits consumed.
+F_NONNULL
+static unsigned nt_walk(const ntree_t* tree, unsigned offset, const unsigned path, const unsigned bits, unsigned* steps)
+{
+    unsigned i = 0;
+    do {
+        gdnsd_assert(offset < tree->count);
+        const nnode_t* current = &tree->store[offset];
+        offset = (path & (1U << (bits - 1U - i))) ? current->one : current->zero;
+        i++;
+    } while (i < bits && !NN_IS_DCLIST(offset));
+    *steps = i;
+    return offset;
+}
+
+// Compiles the binary subtree under the interior node at "offset", which is
+// at "depth" (relative to the ipv4 root for v4), into the npnode_t at pidx,
+// recursing for its children.  In the v6 trie, the ipv4 root becomes a
+// NL_V4_SPACE leaf rather than compiling the v4 subtree a second time.
+F_NONNULL
+static void nt_compile_node(ntree_t* tree, nt_compile_t* ctx, const unsigned pidx, const unsigned offset, const unsigned depth, const bool v4)
+{
+    unsigned children[NT_FANOUT];
+    unsigned nchild = 0;
+    uint64_t vector = 0;
+    uint64_t leafvec = 0;
+    const unsigned base0 = tree->leaves_count;
+    nleaf_t prev = { 0, 0 };
+
+    for (unsigned i = 0; i < NT_FANOUT; i++) {
+        unsigned steps;
+        const unsigned next = nt_walk(tree, offset, i, NT_STRIDE, &steps);
+        nleaf_t leaf;
+        if (NN_IS_DCLIST(next)) {
+            leaf.dclist = next;
+            leaf.mask = depth + steps;
+        } else if (!v4 && next == tree->ipv4) {
+            gdnsd_assert(depth + NT_STRIDE == 96U);
+            leaf.dclist = NN_UNDEF;
+            leaf.mask = NL_V4_SPACE;
+        } else {
+            vector |= UINT64_C(1) << i;
+            children[nchild++] = next;
+            continue;
+        }
+        // a new run starts at the first leaf, and at any leaf unlike the
+        //   previous one, ignoring any children in between
+        if (!leafvec || leaf.dclist != prev.dclist || leaf.mask != prev.mask) {
+            leafvec |= UINT64_C(1) << i;
+            nt_add_leaf(tree, ctx, &leaf);
+            prev = leaf;
+        }
+    }
+
+    const unsigned base1 = nchild ? nt_add_pnodes(tree, ctx, nchild) : 0;
+    npnode_t* node = &tree->nodes[pidx];
+    node->vector = vector;
+    node->leafvec = leafvec;
+    node->base0 = base0;
+    node->base1 = base1;
+
+    for (unsigned c = 0; c < nchild; c++)
+        nt_compile_node(tree, ctx, base1 + c, children[c], depth + NT_STRIDE, v4);
+}
+
+// Builds the direct table for the first NT_V4_DIRECT bits below the ipv4
+// root, and the v4 trie beneath it
+F_NONNULL
+static void nt_compile_v4(ntree_t* tree, nt_compile_t* ctx)
+{
+    tree->v4direct = xmalloc_n(1U << NT_V4_DIRECT, sizeof(*tree->v4direct));
+    nleaf_t prev = { 0, 0 };
+    uint32_t prev_entry = 0;
+
+    for (unsigned i = 0; i < (1U << NT_V4_DIRECT); i++) {
+        unsigned steps = 0;
+        unsigned next = tree->ipv4;
+        if (!NN_IS_DCLIST(next))
+            next = nt_walk(tree, next, i, NT_V4_DIRECT, &steps);
+        if (NN_IS_DCLIST(next)) {
+            // adjacent entries usually share a leaf
+            if (!prev_entry || next != prev.dclist || steps != prev.mask) {
+                prev.dclist = next;
+                prev.mask = steps;
+                prev_entry = NN_SET_DCLIST(nt_add_leaf(tree, ctx, &prev));
+            }
+            tree->v4direct[i] = prev_entry;
+        } else {
+            const unsigned pidx = nt_add_pnodes(tree, ctx, 1U);
+            tree->v4direct[i] = pidx;
+            nt_compile_node(tree, ctx, pidx, next, NT_V4_DIRECT, true);
+        }
+    }
+}
+
+#ifndef NDEBUG
+F_NONNULL
+static void ntree_assert_compiled(const ntree_t* tree);
+#else
+#define ntree_assert_compiled(x)
+#endif
+
 void ntree_finish(ntree_t* tree)
 {
     tree->alloc = 0; // flag fixed, will fail asserts on add_node, etc now
-    tree->store = xrealloc_n(tree->store, tree->count, sizeof(*tree->store));
     tree->ipv4 = ntree_find_v4root(tree);
+
+    nt_compile_t ctx = {
+        .nodes_alloc = NT_SIZE_INIT,
+        .leaves_alloc = NT_SIZE_INIT,
+    };
+    tree->nodes = xmalloc_n(ctx.nodes_alloc, sizeof(*tree->nodes));
+    tree->leaves = xmalloc_n(ctx.leaves_alloc, sizeof(*tree->leaves));
+    tree->nodes_count = 0;
+    tree->leaves_count = 0;
+
+    // The binary trie's root is always an interior node
+    nt_add_pnodes(tree, &ctx, 1U);
+    nt_compile_node(tree, &ctx, 0, 0, 0, false);
+    nt_compile_v4(tree, &ctx);
+
+    tree->nodes = xrealloc_n(tree->nodes, tree->nodes_count, sizeof(*tree->nodes));
+    tree->leaves = xrealloc_n(tree->leaves, tree->leaves_count, sizeof(*tree->leaves));
+
+    ntree_assert_compiled(tree);
+    free(tree->store);
+    tree->store = NULL;
 }
 
 #ifndef NDEBUG // debug dump code
@@ -134,36 +313,90 @@ void ntree_assert_optimal(const ntree_t* tree)
 
 #endif
 
-F_NONNULL
-static bool CHKBIT_v6(const uint8_t* ipv6, const unsigned bit)
+// The index of the 1-bit for entry idx among the set bits of a bitmap, plus
+// one.  For ->vector this counts the children up to and including idx, and
+// for ->leafvec the leaf runs starting at or before idx.
+F_CONST
+static unsigned np_rank(const uint64_t bits, const unsigned idx)
 {
-    gdnsd_assert(bit < 128);
-    return ipv6[bit >> 3] & (1UL << (~bit & 7));
+    return (unsigned)__builtin_popcountll(bits & ((UINT64_C(2) << idx) - 1U));
 }
 
+// NT_STRIDE bits of a v4 address starting at bit "pos", zero-padded past the end
+F_CONST
+static unsigned v4_bits(const uint32_t ip, const unsigned pos)
+{
+    if (pos + NT_STRIDE <= 32U)
+        return (ip >> (32U - NT_STRIDE - pos)) & (NT_FANOUT - 1U);
+    return (ip << (pos + NT_STRIDE - 32U)) & (NT_FANOUT - 1U);
+}
+
+// Likewise for a v6 address as two host-order halves
+F_CONST
+static unsigned v6_bits(const uint64_t hi, const uint64_t lo, const unsigned pos)
+{
+    if (pos + NT_STRIDE <= 64U)
+        return (unsigned)(hi >> (64U - NT_STRIDE - pos)) & (NT_FANOUT - 1U);
+    if (pos >= 64U) {
+        if (pos + NT_STRIDE <= 128U)
+            return (unsigned)(lo >> (128U - NT_STRIDE - pos)) & (NT_FANOUT - 1U);
+        return (unsigned)(lo << (pos + NT_STRIDE - 128U)) & (NT_FANOUT - 1U);
+    }
+    return (unsigned)((hi << (pos + NT_STRIDE - 64U)) | (lo >> (128U - NT_STRIDE - pos))) & (NT_FANOUT - 1U);
+}
+
+F_NONNULL F_PURE F_RETNN
+static const nleaf_t* ntree_leaf_v4(const ntree_t* tree, const uint32_t ip)
+{
+    const uint32_t direct = tree->v4direct[ip >> (32U - NT_V4_DIRECT)];
+    if (NN_IS_DCLIST(direct))
+        return &tree->leaves[NN_GET_DCLIST(direct)];
+
+    const npnode_t* node = &tree->nodes[direct];
+    unsigned pos = NT_V4_DIRECT;
+    unsigned idx = v4_bits(ip, pos);
+    while (node->vector & (UINT64_C(1) << idx)) {
+        node = &tree->nodes[node->base1 + np_rank(node->vector, idx) - 1U];
+        pos += NT_STRIDE;
+        gdnsd_assert(pos < 32U);
+        idx = v4_bits(ip, pos);
+    }
+    return &tree->leaves[node->base0 + np_rank(node->leafvec, idx) - 1U];
+}
+
+// Returns the raw (high-bit-set) dclist, which may be NN_UNDEF
 F_NONNULL
-static unsigned ntree_lookup_v6(const ntree_t* tree, const uint8_t* ip, unsigned* mask_out)
+static unsigned ntree_lookup_v6_raw(const ntree_t* tree, const uint8_t* ip, unsigned* mask_out)
 {
-    unsigned chkbit = 0;
-    unsigned offset = 0;
-    do {
-        gdnsd_assert(offset < tree->count);
-        const nnode_t* current = &tree->store[offset];
-        gdnsd_assert(current->one && current->zero);
-        offset = CHKBIT_v6(ip, chkbit) ? current->one : current->zero;
-        chkbit++;
-        gdnsd_assert(chkbit < 129);
-    } while (!NN_IS_DCLIST(offset));
-
-    *mask_out = chkbit;
-    gdnsd_assert(offset != NN_UNDEF); // the special v4-like undefined areas
-    return NN_GET_DCLIST(offset);
+    const uint64_t hi = ((uint64_t)ntohl(gdnsd_get_una32(&ip[0])) << 32U) | ntohl(gdnsd_get_una32(&ip[4]));
+    const uint64_t lo = ((uint64_t)ntohl(gdnsd_get_una32(&ip[8])) << 32U) | ntohl(gdnsd_get_una32(&ip[12]));
+
+    const npnode_t* node = &tree->nodes[0];
+    unsigned pos = 0;
+    unsigned idx = v6_bits(hi, lo, pos);
+    while (node->vector & (UINT64_C(1) << idx)) {
+        node = &tree->nodes[node->base1 + np_rank(node->vector, idx) - 1U];
+        pos += NT_STRIDE;
+        gdnsd_assert(pos < 128U);
+        idx = v6_bits(hi, lo, pos);
+    }
+    const nleaf_t* leaf = &tree->leaves[node->base0 + np_rank(node->leafvec, idx) - 1U];
+
+    if (unlikely(leaf->mask == NL_V4_SPACE)) {
+        leaf = ntree_leaf_v4(tree, (uint32_t)lo);
+        *mask_out = leaf->mask + 96U;
+    } else {
+        *mask_out = leaf->mask;
+    }
+    return leaf->dclist;
 }
 
-static bool CHKBIT_v4(const uint32_t ip, const unsigned maskbit)
+F_NONNULL
+static unsigned ntree_lookup_v6(const ntree_t* tree, const uint8_t* ip, unsigned* mask_out)
 {
-    gdnsd_assert(maskbit < 32U);
-    return ip & (1U << (31U - maskbit));
+    const unsigned rv = ntree_lookup_v6_raw(tree, ip, mask_out);
+    gdnsd_assert(rv != NN_UNDEF); // the special v4-like undefined areas
+    return NN_GET_DCLIST(rv);
 }
 
 // lookup_v4's "mask_out" is within the range /0 -> /32 and needs adjusting
@@ -176,22 +409,101 @@ static unsigned ntree_lookup_v4(const ntree_t* tree, const uint32_t ip, unsigned
 {
     gdnsd_assert(tree->ipv4);
 
-    unsigned chkbit = 0;
-    unsigned offset = tree->ipv4;
-    while (!NN_IS_DCLIST(offset)) {
-        gdnsd_assert(offset < tree->count);
-        const nnode_t* current = &tree->store[offset];
-        gdnsd_assert(current->one && current->zero);
-        offset = CHKBIT_v4(ip, chkbit) ? current->one : current->zero;
-        chkbit++;
-        gdnsd_assert(chkbit < 33);
+    const nleaf_t* leaf = ntree_leaf_v4(tree, ip);
+    *mask_out = leaf->mask;
+    gdnsd_assert(leaf->dclist != NN_UNDEF); // the special v4-like undefined areas
+    return NN_GET_DCLIST(leaf->dclist);
+}
+
+F_PURE
+static bool nt_leaf_ok(const nleaf_t* leaf, const unsigned dclists_count)
+{
+    if (!NN_IS_DCLIST(leaf->dclist))
+        return false;
+    if (leaf->dclist != NN_UNDEF && NN_GET_DCLIST(leaf->dclist) >= dclists_count)
+        return false;
+    return leaf->mask <= 128U || leaf->mask == NL_V4_SPACE;
+}
+
+bool ntree_check_compiled(const ntree_t* tree, const unsigned dclists_count)
+{
+    if (!tree->nodes_count || !tree->leaves_count)
+        return false;
+
+    for (unsigned i = 0; i < tree->nodes_count; i++) {
+        const npnode_t* node = &tree->nodes[i];
+        // Children always follow their parent, so there are no cycles
+        if (node->vector) {
+            if (node->base1 <= i || node->base1 > tree->nodes_count
+                    || tree->nodes_count - node->base1 < (unsigned)__builtin_popcountll(node->vector))
+                return false;
+        }
+        // Every leaf entry needs a run starting at or before it
+        if (~node->vector) {
+            if (!node->leafvec || __builtin_ctzll(node->leafvec) > __builtin_ctzll(~node->vector))
+                return false;
+            if (node->base0 > tree->leaves_count
+                    || tree->leaves_count - node->base0 < (unsigned)__builtin_popcountll(node->leafvec))
+                return false;
+        }
+    }
+
+    for (unsigned i = 0; i < tree->leaves_count; i++)
+        if (!nt_leaf_ok(&tree->leaves[i], dclists_count))
+            return false;
+
+    for (unsigned i = 0; i < (1U << NT_V4_DIRECT); i++) {
+        const uint32_t direct = tree->v4direct[i];
+        if (NN_IS_DCLIST(direct) ? NN_GET_DCLIST(direct) >= tree->leaves_count : direct >= tree->nodes_count)
+            return false;
+    }
+
+    return true;
+}
+
+#ifndef NDEBUG
+
+// Checks that lookups in the compiled structure give exactly the results of
+//   the binary trie, at both ends of the network of every terminal in it.
+//   For those under the ipv4 root, this covers the v4 path via NL_V4_SPACE.
+F_NONNULL
+static void ntree_check_terminal(const ntree_t* tree, const unsigned val, const unsigned mask, struct in6_addr ipv6)
+{
+    for (unsigned pass = 0; pass < 2U; pass++) {
+        if (pass) {
+            for (unsigned bit = mask; bit < 128U; bit++)
+                SETBIT_v6(ipv6.s6_addr, bit);
+        }
+        unsigned got_mask;
+        const unsigned got = ntree_lookup_v6_raw(tree, ipv6.s6_addr, &got_mask);
+        gdnsd_assert(got == val);
+        gdnsd_assert(got_mask == mask);
     }
+}
 
-    *mask_out = chkbit;
-    gdnsd_assert(offset != NN_UNDEF); // the special v4-like undefined areas
-    return NN_GET_DCLIST(offset);
+F_NONNULL
+static void ntree_check_recurse(const ntree_t* tree, const unsigned offset, const unsigned depth, struct in6_addr ipv6)
+{
+    gdnsd_assert(offset < tree->count);
+    gdnsd_assert(depth < 128U);
+    for (unsigned dir = 0; dir < 2U; dir++) {
+        const unsigned val = dir ? tree->store[offset].one : tree->store[offset].zero;
+        if (dir)
+            SETBIT_v6(ipv6.s6_addr, depth);
+        if (NN_IS_DCLIST(val))
+            ntree_check_terminal(tree, val, depth + 1U, ipv6);
+        else
+            ntree_check_recurse(tree, val, depth + 1U, ipv6);
+    }
+}
+
+static void ntree_assert_compiled(const ntree_t* tree)
+{
+    ntree_check_recurse(tree, 0, 0, ip6_zero);
 }
 
+#endif
+
 // if "addr" is in any v4-compatible spaces other than
 //   v4compat (our canonical one), convert to v4compat,
 //   and return a mask_adj to v4_compat.
@@ -126,11 +126,57 @@ typedef struct {
     uint32_t one;
 } nnode_t;
 
+/*
+ * The binary trie above is only the construction format.  ntree_finish()
+ * compiles it into a multi-bit trie for lookups, in the style of poptrie:
+ * each npnode_t consumes NT_STRIDE bits of the address at once, with
+ * bitmaps and popcounts locating the next node or the final leaf in
+ * contiguous arrays, so that a full-depth IPv6 lookup takes at most 22 node
+ * visits instead of 128.  IPv4 lookups (including the v4-like v6 spaces)
+ * start with a direct 16-bit table at the ipv4 root before that.  Every
+ * leaf records the dclist and mask depth of the binary trie terminal it was
+ * expanded from, so results and scope masks are exactly those of walking
+ * the binary trie.
+ */
+
+// Bits consumed per npnode_t.  The entry bitmaps are 64 bits, and 96 (the
+// depth of the ipv4 root) must be a multiple of this, see NL_V4_SPACE below.
+#define NT_STRIDE 6U
+
+// Bits resolved by the direct table at the ipv4 root
+#define NT_V4_DIRECT 16U
+
 typedef struct {
-    nnode_t* store;
+    uint64_t vector;  // bit i set: entry i is a child node
+    uint64_t leafvec; // bit i set: entry i starts a new run of equal leaves
+    uint32_t base0;   // this node's first leaf in ->leaves
+    uint32_t base1;   // this node's first child in ->nodes (contiguous)
+} npnode_t;
+
+// The v6 trie stops at the ipv4 root with a leaf of this mask, telling
+// lookups to continue in the v4 structure and add 96 to its mask
+#define NL_V4_SPACE UINT32_MAX
+
+typedef struct {
+    uint32_t dclist; // as in nnode_t, always with the high bit set
+    uint32_t mask;   // depth of the terminal, relative to the ipv4 root for v4
+} nleaf_t;
+
+typedef struct {
+    nnode_t* store; // binary trie, freed by ntree_finish()
     unsigned ipv4;  // cached ipv4 lookup hint
     unsigned count; // raw nodes, including interior ones
     unsigned alloc; // current allocation of store during construction, set to zero after _finish()
+    // The compiled lookup structure, from ntree_finish():
+    npnode_t* nodes;    // [0] is the v6 root
+    nleaf_t* leaves;
+    uint32_t* v4direct; // 1 << NT_V4_DIRECT entries, NN_SET_DCLIST(leaf index) or node index
+    unsigned nodes_count;
+    unsigned leaves_count;
+    // Set when the compiled arrays point into a mapped cache file rather
+    //   than being allocated, see mapcache.c
+    void* mapped;
+    size_t mapped_len;
 } ntree_t;
 
 F_WUNUSED F_RETNN
@@ -144,10 +190,12 @@ void ntree_destroy(ntree_t* tree);
 F_NONNULL
 unsigned ntree_add_node(ntree_t* tree);
 
-// call this after done adding data
+// call this after done adding data, which compiles the lookup
+//   structure and frees the binary trie.
 F_NONNULL
 void ntree_finish(ntree_t* tree);
 
+// these inspect the binary trie, and so must be called before ntree_finish()
 #ifndef NDEBUG
 F_NONNULL
 void ntree_debug_dump(const ntree_t* tree);
@@ -158,6 +206,12 @@ void ntree_assert_optimal(const ntree_t* tree);
 #define ntree_assert_optimal(x)
 #endif
 
+// Checks that every index in a compiled tree loaded from elsewhere (see
+//   mapcache.c) is in range for its arrays and for dclists_count dclists,
+//   so that lookups cannot stray outside of them
+F_NONNULL F_PURE
+bool ntree_check_compiled(const ntree_t* tree, const unsigned dclists_count);
+
 F_NONNULL
 unsigned ntree_lookup(const ntree_t* tree, const client_info_t* client, unsigned* scope_mask, const bool ignore_ecs);
 
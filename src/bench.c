@@ -0,0 +1,746 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// This source is for the gdnsd_bench binary, which loads a normal gdnsd
+//  configuration and zone data, and then drives process_dns_query() directly
+//  from one or more threads with a synthetic query mix, without any sockets,
+//  to measure the query engine in isolation.  With -L it instead measures
+//  zone data loading: the per-phase times and memory use of the initial load
+//  and of a number of full reloads.
+
+#include <config.h>
+#include "main.h"
+
+#include "conf.h"
+#include "socks.h"
+#include "dnswire.h"
+#include "dnspacket.h"
+#include "latency.h"
+#include "ltree.h"
+#include "chal.h"
+#include "cookie.h"
+
+#include "plugins/plugapi.h"
+#include "plugins/mon.h"
+#include <gdnsd/alloc.h>
+#include <gdnsd/dname.h>
+#include <gdnsd/log.h>
+#include <gdnsd/misc.h>
+#include <gdnsd/net.h>
+#include <gdnsd/paths.h>
+#include <gdnsd/rand.h>
+#include <gdnsd/vscf.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+
+#include <ev.h>
+#include <urcu-qsbr.h>
+
+// Each thread cycles through its own pre-built pool of this many queries
+#define POOL_SIZE 4096U
+
+// Large enough for a maximal qname, the fixed header and question parts, and
+// an OPT RR with both a client cookie and an ECS option
+#define MAX_QUERY 320U
+
+// How often each thread declares an RCU quiescent state
+#define QSBR_INTERVAL 1024U
+
+// Upper bound on distinct entries in the -T qtype mix
+#define MAX_QTYPES 16U
+
+static const struct {
+    const char* name;
+    unsigned qtype;
+} qtype_names[] = {
+    { "A",      DNS_TYPE_A },
+    { "NS",     DNS_TYPE_NS },
+    { "CNAME",  DNS_TYPE_CNAME },
+    { "SOA",    DNS_TYPE_SOA },
+    { "PTR",    DNS_TYPE_PTR },
+    { "MX",     DNS_TYPE_MX },
+    { "TXT",    DNS_TYPE_TXT },
+    { "AAAA",   DNS_TYPE_AAAA },
+    { "SRV",    DNS_TYPE_SRV },
+    { "NAPTR",  DNS_TYPE_NAPTR },
+    { "DS",     DNS_TYPE_DS },
+    { "DNSKEY", DNS_TYPE_DNSKEY },
+    { "SVCB",   DNS_TYPE_SVCB },
+    { "HTTPS",  DNS_TYPE_HTTPS },
+    { "CAA",    DNS_TYPE_CAA },
+    { "ANY",    DNS_TYPE_ANY },
+};
+
+typedef struct {
+    unsigned qtype;
+    unsigned weight;
+} qtype_mix_t;
+
+typedef struct {
+    const char* cfg_dir;
+    const char* names_file;
+    const char* nx_zone;
+    unsigned long queries;
+    unsigned threads;
+    unsigned nx_pct;
+    unsigned edns_pct;
+    unsigned cookie_pct;
+    unsigned ecs_pct;
+    unsigned depth;
+    unsigned seed;
+    unsigned reloads;
+    bool load_mode;
+    unsigned num_qtypes;
+    unsigned qtype_weight_total;
+    qtype_mix_t qtypes[MAX_QTYPES];
+} bench_opts_t;
+
+typedef struct {
+    unsigned len;
+    uint8_t data[MAX_QUERY];
+} bench_query_t;
+
+typedef struct {
+    pthread_t threadid;
+    unsigned idx;
+    unsigned long queries;
+    gdnsd_anysin_t source;
+    bench_query_t* pool;
+    dnspacket_stats_t* stats;
+    uint64_t elapsed_ns;
+} bench_thread_t;
+
+static bench_opts_t opts = {
+    .cfg_dir = NULL,
+    .names_file = NULL,
+    .nx_zone = NULL,
+    .queries = 1000000LU,
+    .threads = 1U,
+    .nx_pct = 0U,
+    .edns_pct = 0U,
+    .cookie_pct = 0U,
+    .ecs_pct = 0U,
+    .depth = 1U,
+    .seed = 1U,
+    .reloads = 0U,
+    .load_mode = false,
+};
+
+// The qnames that should exist in the zone data, from the -f file
+static uint8_t** hit_names = NULL;
+static unsigned num_hit_names = 0;
+
+// The parent of the synthesized NXDOMAIN names
+static uint8_t nx_parent[256];
+
+static pthread_barrier_t start_barrier;
+
+// Stubs for the main.h interfaces which the core code expects gdnsd's main.c
+// to provide.  Nothing here reloads zones asynchronously or tears down at
+// exit; the -L mode runs its reloads synchronously on the main thread.
+void gdnsd_atexit(void (*f)(void) V_UNUSED)
+{
+}
+
+void spawn_async_zones_reloader_thread(void)
+{
+    gdnsd_assert(0);
+}
+
+void notify_reload_zones_done(void)
+{
+}
+
+F_NONNULL F_NORETURN
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+            PACKAGE_NAME " version " PACKAGE_VERSION "\n"
+            "Usage: %s [-c %s] [-D] [-f names_file] [-z nx_zone] [-t threads]\n"
+            "         [-n queries] [-T qtype_mix] [-x nx_pct] [-d nx_depth]\n"
+            "         [-e edns_pct] [-k cookie_pct] [-s ecs_pct] [-S seed]\n"
+            "       %s [-c %s] [-D] -L reloads\n"
+            "  -c - Configuration directory, default '%s'\n"
+            "  -D - Enable verbose debug output\n"
+            "  -f - File of existing names to query, one per line\n"
+            "  -z - Parent name for synthesized NXDOMAIN queries,\n"
+            "       default is the first name from -f\n"
+            "  -t - Number of query threads, default 1\n"
+            "  -n - Queries per thread, default 1000000\n"
+            "  -T - Weighted qtype mix, e.g. 'A:60,AAAA:30,MX:10', default 'A'\n"
+            "  -x - Percentage of queries for NXDOMAIN names, default 0\n"
+            "       (always 100 if -f is not given)\n"
+            "  -d - Number of random labels in NXDOMAIN names, default 1\n"
+            "  -e - Percentage of queries with an EDNS OPT RR, default 0\n"
+            "  -k - Percentage of EDNS queries with a client cookie, default 0\n"
+            "  -s - Percentage of EDNS queries with an ECS option, default 0\n"
+            "  -S - Seed for the query mix, default 1\n"
+            "  -L - Benchmark zone data loading instead of queries: report the\n"
+            "       phase times and RSS of the initial load and of this many\n"
+            "       full reloads\n"
+            "Latency percentiles include the cost of reading the clock twice\n"
+            "for every query.\n",
+            argv0, gdnsd_get_default_config_dir(),
+            argv0, gdnsd_get_default_config_dir(), gdnsd_get_default_config_dir()
+           );
+    exit(2);
+}
+
+F_NONNULL
+static unsigned long parse_num(const char* argv0, const char* arg, const unsigned long min, const unsigned long max)
+{
+    char* endptr;
+    errno = 0;
+    const unsigned long rv = strtoul(arg, &endptr, 10);
+    if (errno || !*arg || *endptr || rv < min || rv > max)
+        usage(argv0);
+    return rv;
+}
+
+F_NONNULL
+static void parse_qtype_mix(const char* argv0, const char* arg)
+{
+    char* mix = xstrdup(arg);
+    char* saveptr = NULL;
+    opts.num_qtypes = 0;
+    opts.qtype_weight_total = 0;
+    for (char* item = strtok_r(mix, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        if (opts.num_qtypes == MAX_QTYPES)
+            usage(argv0);
+        unsigned weight = 1U;
+        char* colon = strchr(item, ':');
+        if (colon) {
+            *colon = '\0';
+            weight = (unsigned)parse_num(argv0, colon + 1, 1LU, 1000000LU);
+        }
+        unsigned qtype = 0;
+        for (unsigned i = 0; i < ARRAY_SIZE(qtype_names); i++) {
+            if (!strcasecmp(item, qtype_names[i].name)) {
+                qtype = qtype_names[i].qtype;
+                break;
+            }
+        }
+        if (!qtype)
+            log_fatal("Unknown qtype '%s' in -T", item);
+        opts.qtypes[opts.num_qtypes].qtype = qtype;
+        opts.qtypes[opts.num_qtypes].weight = weight;
+        opts.num_qtypes++;
+        opts.qtype_weight_total += weight;
+    }
+    free(mix);
+    if (!opts.num_qtypes)
+        usage(argv0);
+}
+
+F_NONNULL
+static void parse_args(const int argc, char** argv)
+{
+    int optchar;
+    while ((optchar = getopt(argc, argv, "c:Df:z:t:n:T:x:d:e:k:s:S:L:")) != -1) {
+        switch (optchar) {
+        case 'c':
+            opts.cfg_dir = optarg;
+            break;
+        case 'D':
+            gdnsd_log_set_debug(true);
+            break;
+        case 'f':
+            opts.names_file = optarg;
+            break;
+        case 'z':
+            opts.nx_zone = optarg;
+            break;
+        case 't':
+            opts.threads = (unsigned)parse_num(argv[0], optarg, 1LU, 1024LU);
+            break;
+        case 'n':
+            opts.queries = parse_num(argv[0], optarg, 1LU, ULONG_MAX);
+            break;
+        case 'T':
+            parse_qtype_mix(argv[0], optarg);
+            break;
+        case 'x':
+            opts.nx_pct = (unsigned)parse_num(argv[0], optarg, 0LU, 100LU);
+            break;
+        case 'd':
+            opts.depth = (unsigned)parse_num(argv[0], optarg, 1LU, 16LU);
+            break;
+        case 'e':
+            opts.edns_pct = (unsigned)parse_num(argv[0], optarg, 0LU, 100LU);
+            break;
+        case 'k':
+            opts.cookie_pct = (unsigned)parse_num(argv[0], optarg, 0LU, 100LU);
+            break;
+        case 's':
+            opts.ecs_pct = (unsigned)parse_num(argv[0], optarg, 0LU, 100LU);
+            break;
+        case 'S':
+            opts.seed = (unsigned)parse_num(argv[0], optarg, 0LU, UINT32_MAX);
+            break;
+        case 'L':
+            opts.reloads = (unsigned)parse_num(argv[0], optarg, 0LU, 100000LU);
+            opts.load_mode = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc)
+        usage(argv[0]);
+
+    if (!opts.num_qtypes) {
+        opts.qtypes[0].qtype = DNS_TYPE_A;
+        opts.qtypes[0].weight = 1U;
+        opts.num_qtypes = 1U;
+        opts.qtype_weight_total = 1U;
+    }
+
+    if (opts.load_mode)
+        return;
+
+    if (!opts.names_file) {
+        if (!opts.nx_zone)
+            usage(argv[0]);
+        opts.nx_pct = 100U;
+    }
+}
+
+// Parses a name from the commandline or the names file, which is always
+// treated as fully-qualified
+F_NONNULL
+static void parse_name(uint8_t* dname, const char* name)
+{
+    const size_t len = strlen(name);
+    char* fqdn = xmalloc(len + 2U);
+    memcpy(fqdn, name, len);
+    fqdn[len] = '\0';
+    if (!len || fqdn[len - 1U] != '.') {
+        fqdn[len] = '.';
+        fqdn[len + 1U] = '\0';
+    }
+    if (gdnsd_dname_from_string(dname, fqdn, (unsigned)strlen(fqdn)) != DNAME_VALID)
+        log_fatal("Invalid domainname '%s'", name);
+    free(fqdn);
+}
+
+F_NONNULL
+static void load_names(const char* fn)
+{
+    FILE* fp = fopen(fn, "r");
+    if (!fp)
+        log_fatal("Cannot open names file '%s': %s", fn, logf_errno());
+
+    char linebuf[1024];
+    while (fgets(linebuf, sizeof(linebuf), fp)) {
+        char* name = linebuf + strspn(linebuf, " \t");
+        name[strcspn(name, " \t\r\n")] = '\0';
+        if (!*name || *name == '#')
+            continue;
+        hit_names = xrealloc_n(hit_names, num_hit_names + 1U, sizeof(*hit_names));
+        hit_names[num_hit_names] = xmalloc(256U);
+        parse_name(hit_names[num_hit_names], name);
+        num_hit_names++;
+    }
+    if (ferror(fp))
+        log_fatal("Error reading names file '%s'", fn);
+    fclose(fp);
+
+    if (!num_hit_names)
+        log_fatal("Names file '%s' contains no names", fn);
+}
+
+F_NONNULL
+static bool pct_chance(gdnsd_rstate32_t* rs, const unsigned pct)
+{
+    return gdnsd_rand32_bounded(rs, 100U) < pct;
+}
+
+F_NONNULL
+static unsigned pick_qtype(gdnsd_rstate32_t* rs)
+{
+    unsigned w = gdnsd_rand32_bounded(rs, opts.qtype_weight_total);
+    for (unsigned i = 0; i < opts.num_qtypes; i++) {
+        if (w < opts.qtypes[i].weight)
+            return opts.qtypes[i].qtype;
+        w -= opts.qtypes[i].weight;
+    }
+    gdnsd_assert(0); // unreachable
+    return DNS_TYPE_A;
+}
+
+// Writes a random NXDOMAIN name of opts.depth labels under nx_parent
+F_NONNULL
+static unsigned make_nx_qname(gdnsd_rstate32_t* rs, uint8_t* out)
+{
+    static const char lchars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    unsigned len = 0;
+    for (unsigned i = 0; i < opts.depth; i++) {
+        out[len++] = 8U;
+        for (unsigned j = 0; j < 8U; j++)
+            out[len++] = (uint8_t)lchars[gdnsd_rand32_bounded(rs, sizeof(lchars) - 1U)];
+    }
+    const unsigned plen = nx_parent[0];
+    if (len + plen > 255U)
+        log_fatal("NXDOMAIN names of depth %u are too long under the given parent", opts.depth);
+    memcpy(&out[len], &nx_parent[1], plen);
+    return len + plen;
+}
+
+// Builds one wire query at q, according to the configured mix
+F_NONNULL
+static void make_query(gdnsd_rstate32_t* rs, bench_query_t* q)
+{
+    uint8_t* p = q->data;
+    const bool edns = pct_chance(rs, opts.edns_pct);
+
+    wire_dns_header_t* hdr = (wire_dns_header_t*)(void*)p;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->id = (uint16_t)gdnsd_rand32_get(rs);
+    hdr->qdcount = htons(1);
+    hdr->arcount = htons(edns ? 1 : 0);
+    unsigned len = sizeof(*hdr);
+
+    if (pct_chance(rs, opts.nx_pct)) {
+        len += make_nx_qname(rs, &p[len]);
+    } else {
+        const uint8_t* dname = hit_names[gdnsd_rand32_bounded(rs, num_hit_names)];
+        memcpy(&p[len], &dname[1], dname[0]);
+        len += dname[0];
+    }
+    gdnsd_put_una16(htons((uint16_t)pick_qtype(rs)), &p[len]);
+    len += 2U;
+    gdnsd_put_una16(htons(DNS_CLASS_IN), &p[len]);
+    len += 2U;
+
+    if (edns) {
+        const bool cookie = pct_chance(rs, opts.cookie_pct);
+        const bool ecs = pct_chance(rs, opts.ecs_pct);
+        const unsigned rdlen = (cookie ? 12U : 0) + (ecs ? 11U : 0);
+        p[len++] = 0; // root name
+        gdnsd_put_una16(htons(DNS_TYPE_OPT), &p[len]);
+        len += 2U;
+        gdnsd_put_una16(htons(1232U), &p[len]); // UDP size
+        len += 2U;
+        gdnsd_put_una32(0, &p[len]); // ext rcode, version, flags
+        len += 4U;
+        gdnsd_put_una16(htons((uint16_t)rdlen), &p[len]);
+        len += 2U;
+        if (cookie) {
+            gdnsd_put_una16(htons(EDNS_COOKIE_OPTCODE), &p[len]);
+            len += 2U;
+            gdnsd_put_una16(htons(8U), &p[len]);
+            len += 2U;
+            gdnsd_put_una32(gdnsd_rand32_get(rs), &p[len]);
+            gdnsd_put_una32(gdnsd_rand32_get(rs), &p[len + 4U]);
+            len += 8U;
+        }
+        if (ecs) {
+            gdnsd_put_una16(htons(EDNS_CLIENTSUB_OPTCODE), &p[len]);
+            len += 2U;
+            gdnsd_put_una16(htons(7U), &p[len]);
+            len += 2U;
+            gdnsd_put_una16(htons(1U), &p[len]); // IPv4
+            len += 2U;
+            p[len++] = 24U; // source prefix
+            p[len++] = 0; // scope prefix
+            const uint32_t addr = gdnsd_rand32_get(rs);
+            p[len++] = (uint8_t)(addr >> 24);
+            p[len++] = (uint8_t)(addr >> 16);
+            p[len++] = (uint8_t)(addr >> 8);
+        }
+    }
+
+    gdnsd_assert(len <= MAX_QUERY);
+    q->len = len;
+}
+
+// Deterministic seeding, so that a given seed and set of options always
+// produces the same queries
+F_NONNULL
+static void seed_rstate(gdnsd_rstate32_t* rs, const unsigned seed, const unsigned thread_idx)
+{
+    rs->x = 123456789U ^ seed;
+    rs->y = 362436069U ^ (thread_idx * 2654435761U);
+    if (!rs->y)
+        rs->y = 1U;
+    rs->z = 21288629U + seed;
+    rs->w = 14921776U + thread_idx;
+    rs->c = 0;
+}
+
+F_NONNULL
+static void* bench_thread(void* bt_asvoid)
+{
+    bench_thread_t* bt = bt_asvoid;
+    gdnsd_thread_setname("gdnsd-bench");
+
+    dnsp_ctx_t* pctx = dnspacket_ctx_init_udp(&bt->stats, false);
+    pkt_t* pkt = xmalloc(sizeof(*pkt));
+    rcu_register_thread();
+
+    pthread_barrier_wait(&start_barrier);
+    const uint64_t start = latency_now(CLOCK_MONOTONIC);
+    for (unsigned long i = 0; i < bt->queries; i++) {
+        const bench_query_t* q = &bt->pool[i & (POOL_SIZE - 1U)];
+        memcpy(pkt->raw, q->data, q->len);
+        const uint64_t pdq_start = latency_now(CLOCK_MONOTONIC);
+        process_dns_query(pctx, &bt->source, pkt, NULL, q->len);
+        latency_record(&bt->stats->pdq, latency_now(CLOCK_MONOTONIC) - pdq_start);
+        if (!(i & (QSBR_INTERVAL - 1U)))
+            rcu_quiescent_state();
+    }
+    bt->elapsed_ns = latency_now(CLOCK_MONOTONIC) - start;
+
+    rcu_unregister_thread();
+    free(pkt);
+    dnspacket_ctx_cleanup(pctx);
+    return NULL;
+}
+
+// Reports the upper bound of the bucket containing the given percentile of
+// the combined histogram, like the stats output does
+static uint64_t hist_pctl(const uint64_t* buckets, const uint64_t count, const unsigned pctl_thou)
+{
+    const uint64_t rank = ((count * pctl_thou) + 999U) / 1000U;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank && seen)
+            return latency_bucket_upper(i);
+    }
+    return 0;
+}
+
+F_NONNULL
+static void report(const bench_thread_t* bts, const uint64_t wall_ns)
+{
+    uint64_t* buckets = xcalloc_n(LATENCY_BUCKETS, sizeof(*buckets));
+    uint64_t count = 0;
+    uint64_t busy_ns = 0;
+    uint64_t noerror = 0, nxdomain = 0, refused = 0, other = 0;
+    for (unsigned t = 0; t < opts.threads; t++) {
+        const dnspacket_stats_t* s = bts[t].stats;
+        for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+            const uint64_t b = stats_get(&s->pdq.b[i]);
+            buckets[i] += b;
+            count += b;
+        }
+        busy_ns += bts[t].elapsed_ns;
+        noerror += stats_get(&s->noerror);
+        nxdomain += stats_get(&s->nxdomain);
+        refused += stats_get(&s->refused);
+        other += stats_get(&s->notimp) + stats_get(&s->badvers)
+                 + stats_get(&s->formerr) + stats_get(&s->dropped);
+    }
+
+    const double wall_s = (double)wall_ns / 1e9;
+    printf("threads:     %u\n", opts.threads);
+    printf("queries:     %" PRIu64 "\n", count);
+    printf("wall time:   %.3f s\n", wall_s);
+    printf("queries/sec: %.0f\n", (double)count / wall_s);
+    printf("ns/query:    %.1f (per thread)\n", (double)busy_ns / (double)count);
+    printf("latency ns:  p50 %" PRIu64 " p90 %" PRIu64 " p99 %" PRIu64 " p999 %" PRIu64 "\n",
+           hist_pctl(buckets, count, 500U), hist_pctl(buckets, count, 900U),
+           hist_pctl(buckets, count, 990U), hist_pctl(buckets, count, 999U));
+    printf("rcodes:      noerror %" PRIu64 " nxdomain %" PRIu64 " refused %" PRIu64 " other %" PRIu64 "\n",
+           noerror, nxdomain, refused, other);
+    free(buckets);
+}
+
+// Resident set size right now, in KiB
+static unsigned long rss_now_kib(void)
+{
+    unsigned long size = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * ((unsigned long)sysconf(_SC_PAGESIZE) / 1024LU);
+}
+
+// Peak resident set size of the process so far, in KiB
+static unsigned long rss_peak_kib(void)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru))
+        return 0;
+    return (unsigned long)ru.ru_maxrss;
+}
+
+F_NONNULL
+static void report_load(const char* what)
+{
+    uint64_t prof[LTREE_LOAD_PHASES];
+    ltree_load_prof_get(prof);
+    printf("%-10s", what);
+    for (unsigned i = 0; i < LTREE_LOAD_PHASES; i++)
+        printf(" %10.1f", (double)prof[i] / 1e6);
+    printf(" %10.1f %10.1f\n", (double)rss_now_kib() / 1024.0,
+           (double)rss_peak_kib() / 1024.0);
+    fflush(stdout);
+}
+
+// The -L mode: the initial load and then opts.reloads full reloads of the
+// same data, each replacing the last as a daemon reload would.  The summed
+// phases (see ltree.h) are CPU time across the rfc1035 worker threads rather
+// than wall time.  RSS is measured after each (re-)load has freed the old
+// tree, so the difference between rss and peak_rss is roughly the cost of
+// briefly holding two copies of the data.
+static void load_bench(void)
+{
+    printf("%-10s", "load");
+    for (unsigned i = 0; i < LTREE_LOAD_PHASES; i++)
+        printf(" %10s", ltree_load_phase_name(i));
+    printf(" %10s %10s\n", "rss", "peak_rss");
+    printf("%-10s", "");
+    for (unsigned i = 0; i < LTREE_LOAD_PHASES; i++)
+        printf(" %10s", "(ms)");
+    printf(" %10s %10s\n", "(MiB)", "(MiB)");
+
+    if (ltree_zones_reloader_thread((void*)true))
+        log_fatal("Loading zone data failed");
+    report_load("initial");
+
+    for (unsigned r = 1; r <= opts.reloads; r++) {
+        if (ltree_zones_reloader_thread((void*)false))
+            log_fatal("Reloading zone data failed");
+        char what[16];
+        snprintf(what, sizeof(what), "reload%u", r);
+        report_load(what);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    umask(022);
+    parse_args(argc, argv);
+
+    if (opts.load_mode) {
+        vscf_data_t* cfg_root = gdnsd_init_paths(opts.cfg_dir, false);
+        gcfg = conf_load(cfg_root, false);
+        vscf_destroy(cfg_root);
+        chal_init();
+        ltree_init();
+        load_bench();
+        return 0;
+    }
+
+    if (opts.names_file)
+        load_names(opts.names_file);
+    if (opts.nx_zone)
+        parse_name(nx_parent, opts.nx_zone);
+    else
+        memcpy(nx_parent, hit_names[0], 256U);
+
+    // Load the configuration, plugins, and zone data, as the daemon does for
+    // "checkconf", and then the parts of the runtime setup which queries
+    // depend on
+    vscf_data_t* cfg_root = gdnsd_init_paths(opts.cfg_dir, false);
+    socks_cfg_t socks_cfg;
+    memset(&socks_cfg, 0, sizeof(socks_cfg));
+    socks_cfg.num_dns_threads = opts.threads;
+    gcfg = conf_load(cfg_root, false);
+    vscf_destroy(cfg_root);
+    chal_init();
+    ltree_init();
+    if (ltree_zones_reloader_thread((void*)true))
+        log_fatal("Loading zone data failed");
+    if (!gcfg->disable_cookies)
+        cookie_config(gcfg->cookie_key_file);
+    dnspacket_global_setup(&socks_cfg);
+
+    // Monitored resources get their initial states and cookies get their
+    // first keys, but the loop is never run again, so neither changes during
+    // the benchmark
+    struct ev_loop* loop = ev_loop_new(EVFLAG_AUTO);
+    if (!loop)
+        log_fatal("Could not initialize a libev loop");
+    gdnsd_mon_start(loop);
+    if (!gcfg->disable_cookies)
+        cookie_runtime_init(loop);
+    gdnsd_plugins_action_pre_run();
+
+    bench_thread_t* bts = xcalloc_n(opts.threads, sizeof(*bts));
+    for (unsigned i = 0; i < opts.threads; i++) {
+        bench_thread_t* bt = &bts[i];
+        bt->idx = i;
+        bt->queries = opts.queries;
+        bt->source.sin4.sin_family = AF_INET;
+        bt->source.sin4.sin_addr.s_addr = htonl(0x7F000001U);
+        bt->source.sin4.sin_port = htons((uint16_t)(10000U + i));
+        bt->source.len = sizeof(bt->source.sin4);
+        bt->pool = xmalloc_n(POOL_SIZE, sizeof(*bt->pool));
+        gdnsd_rstate32_t rs;
+        seed_rstate(&rs, opts.seed, i);
+        for (unsigned j = 0; j < POOL_SIZE; j++)
+            make_query(&rs, &bt->pool[j]);
+    }
+
+    if (pthread_barrier_init(&start_barrier, NULL, opts.threads + 1U))
+        log_fatal("pthread_barrier_init() failed");
+
+    sigset_t sigmask_all;
+    sigfillset(&sigmask_all);
+    sigset_t sigmask_prev;
+    sigemptyset(&sigmask_prev);
+    if (pthread_sigmask(SIG_SETMASK, &sigmask_all, &sigmask_prev))
+        log_fatal("pthread_sigmask() failed");
+
+    pthread_attr_t attribs;
+    pthread_attr_init(&attribs);
+    pthread_attr_setdetachstate(&attribs, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setscope(&attribs, PTHREAD_SCOPE_SYSTEM);
+
+    for (unsigned i = 0; i < opts.threads; i++) {
+        const int pthread_err = pthread_create(&bts[i].threadid, &attribs, bench_thread, &bts[i]);
+        if (pthread_err)
+            log_fatal("pthread_create() of benchmark thread %u failed: %s", i, logf_strerror(pthread_err));
+    }
+
+    if (pthread_sigmask(SIG_SETMASK, &sigmask_prev, NULL))
+        log_fatal("pthread_sigmask() failed");
+    pthread_attr_destroy(&attribs);
+
+    // Wait for every thread to finish its own setup, then time the run
+    pthread_barrier_wait(&start_barrier);
+    const uint64_t start = latency_now(CLOCK_MONOTONIC);
+    for (unsigned i = 0; i < opts.threads; i++) {
+        const int pthread_err = pthread_join(bts[i].threadid, NULL);
+        if (pthread_err)
+            log_fatal("pthread_join() of benchmark thread %u failed: %s", i, logf_strerror(pthread_err));
+    }
+    const uint64_t wall_ns = latency_now(CLOCK_MONOTONIC) - start;
+
+    report(bts, wall_ns);
+    return 0;
+}
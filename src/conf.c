@@ -31,6 +31,8 @@
 #include "plugins/plugapi.h"
 
 #include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -47,6 +49,8 @@ static const cfg_t cfg_defaults = {
     .chaos = { .data = NULL, .len = 0 },
     .nsid = { .data = NULL, .len = 0 },
     .cookie_key_file = NULL,
+    .dnstap_output = NULL,
+    .xfr_allow = NULL,
     .lock_mem = false,
     .disable_text_autosplit = false,
     .edns_client_subnet = true,
@@ -54,6 +58,8 @@ static const cfg_t cfg_defaults = {
     .disable_cookies = false,
     .experimental_no_chain = true,
     .disable_tcp_dso = false,
+    .dnstap_log_queries = true,
+    .dnstap_log_responses = true,
     .max_nocookie_response = 0,
     .zones_default_ttl = 86400U,
     .max_ncache_ttl = 10800U,
@@ -64,6 +70,16 @@ static const cfg_t cfg_defaults = {
     .acme_challenge_ttl = 600U,
     .acme_challenge_dns_ttl = 0U,
     .zones_rfc1035_threads = 2U,
+    .xfr_allow_count = 0,
+    .xfr_max_active = 4U,
+    .xfr_rate_limit = 0,
+    .xfr_ixfr_history = 16U,
+    .zone_stats = 0,
+    .dnstap_sample = 1U,
+    .dnstap_ring_size = 1048576U,
+    .monitor_threads = 1U,
+    .monitor_max_inflight = 0,
+    .monitor_publish_delay = 0.2,
 };
 
 F_NONNULL
@@ -122,6 +138,70 @@ static void set_nsid_ascii(cfg_t* cfg, const char* data)
     cfg->nsid.data = (uint8_t*)xstrdup(data);
 }
 
+F_NONNULL
+static void xfr_acl_parse(xfr_acl_t* acl, const char* spec)
+{
+    char* addr_str = xstrdup(spec);
+    unsigned long mask = ULONG_MAX;
+    char* slash = strchr(addr_str, '/');
+    if (slash) {
+        *slash++ = '\0';
+        char* endptr;
+        errno = 0;
+        mask = strtoul(slash, &endptr, 10);
+        if (errno || !*slash || *endptr)
+            log_fatal("Option 'xfr_allow': Invalid prefix length in '%s'", spec);
+    }
+
+    const int addr_err = gdnsd_anysin_fromstr(addr_str, 0, &acl->addr);
+    if (addr_err)
+        log_fatal("Option 'xfr_allow': Cannot parse address in '%s': %s", spec, gai_strerror(addr_err));
+    free(addr_str);
+
+    uint8_t* bytes;
+    unsigned max_mask;
+    if (acl->addr.sa.sa_family == AF_INET6) {
+        bytes = acl->addr.sin6.sin6_addr.s6_addr;
+        max_mask = 128U;
+    } else {
+        gdnsd_assert(acl->addr.sa.sa_family == AF_INET);
+        bytes = (uint8_t*)&acl->addr.sin4.sin_addr.s_addr;
+        max_mask = 32U;
+    }
+    if (mask == ULONG_MAX)
+        mask = max_mask;
+    else if (mask > max_mask)
+        log_fatal("Option 'xfr_allow': Prefix length in '%s' is larger than %u", spec, max_mask);
+    acl->mask = (unsigned)mask;
+
+    // Clear host bits so that matching can compare prefixes directly
+    for (unsigned i = 0; i < (max_mask >> 3U); i++) {
+        const unsigned bit = i << 3U;
+        if (bit >= mask)
+            bytes[i] = 0;
+        else if (mask - bit < 8U)
+            bytes[i] &= (uint8_t)(0xFF00U >> (mask - bit));
+    }
+}
+
+// "xfr_allow" is a single address/network string or an array of them
+F_NONNULL
+static void set_xfr_allow(cfg_t* cfg, vscf_data_t* xa)
+{
+    const unsigned count = vscf_array_get_len(xa);
+    if (!count)
+        return;
+    xfr_acl_t* acls = xcalloc_n(count, sizeof(*acls));
+    for (unsigned i = 0; i < count; i++) {
+        vscf_data_t* item = vscf_array_get_data(xa, i);
+        if (!vscf_is_simple(item))
+            log_fatal("Option 'xfr_allow': must be a string or an array of strings");
+        xfr_acl_parse(&acls[i], vscf_simple_get_data(item));
+    }
+    cfg->xfr_allow = acls;
+    cfg->xfr_allow_count = count;
+}
+
 // Generic iterator for catching bad config hash keys in various places below
 F_NONNULL F_NORETURN
 static bool bad_key(const char* key, unsigned klen V_UNUSED, vscf_data_t* d V_UNUSED, const void* which_asvoid)
@@ -304,6 +384,21 @@ cfg_t* conf_load(const vscf_data_t* cfg_root, const bool force_zsd)
         if (cfg->max_nocookie_response && cfg->max_nocookie_response < 128U)
             log_fatal("The global option 'max_nocookie_response' (%u) must be zero, or in the range 128 - 1024", cfg->max_nocookie_response);
         CFG_OPT_STR(options, cookie_key_file);
+        CFG_OPT_UINT(options, xfr_max_active, 1LU, 1024LU);
+        CFG_OPT_UINT_NOMIN(options, xfr_rate_limit, 4294967295LU);
+        CFG_OPT_UINT_NOMIN(options, xfr_ixfr_history, 1024LU);
+        CFG_OPT_UINT_NOMIN(options, zone_stats, 65536LU);
+        CFG_OPT_STR(options, dnstap_output);
+        CFG_OPT_BOOL(options, dnstap_log_queries);
+        CFG_OPT_BOOL(options, dnstap_log_responses);
+        CFG_OPT_UINT(options, dnstap_sample, 1LU, 1000000LU);
+        CFG_OPT_UINT(options, dnstap_ring_size, 65536LU, 1073741824LU);
+        CFG_OPT_UINT(options, monitor_threads, 1LU, 64LU);
+        CFG_OPT_UINT_NOMIN(options, monitor_max_inflight, 1000000LU);
+        CFG_OPT_DBL(options, monitor_publish_delay, 0.0, 10.0);
+        vscf_data_t* xfr_allow = vscf_hash_get_data_byconstkey(options, "xfr_allow", true);
+        if (xfr_allow)
+            set_xfr_allow(cfg, xfr_allow);
 
         CFG_OPT_STR_NOCOPY(options, chaos_response, chaos_data);
         CFG_OPT_STR_NOCOPY(options, nsid, nsid_data);
@@ -334,6 +429,9 @@ cfg_t* conf_load(const vscf_data_t* cfg_root, const bool force_zsd)
                               : NULL;
 
     // Phase 1 of service_types config
+    gdnsd_mon_cfg_publish_delay(cfg->monitor_publish_delay);
+    gdnsd_mon_cfg_threads(cfg->monitor_threads);
+    gdnsd_mon_cfg_max_inflight(cfg->monitor_max_inflight);
     gdnsd_mon_cfg_stypes_p1(stypes_cfg);
 
     // Load plugins
@@ -23,6 +23,7 @@
 #include "socks.h"
 
 #include <gdnsd/compiler.h>
+#include <gdnsd/net.h>
 #include <gdnsd/vscf.h>
 
 #include <stdbool.h>
@@ -33,10 +34,18 @@ typedef struct binstr_t {
     unsigned len;
 } binstr_t;
 
+// One network from "xfr_allow", with the host bits of addr cleared
+typedef struct {
+    gdnsd_anysin_t addr;
+    unsigned mask;
+} xfr_acl_t;
+
 typedef struct {
     binstr_t chaos;
     binstr_t nsid;
     const char*    cookie_key_file;
+    const char*    dnstap_output;
+    const xfr_acl_t* xfr_allow;
     bool     lock_mem;
     bool     disable_text_autosplit;
     bool     edns_client_subnet;
@@ -44,6 +53,8 @@ typedef struct {
     bool     disable_cookies;
     bool     experimental_no_chain;
     bool     disable_tcp_dso;
+    bool     dnstap_log_queries;
+    bool     dnstap_log_responses;
     unsigned max_nocookie_response;
     unsigned zones_default_ttl;
     unsigned max_ncache_ttl;
@@ -54,6 +65,16 @@ typedef struct {
     unsigned acme_challenge_ttl;
     unsigned acme_challenge_dns_ttl;
     unsigned zones_rfc1035_threads;
+    unsigned xfr_allow_count;
+    unsigned xfr_max_active;
+    unsigned xfr_rate_limit;
+    unsigned xfr_ixfr_history;
+    unsigned zone_stats;
+    unsigned dnstap_sample;
+    unsigned dnstap_ring_size;
+    unsigned monitor_threads;
+    unsigned monitor_max_inflight;
+    double   monitor_publish_delay;
 } cfg_t;
 
 extern const cfg_t* gcfg;
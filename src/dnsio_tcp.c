@@ -25,6 +25,9 @@
 #include "dnspacket.h"
 #include "socks.h"
 #include "proxy.h"
+#include "dnstls.h"
+#include "xfr.h"
+#include "latency.h"
 
 #include <gdnsd/alloc.h>
 #include <gdnsd/log.h>
@@ -48,8 +51,10 @@
 
 // libev prio map:
 // +2: thread async stop watcher (highest prio)
-// +1: conn check/read watchers (only 1 per conn active at any time)
-//  0: thread timeout watcher
+// +1: conn check/read watchers (only 1 per conn active at any time, and the
+//     read watcher doubles as the TLS handshake read/write watcher and the
+//     zone transfer write watcher)
+//  0: thread timeout watcher, conn zone transfer rate limit timers
 // -1: thread accept watcher
 // -2: thread idle watcher (lowest prio)
 
@@ -91,6 +96,19 @@ _Static_assert(_Alignof(pkt_t) <= _Alignof(uint16_t), "No padding for pkt");
 struct conn;
 typedef struct conn conn_t;
 
+// State for a zone transfer in progress on a conn.  While this exists, the
+// conn's read watcher is switched to EV_WRITE for streaming the transfer's
+// messages, and any further requests wait in the readbuf until it's done.
+typedef struct {
+    xfr_t* xfr;
+    const uint8_t* msg; // current message, including TCP length prefix
+    size_t msg_len;
+    size_t msg_sent;
+    uint64_t total; // bytes of all completed messages, for xfr_rate_limit
+    ev_tstamp start;
+    ev_timer rl_timer; // pauses the write watcher for xfr_rate_limit
+} conn_xfr_t;
+
 // per-thread state
 typedef struct {
     // These pointers and values are fixed for the life of the thread:
@@ -99,6 +117,7 @@ typedef struct {
     struct ev_loop* loop;
     conn_t** churn; // save conn_t allocations from previously-closed conns
     tcp_pkt_t* tpkt;
+    dnstls_ctx_t* tls_ctx; // NULL if not a TLS listener
     double server_timeout;
     size_t max_clients;
     unsigned churn_alloc;
@@ -130,6 +149,10 @@ struct conn {
     gdnsd_anysin_t sa;
     bool need_proxy_init;
     dso_state_t dso; // shared w/ dnspacket layer
+    // Only non-NULL during the TLS handshake, or for the life of the conn if
+    // the kernel couldn't take over the receive side of the TLS record layer:
+    dnstls_sess_t* tls_sess;
+    conn_xfr_t* xfr; // Only non-NULL while a zone transfer is in progress
     size_t readbuf_head;
     size_t readbuf_bytes;
     union {
@@ -289,6 +312,16 @@ static void connq_destruct_conn(thread_t* thr, conn_t* conn, const bool rst, con
         thr->check_mode_conns--;
     }
 
+    if (conn->tls_sess)
+        dnstls_sess_free(conn->tls_sess);
+
+    if (conn->xfr) {
+        ev_timer* rl_timer = &conn->xfr->rl_timer;
+        ev_timer_stop(thr->loop, rl_timer);
+        xfr_destroy(conn->xfr->xfr);
+        free(conn->xfr);
+    }
+
     const int fd = read_watcher->fd;
     if (rst) {
         const struct linger lin = { .l_onoff = 1, .l_linger = 0 };
@@ -541,12 +574,13 @@ static void stop_handler(struct ev_loop* loop, ev_async* w, int revents V_UNUSED
     // Inform dnspacket layer we're in graceful shutdown phase (zero timeouts)
     dnspacket_ctx_set_grace(thr->pctx);
 
-    // send unidirectional KeepAlive w/ inactivity=0 to all DSO clients
+    // send unidirectional KeepAlive w/ inactivity=0 to all DSO clients, except
+    // those in the middle of a zone transfer, where it would corrupt the stream
     conn_t* conn = thr->connq_head;
     gdnsd_assert(conn);
     while (conn) {
         conn_t* next_conn = conn->next;
-        if (conn->dso.estab)
+        if (conn->dso.estab && !conn->xfr)
             conn_send_dso_uni(thr, conn);
         conn = next_conn;
     }
@@ -571,6 +605,57 @@ static void stop_handler(struct ev_loop* loop, ev_async* w, int revents V_UNUSED
     }
 }
 
+// This does the actual recv() call and immediate post-processing (incl conn
+// termination on EOF or error).
+// rv true means caller should return immediately (connection closed or read
+// gave no new bytes and wants to block in the eventloop again).  rv false
+// means one or more new bytes were added to the readbuf.
+F_NONNULL
+static bool conn_do_recv(thread_t* thr, conn_t* conn)
+{
+    gdnsd_assert(conn->readbuf_bytes < sizeof(conn->readbuf));
+    const size_t wanted = sizeof(conn->readbuf) - conn->readbuf_bytes;
+    ssize_t recvrv;
+    if (conn->tls_sess)
+        recvrv = dnstls_sess_recv(conn->tls_sess, &conn->readbuf[conn->readbuf_bytes], wanted);
+    else
+        recvrv = recv(conn->read_watcher.fd, &conn->readbuf[conn->readbuf_bytes], wanted, 0);
+
+    // With receive-side kTLS, a non-data TLS record from the client (e.g. its
+    // close_notify alert) fails the recv() with EIO, which we treat as EOF
+    if (recvrv < 0 && errno == EIO && thr->tls_ctx)
+        recvrv = 0;
+
+    if (recvrv == 0) { // (EOF)
+        if (conn->readbuf_bytes) {
+            log_debug("TCP DNS conn from %s closed by client while reading: unexpected EOF", logf_anysin(&conn->sa));
+            stats_own_inc(&thr->stats->tcp.recvfail);
+            stats_own_inc(&thr->stats->tcp.close_s_err);
+        } else {
+            log_debug("TCP DNS conn from %s closed by client while idle (ideal close)", logf_anysin(&conn->sa));
+            stats_own_inc(&thr->stats->tcp.close_c);
+        }
+        connq_destruct_conn(thr, conn, false, true);
+        return true;
+    }
+
+    if (recvrv < 0) { // negative return -> errno
+        if (!ERRNO_WOULDBLOCK) {
+            log_debug("TCP DNS conn from %s reset by server: error while reading: %s", logf_anysin(&conn->sa), logf_errno());
+            stats_own_inc(&thr->stats->tcp.recvfail);
+            stats_own_inc(&thr->stats->tcp.close_s_err);
+            connq_destruct_conn(thr, conn, true, true);
+        }
+        return true;
+    }
+
+    size_t pktlen = (size_t)recvrv;
+    gdnsd_assert(pktlen <= wanted);
+    gdnsd_assert((conn->readbuf_bytes + pktlen) <= sizeof(conn->readbuf));
+    conn->readbuf_bytes += pktlen;
+    return false;
+}
+
 // Checks the status of the next request in the buffer, if any, and takes a few
 // sanitizing actions along the way.
 // TLDR: -1 == killed conn, 0 == need more read, 1+ == size of full req avail
@@ -614,6 +699,188 @@ static ssize_t conn_check_next_req(thread_t* thr, conn_t* conn)
     return (ssize_t)req_size;
 }
 
+// Called with either the read or check watcher active after finishing a
+// response (or a whole zone transfer) to decide which of the two should be
+// active for the next request.  May close the conn.
+F_NONNULL
+static void conn_set_next_watcher(thread_t* thr, conn_t* conn)
+{
+    ev_io* readw = &conn->read_watcher;
+    ev_check* checkw = &conn->check_watcher;
+
+    // Check status of next readbuf req, decide which watcher should be active
+    ssize_t ccnr_rv = conn_check_next_req(thr, conn);
+
+    // Data already decrypted and buffered inside a userspace TLS session will
+    // never wake up the read watcher, so it has to be pulled in here
+    while (!ccnr_rv && conn->tls_sess && dnstls_sess_pending(conn->tls_sess)) {
+        if (conn_do_recv(thr, conn))
+            return; // conn closed
+        ccnr_rv = conn_check_next_req(thr, conn);
+    }
+
+    if (ccnr_rv < 0) // ccnr closed the conn for illegal next req size
+        return;
+    if (!ccnr_rv) { // No full req available, need to hit the read_handler next
+        if (ev_is_active(checkw)) {
+            ev_check_stop(thr->loop, checkw);
+            gdnsd_assert(!ev_is_active(readw));
+            ev_io_start(thr->loop, readw);
+            gdnsd_assert(thr->check_mode_conns);
+            thr->check_mode_conns--;
+        } else {
+            gdnsd_assert(ev_is_active(readw));
+        }
+    } else { // Full req available, need to hit the check_handler next
+        if (ev_is_active(readw)) {
+            ev_io_stop(thr->loop, readw);
+            gdnsd_assert(!ev_is_active(checkw));
+            ev_check_start(thr->loop, checkw);
+            thr->check_mode_conns++;
+        } else {
+            gdnsd_assert(ev_is_active(checkw));
+        }
+    }
+}
+
+F_NONNULL
+static void read_handler(struct ev_loop* loop V_UNUSED, ev_io* w, const int revents V_UNUSED);
+
+// Ends a zone transfer which has sent its final message, and resumes normal
+// request processing on the conn.
+F_NONNULL
+static void conn_xfr_finish(thread_t* thr, conn_t* conn)
+{
+    conn_xfr_t* cx = conn->xfr;
+    gdnsd_assert(cx);
+    gdnsd_assert(!ev_is_active(&cx->rl_timer));
+    log_debug("TCP DNS conn from %s: zone transfer complete, %" PRIu64 " bytes", logf_anysin(&conn->sa), cx->total);
+    xfr_destroy(cx->xfr);
+    free(cx);
+    conn->xfr = NULL;
+
+    ev_io* readw = &conn->read_watcher;
+    ev_io_stop(thr->loop, readw);
+    ev_io_set(readw, readw->fd, EV_READ);
+    ev_set_cb(readw, read_handler);
+    ev_io_start(thr->loop, readw);
+    conn_set_next_watcher(thr, conn);
+}
+
+// The read watcher's callback (for EV_WRITE) while a zone transfer is in
+// progress.  Unlike normal responses, transfer messages are large and many,
+// so partial writes are expected, and we simply wait for writability.  Only
+// one new message is generated per callback, so that other connections on the
+// thread aren't starved while the transfer streams.
+F_NONNULL
+static void xfr_write_handler(struct ev_loop* loop, ev_io* w, const int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_WRITE);
+    conn_t* conn = w->data;
+    gdnsd_assert(conn);
+    thread_t* thr = conn->thr;
+    gdnsd_assert(thr);
+    conn_xfr_t* cx = conn->xfr;
+    gdnsd_assert(cx);
+
+    if (cx->msg_sent < cx->msg_len) {
+        const ssize_t send_rv = send(w->fd, &cx->msg[cx->msg_sent], cx->msg_len - cx->msg_sent, 0);
+        if (send_rv < 0) {
+            if (ERRNO_WOULDBLOCK)
+                return;
+            log_debug("TCP DNS conn from %s reset by server: failed while writing zone transfer: %s", logf_anysin(&conn->sa), logf_errno());
+            stats_own_inc(&thr->stats->tcp.sendfail);
+            stats_own_inc(&thr->stats->tcp.xfr_fail);
+            stats_own_inc(&thr->stats->tcp.close_s_err);
+            connq_destruct_conn(thr, conn, true, true);
+            return;
+        }
+        cx->msg_sent += (size_t)send_rv;
+        if (cx->msg_sent < cx->msg_len)
+            return;
+
+        // A message was completed, which counts as activity for idle timeouts
+        cx->total += cx->msg_len;
+        connq_refresh_conn(thr, conn);
+
+        if (gcfg->xfr_rate_limit) {
+            const ev_tstamp due = cx->start + ((double)cx->total / gcfg->xfr_rate_limit);
+            const ev_tstamp now = ev_now(loop);
+            if (due > now) {
+                ev_io_stop(loop, w);
+                ev_timer* rl_timer = &cx->rl_timer;
+                ev_timer_set(rl_timer, due - now, 0.);
+                ev_timer_start(loop, rl_timer);
+                stats_own_inc(&thr->stats->tcp.xfr_throttled);
+                return;
+            }
+        }
+    }
+
+    // Bring RCU online (or quiesce) and generate the next message
+    if (!thr->rcu_is_online) {
+        thr->rcu_is_online = true;
+        rcu_thread_online();
+    } else {
+        rcu_quiescent_state();
+    }
+
+    const xfr_next_rv_t rv = xfr_next(cx->xfr, &cx->msg, &cx->msg_len);
+    if (rv == XFR_NEXT_MSG) {
+        cx->msg_sent = 0;
+    } else if (rv == XFR_NEXT_DONE) {
+        conn_xfr_finish(thr, conn);
+    } else {
+        gdnsd_assert(rv == XFR_NEXT_ABORT);
+        log_debug("TCP DNS conn from %s reset by server: zone transfer aborted", logf_anysin(&conn->sa));
+        stats_own_inc(&thr->stats->tcp.xfr_fail);
+        stats_own_inc(&thr->stats->tcp.close_s_err);
+        connq_destruct_conn(thr, conn, true, true);
+    }
+}
+
+F_NONNULL
+static void xfr_rl_handler(struct ev_loop* loop, ev_timer* t, const int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_TIMER);
+    conn_t* conn = t->data;
+    gdnsd_assert(conn);
+    gdnsd_assert(conn->xfr);
+    ev_io* readw = &conn->read_watcher;
+    ev_io_start(loop, readw);
+}
+
+// Takes over a zone transfer just started by process_dns_query(), whose
+// normal response is discarded in favor of the transfer's own messages.
+F_NONNULL
+static void conn_xfr_start(thread_t* thr, conn_t* conn)
+{
+    gdnsd_assert(!conn->xfr);
+    conn_xfr_t* cx = xcalloc(sizeof(*cx));
+    cx->xfr = conn->dso.xfr;
+    conn->dso.xfr = NULL;
+    cx->start = ev_now(thr->loop);
+    ev_timer* rl_timer = &cx->rl_timer;
+    ev_timer_init(rl_timer, xfr_rl_handler, 0., 0.);
+    rl_timer->data = conn;
+    conn->xfr = cx;
+
+    ev_io* readw = &conn->read_watcher;
+    ev_check* checkw = &conn->check_watcher;
+    if (ev_is_active(checkw)) {
+        ev_check_stop(thr->loop, checkw);
+        gdnsd_assert(thr->check_mode_conns);
+        thr->check_mode_conns--;
+    } else {
+        gdnsd_assert(ev_is_active(readw));
+        ev_io_stop(thr->loop, readw);
+    }
+    ev_io_set(readw, readw->fd, EV_WRITE);
+    ev_set_cb(readw, xfr_write_handler);
+    ev_io_start(thr->loop, readw);
+    xfr_write_handler(thr->loop, readw, EV_WRITE);
+}
+
 // Assumes a full request packet (starting with the 12 byte DNS header) is
 // available starting at "conn->readbuf[conn->readbuf_head + 2U]" and the
 // length indicated by the 2-byte length prefix from TCP DNS is indicated in
@@ -641,7 +908,9 @@ static void conn_respond(thread_t* thr, conn_t* conn, const size_t req_size)
     }
 
     conn->dso.last_was_ka = false;
+    const uint64_t pdq_start = latency_now(CLOCK_MONOTONIC);
     size_t resp_size = process_dns_query(thr->pctx, &conn->sa, &tpkt->pkt, &conn->dso, req_size);
+    latency_record(&thr->stats->pdq, latency_now(CLOCK_MONOTONIC) - pdq_start);
     if (!resp_size) {
         log_debug("TCP DNS conn from %s reset by server: dropped invalid query", logf_anysin(&conn->sa));
         stats_own_inc(&thr->stats->tcp.close_s_err);
@@ -649,8 +918,10 @@ static void conn_respond(thread_t* thr, conn_t* conn, const size_t req_size)
         return;
     }
 
-    ev_io* readw = &conn->read_watcher;
-    ev_check* checkw = &conn->check_watcher;
+    if (conn->dso.xfr) {
+        conn_xfr_start(thr, conn);
+        return;
+    }
 
     // We only make one attempt to send the whole response, and do not accept
     // EAGAIN.  This is incorrect in theory, but it makes sense in practice for
@@ -667,30 +938,7 @@ static void conn_respond(thread_t* thr, conn_t* conn, const size_t req_size)
     if (!conn->dso.last_was_ka)
         connq_refresh_conn(thr, conn);
 
-    // Check status of next readbuf req, decide which watcher should be active
-    const ssize_t ccnr_rv = conn_check_next_req(thr, conn);
-    if (ccnr_rv < 0) // ccnr closed the conn for illegal next req size
-        return;
-    if (!ccnr_rv) { // No full req available, need to hit the read_handler next
-        if (ev_is_active(checkw)) {
-            ev_check_stop(thr->loop, checkw);
-            gdnsd_assert(!ev_is_active(readw));
-            ev_io_start(thr->loop, readw);
-            gdnsd_assert(thr->check_mode_conns);
-            thr->check_mode_conns--;
-        } else {
-            gdnsd_assert(ev_is_active(readw));
-        }
-    } else { // Full req available, need to hit the check_handler next
-        if (ev_is_active(readw)) {
-            ev_io_stop(thr->loop, readw);
-            gdnsd_assert(!ev_is_active(checkw));
-            ev_check_start(thr->loop, checkw);
-            thr->check_mode_conns++;
-        } else {
-            gdnsd_assert(ev_is_active(checkw));
-        }
-    }
+    conn_set_next_watcher(thr, conn);
 }
 
 F_NONNULL
@@ -712,48 +960,6 @@ static void check_handler(struct ev_loop* loop V_UNUSED, ev_check* w, const int
     conn_respond(thr, conn, req_size);
 }
 
-// This does the actual recv() call and immediate post-processing (incl conn
-// termination on EOF or error).
-// rv true means caller should return immediately (connection closed or read
-// gave no new bytes and wants to block in the eventloop again).  rv false
-// means one or more new bytes were added to the readbuf.
-F_NONNULL
-static bool conn_do_recv(thread_t* thr, conn_t* conn)
-{
-    gdnsd_assert(conn->readbuf_bytes < sizeof(conn->readbuf));
-    const size_t wanted = sizeof(conn->readbuf) - conn->readbuf_bytes;
-    const ssize_t recvrv = recv(conn->read_watcher.fd, &conn->readbuf[conn->readbuf_bytes], wanted, 0);
-
-    if (recvrv == 0) { // (EOF)
-        if (conn->readbuf_bytes) {
-            log_debug("TCP DNS conn from %s closed by client while reading: unexpected EOF", logf_anysin(&conn->sa));
-            stats_own_inc(&thr->stats->tcp.recvfail);
-            stats_own_inc(&thr->stats->tcp.close_s_err);
-        } else {
-            log_debug("TCP DNS conn from %s closed by client while idle (ideal close)", logf_anysin(&conn->sa));
-            stats_own_inc(&thr->stats->tcp.close_c);
-        }
-        connq_destruct_conn(thr, conn, false, true);
-        return true;
-    }
-
-    if (recvrv < 0) { // negative return -> errno
-        if (!ERRNO_WOULDBLOCK) {
-            log_debug("TCP DNS conn from %s reset by server: error while reading: %s", logf_anysin(&conn->sa), logf_errno());
-            stats_own_inc(&thr->stats->tcp.recvfail);
-            stats_own_inc(&thr->stats->tcp.close_s_err);
-            connq_destruct_conn(thr, conn, true, true);
-        }
-        return true;
-    }
-
-    size_t pktlen = (size_t)recvrv;
-    gdnsd_assert(pktlen <= wanted);
-    gdnsd_assert((conn->readbuf_bytes + pktlen) <= sizeof(conn->readbuf));
-    conn->readbuf_bytes += pktlen;
-    return false;
-}
-
 F_NONNULL
 static void read_handler(struct ev_loop* loop V_UNUSED, ev_io* w, const int revents V_UNUSED)
 {
@@ -788,6 +994,120 @@ static void read_handler(struct ev_loop* loop V_UNUSED, ev_io* w, const int reve
     conn_respond(thr, conn, (size_t)ccnr_rv);
 }
 
+// Handles the PROXY header for TLS listeners.  Unlike the plain TCP case, we
+// can't read past the end of the PROXY header, as the rest of the stream
+// belongs to the TLS handshake, so we peek first and then consume exactly the
+// parsed length.
+// rv true means caller should return immediately (connection closed or no
+// data available yet).
+F_NONNULL
+static bool conn_tls_proxy_init(thread_t* thr, conn_t* conn)
+{
+    const int fd = conn->read_watcher.fd;
+    const ssize_t peekrv = recv(fd, conn->readbuf, sizeof(conn->readbuf), MSG_PEEK);
+    if (peekrv <= 0) {
+        if (peekrv < 0 && ERRNO_WOULDBLOCK)
+            return true;
+        if (!peekrv) {
+            log_debug("TCP DNS conn from %s closed by client before PROXY header", logf_anysin(&conn->sa));
+            stats_own_inc(&thr->stats->tcp.close_c);
+        } else {
+            log_debug("TCP DNS conn from %s reset by server: error while reading: %s", logf_anysin(&conn->sa), logf_errno());
+            stats_own_inc(&thr->stats->tcp.recvfail);
+            stats_own_inc(&thr->stats->tcp.close_s_err);
+        }
+        connq_destruct_conn(thr, conn, !!peekrv, true);
+        return true;
+    }
+
+    conn->need_proxy_init = false;
+    const size_t consumed = proxy_parse(&conn->sa, &conn->proxy_hdr, (size_t)peekrv);
+    gdnsd_assert(consumed <= (size_t)peekrv);
+    if (!consumed || recv(fd, conn->readbuf, consumed, 0) != (ssize_t)consumed) {
+        log_neterr("PROXY parse fail from %s, resetting connection", logf_anysin(&conn->sa));
+        stats_own_inc(&thr->stats->tcp.proxy_fail);
+        stats_own_inc(&thr->stats->tcp.close_s_err);
+        connq_destruct_conn(thr, conn, true, true);
+        return true;
+    }
+
+    return false;
+}
+
+// The handshake may need to wait on writability as well as readability, which
+// we do by re-pointing the conn's read watcher.
+F_NONNULL
+static void conn_tls_set_events(thread_t* thr, conn_t* conn, const int events)
+{
+    ev_io* readw = &conn->read_watcher;
+    if ((readw->events & (EV_READ | EV_WRITE)) != events) {
+        ev_io_stop(thr->loop, readw);
+        ev_io_set(readw, readw->fd, events);
+        ev_io_start(thr->loop, readw);
+    }
+}
+
+// The read watcher's callback for TLS listener connections until the TLS
+// handshake is complete, at which point it's switched to read_handler and
+// the connection is handled like any other from then on.
+F_NONNULL
+static void tls_handler(struct ev_loop* loop, ev_io* w, const int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_READ || revents == EV_WRITE);
+    conn_t* conn = w->data;
+    gdnsd_assert(conn);
+    thread_t* thr = conn->thr;
+    gdnsd_assert(thr);
+    gdnsd_assert(thr->tls_ctx);
+
+    if (conn->need_proxy_init && conn_tls_proxy_init(thr, conn))
+        return; // conn closed or PROXY header not yet available
+
+    if (!conn->tls_sess) {
+        conn->tls_sess = dnstls_sess_new(thr->tls_ctx, w->fd);
+        if (!conn->tls_sess) {
+            log_neterr("TCP DNS conn from %s reset by server: cannot create TLS session", logf_anysin(&conn->sa));
+            stats_own_inc(&thr->stats->tcp.tls_fail);
+            stats_own_inc(&thr->stats->tcp.close_s_err);
+            connq_destruct_conn(thr, conn, true, true);
+            return;
+        }
+    }
+
+    const dnstls_rv_t tls_rv = dnstls_sess_handshake(conn->tls_sess, &conn->sa);
+    if (tls_rv == DNSTLS_WANT_READ) {
+        conn_tls_set_events(thr, conn, EV_READ);
+        return;
+    }
+    if (tls_rv == DNSTLS_WANT_WRITE) {
+        conn_tls_set_events(thr, conn, EV_WRITE);
+        return;
+    }
+    if (tls_rv == DNSTLS_FAIL) {
+        log_debug("TCP DNS conn from %s reset by server: TLS handshake failed", logf_anysin(&conn->sa));
+        stats_own_inc(&thr->stats->tcp.tls_fail);
+        stats_own_inc(&thr->stats->tcp.close_s_err);
+        connq_destruct_conn(thr, conn, true, true);
+        return;
+    }
+    gdnsd_assert(tls_rv == DNSTLS_DONE);
+
+    // The kernel owns at least the send side of the record layer now.  If it
+    // owns the receive side as well, we don't need the session at all anymore
+    // and the socket is used exactly like a plain TCP one.
+    if (dnstls_sess_ktls_rx(conn->tls_sess)) {
+        dnstls_sess_free(conn->tls_sess);
+        conn->tls_sess = NULL;
+    }
+
+    conn_tls_set_events(thr, conn, EV_READ);
+    ev_set_cb(w, read_handler);
+
+    // Clients commonly send the first request right behind their final
+    // handshake message, so try to read it immediately
+    read_handler(loop, w, EV_READ);
+}
+
 F_NONNULL
 static void accept_handler(struct ev_loop* loop, ev_io* w, const int revents V_UNUSED)
 {
@@ -837,12 +1157,14 @@ static void accept_handler(struct ev_loop* loop, ev_io* w, const int revents V_U
         stats_own_inc(&thr->stats->tcp.proxy);
         conn->need_proxy_init = true;
     }
+    if (thr->tls_ctx)
+        stats_own_inc(&thr->stats->tcp.tls);
 
     conn->thr = thr;
     connq_append_new_conn(thr, conn);
 
     ev_io* read_watcher = &conn->read_watcher;
-    ev_io_init(read_watcher, read_handler, sock, EV_READ);
+    ev_io_init(read_watcher, thr->tls_ctx ? tls_handler : read_handler, sock, EV_READ);
     ev_set_priority(read_watcher, 1);
     read_watcher->data = conn;
     ev_io_start(loop, read_watcher);
@@ -852,10 +1174,14 @@ static void accept_handler(struct ev_loop* loop, ev_io* w, const int revents V_U
     ev_set_priority(check_watcher, 1);
     check_watcher->data = conn;
 
-    // Always optimistically attempt to read a req at conn start.  Even if
-    // TCP_DEFER_ACCEPT and SO_ACCEPTFILTER are both unavailable, there's a
-    // chance that under load the request data is already present.
-    read_handler(loop, read_watcher, EV_READ);
+    // Always optimistically attempt to read a req (or the TLS ClientHello) at
+    // conn start.  Even if TCP_DEFER_ACCEPT and SO_ACCEPTFILTER are both
+    // unavailable, there's a chance that under load the data is already
+    // present.
+    if (thr->tls_ctx)
+        tls_handler(loop, read_watcher, EV_READ);
+    else
+        read_handler(loop, read_watcher, EV_READ);
 }
 
 F_NONNULL
@@ -982,7 +1308,7 @@ static void set_accf(const dns_addr_t* addrconf V_UNUSED, const int sock V_UNUSE
     socklen_t afa_exist_size = sizeof(afa_exist);
     memset(&afa_exist, 0, sizeof(afa_exist));
     memset(&afa_want, 0, sizeof(afa_want));
-    strcpy(afa_want.af_name, addrconf->tcp_proxy ? "dataready" : "dnsready");
+    strcpy(afa_want.af_name, (addrconf->tcp_proxy || addrconf->tls) ? "dataready" : "dnsready");
 
     const int getrv = getsockopt(sock, SOL_SOCKET, SO_ACCEPTFILTER, &afa_exist, &afa_exist_size);
     if (getrv && errno != EINVAL) {
@@ -1005,7 +1331,7 @@ static void set_accf(const dns_addr_t* addrconf V_UNUSED, const int sock V_UNUSE
                 // "dataready" just in case that one happens to be loaded;
                 // it's better than nothing and matches what we get on Linux
                 // with just TCP_DEFER_ACCEPT
-                if (!addrconf->tcp_proxy) {
+                if (!addrconf->tcp_proxy && !addrconf->tls) {
                     strcpy(afa_want.af_name, "dataready");
                     if (setsockopt(sock, SOL_SOCKET, SO_ACCEPTFILTER, &afa_want, sizeof(afa_want)))
                         log_err("Failed to install '%s' SO_ACCEPTFILTER on TCP socket %s: %s", afa_want.af_name, logf_anysin(&addrconf->addr), logf_errno());
@@ -1040,6 +1366,7 @@ void* dnsio_tcp_start(void* thread_asvoid)
     thr.max_clients = addrconf->tcp_clients_per_thread;
     thr.do_proxy = addrconf->tcp_proxy;
     thr.tcp_pad = addrconf->tcp_pad;
+    thr.tls_ctx = addrconf->tls_ctx;
 
     // Set up the conn_t churn buffer, which saves some per-new-connection
     // memory allocation churn by saving up to sqrt(max_clients) old conn_t
@@ -1095,7 +1422,7 @@ void* dnsio_tcp_start(void* thread_asvoid)
     // Therefore, this must happen after register_thread() above, to ensure
     // that all tcp threads are properly registered with the shutdown handler
     // before we begin processing possible future shutdown events.
-    thr.pctx = dnspacket_ctx_init_tcp(&thr.stats, addrconf->tcp_pad, addrconf->tcp_timeout);
+    thr.pctx = dnspacket_ctx_init_tcp(&thr.stats, addrconf->tcp_pad, addrconf->tls, addrconf->tcp_timeout);
 
     rcu_register_thread();
     thr.rcu_is_online = true;
@@ -24,6 +24,7 @@
 #include "dnswire.h"
 #include "dnspacket.h"
 #include "socks.h"
+#include "latency.h"
 
 #include <gdnsd/log.h>
 #include <gdnsd/misc.h>
@@ -56,6 +57,23 @@
 #define SOL_IP IPPROTO_IP
 #endif
 
+// Kernel receive timestamps for the "rx_tx" latency histogram, preferring
+// nanosecond resolution where available.  Either way the timestamps are on
+// the CLOCK_REALTIME timebase.
+#if defined SO_TIMESTAMPNS && defined SCM_TIMESTAMPNS
+#  define USE_RX_TS 1
+#  define RX_TS_SO SO_TIMESTAMPNS
+#  define RX_TS_SCM SCM_TIMESTAMPNS
+typedef struct timespec rx_ts_t;
+#  define RX_TS_NS(_ts) ((uint64_t)(_ts).tv_nsec)
+#elif defined SO_TIMESTAMP && defined SCM_TIMESTAMP
+#  define USE_RX_TS 1
+#  define RX_TS_SO SO_TIMESTAMP
+#  define RX_TS_SCM SCM_TIMESTAMP
+typedef struct timeval rx_ts_t;
+#  define RX_TS_NS(_ts) ((uint64_t)(_ts).tv_usec * 1000U)
+#endif
+
 // "Fast" SO_RCVTIMEO for recvmsg(), in microseconds:
 // In the fast path with fairly constant network input, this is the maximum
 // time we'll block in recvmsg().  This timeout value has three critical
@@ -249,6 +267,11 @@ void udp_sock_setup(dns_thread_t* t)
     sockopt_bool_warn(UDP, sa, t->sock, SOL_SOCKET, SO_REUSEPORT_LB, 1);
 #endif
 
+#ifdef USE_RX_TS
+    // Only used for stats, so it's not critical if it fails
+    sockopt_bool_warn(UDP, sa, t->sock, SOL_SOCKET, RX_TS_SO, 1);
+#endif
+
     if (addrconf->udp_rcvbuf)
         sockopt_int_fatal(UDP, sa, t->sock, SOL_SOCKET, SO_RCVBUF, (int)addrconf->udp_rcvbuf);
     if (addrconf->udp_sndbuf)
@@ -276,8 +299,13 @@ static unsigned get_pgsz(void)
 // is assumed to be larger than that needed for IPv4 (we use the same buffer
 // size for both cases for simplicity).  There could be portability issues
 // lurking here that will need to be addressed, but this works for Linux and I
-// think it works for the *BSDs as well.
+// think it works for the *BSDs as well.  The receive timestamp, if enabled, is
+// in addition to the pktinfo.
+#ifdef USE_RX_TS
+#define CMSG_BUFSIZE (CMSG_SPACE(sizeof(struct in6_pktinfo)) + CMSG_SPACE(sizeof(rx_ts_t)))
+#else
 #define CMSG_BUFSIZE CMSG_SPACE(sizeof(struct in6_pktinfo))
+#endif
 
 // Clear the ipi6_ifindex value of an IPV6_PKTINFO unless the address is
 // link-local.  Leaving it set to its original value in other cases can cause
@@ -301,6 +329,48 @@ static void ipv6_pktinfo_ifindex_fixup(struct msghdr* msg_hdr)
     }
 }
 
+#ifdef USE_RX_TS
+// Returns the kernel receive timestamp of a received message in nanoseconds
+// (or zero if there wasn't one), and removes it from the control data, which
+// is re-used as-is for sending the response, where it would cause an EINVAL.
+// Whatever else is left (the pktinfo, if any) is moved to the front.
+F_NONNULL
+static uint64_t rx_ts_take(struct msghdr* msg_hdr)
+{
+    uint64_t rv = 0;
+    struct cmsghdr* keep = NULL;
+    struct cmsghdr* cmsg = (struct cmsghdr*)CMSG_FIRSTHDR(msg_hdr);
+    while (cmsg) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == RX_TS_SCM)) {
+            rx_ts_t ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            rv = ((uint64_t)ts.tv_sec * UINT64_C(1000000000)) + RX_TS_NS(ts);
+        } else if (!keep) {
+            keep = cmsg;
+        }
+        cmsg = (struct cmsghdr*)CMSG_NXTHDR(msg_hdr, cmsg);
+    }
+
+    if (keep) {
+        const size_t keep_len = keep->cmsg_len;
+        if ((void*)keep != msg_hdr->msg_control)
+            memmove(msg_hdr->msg_control, keep, keep_len);
+        msg_hdr->msg_controllen = CMSG_SPACE(keep_len - CMSG_LEN(0));
+    } else {
+        msg_hdr->msg_controllen = 0;
+    }
+    return rv;
+}
+
+// Records the rx_tx latency for a response which was just sent
+F_NONNULL
+static void rx_ts_record(dnspacket_stats_t* stats, const uint64_t rx_ts, const uint64_t now)
+{
+    if (rx_ts && now > rx_ts)
+        latency_record(&stats->rx_tx, now - rx_ts);
+}
+#endif
+
 // Once traffic has become "idle", the mainloop invokes this function, which is
 // intended to reliably block as long as it can, until either the terminal
 // signal or fresh network traffic arrives.  We have to be careful about signal
@@ -346,9 +416,15 @@ static void process_msg(const int fd, dnsp_ctx_t* pctx, dnspacket_stats_t* stats
     if (sa->sa.sa_family == AF_INET6)
         ipv6_pktinfo_ifindex_fixup(msg_hdr);
 
+#ifdef USE_RX_TS
+    const uint64_t rx_ts = rx_ts_take(msg_hdr);
+#endif
+
     sa->len = msg_hdr->msg_namelen;
     struct iovec* iov = msg_hdr->msg_iov;
+    const uint64_t pdq_start = latency_now(CLOCK_MONOTONIC);
     iov->iov_len = process_dns_query(pctx, sa, iov->iov_base, NULL, buf_in_len);
+    latency_record(&stats->pdq, latency_now(CLOCK_MONOTONIC) - pdq_start);
     if (iov->iov_len) {
         ssize_t sent;
         do {
@@ -359,6 +435,11 @@ static void process_msg(const int fd, dnsp_ctx_t* pctx, dnspacket_stats_t* stats
             log_neterr("UDP sendmsg() of %zu bytes to %s failed: %s",
                        iov->iov_len, logf_anysin(sa), logf_errno());
         }
+#ifdef USE_RX_TS
+        else {
+            rx_ts_record(stats, rx_ts, latency_now(CLOCK_REALTIME));
+        }
+#endif
     }
 }
 
@@ -426,7 +507,13 @@ static void process_mmsgs(const int fd, dnsp_ctx_t* pctx, dnspacket_stats_t* sta
     // we instantly drop it at this layer), then process it through
     // process_dns_query to generate a response (which may return a length of
     // zero to indicate a need to drop the response as well).  The resulting
-    // response size (or zero for drop) is stored to the iov_len.
+    // response size (or zero for drop) is stored to the iov_len.  The pdq
+    // latency timestamps are chained, so that there's only one clock read per
+    // packet.
+#ifdef USE_RX_TS
+    uint64_t rx_ts[MMSG_WIDTH];
+#endif
+    uint64_t pdq_last = latency_now(CLOCK_MONOTONIC);
     for (unsigned i = 0; i < pkts; i++) {
         gdnsd_anysin_t* asp = dgrams[i].msg_hdr.msg_name;
         struct iovec* iop = &dgrams[i].msg_hdr.msg_iov[0];
@@ -435,11 +522,20 @@ static void process_mmsgs(const int fd, dnsp_ctx_t* pctx, dnspacket_stats_t* sta
             // immediately fail with no log output for packets with source port zero
             stats_own_inc(&stats->dropped);
             iop->iov_len = 0; // skip send, same as if process_dns_query() rejected it
+#ifdef USE_RX_TS
+            rx_ts[i] = 0;
+#endif
         } else {
             if (asp->sa.sa_family == AF_INET6)
                 ipv6_pktinfo_ifindex_fixup(&dgrams[i].msg_hdr);
+#ifdef USE_RX_TS
+            rx_ts[i] = rx_ts_take(&dgrams[i].msg_hdr);
+#endif
             asp->len = dgrams[i].msg_hdr.msg_namelen;
             iop->iov_len = process_dns_query(pctx, asp, iop->iov_base, NULL, dgrams[i].msg_len);
+            const uint64_t pdq_now = latency_now(CLOCK_MONOTONIC);
+            latency_record(&stats->pdq, pdq_now - pdq_last);
+            pdq_last = pdq_now;
         }
     }
 
@@ -483,6 +579,13 @@ static void process_mmsgs(const int fd, dnsp_ctx_t* pctx, dnspacket_stats_t* sta
                            logf_errno());
                 mmsg_rv = 1;
             }
+#ifdef USE_RX_TS
+            else {
+                const uint64_t now = latency_now(CLOCK_REALTIME);
+                for (unsigned i = 0; i < (unsigned)mmsg_rv; i++)
+                    rx_ts_record(stats, rx_ts[pkts_done + i], now);
+            }
+#endif
 
             // Account for progress and loop as necessary
             pkts_done += (unsigned)mmsg_rv;
@@ -590,9 +693,13 @@ void* dnsio_udp_start(void* thread_asvoid)
 
     rcu_register_thread();
 
+#ifdef USE_RX_TS
+    const bool use_cmsg = true;
+#else
     const bool use_cmsg = addrconf->addr.sa.sa_family == AF_INET6
                           ? true
                           : gdnsd_anysin_is_anyaddr(&addrconf->addr);
+#endif
 
 #ifdef USE_MMSG
     if (use_mmsg)
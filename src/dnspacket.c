@@ -26,6 +26,7 @@
 #include "ltree.h"
 #include "chal.h"
 #include "cookie.h"
+#include "dnstap.h"
 
 #include "plugins/plugapi.h"
 #include <gdnsd/alloc.h>
@@ -163,6 +164,9 @@ typedef struct {
 
     // EDNS-related states
     edns_t edns;
+
+    // Row of stats->zone for the zone the query name fell into, if any
+    stats_t* zone_stats;
 } txn_t;
 
 // per-thread persistent context
@@ -195,6 +199,11 @@ struct dnsp_ctx {
     unsigned edns_tcp_keepalive;
     unsigned dso_inactivity;
 
+    // This thread's dnstap ring (NULL if dnstap isn't configured), and the
+    // transport to report in its records
+    dnstap_ring_t* dnstap;
+    dnstap_proto_t dnstap_proto;
+
     // The current transaction state
     txn_t txn;
 };
@@ -226,7 +235,7 @@ void dnspacket_wait_stats(const socks_cfg_t* socks_cfg)
     pthread_mutex_unlock(&stats_init_mutex);
 }
 
-static dnsp_ctx_t* dnspacket_ctx_init(dnspacket_stats_t** stats_out, const bool is_udp, const bool udp_is_ipv6, const bool tcp_pad, const unsigned tcp_timeout_secs)
+static dnsp_ctx_t* dnspacket_ctx_init(dnspacket_stats_t** stats_out, const bool is_udp, const bool udp_is_ipv6, const bool tcp_pad, const bool tcp_tls, const unsigned tcp_timeout_secs)
 {
     if (udp_is_ipv6)
         gdnsd_assert(is_udp);
@@ -237,6 +246,8 @@ static dnsp_ctx_t* dnspacket_ctx_init(dnspacket_stats_t** stats_out, const bool
 
     dnsp_ctx_t* ctx = xcalloc(sizeof(*ctx));
     ctx->stats = *stats_out = xcalloc(sizeof(*ctx->stats));
+    if (gcfg->zone_stats)
+        ctx->stats->zone = xcalloc_n((gcfg->zone_stats + 1U) * ZONE_STAT_COUNT, sizeof(*ctx->stats->zone));
     ctx->dyn = xmalloc(gdnsd_result_get_alloc());
     gdnsd_rand32_init(&ctx->rand_state);
     gdnsd_plugins_action_iothread_init();
@@ -247,6 +258,8 @@ static dnsp_ctx_t* dnspacket_ctx_init(dnspacket_stats_t** stats_out, const bool
     ctx->tcp_pad = tcp_pad;
     ctx->edns_tcp_keepalive = tcp_timeout_secs * 10;
     ctx->dso_inactivity = tcp_timeout_secs * 1000;
+    ctx->dnstap = dnstap_ring_new();
+    ctx->dnstap_proto = is_udp ? DNSTAP_PROTO_UDP : tcp_tls ? DNSTAP_PROTO_DOT : DNSTAP_PROTO_TCP;
 
     pthread_mutex_lock(&stats_init_mutex);
     dnspacket_stats[stats_initialized++] = ctx->stats;
@@ -258,12 +271,12 @@ static dnsp_ctx_t* dnspacket_ctx_init(dnspacket_stats_t** stats_out, const bool
 
 dnsp_ctx_t* dnspacket_ctx_init_udp(dnspacket_stats_t** stats_out, const bool is_ipv6)
 {
-    return dnspacket_ctx_init(stats_out, true, is_ipv6, false, 0);
+    return dnspacket_ctx_init(stats_out, true, is_ipv6, false, false, 0);
 }
 
-dnsp_ctx_t* dnspacket_ctx_init_tcp(dnspacket_stats_t** stats_out, const bool pad, const unsigned timeout_secs)
+dnsp_ctx_t* dnspacket_ctx_init_tcp(dnspacket_stats_t** stats_out, const bool pad, const bool tls, const unsigned timeout_secs)
 {
-    return dnspacket_ctx_init(stats_out, false, false, pad, timeout_secs);
+    return dnspacket_ctx_init(stats_out, false, false, pad, tls, timeout_secs);
 }
 
 void dnspacket_ctx_set_grace(dnsp_ctx_t* ctx)
@@ -288,6 +301,7 @@ typedef enum {
     DECODE_NOTIMP  = -1, // unsupported opcode or QUERY meta-type, we return NOTIMP
     DECODE_OK      =  0, // normal and valid, QUERY opcode
     DECODE_DSO     =  1, // DSO opcode, kicks out to special handling
+    DECODE_XFR     =  2, // AXFR/IXFR over TCP with xfr_allow configured
 } rcode_rv_t;
 
 F_NONNULL
@@ -743,8 +757,12 @@ static rcode_rv_t decode_query(dnsp_ctx_t* ctx, unsigned* output_offset_ptr, con
 
         if (unlikely(ctx->txn.qtype > 127 && ctx->txn.qtype < 255)) {
             // Range 128-255 is meta-query types, not data types.  We implement ANY
-            // (255) in normal response process, but we do not implement any others
-            // (e.g. IXFR, AXFR, MAILA, MAILB, TKEY, TSIG, etc).
+            // (255) in normal response process, and AXFR/IXFR over TCP if
+            // transfers are configured, but we do not implement any others
+            // (e.g. MAILA, MAILB, TKEY, TSIG, etc).
+            if ((ctx->txn.qtype == DNS_TYPE_AXFR || ctx->txn.qtype == DNS_TYPE_IXFR)
+                    && !ctx->is_udp && gcfg->xfr_allow_count)
+                return DECODE_XFR;
             log_devdebug("Unsupported meta-query type %u (NOTIMP) attempted", ctx->txn.qtype);
             return DECODE_NOTIMP;
         }
@@ -1847,6 +1865,12 @@ static unsigned db_lookup(dnsp_ctx_t* ctx, const uint8_t* qname, unsigned offset
 
     gdnsd_assert(res.auth);
 
+    if (ctx->stats->zone && !via_cname) {
+        const ltree_rrset_soa_t* soa = ltree_node_get_rrset_soa(res.auth);
+        gdnsd_assert(soa);
+        ctx->txn.zone_stats = &ctx->stats->zone[soa->zone_id * ZONE_STAT_COUNT];
+    }
+
     // In the initial search, it's known that "qname" is in fact the real query name and therefore
     //  uncompressed, which is what makes the simplistic ctx->txn.auth_comp calculation possible.
     if (!via_cname)
@@ -2188,6 +2212,130 @@ static size_t handle_dso_with_padding(const dnsp_ctx_t* ctx, const size_t packet
     return offset;
 }
 
+// RFC 1995: the client's current version of the zone is indicated by an SOA
+// in the authority section, whose serial we fetch here if present.
+// parse_query_rrs() has already checked the extents of the RRs before it.
+F_NONNULL
+static bool get_ixfr_client_serial(const txn_t* txn, const unsigned qend, const unsigned packet_len, uint32_t* serial_out)
+{
+    const wire_dns_header_t* hdr = &txn->pkt->hdr;
+    if (!DNSH_GET_NSCOUNT(hdr))
+        return false;
+
+    unsigned offset = qend;
+    const unsigned ancount = DNSH_GET_ANCOUNT(hdr);
+    for (unsigned i = 0; i < ancount; i++)
+        if (parse_rr_minimal(txn, &offset, packet_len, true))
+            return false;
+
+    const unsigned len = packet_len - offset;
+    if (!len)
+        return false;
+    const uint8_t* rr = &txn->pkt->raw[offset];
+    const unsigned name_len = parse_rr_name_minimal(rr, len);
+    if (!name_len || name_len + 10U > len)
+        return false;
+    const unsigned type = ntohs(gdnsd_get_una16(&rr[name_len]));
+    const unsigned rdlen = ntohs(gdnsd_get_una16(&rr[name_len + 8U]));
+    if (type != DNS_TYPE_SOA || rdlen < 22U || name_len + 10U + rdlen > len)
+        return false;
+
+    // The serial is the first of the 5 fixed 32-bit fields at the end
+    *serial_out = ntohl(gdnsd_get_una32(&rr[name_len + 10U + rdlen - 20U]));
+    return true;
+}
+
+// Attempts to start a zone transfer for dnsio_tcp to stream in place of our
+// normal response (see xfr.h), returning true if the request should be
+// REFUSED instead.  "qend" is the offset just past the question.
+F_NONNULL
+static bool start_xfr(dnsp_ctx_t* ctx, const gdnsd_anysin_t* sa, const unsigned qend, const unsigned packet_len)
+{
+    txn_t* txn = &ctx->txn;
+    gdnsd_assert(!ctx->is_udp);
+    gdnsd_assert(txn->dso);
+    gdnsd_assert(!txn->dso->xfr);
+
+    const bool ixfr = (txn->qtype == DNS_TYPE_IXFR);
+    const char* xfr_name = ixfr ? "IXFR" : "AXFR";
+
+    if (txn->qclass != DNS_CLASS_IN || !xfr_acl_check(sa)) {
+        log_debug("%s of %s from %s refused by class or xfr_allow", xfr_name, logf_dname(txn->lqname), logf_anysin(sa));
+        stats_own_inc(&ctx->stats->tcp.xfr_refused);
+        return true;
+    }
+
+    uint32_t client_serial = 0;
+    const bool have_serial = ixfr && get_ixfr_client_serial(txn, qend, packet_len, &client_serial);
+    const xfr_start_rv_t rv = xfr_new(&txn->dso->xfr, txn->pkt->raw, qend, txn->lqname, ixfr, have_serial ? &client_serial : NULL);
+
+    switch (rv) {
+    case XFR_START_OK:
+        log_info("%s of %s to %s started", xfr_name, logf_dname(txn->lqname), logf_anysin(sa));
+        stats_own_inc(ixfr ? &ctx->stats->tcp.ixfr : &ctx->stats->tcp.axfr);
+        return false;
+    case XFR_START_NOZONE:
+        log_debug("%s of %s from %s refused: not a zone", xfr_name, logf_dname(txn->lqname), logf_anysin(sa));
+        stats_own_inc(&ctx->stats->tcp.xfr_refused);
+        return true;
+    case XFR_START_DYNAMIC:
+        log_info("%s of %s from %s refused: zone has DYNA/DYNC data", xfr_name, logf_dname(txn->lqname), logf_anysin(sa));
+        stats_own_inc(&ctx->stats->tcp.xfr_refused);
+        return true;
+    case XFR_START_BUSY:
+    default:
+        gdnsd_assert(rv == XFR_START_BUSY);
+        log_info("%s of %s from %s refused: xfr_max_active (%u) reached", xfr_name, logf_dname(txn->lqname), logf_anysin(sa), gcfg->xfr_max_active);
+        stats_own_inc(&ctx->stats->tcp.xfr_busy);
+        return true;
+    }
+}
+
+F_CONST
+static qtype_stat_t qtype_stat_idx(const unsigned qtype)
+{
+    switch (qtype) {
+    case DNS_TYPE_A:
+        return QTYPE_STAT_A;
+    case DNS_TYPE_NS:
+        return QTYPE_STAT_NS;
+    case DNS_TYPE_CNAME:
+        return QTYPE_STAT_CNAME;
+    case DNS_TYPE_SOA:
+        return QTYPE_STAT_SOA;
+    case DNS_TYPE_PTR:
+        return QTYPE_STAT_PTR;
+    case DNS_TYPE_MX:
+        return QTYPE_STAT_MX;
+    case DNS_TYPE_TXT:
+        return QTYPE_STAT_TXT;
+    case DNS_TYPE_AAAA:
+        return QTYPE_STAT_AAAA;
+    case DNS_TYPE_SRV:
+        return QTYPE_STAT_SRV;
+    case DNS_TYPE_NAPTR:
+        return QTYPE_STAT_NAPTR;
+    case DNS_TYPE_DS:
+        return QTYPE_STAT_DS;
+    case DNS_TYPE_DNSKEY:
+        return QTYPE_STAT_DNSKEY;
+    case DNS_TYPE_SVCB:
+        return QTYPE_STAT_SVCB;
+    case DNS_TYPE_HTTPS:
+        return QTYPE_STAT_HTTPS;
+    case DNS_TYPE_CAA:
+        return QTYPE_STAT_CAA;
+    case DNS_TYPE_ANY:
+        return QTYPE_STAT_ANY;
+    case DNS_TYPE_IXFR:
+        return QTYPE_STAT_IXFR;
+    case DNS_TYPE_AXFR:
+        return QTYPE_STAT_AXFR;
+    default:
+        return QTYPE_STAT_OTHER;
+    }
+}
+
 unsigned process_dns_query(dnsp_ctx_t* ctx, const gdnsd_anysin_t* sa, pkt_t* pkt, dso_state_t* dso, const unsigned packet_len)
 {
     // iothreads don't allow queries larger than this
@@ -2206,6 +2354,11 @@ unsigned process_dns_query(dnsp_ctx_t* ctx, const gdnsd_anysin_t* sa, pkt_t* pkt
     if (sa->sa.sa_family == AF_INET6)
         stats_own_inc(&ctx->stats->v6);
 
+    // The query must be copied before decoding, which can alter the packet
+    const bool dnstap = ctx->dnstap && dnstap_sampled(ctx->dnstap);
+    if (dnstap && gcfg->dnstap_log_queries)
+        dnstap_log(ctx->dnstap, DNSTAP_AUTH_QUERY, ctx->dnstap_proto, sa, pkt->raw, packet_len);
+
     // parse_optrr() will raise this value in the udp edns case as necc.
     ctx->txn.this_max_response = ctx->is_udp ? 512U : MAX_RESPONSE_DATA;
 
@@ -2227,6 +2380,7 @@ unsigned process_dns_query(dnsp_ctx_t* ctx, const gdnsd_anysin_t* sa, pkt_t* pkt
     if (likely(status == DECODE_OK)) {
         hdr->flags2 = DNS_RCODE_NOERROR;
         if (likely(DNSH_GET_QDCOUNT(hdr) == 1U)) {
+            stats_own_inc(&ctx->stats->qtype[qtype_stat_idx(ctx->txn.qtype)]);
             if (likely(ctx->txn.qclass == DNS_CLASS_IN) || ctx->txn.qclass == DNS_CLASS_ANY) {
                 res_offset = answer_from_db(ctx, res_offset);
             } else if (ctx->txn.qclass == DNS_CLASS_CH) {
@@ -2242,6 +2396,21 @@ unsigned process_dns_query(dnsp_ctx_t* ctx, const gdnsd_anysin_t* sa, pkt_t* pkt
         }
         if (hdr->flags2 == DNS_RCODE_NOERROR)
             stats_own_inc(&ctx->stats->noerror);
+        if (ctx->txn.zone_stats) {
+            if (hdr->flags2 == DNS_RCODE_NOERROR)
+                stats_own_inc(&ctx->txn.zone_stats[ZONE_STAT_NOERROR]);
+            else if (hdr->flags2 == DNS_RCODE_NXDOMAIN)
+                stats_own_inc(&ctx->txn.zone_stats[ZONE_STAT_NXDOMAIN]);
+        }
+    } else if (status == DECODE_XFR) {
+        stats_own_inc(&ctx->stats->qtype[qtype_stat_idx(ctx->txn.qtype)]);
+        if (!start_xfr(ctx, sa, res_offset, packet_len)) {
+            // dnsio_tcp sends the transfer's messages instead of this
+            stats_own_inc(&ctx->stats->noerror);
+            return res_offset;
+        }
+        hdr->flags2 = DNS_RCODE_REFUSED;
+        stats_own_inc(&ctx->stats->refused);
     } else {
         if (status == DECODE_FORMERR) {
             hdr->flags2 = DNS_RCODE_FORMERR;
@@ -2266,5 +2435,8 @@ unsigned process_dns_query(dnsp_ctx_t* ctx, const gdnsd_anysin_t* sa, pkt_t* pkt
 
     gdnsd_assert(res_offset <= MAX_RESPONSE_BUF);
 
+    if (dnstap && gcfg->dnstap_log_responses)
+        dnstap_log(ctx->dnstap, DNSTAP_AUTH_RESPONSE, ctx->dnstap_proto, sa, pkt->raw, res_offset);
+
     return res_offset;
 }
@@ -22,6 +22,8 @@
 
 #include "socks.h"
 #include "dnswire.h"
+#include "xfr.h"
+#include "latency.h"
 
 #include <gdnsd/compiler.h>
 #include <gdnsd/stats.h>
@@ -29,6 +31,39 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+// Indices of the per-qtype request counters below.  The order must match the
+// DNS_QTYPE_* slots in statio.c
+typedef enum {
+    QTYPE_STAT_A      = 0,
+    QTYPE_STAT_NS     = 1,
+    QTYPE_STAT_CNAME  = 2,
+    QTYPE_STAT_SOA    = 3,
+    QTYPE_STAT_PTR    = 4,
+    QTYPE_STAT_MX     = 5,
+    QTYPE_STAT_TXT    = 6,
+    QTYPE_STAT_AAAA   = 7,
+    QTYPE_STAT_SRV    = 8,
+    QTYPE_STAT_NAPTR  = 9,
+    QTYPE_STAT_DS     = 10,
+    QTYPE_STAT_DNSKEY = 11,
+    QTYPE_STAT_SVCB   = 12,
+    QTYPE_STAT_HTTPS  = 13,
+    QTYPE_STAT_CAA    = 14,
+    QTYPE_STAT_ANY    = 15,
+    QTYPE_STAT_IXFR   = 16,
+    QTYPE_STAT_AXFR   = 17,
+    QTYPE_STAT_OTHER  = 18,
+    QTYPE_STAT_COUNT  = 19,
+} qtype_stat_t;
+
+// Columns of the per-zone counter matrix.  These are the only response codes
+// possible for a query name within one of our zones.
+typedef enum {
+    ZONE_STAT_NOERROR  = 0,
+    ZONE_STAT_NXDOMAIN = 1,
+    ZONE_STAT_COUNT    = 2,
+} zone_stat_t;
+
 // dnspacket-layer statistics, per-thread
 typedef struct {
     bool is_udp;
@@ -56,6 +91,14 @@ typedef struct {
             stats_t dso_protoerr;
             stats_t dso_typeni;
             stats_t acceptfail;
+            stats_t tls;
+            stats_t tls_fail;
+            stats_t axfr;
+            stats_t ixfr;
+            stats_t xfr_refused;
+            stats_t xfr_busy;
+            stats_t xfr_fail;
+            stats_t xfr_throttled;
         } tcp;
     };
 
@@ -91,6 +134,23 @@ typedef struct {
     stats_t edns_cookie_ok;      // Valid server cookie issued by us
     stats_t edns_cookie_init;    // No server cookie sent at all
     stats_t edns_cookie_bad;     // Invalid server cookie (e.g. expired)
+
+    // Latency histograms.  "pdq" is the time spent in process_dns_query() for
+    // every request on both protocols.  "rx_tx" is UDP-only, and is the time
+    // from the kernel's receive timestamp on the request to just after the
+    // response was sent, and is only recorded when the platform supports
+    // SO_TIMESTAMPNS (or SO_TIMESTAMP, at microsecond resolution).
+    latency_hist_t pdq;
+    latency_hist_t rx_tx;
+
+    // Count of requests by query type, for all requests with one question
+    // which were valid enough to attempt an answer
+    stats_t qtype[QTYPE_STAT_COUNT];
+
+    // NULL unless "zone_stats" is configured, in which case this is a matrix
+    // of ZONE_STAT_COUNT counters for each zone id from statio_zone_id(),
+    // with row zero counting all zones beyond the zone_stats limit.
+    stats_t* zone;
 } dnspacket_stats_t;
 
 // Per-connection DSO state-tracking between dnsio_tcp (TCP) + dnspacket at the
@@ -104,6 +164,10 @@ typedef struct {
     // DSO is established by client DSO KeepAlive reception, which changes some
     // code behaviors on both sides.
     bool estab;
+    // xfr: NULL by default, PDQ sets it when it starts an AXFR/IXFR for the
+    // request, in which case its normal response is not sent, and dnsio_tcp
+    // takes ownership of the transfer and streams its messages instead.
+    xfr_t* xfr;
 } dso_state_t;
 
 struct dnsp_ctx; // opaque to outsiders
@@ -121,7 +185,7 @@ F_NONNULL F_WUNUSED F_RETNN
 dnsp_ctx_t* dnspacket_ctx_init_udp(dnspacket_stats_t** stats_out, const bool is_ipv6);
 
 F_NONNULL F_WUNUSED F_RETNN
-dnsp_ctx_t* dnspacket_ctx_init_tcp(dnspacket_stats_t** stats_out, const bool pad, const unsigned timeout_secs);
+dnsp_ctx_t* dnspacket_ctx_init_tcp(dnspacket_stats_t** stats_out, const bool pad, const bool tls, const unsigned timeout_secs);
 
 // TCP threads call this on their context when they start graceful shutdown,
 // telling the dnspacket layer to advertise inactivity timeouts of zero for the
@@ -0,0 +1,713 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "dnstap.h"
+
+#include "conf.h"
+
+#include <gdnsd/alloc.h>
+#include <gdnsd/log.h>
+#include <gdnsd/misc.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
+/*
+
+  dnstap output (https://dnstap.info/): I/O threads copy sampled queries and
+responses, with the little bit of metadata we report, into their own byte
+ring, and a dedicated writer thread drains all of the rings, encodes the
+dnstap protobuf messages, and writes them as Frame Streams data frames to a
+file or a UNIX socket.
+
+  The rings are classic single-producer, single-consumer queues: the producer
+only ever advances "head", the consumer only ever advances "tail", and both
+are free-running byte offsets masked into the power-of-two buffer.  Records
+are 8-byte aligned and never split across the end of the buffer; a producer
+that would cross the end writes a wrap marker there instead and starts over
+at offset zero.  A full ring drops the record, so the I/O threads never block
+or make syscalls on behalf of dnstap.
+
+  The writer polls the rings, sleeping briefly whenever a full pass finds
+nothing to do.  Output failures (e.g. no socket reader) are retried every
+few seconds, and records drained while there's no working output are counted
+as lost.
+
+*/
+
+// Frame Streams constants
+#define FSTRM_CONTROL_ACCEPT 1U
+#define FSTRM_CONTROL_START  2U
+#define FSTRM_CONTROL_STOP   3U
+#define FSTRM_CONTROL_READY  4U
+#define FSTRM_CONTROL_FINISH 5U
+#define FSTRM_FIELD_CONTENT_TYPE 1U
+#define FSTRM_CONTROL_MAX 512U
+static const char fstrm_ctype[] = "protobuf:dnstap.Dnstap";
+
+// Protobuf wire types
+#define PB_VARINT 0U
+#define PB_LEN    2U
+#define PB_FIXED32 5U
+
+// dnstap protobuf field numbers
+#define DT_IDENTITY 1U
+#define DT_VERSION  2U
+#define DT_MESSAGE  14U
+#define DT_TYPE     15U
+#define DT_TYPE_MESSAGE 1U
+#define DTM_TYPE           1U
+#define DTM_SOCKET_FAMILY  2U
+#define DTM_SOCKET_PROTO   3U
+#define DTM_QUERY_ADDRESS  4U
+#define DTM_QUERY_PORT     6U
+#define DTM_QUERY_SEC      8U
+#define DTM_QUERY_NSEC     9U
+#define DTM_QUERY_MESSAGE  10U
+#define DTM_RESPONSE_SEC   12U
+#define DTM_RESPONSE_NSEC  13U
+#define DTM_RESPONSE_MESSAGE 14U
+#define DT_FAMILY_INET  1U
+#define DT_FAMILY_INET6 2U
+
+// Writer output buffer size, which must hold at least one maximal frame
+#define WBUF_SIZE 262144U
+
+// Writer sleeps this long when it finds nothing to do
+#define WRITER_IDLE_NS 10000000L
+
+// Retry interval for a failed output, and the timeout for socket I/O
+#define OUTPUT_RETRY_SECS 5
+#define SOCKET_TIMEOUT_SECS 5
+
+// Record type, only used internally for the end-of-buffer marker
+#define REC_WRAP 0U
+
+// The record header in the rings, followed by msg_len bytes of DNS message
+// and padding to 8 bytes.  "len" and "type" must be in the first 8 bytes,
+// as a wrap marker might only have 8 bytes of room.
+typedef struct {
+    uint32_t len;
+    uint8_t type; // dnstap_mtype_t, or REC_WRAP
+    uint8_t proto;
+    uint8_t family;
+    uint8_t addr_len;
+    uint32_t msg_len;
+    uint32_t nsec;
+    uint64_t sec;
+    uint8_t addr[16];
+    uint16_t port;
+    uint8_t pad[6];
+} dnstap_rec_t;
+
+struct dnstap_ring_s_ {
+    uint8_t* buf;
+    size_t size;
+    size_t mask;
+    size_t head; // written by producer only
+    size_t tail; // written by consumer only
+    unsigned sample_ctr; // producer only
+    stats_t dropped; // producer is the owner
+};
+
+static bool enabled = false;
+static bool testsuite_nodelay = false;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static dnstap_ring_t** rings = NULL;
+static unsigned num_rings = 0;
+static unsigned rings_registered = 0;
+
+static pthread_t writer_threadid;
+static bool writer_stop = false;
+
+// The rest are owned by the writer thread, except the stats, which anyone can
+// read
+static const char* output_path = NULL;
+static bool output_is_socket = false;
+static int output_fd = -1;
+static bool output_failed_logged = false;
+static time_t output_retry_at = 0;
+static uint8_t* wbuf = NULL;
+static size_t wbuf_len = 0;
+static unsigned wbuf_frames = 0;
+static char* identity = NULL;
+static size_t identity_len = 0;
+static const char version[] = "gdnsd " PACKAGE_VERSION;
+static stats_t written;
+static stats_t lost;
+
+/***********************
+ * I/O thread (producer)
+ ***********************/
+
+dnstap_ring_t* dnstap_ring_new(void)
+{
+    if (!enabled)
+        return NULL;
+
+    dnstap_ring_t* ring = xcalloc(sizeof(*ring));
+    ring->size = gcfg->dnstap_ring_size;
+    ring->mask = ring->size - 1U;
+    ring->buf = xmalloc(ring->size);
+
+    pthread_mutex_lock(&rings_lock);
+    gdnsd_assert(rings_registered < num_rings);
+    rings[rings_registered++] = ring;
+    pthread_mutex_unlock(&rings_lock);
+
+    return ring;
+}
+
+bool dnstap_sampled(dnstap_ring_t* ring)
+{
+    if (++ring->sample_ctr < gcfg->dnstap_sample)
+        return false;
+    ring->sample_ctr = 0;
+    return true;
+}
+
+void dnstap_log(dnstap_ring_t* ring, const dnstap_mtype_t type, const dnstap_proto_t proto, const gdnsd_anysin_t* sa, const uint8_t* msg, const unsigned msg_len)
+{
+    const size_t rec_len = (sizeof(dnstap_rec_t) + msg_len + 7U) & ~(size_t)7U;
+    size_t head = ring->head;
+    const size_t tail = CMM_LOAD_SHARED(ring->tail);
+    // Our writes below to space just released by the consumer must not be
+    // ordered before our load of "tail" above
+    cmm_smp_mb();
+
+    size_t pos = head & ring->mask;
+    const size_t skip = (pos + rec_len > ring->size) ? ring->size - pos : 0;
+    if ((head - tail) + skip + rec_len > ring->size) {
+        stats_own_inc(&ring->dropped);
+        return;
+    }
+
+    if (skip) {
+        dnstap_rec_t* wrap = (dnstap_rec_t*)&ring->buf[pos];
+        wrap->len = (uint32_t)skip;
+        wrap->type = REC_WRAP;
+        head += skip;
+        pos = 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    dnstap_rec_t* rec = (dnstap_rec_t*)&ring->buf[pos];
+    rec->len = (uint32_t)rec_len;
+    rec->type = (uint8_t)type;
+    rec->proto = (uint8_t)proto;
+    rec->msg_len = msg_len;
+    rec->sec = (uint64_t)now.tv_sec;
+    rec->nsec = (uint32_t)now.tv_nsec;
+    if (sa->sa.sa_family == AF_INET6) {
+        rec->family = DT_FAMILY_INET6;
+        rec->addr_len = 16U;
+        memcpy(rec->addr, &sa->sin6.sin6_addr, 16U);
+        rec->port = ntohs(sa->sin6.sin6_port);
+    } else {
+        rec->family = DT_FAMILY_INET;
+        rec->addr_len = 4U;
+        memcpy(rec->addr, &sa->sin4.sin_addr, 4U);
+        rec->port = ntohs(sa->sin4.sin_port);
+    }
+    memcpy(&rec[1], msg, msg_len);
+
+    // Publish the record contents before the new head
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(ring->head, head + rec_len);
+}
+
+/************************
+ * Protobuf encoding
+ ************************/
+
+F_CONST
+static size_t pb_varint_len(uint64_t v)
+{
+    size_t len = 1;
+    while (v >= 0x80U) {
+        v >>= 7;
+        len++;
+    }
+    return len;
+}
+
+F_NONNULL F_RETNN
+static uint8_t* pb_put_varint(uint8_t* p, uint64_t v)
+{
+    while (v >= 0x80U) {
+        *p++ = (uint8_t)(v | 0x80U);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// All of our field numbers are < 16, so tags are always a single byte
+F_NONNULL F_RETNN
+static uint8_t* pb_put_tag(uint8_t* p, const unsigned field, const unsigned wtype)
+{
+    *p++ = (uint8_t)((field << 3) | wtype);
+    return p;
+}
+
+F_NONNULL F_RETNN
+static uint8_t* pb_put_uint(uint8_t* p, const unsigned field, const uint64_t v)
+{
+    return pb_put_varint(pb_put_tag(p, field, PB_VARINT), v);
+}
+
+F_NONNULL F_RETNN
+static uint8_t* pb_put_fixed32(uint8_t* p, const unsigned field, const uint32_t v)
+{
+    p = pb_put_tag(p, field, PB_FIXED32);
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+F_NONNULLX(1) F_RETNN
+static uint8_t* pb_put_bytes(uint8_t* p, const unsigned field, const void* data, const size_t len)
+{
+    p = pb_put_varint(pb_put_tag(p, field, PB_LEN), len);
+    if (len)
+        memcpy(p, data, len);
+    return p + len;
+}
+
+F_CONST
+static size_t pb_uint_len(const uint64_t v)
+{
+    return 1U + pb_varint_len(v);
+}
+
+F_CONST
+static size_t pb_bytes_len(const size_t len)
+{
+    return 1U + pb_varint_len(len) + len;
+}
+
+F_NONNULL F_RETNN
+static uint8_t* put_be32(uint8_t* p, const uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+    return p + 4;
+}
+
+// Maximum encoded frame size for a record with msg_len bytes of message
+static size_t frame_max_len(const size_t msg_len)
+{
+    return 4U + 128U + identity_len + sizeof(version) + msg_len;
+}
+
+// Encodes a record as a Frame Streams data frame at "out", returning the end
+F_NONNULL F_RETNN
+static uint8_t* encode_frame(uint8_t* out, const dnstap_rec_t* rec)
+{
+    const bool is_query = (rec->type == DNSTAP_AUTH_QUERY);
+    const size_t msg_len = pb_uint_len(rec->type)
+                           + pb_uint_len(rec->family)
+                           + pb_uint_len(rec->proto)
+                           + pb_bytes_len(rec->addr_len)
+                           + pb_uint_len(rec->port)
+                           + pb_uint_len(rec->sec)
+                           + 5U // nsec
+                           + pb_bytes_len(rec->msg_len);
+    const size_t dt_len = pb_bytes_len(identity_len)
+                          + pb_bytes_len(sizeof(version) - 1U)
+                          + pb_bytes_len(msg_len)
+                          + pb_uint_len(DT_TYPE_MESSAGE);
+
+    uint8_t* p = put_be32(out, (uint32_t)dt_len);
+    p = pb_put_bytes(p, DT_IDENTITY, identity, identity_len);
+    p = pb_put_bytes(p, DT_VERSION, version, sizeof(version) - 1U);
+    p = pb_put_varint(pb_put_tag(p, DT_MESSAGE, PB_LEN), msg_len);
+    p = pb_put_uint(p, DTM_TYPE, rec->type);
+    p = pb_put_uint(p, DTM_SOCKET_FAMILY, rec->family);
+    p = pb_put_uint(p, DTM_SOCKET_PROTO, rec->proto);
+    p = pb_put_bytes(p, DTM_QUERY_ADDRESS, rec->addr, rec->addr_len);
+    p = pb_put_uint(p, DTM_QUERY_PORT, rec->port);
+    p = pb_put_uint(p, is_query ? DTM_QUERY_SEC : DTM_RESPONSE_SEC, rec->sec);
+    p = pb_put_fixed32(p, is_query ? DTM_QUERY_NSEC : DTM_RESPONSE_NSEC, rec->nsec);
+    p = pb_put_bytes(p, is_query ? DTM_QUERY_MESSAGE : DTM_RESPONSE_MESSAGE, &rec[1], rec->msg_len);
+    p = pb_put_uint(p, DT_TYPE, DT_TYPE_MESSAGE);
+    gdnsd_assert((size_t)(p - out) == 4U + dt_len);
+    return p;
+}
+
+/************************
+ * Writer thread output
+ ************************/
+
+// Blocking write of the whole buffer, false on failure
+F_NONNULL
+static bool output_write(const uint8_t* data, const size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        const ssize_t rv = output_is_socket
+                           ? send(output_fd, &data[done], len - done, MSG_NOSIGNAL)
+                           : write(output_fd, &data[done], len - done);
+        if (rv < 0) {
+            if (errno == EINTR)
+                continue;
+            log_err("dnstap: write to '%s' failed: %s", output_path, logf_errno());
+            return false;
+        }
+        done += (size_t)rv;
+    }
+    return true;
+}
+
+// Sends a control frame with an optional content type field
+static bool output_control(const unsigned ctype, const bool with_content_type)
+{
+    uint8_t buf[64];
+    const size_t field_len = with_content_type ? (8U + sizeof(fstrm_ctype) - 1U) : 0;
+    uint8_t* p = put_be32(buf, 0); // escape
+    p = put_be32(p, (uint32_t)(4U + field_len));
+    p = put_be32(p, ctype);
+    if (with_content_type) {
+        p = put_be32(p, FSTRM_FIELD_CONTENT_TYPE);
+        p = put_be32(p, sizeof(fstrm_ctype) - 1U);
+        memcpy(p, fstrm_ctype, sizeof(fstrm_ctype) - 1U);
+        p += sizeof(fstrm_ctype) - 1U;
+    }
+    return output_write(buf, (size_t)(p - buf));
+}
+
+// Reads a control frame from the socket and checks its type
+static bool output_read_control(const unsigned want_ctype)
+{
+    uint8_t buf[8U + FSTRM_CONTROL_MAX];
+    size_t want = 8U;
+    size_t done = 0;
+    while (done < want) {
+        const ssize_t rv = recv(output_fd, &buf[done], want - done, 0);
+        if (rv <= 0) {
+            if (rv < 0 && errno == EINTR)
+                continue;
+            log_err("dnstap: read of control frame from '%s' failed: %s", output_path, rv ? logf_errno() : "EOF");
+            return false;
+        }
+        done += (size_t)rv;
+        if (done == 8U && want == 8U) {
+            const uint32_t escape = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+            const uint32_t clen = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) | ((uint32_t)buf[6] << 8) | buf[7];
+            if (escape || clen < 4U || clen > FSTRM_CONTROL_MAX) {
+                log_err("dnstap: invalid control frame from '%s'", output_path);
+                return false;
+            }
+            want += clen;
+        }
+    }
+    const uint32_t ctype = ((uint32_t)buf[8] << 24) | ((uint32_t)buf[9] << 16) | ((uint32_t)buf[10] << 8) | buf[11];
+    if (ctype != want_ctype) {
+        log_err("dnstap: unexpected control frame type %" PRIu32 " from '%s'", ctype, output_path);
+        return false;
+    }
+    return true;
+}
+
+static void output_close(const bool clean)
+{
+    if (clean) {
+        if (output_control(FSTRM_CONTROL_STOP, false) && output_is_socket)
+            output_read_control(FSTRM_CONTROL_FINISH);
+    }
+    close(output_fd);
+    output_fd = -1;
+}
+
+static void output_fail(void)
+{
+    output_close(false);
+    output_retry_at = time(NULL) + (testsuite_nodelay ? 0 : OUTPUT_RETRY_SECS);
+}
+
+static bool output_open_socket(void)
+{
+    struct sockaddr_un addr;
+    const socklen_t addr_len = gdnsd_sun_set_path(&addr, output_path);
+    output_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (output_fd < 0) {
+        log_err("dnstap: socket() failed: %s", logf_errno());
+        return false;
+    }
+
+    // The writer should eventually give up on a stuck reader, rather than
+    // wait forever while the rings overflow
+    const struct timeval tmout = { .tv_sec = SOCKET_TIMEOUT_SECS, .tv_usec = 0 };
+    if (setsockopt(output_fd, SOL_SOCKET, SO_SNDTIMEO, &tmout, sizeof(tmout))
+            || setsockopt(output_fd, SOL_SOCKET, SO_RCVTIMEO, &tmout, sizeof(tmout)))
+        log_warn("dnstap: failed to set socket timeouts: %s", logf_errno());
+
+    if (connect(output_fd, (struct sockaddr*)&addr, addr_len)) {
+        if (!output_failed_logged)
+            log_err("dnstap: connect() to '%s' failed: %s", output_path, logf_errno());
+        return false;
+    }
+
+    // Bi-directional Frame Streams handshake
+    return output_control(FSTRM_CONTROL_READY, true)
+           && output_read_control(FSTRM_CONTROL_ACCEPT)
+           && output_control(FSTRM_CONTROL_START, true);
+}
+
+// Each open of a file output starts a new file holding just the one Frame
+// Streams stream, so that no reader ever sees two streams (e.g. those of the
+// old and new daemons during a replace) in one file.  Any existing file is
+// first renamed to "<path>.<time>.<pid>.<count>", and whatever still has it
+// open keeps writing its own stream there.
+static bool output_open_file(void)
+{
+    static unsigned open_count = 0;
+
+    for (unsigned tries = 0; tries < 3U; tries++) {
+        output_fd = open(output_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0640);
+        if (output_fd >= 0)
+            return output_control(FSTRM_CONTROL_START, true);
+        if (errno != EEXIST)
+            break;
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".%lld.%ld.%u",
+                 (long long)time(NULL), (long)getpid(), open_count++);
+        char* rotated = gdnsd_str_combine_n(2, output_path, suffix);
+        const bool rename_failed = rename(output_path, rotated) && errno != ENOENT;
+        if (rename_failed && !output_failed_logged)
+            log_err("dnstap: rename() of '%s' to '%s' failed: %s", output_path, rotated, logf_errno());
+        free(rotated);
+        if (rename_failed)
+            return false;
+    }
+
+    if (!output_failed_logged)
+        log_err("dnstap: open() of '%s' failed: %s", output_path, logf_errno());
+    return false;
+}
+
+static void output_open(void)
+{
+    gdnsd_assert(output_fd < 0);
+    if (time(NULL) < output_retry_at)
+        return;
+
+    if (output_is_socket ? output_open_socket() : output_open_file()) {
+        log_info("dnstap: writing to '%s'", output_path);
+        output_failed_logged = false;
+        return;
+    }
+
+    if (output_fd >= 0)
+        output_fail();
+    else
+        output_retry_at = time(NULL) + (testsuite_nodelay ? 0 : OUTPUT_RETRY_SECS);
+    if (!output_failed_logged) {
+        log_err("dnstap: output to '%s' unavailable, records will be lost until it can be established", output_path);
+        output_failed_logged = true;
+    }
+}
+
+static void wbuf_flush(void)
+{
+    if (!wbuf_len)
+        return;
+    if (output_fd >= 0 && output_write(wbuf, wbuf_len)) {
+        for (unsigned i = 0; i < wbuf_frames; i++)
+            stats_own_inc(&written);
+    } else {
+        if (output_fd >= 0)
+            output_fail();
+        for (unsigned i = 0; i < wbuf_frames; i++)
+            stats_own_inc(&lost);
+    }
+    wbuf_len = 0;
+    wbuf_frames = 0;
+}
+
+// Drains one ring, returning the count of records consumed
+F_NONNULL
+static unsigned drain_ring(dnstap_ring_t* ring)
+{
+    unsigned count = 0;
+    size_t tail = ring->tail;
+    const size_t head = CMM_LOAD_SHARED(ring->head);
+    // Our reads of the records must not be ordered before the load of "head"
+    cmm_smp_rmb();
+
+    while (tail != head) {
+        const dnstap_rec_t* rec = (const dnstap_rec_t*)&ring->buf[tail & ring->mask];
+        gdnsd_assert(rec->len >= 8U && rec->len <= head - tail);
+        if (rec->type != REC_WRAP) {
+            count++;
+            if (output_fd < 0) {
+                stats_own_inc(&lost);
+            } else {
+                if (wbuf_len + frame_max_len(rec->msg_len) > WBUF_SIZE)
+                    wbuf_flush();
+                uint8_t* end = encode_frame(&wbuf[wbuf_len], rec);
+                wbuf_len = (size_t)(end - wbuf);
+                wbuf_frames++;
+            }
+        }
+        tail += rec->len;
+    }
+
+    // Our reads of the records must complete before the producer can see
+    // the space as free
+    cmm_smp_mb();
+    CMM_STORE_SHARED(ring->tail, tail);
+    return count;
+}
+
+static unsigned drain_all(void)
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < num_rings; i++)
+        count += drain_ring(rings[i]);
+    wbuf_flush();
+    return count;
+}
+
+static void* dnstap_writer(void* unused V_UNUSED)
+{
+    gdnsd_thread_setname("gdnsd-dnstap");
+
+    while (!CMM_LOAD_SHARED(writer_stop)) {
+        if (output_fd < 0)
+            output_open();
+        if (!drain_all()) {
+            const struct timespec idle = { .tv_sec = 0, .tv_nsec = WRITER_IDLE_NS };
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    // Final drain after the I/O threads have all stopped
+    drain_all();
+    if (output_fd >= 0)
+        output_close(true);
+    return NULL;
+}
+
+/********************
+ * Main thread APIs *
+ ********************/
+
+void dnstap_init(const unsigned num_io_threads)
+{
+    if (!gcfg->dnstap_output)
+        return;
+
+    static const char unix_prefix[] = "unix:";
+    const char* out = gcfg->dnstap_output;
+    if (!strncmp(out, unix_prefix, sizeof(unix_prefix) - 1U)) {
+        output_is_socket = true;
+        out += sizeof(unix_prefix) - 1U;
+        struct sockaddr_un addr;
+        if (strlen(out) >= sizeof(addr.sun_path))
+            log_fatal("dnstap_output: socket path '%s' is too long", out);
+    }
+    if (out[0] != '/')
+        log_fatal("dnstap_output: '%s' must be an absolute path", out);
+    output_path = out;
+
+    if (gcfg->dnstap_ring_size & (gcfg->dnstap_ring_size - 1U))
+        log_fatal("dnstap_ring_size: %u is not a power of two", gcfg->dnstap_ring_size);
+
+    char hostname[256];
+    if (gethostname(hostname, sizeof(hostname)))
+        hostname[0] = '\0';
+    hostname[sizeof(hostname) - 1U] = '\0';
+    identity = xstrdup(hostname);
+    identity_len = strlen(identity);
+
+    if (getenv("GDNSD_TESTSUITE_NODELAY"))
+        testsuite_nodelay = true;
+
+    num_rings = num_io_threads;
+    rings = xcalloc_n(num_rings, sizeof(*rings));
+    wbuf = xmalloc(WBUF_SIZE);
+    enabled = true;
+}
+
+void dnstap_start(void)
+{
+    if (!enabled)
+        return;
+    gdnsd_assert(rings_registered == num_rings);
+
+    sigset_t sigmask_all;
+    sigfillset(&sigmask_all);
+    sigset_t sigmask_prev;
+    sigemptyset(&sigmask_prev);
+    if (pthread_sigmask(SIG_SETMASK, &sigmask_all, &sigmask_prev))
+        log_fatal("pthread_sigmask() failed");
+
+    const int pthread_err = pthread_create(&writer_threadid, NULL, dnstap_writer, NULL);
+    if (pthread_err)
+        log_fatal("pthread_create() of dnstap writer thread failed: %s", logf_strerror(pthread_err));
+
+    if (pthread_sigmask(SIG_SETMASK, &sigmask_prev, NULL))
+        log_fatal("pthread_sigmask() failed");
+}
+
+void dnstap_stop(void)
+{
+    if (!enabled)
+        return;
+    CMM_STORE_SHARED(writer_stop, true);
+    const int pthread_err = pthread_join(writer_threadid, NULL);
+    if (pthread_err)
+        log_err("pthread_join() of dnstap writer thread failed: %s", logf_strerror(pthread_err));
+}
+
+void dnstap_get_stats(stats_uint_t* written_out, stats_uint_t* dropped_out, stats_uint_t* lost_out)
+{
+    *written_out = stats_get(&written);
+    *lost_out = stats_get(&lost);
+    stats_uint_t dropped = 0;
+    if (enabled) {
+        pthread_mutex_lock(&rings_lock);
+        for (unsigned i = 0; i < rings_registered; i++)
+            dropped += stats_get(&rings[i]->dropped);
+        pthread_mutex_unlock(&rings_lock);
+    }
+    *dropped_out = dropped;
+}
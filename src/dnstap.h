@@ -0,0 +1,76 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GDNSD_DNSTAP_H
+#define GDNSD_DNSTAP_H
+
+#include <gdnsd/compiler.h>
+#include <gdnsd/net.h>
+#include <gdnsd/stats.h>
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+// Values of the dnstap protobuf Message.Type enum that we emit
+typedef enum {
+    DNSTAP_AUTH_QUERY    = 1,
+    DNSTAP_AUTH_RESPONSE = 2,
+} dnstap_mtype_t;
+
+// Values of the dnstap protobuf SocketProtocol enum that we emit
+typedef enum {
+    DNSTAP_PROTO_UDP = 1,
+    DNSTAP_PROTO_TCP = 2,
+    DNSTAP_PROTO_DOT = 3,
+} dnstap_proto_t;
+
+// Single-producer, single-consumer ring of records, one per I/O thread
+struct dnstap_ring_s_;
+typedef struct dnstap_ring_s_ dnstap_ring_t;
+
+// Main thread, before any I/O threads are started.  No-op unless
+// "dnstap_output" is configured.
+void dnstap_init(const unsigned num_io_threads);
+
+// I/O thread startup: returns this thread's ring, or NULL if dnstap is not
+// configured.
+dnstap_ring_t* dnstap_ring_new(void);
+
+// I/O thread: returns true if the current transaction is one of the sampled
+// ones, according to "dnstap_sample"
+F_NONNULL
+bool dnstap_sampled(dnstap_ring_t* ring);
+
+// I/O thread: copies a DNS message and its metadata into the ring, or counts
+// it as dropped if the ring is full.  Never blocks.
+F_NONNULL
+void dnstap_log(dnstap_ring_t* ring, const dnstap_mtype_t type, const dnstap_proto_t proto, const gdnsd_anysin_t* sa, const uint8_t* msg, const unsigned msg_len);
+
+// Main thread: start the writer thread after all I/O threads have called
+// dnstap_ring_new(), and stop it (flushing all remaining records) after all
+// I/O threads have exited.
+void dnstap_start(void);
+void dnstap_stop(void);
+
+// Any thread: current totals of records written to the output, dropped due
+// to full rings, and lost due to output errors.
+F_NONNULL
+void dnstap_get_stats(stats_uint_t* written, stats_uint_t* dropped, stats_uint_t* lost);
+
+#endif // GDNSD_DNSTAP_H
@@ -0,0 +1,232 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "dnstls.h"
+
+#include <gdnsd/log.h>
+
+#include <errno.h>
+#include <stddef.h>
+
+#ifdef HAVE_KTLS
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// The opaque types are never defined, we just cast to/from the OpenSSL ones
+#define TO_CTX(_c) ((SSL_CTX*)(_c))
+#define TO_SSL(_s) ((SSL*)(_s))
+
+// Fetch the most-recent OpenSSL error as a string for logging
+static const char* logf_sslerr(void)
+{
+    const unsigned long e = ERR_get_error();
+    if (!e)
+        return "unknown error";
+    return ERR_reason_error_string(e) ? ERR_reason_error_string(e) : "unknown error";
+}
+
+dnstls_ctx_t* dnstls_ctx_new(const char* cert_path, const char* key_path)
+{
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx)
+        log_fatal("TLS: Cannot create server context: %s", logf_sslerr());
+
+    // RFC 8310 requires TLS 1.2+.  Renegotiation would mean handshake records
+    // arriving after we've handed the connection to the kernel.
+    if (!SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION))
+        log_fatal("TLS: Cannot set minimum protocol version: %s", logf_sslerr());
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION
+                        | SSL_OP_NO_COMPRESSION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+    // TLS 1.3 session tickets are sent after the handshake proper, and would
+    // have to be written through the kernel record layer behind OpenSSL's back,
+    // so they're disabled.  TLS 1.2 session-id resumption still works via the
+    // default server-side session cache.
+    SSL_CTX_set_num_tickets(ctx, 0);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+    // Sessions without receive-side kTLS live as long as their connection,
+    // so don't let them hang on to idle record buffers
+    SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_path) != 1)
+        log_fatal("TLS: Cannot load certificate chain from '%s': %s", cert_path, logf_sslerr());
+    if (SSL_CTX_use_PrivateKey_file(ctx, key_path, SSL_FILETYPE_PEM) != 1)
+        log_fatal("TLS: Cannot load private key from '%s': %s", key_path, logf_sslerr());
+    if (SSL_CTX_check_private_key(ctx) != 1)
+        log_fatal("TLS: Private key '%s' does not match certificate '%s': %s", key_path, cert_path, logf_sslerr());
+
+    log_info("TLS: Loaded certificate chain '%s'", cert_path);
+    return (dnstls_ctx_t*)ctx;
+}
+
+dnstls_sess_t* dnstls_sess_new(dnstls_ctx_t* ctx, const int fd)
+{
+    SSL* ssl = SSL_new(TO_CTX(ctx));
+    if (!ssl)
+        return NULL;
+    // SSL_set_fd() creates a socket BIO with BIO_NOCLOSE, so that freeing the
+    // session never closes the socket out from under dnsio_tcp
+    if (SSL_set_fd(ssl, fd) != 1) {
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    return (dnstls_sess_t*)ssl;
+}
+
+dnstls_rv_t dnstls_sess_handshake(dnstls_sess_t* sess, const gdnsd_anysin_t* sa)
+{
+    SSL* ssl = TO_SSL(sess);
+    ERR_clear_error();
+    errno = 0;
+    const int rv = SSL_do_handshake(ssl);
+    if (rv == 1) {
+        // We insist on at least the send side being handled by the kernel, so
+        // that dnsio_tcp's response path is always a plain send()
+        if (!BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+            log_neterr("TLS conn from %s: kTLS send offload unavailable for %s/%s, closing",
+                       logf_anysin(sa), SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+            return DNSTLS_FAIL;
+        }
+        log_debug("TLS conn from %s: handshake complete, %s/%s, kTLS rx %s",
+                  logf_anysin(sa), SSL_get_version(ssl), SSL_get_cipher_name(ssl),
+                  BIO_get_ktls_recv(SSL_get_rbio(ssl)) ? "on" : "off");
+        return DNSTLS_DONE;
+    }
+
+    switch (SSL_get_error(ssl, rv)) {
+    case SSL_ERROR_WANT_READ:
+        return DNSTLS_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return DNSTLS_WANT_WRITE;
+    case SSL_ERROR_SYSCALL:
+        log_debug("TLS conn from %s: handshake failed: %s", logf_anysin(sa), errno ? logf_errno() : "unexpected EOF");
+        return DNSTLS_FAIL;
+    default:
+        log_debug("TLS conn from %s: handshake failed: %s", logf_anysin(sa), logf_sslerr());
+        return DNSTLS_FAIL;
+    }
+}
+
+bool dnstls_sess_ktls_rx(dnstls_sess_t* sess)
+{
+    SSL* ssl = TO_SSL(sess);
+    // Any already-buffered input means OpenSSL read past the handshake, and
+    // it can't be handed to the kernel.  This shouldn't happen without
+    // read-ahead, but it's cheap to be sure.
+    return BIO_get_ktls_recv(SSL_get_rbio(ssl)) && !SSL_has_pending(ssl);
+}
+
+ssize_t dnstls_sess_recv(dnstls_sess_t* sess, void* buf, const size_t len)
+{
+    SSL* ssl = TO_SSL(sess);
+    size_t done = 0;
+    while (done < len) {
+        size_t readbytes = 0;
+        ERR_clear_error();
+        errno = 0;
+        const int rv = SSL_read_ex(ssl, (char*)buf + done, len - done, &readbytes);
+        if (rv == 1) {
+            done += readbytes;
+            if (!SSL_pending(ssl))
+                break;
+            continue;
+        }
+        if (done)
+            break;
+        switch (SSL_get_error(ssl, rv)) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            if (!errno)
+                return 0; // EOF without close_notify
+            return -1;
+        default:
+            errno = EPROTO;
+            return -1;
+        }
+    }
+    return (ssize_t)done;
+}
+
+bool dnstls_sess_pending(dnstls_sess_t* sess)
+{
+    return SSL_pending(TO_SSL(sess)) > 0;
+}
+
+void dnstls_sess_free(dnstls_sess_t* sess)
+{
+    // Never send close_notify or any other alert from here, the kernel may
+    // own the record layer already.
+    SSL_set_quiet_shutdown(TO_SSL(sess), 1);
+    SSL_free(TO_SSL(sess));
+}
+
+#else // HAVE_KTLS
+
+dnstls_ctx_t* dnstls_ctx_new(const char* cert_path, const char* key_path V_UNUSED)
+{
+    log_fatal("TLS: DNS-over-TLS support needed by '%s' not included in this build!", cert_path);
+    return NULL; // unreachable
+}
+
+dnstls_sess_t* dnstls_sess_new(dnstls_ctx_t* ctx V_UNUSED, const int fd V_UNUSED)
+{
+    gdnsd_assert(0); // unreachable
+    return NULL;
+}
+
+dnstls_rv_t dnstls_sess_handshake(dnstls_sess_t* sess V_UNUSED, const gdnsd_anysin_t* sa V_UNUSED)
+{
+    gdnsd_assert(0); // unreachable
+    return DNSTLS_FAIL;
+}
+
+bool dnstls_sess_ktls_rx(dnstls_sess_t* sess V_UNUSED)
+{
+    gdnsd_assert(0); // unreachable
+    return false;
+}
+
+ssize_t dnstls_sess_recv(dnstls_sess_t* sess V_UNUSED, void* buf V_UNUSED, const size_t len V_UNUSED)
+{
+    gdnsd_assert(0); // unreachable
+    errno = EPROTO;
+    return -1;
+}
+
+bool dnstls_sess_pending(dnstls_sess_t* sess V_UNUSED)
+{
+    gdnsd_assert(0); // unreachable
+    return false;
+}
+
+void dnstls_sess_free(dnstls_sess_t* sess V_UNUSED)
+{
+    gdnsd_assert(0); // unreachable
+}
+
+#endif // HAVE_KTLS
@@ -0,0 +1,85 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GDNSD_DNSTLS_H
+#define GDNSD_DNSTLS_H
+
+#include <gdnsd/compiler.h>
+#include <gdnsd/net.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// DNS-over-TLS (RFC 7858) support for dnsio_tcp.  The TLS handshake is done in
+// userspace by OpenSSL, and then the symmetric record layer is handed off to
+// the kernel (kTLS), so that dnsio_tcp can keep using plain send() (and where
+// possible, plain recv()) on the connection socket for the life of the
+// connection.  These are both opaque types wrapping the OpenSSL ones.
+typedef struct dnstls_ctx dnstls_ctx_t;
+typedef struct dnstls_sess dnstls_sess_t;
+
+typedef enum {
+    DNSTLS_DONE = 0,       // handshake complete, kTLS is active
+    DNSTLS_WANT_READ = 1,  // wait for the socket to become readable
+    DNSTLS_WANT_WRITE = 2, // wait for the socket to become writable
+    DNSTLS_FAIL = 3,       // failed, close the connection
+} dnstls_rv_t;
+
+// Loads the certificate chain and private key from PEM files and creates a
+// server context for one listener address.  Fails fatally (this happens at
+// config load time).
+F_NONNULL F_RETNN
+dnstls_ctx_t* dnstls_ctx_new(const char* cert_path, const char* key_path);
+
+// Creates a new per-connection session for a freshly-accepted socket.
+// Returns NULL on failure.
+F_NONNULL F_WUNUSED
+dnstls_sess_t* dnstls_sess_new(dnstls_ctx_t* ctx, const int fd);
+
+// Advances the handshake as far as possible without blocking.  On
+// DNSTLS_DONE, kTLS is active for (at least) the transmit side of the socket.
+// The caller should then check dnstls_sess_ktls_rx(): if true, the session
+// object can be freed and the socket used as a plain TCP socket from then on,
+// otherwise the receive side must continue to use dnstls_sess_recv().
+F_NONNULL F_WUNUSED
+dnstls_rv_t dnstls_sess_handshake(dnstls_sess_t* sess, const gdnsd_anysin_t* sa);
+
+// True if the receive side of the record layer was also handed to the kernel
+F_NONNULL
+bool dnstls_sess_ktls_rx(dnstls_sess_t* sess);
+
+// recv()-like interface for sessions without receive-side kTLS.  Returns the
+// count of bytes read, zero on clean EOF (or close_notify), or -1 with errno
+// set (EAGAIN for no data available, something else for a fatal failure).  It
+// will keep consuming already-decrypted data until "len" is exhausted.
+F_NONNULL F_WUNUSED
+ssize_t dnstls_sess_recv(dnstls_sess_t* sess, void* buf, const size_t len);
+
+// True if there is already-decrypted data buffered inside the session which
+// won't cause the socket to report readability.
+F_NONNULL
+bool dnstls_sess_pending(dnstls_sess_t* sess);
+
+// Frees the session without closing the underlying socket, and without
+// sending any TLS alerts
+F_NONNULL
+void dnstls_sess_free(dnstls_sess_t* sess);
+
+#endif // GDNSD_DNSTLS_H
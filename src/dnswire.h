@@ -123,9 +123,14 @@ typedef struct {
 #define DNS_TYPE_SRV 33U
 #define DNS_TYPE_NAPTR 35U
 #define DNS_TYPE_OPT 41U
+#define DNS_TYPE_DS 43U
+#define DNS_TYPE_DNSKEY 48U
+#define DNS_TYPE_SVCB 64U
+#define DNS_TYPE_HTTPS 65U
 #define DNS_TYPE_IXFR 251U
 #define DNS_TYPE_AXFR 252U
 #define DNS_TYPE_ANY 255U
+#define DNS_TYPE_CAA 257U
 
 #define DNS_CLASS_IN 1U
 #define DNS_CLASS_CH 3U
@@ -0,0 +1,102 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GDNSD_LATENCY_H
+#define GDNSD_LATENCY_H
+
+#include <gdnsd/compiler.h>
+#include <gdnsd/stats.h>
+
+#include <inttypes.h>
+#include <time.h>
+
+/*
+
+  Log-linear ("HDR"-style) latency histograms in nanoseconds.
+
+  Each power-of-two range of values is split into LATENCY_SUB_COUNT linear
+sub-buckets, so the relative error of any recorded value is bounded at
+1/LATENCY_SUB_COUNT (6.25%) across the whole range, while values below
+LATENCY_SUB_COUNT get exact buckets.  Values at or above 2^LATENCY_MAX_BITS
+nanoseconds (~4.3 seconds) are clamped into the final bucket.
+
+  Like all other dnspacket_stats_t members, the histograms belong to one I/O
+thread, which is the only writer, and any other thread may read them at any
+time without locking.  Readers sum the buckets to get the total count, so
+that there's no separate counter that could disagree with the buckets.
+
+*/
+
+#define LATENCY_SUB_BITS 4U
+#define LATENCY_SUB_COUNT (1U << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 32U
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1U) * LATENCY_SUB_COUNT)
+
+typedef struct {
+    stats_t b[LATENCY_BUCKETS];
+} latency_hist_t;
+
+F_CONST F_UNUSED
+static unsigned latency_bucket(const uint64_t ns)
+{
+    const uint32_t v = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    if (v < LATENCY_SUB_COUNT)
+        return v;
+    const unsigned msb = 31U ^ (unsigned)__builtin_clz(v);
+    return ((msb - LATENCY_SUB_BITS + 1U) << LATENCY_SUB_BITS)
+           + ((v >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_COUNT - 1U));
+}
+
+// Inverse of the above: the lowest value which lands in bucket "idx"
+F_CONST F_UNUSED
+static uint64_t latency_bucket_lower(const unsigned idx)
+{
+    if (idx < LATENCY_SUB_COUNT)
+        return idx;
+    const unsigned shift = (idx >> LATENCY_SUB_BITS) - 1U;
+    return ((uint64_t)LATENCY_SUB_COUNT + (idx & (LATENCY_SUB_COUNT - 1U))) << shift;
+}
+
+// ... and the highest value which lands in bucket "idx"
+F_CONST F_UNUSED
+static uint64_t latency_bucket_upper(const unsigned idx)
+{
+    if (idx < LATENCY_SUB_COUNT)
+        return idx;
+    const unsigned shift = (idx >> LATENCY_SUB_BITS) - 1U;
+    return latency_bucket_lower(idx) + (UINT64_C(1) << shift) - 1U;
+}
+
+// Owner thread only
+F_NONNULL F_UNUSED
+static void latency_record(latency_hist_t* h, const uint64_t ns)
+{
+    stats_own_inc(&h->b[latency_bucket(ns)]);
+}
+
+// Current time in nanoseconds for latency deltas, from the given clock
+F_UNUSED
+static uint64_t latency_now(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ((uint64_t)ts.tv_sec * UINT64_C(1000000000)) + (uint64_t)ts.tv_nsec;
+}
+
+#endif // GDNSD_LATENCY_H
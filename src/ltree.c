@@ -25,6 +25,9 @@
 #include "zsrc_rfc1035.h"
 #include "chal.h"
 #include "main.h"
+#include "xfr.h"
+#include "statio.h"
+#include "latency.h"
 
 #include <gdnsd/alloc.h>
 #include <gdnsd/dname.h>
@@ -37,6 +40,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <urcu-qsbr.h>
 
@@ -1312,6 +1316,8 @@ bool ltree_postproc_zone(zone_t* zone)
     gdnsd_assert(zone->dname);
     gdnsd_assert(zone->root);
 
+    const uint64_t start = latency_now(CLOCK_MONOTONIC);
+
     // zroot phase1 is a readonly check of zone basics
     //   (e.g. NS/SOA existence), also sets zone->serial
     if (unlikely(ltree_postproc_zroot_phase1(zone)))
@@ -1324,6 +1330,9 @@ bool ltree_postproc_zone(zone_t* zone)
     if (unlikely(ltree_postproc(zone, ltree_postproc_phase1)))
         return true;
 
+    const uint64_t mid = latency_now(CLOCK_MONOTONIC);
+    ltree_load_prof_add(LTREE_LOAD_POSTPROC1, mid - start);
+
     // zroot phase2 checks for unused out-of-zone glue addresses,
     if (unlikely(ltree_postproc_zroot_phase2(zone)))
         return true;
@@ -1331,6 +1340,8 @@ bool ltree_postproc_zone(zone_t* zone)
     // tree phase2 looks for unused delegation glue addresses
     if (unlikely(ltree_postproc(zone, ltree_postproc_phase2)))
         return true;
+
+    ltree_load_prof_add(LTREE_LOAD_POSTPROC2, latency_now(CLOCK_MONOTONIC) - mid);
     return false;
 }
 
@@ -1404,6 +1415,56 @@ void ltree_destroy_zone(zone_t* zone)
 
 // -- meta-stuff for zone loading/reloading, etc:
 
+// Additions come from the rfc1035 worker threads at most once per phase per
+// zone, so a plain mutex costs nothing noticeable here
+static pthread_mutex_t load_prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t load_prof[LTREE_LOAD_PHASES];
+
+static const char* const load_phase_names[LTREE_LOAD_PHASES] = {
+    "readdir",
+    "scan",
+    "postproc1",
+    "postproc2",
+    "merge",
+    "xfr_index",
+    "swap",
+    "destroy",
+    "total",
+};
+
+void ltree_load_prof_add(const ltree_load_phase_t phase, const uint64_t ns)
+{
+    gdnsd_assert(phase < LTREE_LOAD_PHASES);
+    pthread_mutex_lock(&load_prof_lock);
+    load_prof[phase] += ns;
+    pthread_mutex_unlock(&load_prof_lock);
+}
+
+void ltree_load_prof_get(uint64_t* out)
+{
+    pthread_mutex_lock(&load_prof_lock);
+    memcpy(out, load_prof, sizeof(load_prof));
+    pthread_mutex_unlock(&load_prof_lock);
+}
+
+const char* ltree_load_phase_name(const ltree_load_phase_t phase)
+{
+    gdnsd_assert(phase < LTREE_LOAD_PHASES);
+    return load_phase_names[phase];
+}
+
+static void ltree_load_prof_log(void)
+{
+    uint64_t prof[LTREE_LOAD_PHASES];
+    ltree_load_prof_get(prof);
+    char buf[512];
+    size_t len = 0;
+    for (unsigned i = 0; i < LTREE_LOAD_PHASES && len < sizeof(buf); i++)
+        len += (size_t)snprintf(&buf[len], sizeof(buf) - len, "%s%s %.1f",
+                                i ? ", " : "", load_phase_names[i], (double)prof[i] / 1e6);
+    log_info("Zone data load phases (ms): %s", buf);
+}
+
 void* ltree_zones_reloader_thread(void* init_asvoid)
 {
     gdnsd_thread_setname("gdnsd-zreload");
@@ -1419,6 +1480,11 @@ void* ltree_zones_reloader_thread(void* init_asvoid)
 
     uintptr_t rv = 0;
 
+    pthread_mutex_lock(&load_prof_lock);
+    memset(load_prof, 0, sizeof(load_prof));
+    pthread_mutex_unlock(&load_prof_lock);
+    const uint64_t start = latency_now(CLOCK_MONOTONIC);
+
     ltarena_t* new_root_arena = lta_new();
     ltree_node_t* new_root_tree = xcalloc(sizeof(*new_root_tree));
 
@@ -1430,9 +1496,20 @@ void* ltree_zones_reloader_thread(void* init_asvoid)
         lta_destroy(new_root_arena);
         rv = 1; // the zsrc already logged why
     } else {
+        // The transfer index is built against the still-current old tree, so
+        // that IXFR change sets can be computed from both versions
+        uint64_t t0 = latency_now(CLOCK_MONOTONIC);
+        xfr_zones_t* new_xfr_zones = xfr_zones_new(new_root_tree);
+        uint64_t t1 = latency_now(CLOCK_MONOTONIC);
+        ltree_load_prof_add(LTREE_LOAD_XFR_INDEX, t1 - t0);
         ltree_node_t* old_root_tree = root_tree;
         rcu_assign_pointer(root_tree, new_root_tree);
+        xfr_zones_t* old_xfr_zones = xfr_zones_swap(new_xfr_zones);
         synchronize_rcu();
+        t0 = latency_now(CLOCK_MONOTONIC);
+        ltree_load_prof_add(LTREE_LOAD_SWAP, t0 - t1);
+        if (old_xfr_zones)
+            xfr_zones_destroy(old_xfr_zones);
         if (old_root_tree) {
             ltree_destroy(old_root_tree);
             gdnsd_assert(root_arena);
@@ -1442,6 +1519,10 @@ void* ltree_zones_reloader_thread(void* init_asvoid)
         }
         root_arena = new_root_arena;
         lta_close(root_arena);
+        const uint64_t done = latency_now(CLOCK_MONOTONIC);
+        ltree_load_prof_add(LTREE_LOAD_DESTROY, done - t0);
+        ltree_load_prof_add(LTREE_LOAD_TOTAL, done - start);
+        ltree_load_prof_log();
     }
 
     if (!init)
@@ -1519,6 +1600,11 @@ bool ltree_merge_zone(ltree_node_t* new_root_tree, ltarena_t* new_root_arena, zo
     }
     gdnsd_assert(!n->child_table);
     gdnsd_assert(!n->rrsets);
+    if (gcfg->zone_stats) {
+        ltree_rrset_soa_t* soa = ltree_node_get_rrset_soa(new_zone->root);
+        if (soa)
+            soa->zone_id = statio_zone_id(new_zone->dname);
+    }
     memcpy(n, new_zone->root, sizeof(*n));
     free(new_zone->root);
     log_info("Zone %s with serial %u loaded", logf_dname(new_zone->dname), new_zone->serial);
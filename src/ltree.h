@@ -221,6 +221,7 @@ struct ltree_rrset_soa {
     uint8_t* rname;
     uint8_t* mname;
     uint32_t times[5];
+    uint32_t zone_id; // from statio_zone_id(), only set if zone_stats
 };
 
 struct ltree_rrset_cname {
@@ -339,6 +340,30 @@ bool ltree_postproc_zone(zone_t* zone);
 F_NONNULL
 void ltree_destroy_zone(zone_t* zone);
 
+// Profile of where the time went in the most recent zone data (re-)load,
+// which ltree_zones_reloader_thread() resets at its start and logs at its
+// end.  SCAN and both POSTPROC phases run in parallel on the rfc1035 worker
+// threads, and their times are summed over all workers; the rest are wall
+// times of serial steps.
+typedef enum {
+    LTREE_LOAD_READDIR = 0, // zones directory scan
+    LTREE_LOAD_SCAN,        // zscan_rfc1035() parsing into per-zone trees
+    LTREE_LOAD_POSTPROC1,   // ltree_postproc_zone() checks and glue linking
+    LTREE_LOAD_POSTPROC2,   // ltree_postproc_zone() unused glue checks
+    LTREE_LOAD_MERGE,       // ltree_merge_zone() into the new root tree
+    LTREE_LOAD_XFR_INDEX,   // zone transfer index for the new tree
+    LTREE_LOAD_SWAP,        // RCU publication and grace period
+    LTREE_LOAD_DESTROY,     // freeing the old tree
+    LTREE_LOAD_TOTAL,       // the whole (re-)load
+    LTREE_LOAD_PHASES
+} ltree_load_phase_t;
+
+void ltree_load_prof_add(const ltree_load_phase_t phase, const uint64_t ns);
+F_NONNULL
+void ltree_load_prof_get(uint64_t* out); // must have LTREE_LOAD_PHASES entries
+F_RETNN
+const char* ltree_load_phase_name(const ltree_load_phase_t phase);
+
 // parameter structures for arguments to ltree_add_rec that otherwise
 // have confusingly-long parameter lists
 typedef struct lt_soa_args {
@@ -32,6 +32,8 @@
 #include "csc.h"
 #include "chal.h"
 #include "cookie.h"
+#include "metrics.h"
+#include "dnstap.h"
 
 #include "plugins/plugapi.h"
 #include "plugins/mon.h"
@@ -479,6 +481,9 @@ static css_t* runtime_execute(const char* argv0, socks_cfg_t* socks_cfg, css_t*
     // init the stats code
     statio_init(socks_cfg->num_dns_threads);
 
+    // dnstap output setup, if configured, before I/O threads need their rings
+    dnstap_init(socks_cfg->num_dns_threads);
+
     // Lock whole daemon into memory, including all future allocations.
     if (gcfg->lock_mem && mlockall(MCL_CURRENT | MCL_FUTURE))
         log_fatal("mlockall(MCL_CURRENT | MCL_FUTURE) failed: %s (you may need to disable the lock_mem config option if your system or your ulimits do not allow it)", logf_errno());
@@ -501,8 +506,10 @@ static css_t* runtime_execute(const char* argv0, socks_cfg_t* socks_cfg, css_t*
     if (!loop)
         log_fatal("Could not initialize the default libev loop");
 
-    // set up monitoring, which expects an initially empty loop
+    // set up monitoring, which expects an initially empty loop, and then
+    // hand the runtime monitoring off to its own threads
     gdnsd_mon_start(loop);
+    gdnsd_mon_start_threads();
 
     // import challenge data in takeover case
     if (csc)
@@ -551,6 +558,9 @@ static css_t* runtime_execute(const char* argv0, socks_cfg_t* socks_cfg, css_t*
     //  requests at the socket layer from the time it's bound.
     dnspacket_wait_stats(socks_cfg);
 
+    // All I/O threads have their dnstap rings now, if enabled
+    dnstap_start();
+
     // Notify 3rd parties of readiness (systemd, or fg process if daemonizing)
     gdnsd_daemon_notify_ready();
 
@@ -576,10 +586,19 @@ static css_t* runtime_execute(const char* argv0, socks_cfg_t* socks_cfg, css_t*
     setup_reload_zones(css, loop);
     css_start(css, loop);
 
+    // HTTP metrics listeners, if configured
+    metrics_t* metrics = metrics_new(socks_cfg);
+    if (metrics)
+        metrics_start(metrics, loop);
+
     // The daemon stays in this libev loop for life,
     // until there's a reason to cleanly exit
     ev_run(loop, 0);
 
+    // stop serving metrics, leaving them to our replacement (if any)
+    if (metrics)
+        metrics_delete(metrics);
+
     // request i/o threads to exit
     request_io_threads_stop(socks_cfg);
 
@@ -589,6 +608,9 @@ static css_t* runtime_execute(const char* argv0, socks_cfg_t* socks_cfg, css_t*
     // wait for i/o threads to exit
     wait_io_threads_stop(socks_cfg);
 
+    // flush out any remaining dnstap records and stop the writer
+    dnstap_stop();
+
     // If we were replaced, this sends a final dump of stats to the new daemon
     // for stats counter continuity
     css_send_stats_handoff(css);
@@ -0,0 +1,564 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "metrics.h"
+
+#include "statio.h"
+#include "plugins/mon.h"
+#include "plugins/plugapi.h"
+
+#include <gdnsd/alloc.h>
+#include <gdnsd/log.h>
+#include <gdnsd/misc.h>
+#include <gdnsd/net.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef SOL_TCP
+#define SOL_TCP IPPROTO_TCP
+#endif
+
+/*
+
+  A minimal HTTP/1.1 server for the main thread's eventloop, which answers
+"GET /metrics" (and HEAD) with the daemon's stats and monitored states in the
+Prometheus or OpenMetrics text formats.  Requests are expected to be tiny and
+infrequent (a scraper or two, every few seconds at most), so this doesn't try
+to be clever: one fixed request buffer per connection, no request bodies,
+pipelined requests are handled one at a time, and anything unexpected gets an
+error and a close.
+
+*/
+
+// Idle keepalive connections, and stalled requests/responses, are closed
+// after this many seconds
+#define METRICS_TIMEOUT 30.0
+
+// Max size of a request's line and headers
+#define METRICS_RBUF_SIZE 4096U
+
+static const char ctype_prom[] = "text/plain; version=0.0.4; charset=utf-8";
+static const char ctype_om[] = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+static const char ctype_text[] = "text/plain; charset=utf-8";
+
+struct metrics_conn_s_;
+typedef struct metrics_conn_s_ metrics_conn_t;
+
+struct metrics_conn_s_ {
+    metrics_conn_t* next; // linked-list for cleanup
+    metrics_conn_t* prev;
+    metrics_t* metrics;
+    ev_io w_read;
+    ev_io w_write;
+    ev_timer w_timeout;
+    int fd;
+    bool close_after; // close after the current response is written
+    size_t req_len; // bytes of rbuf consumed by the current request
+    size_t rbuf_len;
+    size_t hdr_len;
+    size_t body_len; // bytes of body to send, zero for HEAD
+    size_t sent; // bytes of hdr + body sent so far
+    metrics_buf_t body;
+    char hdr[256];
+    char rbuf[METRICS_RBUF_SIZE];
+};
+
+struct metrics_s_ {
+    struct ev_loop* loop;
+    ev_io* w_accepts; // hold the listen fds as well
+    unsigned num_lsnrs;
+    unsigned num_clients;
+    metrics_conn_t* clients;
+};
+
+/***********************
+ * Output buffer stuff *
+ ***********************/
+
+void metrics_printf(metrics_buf_t* mb, const char* fmt, ...)
+{
+    while (1) {
+        const size_t avail = mb->alloc - mb->len;
+        va_list ap;
+        va_start(ap, fmt);
+        const int snp_rv = vsnprintf(&mb->buf[mb->len], avail, fmt, ap);
+        va_end(ap);
+        gdnsd_assert(snp_rv >= 0);
+        if ((size_t)snp_rv < avail) {
+            mb->len += (size_t)snp_rv;
+            return;
+        }
+        size_t new_alloc = mb->alloc ? mb->alloc : 4096U;
+        while (new_alloc - mb->len <= (size_t)snp_rv)
+            new_alloc <<= 1U;
+        mb->buf = xrealloc(mb->buf, new_alloc);
+        mb->alloc = new_alloc;
+    }
+}
+
+void metrics_family(metrics_buf_t* mb, const char* name, const metric_type_t type, const char* help)
+{
+    // The Prometheus format wants the TYPE line to name the samples exactly,
+    // while OpenMetrics wants the family name, which excludes "_total"
+    const bool suffix = (type == METRIC_COUNTER && !mb->openmetrics);
+    const char* type_str = "counter";
+    if (type == METRIC_GAUGE)
+        type_str = "gauge";
+    else if (type == METRIC_HISTOGRAM)
+        type_str = "histogram";
+    metrics_printf(mb, "# HELP %s%s %s\n# TYPE %s%s %s\n",
+                   name, suffix ? "_total" : "", help,
+                   name, suffix ? "_total" : "", type_str);
+}
+
+void metrics_label_value(metrics_buf_t* mb, const char* val)
+{
+    const size_t len = strlen(val);
+    // worst case, every byte escaped
+    if (mb->alloc - mb->len <= len * 2U) {
+        size_t new_alloc = mb->alloc ? mb->alloc : 4096U;
+        while (new_alloc - mb->len <= len * 2U)
+            new_alloc <<= 1U;
+        mb->buf = xrealloc(mb->buf, new_alloc);
+        mb->alloc = new_alloc;
+    }
+    char* out = &mb->buf[mb->len];
+    for (size_t i = 0; i < len; i++) {
+        if (val[i] == '\n') {
+            *out++ = '\\';
+            *out++ = 'n';
+        } else {
+            if (val[i] == '\\' || val[i] == '"')
+                *out++ = '\\';
+            *out++ = val[i];
+        }
+    }
+    mb->len = (size_t)(out - mb->buf);
+}
+
+/***************
+ * HTTP server *
+ ***************/
+
+F_NONNULL
+static void metrics_conn_cleanup(metrics_conn_t* c)
+{
+    metrics_t* metrics = c->metrics;
+    ev_io* w_read = &c->w_read;
+    ev_io_stop(metrics->loop, w_read);
+    ev_io* w_write = &c->w_write;
+    ev_io_stop(metrics->loop, w_write);
+    ev_timer* w_timeout = &c->w_timeout;
+    ev_timer_stop(metrics->loop, w_timeout);
+    close(c->fd);
+
+    if (c->next)
+        c->next->prev = c->prev;
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        metrics->clients = c->next;
+    gdnsd_assert(metrics->num_clients);
+    metrics->num_clients--;
+
+    free(c->body.buf);
+    free(c);
+}
+
+// Case-insensitive search for "tok" within a header value
+F_NONNULL F_PURE
+static bool hdr_has(const char* val, const size_t len, const char* tok)
+{
+    const size_t tok_len = strlen(tok);
+    for (size_t i = 0; i + tok_len <= len; i++)
+        if (!strncasecmp(&val[i], tok, tok_len))
+            return true;
+    return false;
+}
+
+// Returns the length of the complete request at the start of rbuf, including
+// the terminal empty line, or zero if it's not complete yet.
+F_NONNULL F_PURE
+static size_t req_complete_len(const char* rbuf, const size_t rbuf_len)
+{
+    for (size_t i = 1; i < rbuf_len; i++) {
+        if (rbuf[i] != '\n')
+            continue;
+        if (rbuf[i - 1] == '\n')
+            return i + 1U;
+        if (i > 1 && rbuf[i - 1] == '\r' && rbuf[i - 2] == '\n')
+            return i + 1U;
+    }
+    return 0;
+}
+
+F_NONNULL
+static void set_response(metrics_conn_t* c, const unsigned code, const char* reason, const char* ctype, const bool head_only)
+{
+    c->body_len = head_only ? 0 : c->body.len;
+    const int snp_rv = snprintf(c->hdr, sizeof(c->hdr),
+                                "HTTP/1.1 %u %s\r\n"
+                                "Content-Type: %s\r\n"
+                                "Content-Length: %zu\r\n"
+                                "%s"
+                                "Connection: %s\r\n\r\n",
+                                code, reason, ctype, c->body.len,
+                                (code == 405U) ? "Allow: GET, HEAD\r\n" : "",
+                                c->close_after ? "close" : "keep-alive");
+    gdnsd_assert(snp_rv > 0 && (size_t)snp_rv < sizeof(c->hdr));
+    c->hdr_len = (size_t)snp_rv;
+    c->sent = 0;
+
+    ev_io* w_read = &c->w_read;
+    ev_io_stop(c->metrics->loop, w_read);
+    ev_io* w_write = &c->w_write;
+    ev_io_start(c->metrics->loop, w_write);
+}
+
+F_NONNULL
+static void respond_error(metrics_conn_t* c, const unsigned code, const char* reason)
+{
+    c->body.len = 0;
+    metrics_printf(&c->body, "%s\n", reason);
+    set_response(c, code, reason, ctype_text, false);
+}
+
+F_NONNULL
+static void respond_metrics(metrics_conn_t* c, const bool head_only)
+{
+    metrics_buf_t* mb = &c->body;
+    mb->len = 0;
+    statio_get_metrics(mb, time(NULL));
+    gdnsd_mon_states_get_metrics(mb);
+    gdnsd_plugins_action_get_metrics(mb);
+    if (mb->openmetrics)
+        metrics_printf(mb, "# EOF\n");
+    set_response(c, 200U, "OK", mb->openmetrics ? ctype_om : ctype_prom, head_only);
+}
+
+// Parses and responds to the complete request at the start of rbuf
+F_NONNULL
+static void handle_request(metrics_conn_t* c)
+{
+    const char* req = c->rbuf;
+    const size_t req_len = c->req_len;
+
+    // Request line: method, target, and version separated by single spaces
+    const char* eol = memchr(req, '\n', req_len);
+    gdnsd_assert(eol);
+    size_t line_len = (size_t)(eol - req);
+    if (line_len && req[line_len - 1U] == '\r')
+        line_len--;
+    const char* sp1 = memchr(req, ' ', line_len);
+    const char* sp2 = sp1 ? memchr(sp1 + 1, ' ', line_len - (size_t)(sp1 + 1 - req)) : NULL;
+    if (!sp2) {
+        c->close_after = true;
+        respond_error(c, 400U, "Bad Request");
+        return;
+    }
+    const size_t meth_len = (size_t)(sp1 - req);
+    const char* target = sp1 + 1;
+    size_t target_len = (size_t)(sp2 - target);
+    const char* vers = sp2 + 1;
+    const size_t vers_len = line_len - (size_t)(vers - req);
+
+    bool http10;
+    if (vers_len == 8U && !memcmp(vers, "HTTP/1.1", 8U)) {
+        http10 = false;
+    } else if (vers_len == 8U && !memcmp(vers, "HTTP/1.0", 8U)) {
+        http10 = true;
+    } else {
+        c->close_after = true;
+        respond_error(c, 400U, "Bad Request");
+        return;
+    }
+
+    // Only the Connection and Accept headers matter to us
+    bool conn_close = false;
+    bool conn_keepalive = false;
+    c->body.openmetrics = false;
+    const char* line = eol + 1;
+    const char* end = req + req_len;
+    while (line < end) {
+        const char* next = memchr(line, '\n', (size_t)(end - line));
+        gdnsd_assert(next);
+        const size_t len = (size_t)(next - line);
+        const char* colon = memchr(line, ':', len);
+        if (colon) {
+            const size_t name_len = (size_t)(colon - line);
+            const char* val = colon + 1;
+            const size_t val_len = len - name_len - 1U;
+            if (name_len == 10U && !strncasecmp(line, "connection", 10U)) {
+                conn_close = hdr_has(val, val_len, "close");
+                conn_keepalive = hdr_has(val, val_len, "keep-alive");
+            } else if (name_len == 6U && !strncasecmp(line, "accept", 6U)) {
+                c->body.openmetrics = hdr_has(val, val_len, "application/openmetrics-text");
+            }
+        }
+        line = next + 1;
+    }
+    c->close_after = http10 ? !conn_keepalive : conn_close;
+
+    bool head_only = false;
+    if (meth_len == 4U && !memcmp(req, "HEAD", 4U)) {
+        head_only = true;
+    } else if (meth_len != 3U || memcmp(req, "GET", 3U)) {
+        respond_error(c, 405U, "Method Not Allowed");
+        return;
+    }
+
+    const char* query = memchr(target, '?', target_len);
+    if (query)
+        target_len = (size_t)(query - target);
+    if (target_len != 8U || memcmp(target, "/metrics", 8U)) {
+        respond_error(c, 404U, "Not Found");
+        return;
+    }
+
+    respond_metrics(c, head_only);
+}
+
+// Called when rbuf may contain a complete request
+F_NONNULL
+static void process_rbuf(metrics_conn_t* c)
+{
+    c->req_len = req_complete_len(c->rbuf, c->rbuf_len);
+    if (c->req_len) {
+        handle_request(c);
+    } else if (c->rbuf_len == sizeof(c->rbuf)) {
+        c->req_len = c->rbuf_len;
+        c->close_after = true;
+        respond_error(c, 431U, "Request Header Fields Too Large");
+    }
+}
+
+F_NONNULL
+static void metrics_conn_read(struct ev_loop* loop, ev_io* w, int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_READ);
+    metrics_conn_t* c = w->data;
+    gdnsd_assert(c);
+    gdnsd_assert(c->rbuf_len < sizeof(c->rbuf));
+
+    const ssize_t pktlen = recv(c->fd, &c->rbuf[c->rbuf_len], sizeof(c->rbuf) - c->rbuf_len, MSG_DONTWAIT);
+    if (pktlen <= 0) {
+        if (pktlen < 0 && ERRNO_WOULDBLOCK)
+            return;
+        if (pktlen < 0)
+            log_debug("metrics client read failed, closing: %s", logf_errno());
+        metrics_conn_cleanup(c);
+        return;
+    }
+
+    c->rbuf_len += (size_t)pktlen;
+    ev_timer* w_timeout = &c->w_timeout;
+    ev_timer_again(loop, w_timeout);
+    process_rbuf(c);
+}
+
+F_NONNULL
+static void metrics_conn_write(struct ev_loop* loop, ev_io* w, int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_WRITE);
+    metrics_conn_t* c = w->data;
+    gdnsd_assert(c);
+
+    struct iovec iov[2];
+    unsigned iov_count = 0;
+    if (c->sent < c->hdr_len) {
+        iov[iov_count].iov_base = &c->hdr[c->sent];
+        iov[iov_count++].iov_len = c->hdr_len - c->sent;
+    }
+    const size_t body_sent = (c->sent > c->hdr_len) ? c->sent - c->hdr_len : 0;
+    if (body_sent < c->body_len) {
+        iov[iov_count].iov_base = &c->body.buf[body_sent];
+        iov[iov_count++].iov_len = c->body_len - body_sent;
+    }
+    gdnsd_assert(iov_count);
+
+    const struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = iov_count,
+    };
+    const ssize_t sent = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) {
+        if (ERRNO_WOULDBLOCK)
+            return;
+        log_debug("metrics client write failed, closing: %s", logf_errno());
+        metrics_conn_cleanup(c);
+        return;
+    }
+
+    ev_timer* w_timeout = &c->w_timeout;
+    ev_timer_again(loop, w_timeout);
+    c->sent += (size_t)sent;
+    if (c->sent < c->hdr_len + c->body_len)
+        return;
+
+    if (c->close_after) {
+        metrics_conn_cleanup(c);
+        return;
+    }
+
+    // Response complete, shift out the request and look for another
+    gdnsd_assert(c->req_len <= c->rbuf_len);
+    c->rbuf_len -= c->req_len;
+    if (c->rbuf_len)
+        memmove(c->rbuf, &c->rbuf[c->req_len], c->rbuf_len);
+    c->req_len = 0;
+    ev_io_stop(loop, w);
+    ev_io* w_read = &c->w_read;
+    ev_io_start(loop, w_read);
+    if (c->rbuf_len)
+        process_rbuf(c);
+}
+
+F_NONNULL
+static void metrics_conn_timeout(struct ev_loop* loop V_UNUSED, ev_timer* w, int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_TIMER);
+    metrics_conn_t* c = w->data;
+    gdnsd_assert(c);
+    log_debug("metrics client timed out, closing");
+    metrics_conn_cleanup(c);
+}
+
+F_NONNULL
+static void metrics_accept(struct ev_loop* loop, ev_io* w, int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_READ);
+    metrics_t* metrics = w->data;
+    gdnsd_assert(metrics);
+
+    const int fd = accept4(w->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (unlikely(fd < 0)) {
+        switch (errno) {
+        case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
+        case EINTR:
+            break;
+        default:
+            log_err("metrics socket early connection failure: %s", logf_errno());
+            break;
+        }
+        return;
+    }
+
+    if (metrics->num_clients >= METRICS_MAX_CLIENTS) {
+        log_debug("metrics socket has too many clients, closing new connection");
+        close(fd);
+        return;
+    }
+
+    metrics_conn_t* c = xcalloc(sizeof(*c));
+    c->metrics = metrics;
+    c->fd = fd;
+    ev_io* w_read = &c->w_read;
+    ev_io_init(w_read, metrics_conn_read, fd, EV_READ);
+    w_read->data = c;
+    ev_io* w_write = &c->w_write;
+    ev_io_init(w_write, metrics_conn_write, fd, EV_WRITE);
+    w_write->data = c;
+    ev_timer* w_timeout = &c->w_timeout;
+    ev_timer_init(w_timeout, metrics_conn_timeout, 0., METRICS_TIMEOUT);
+    w_timeout->data = c;
+    ev_io_start(loop, w_read);
+    ev_timer_again(loop, w_timeout);
+
+    // insert into front of linked list
+    if (metrics->clients) {
+        c->next = metrics->clients;
+        metrics->clients->prev = c;
+    }
+    metrics->clients = c;
+    metrics->num_clients++;
+}
+
+F_NONNULL F_WUNUSED
+static int make_metrics_listener_fd(const gdnsd_anysin_t* addr)
+{
+    const int fd = socket(addr->sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fd < 0)
+        log_fatal("Failed to create TCP metrics socket: %s", logf_errno());
+    sockopt_bool_fatal(TCP, addr, fd, SOL_SOCKET, SO_REUSEADDR, 1);
+    sockopt_bool_fatal(TCP, addr, fd, SOL_SOCKET, SO_REUSEPORT, 1);
+    sockopt_bool_fatal(TCP, addr, fd, SOL_TCP, TCP_NODELAY, 1);
+    if (bind(fd, &addr->sa, addr->len))
+        log_fatal("bind() of TCP metrics socket %s failed: %s", logf_anysin(addr), logf_errno());
+    if (listen(fd, 100))
+        log_fatal("Failed to listen() on metrics socket %s: %s", logf_anysin(addr), logf_errno());
+    log_info("HTTP metrics listener initialized @ %s", logf_anysin(addr));
+    return fd;
+}
+
+/*********************
+ * Public interfaces *
+ *********************/
+
+metrics_t* metrics_new(const socks_cfg_t* socks_cfg)
+{
+    if (!socks_cfg->num_metrics_addrs)
+        return NULL;
+
+    metrics_t* metrics = xcalloc(sizeof(*metrics));
+    metrics->num_lsnrs = socks_cfg->num_metrics_addrs;
+    metrics->w_accepts = xcalloc_n(metrics->num_lsnrs, sizeof(*metrics->w_accepts));
+    for (unsigned i = 0; i < metrics->num_lsnrs; i++) {
+        ev_io* w_accept = &metrics->w_accepts[i];
+        const int fd = make_metrics_listener_fd(&socks_cfg->metrics_addrs[i]);
+        ev_io_init(w_accept, metrics_accept, fd, EV_READ);
+        w_accept->data = metrics;
+    }
+    return metrics;
+}
+
+void metrics_start(metrics_t* metrics, struct ev_loop* loop)
+{
+    metrics->loop = loop;
+    for (unsigned i = 0; i < metrics->num_lsnrs; i++) {
+        ev_io* w_accept = &metrics->w_accepts[i];
+        ev_io_start(loop, w_accept);
+    }
+}
+
+void metrics_delete(metrics_t* metrics)
+{
+    while (metrics->clients)
+        metrics_conn_cleanup(metrics->clients);
+    for (unsigned i = 0; i < metrics->num_lsnrs; i++) {
+        ev_io* w_accept = &metrics->w_accepts[i];
+        ev_io_stop(metrics->loop, w_accept);
+        close(w_accept->fd);
+    }
+    free(metrics->w_accepts);
+    free(metrics);
+}
@@ -0,0 +1,80 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GDNSD_METRICS_H
+#define GDNSD_METRICS_H
+
+#include "socks.h"
+
+#include <gdnsd/compiler.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ev.h>
+
+// Concurrent clients of the daemon's metrics listeners (over all of them)
+// beyond this are closed immediately after accept
+#define METRICS_MAX_CLIENTS 64U
+
+// Output buffer for the text exposition formats.  Each HTTP connection owns
+// one, which is emptied (but not freed) for each response and grows as
+// necessary, so that repeated scrapes over a keepalive connection settle into
+// a buffer of the right size and don't allocate at all.
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t alloc;
+    bool openmetrics; // OpenMetrics 1.0.0 if true, else Prometheus 0.0.4
+} metrics_buf_t;
+
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} metric_type_t;
+
+// Append formatted text to the buffer
+F_NONNULL F_PRINTF(2, 3)
+void metrics_printf(metrics_buf_t* mb, const char* fmt, ...);
+
+// Append the HELP and TYPE lines for a metric family.  Counter families are
+// named without the "_total" suffix here, but their samples must have it.
+F_NONNULL
+void metrics_family(metrics_buf_t* mb, const char* name, const metric_type_t type, const char* help);
+
+// Append an arbitrary string as a label value (without the quotes), escaped
+F_NONNULL
+void metrics_label_value(metrics_buf_t* mb, const char* val);
+
+struct metrics_s_;
+typedef struct metrics_s_ metrics_t;
+
+// Binds the "metrics_listen" sockets, if any are configured.  Returns NULL if
+// there are none.
+F_NONNULL
+metrics_t* metrics_new(const socks_cfg_t* socks_cfg);
+
+F_NONNULL
+void metrics_start(metrics_t* metrics, struct ev_loop* loop);
+
+F_NONNULL
+void metrics_delete(metrics_t* metrics);
+
+#endif // GDNSD_METRICS_H
@@ -0,0 +1,602 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// This source is for the gdnsd_microbench binary ("make microbench"), which
+//  times the individual primitives on the query hot path in isolation.  Most
+//  of those are static functions in dnspacket.c, so rather than exporting
+//  them just for this, we compile dnspacket.c directly into this translation
+//  unit.  Its copy in libgdnsd_core.a is then never pulled in by the linker,
+//  as everything it defines is already defined here.
+//
+// The zone data for the lookup benchmarks is generated into a temporary
+//  configuration directory and loaded the normal way.  Every benchmark walks
+//  a fixed pool of pre-generated inputs, and is timed over several separate
+//  runs after a warm-up, reporting the fastest, median, and slowest run in
+//  nanoseconds per operation.  The fastest run is the least disturbed by
+//  other system activity, and is the one to compare across builds.
+
+#include "dnspacket.c"
+
+#include "main.h"
+#include "chal.h"
+#include "latency.h"
+#include "zsrc_rfc1035.h"
+
+#include "../libgdmaps/nlist.h"
+#include "../libgdmaps/ntree.h"
+
+#include <gdnsd/mm3.h>
+#include <gdnsd/paths.h>
+#include <gdnsd/vscf.h>
+
+#include <ftw.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+// Every benchmark cycles through this many pre-generated inputs
+#define POOL_SIZE 4096U
+
+// Names in the zone "bench.example", queried by the lookup benchmarks
+#define ZONE_NAMES 10000U
+
+// Networks of each address family in the benchmark ntree
+#define NTREE_NETS 20000U
+
+// Addresses in the rrset shuffled by shuffle_addrs_rdata
+#define SHUFFLE_ADDRS 8U
+
+static struct {
+    unsigned long ops;
+    unsigned runs;
+    int cpu;
+    const char* only;
+} opts = {
+    .ops = 2000000LU,
+    .runs = 7U,
+    .cpu = -1,
+    .only = NULL,
+};
+
+// Benchmark inputs, all set up before any timing starts
+static uint8_t** hit_names;
+static uint8_t** nx_names;
+static uint8_t** labels;
+static const ltree_node_t* zone_apex;
+static gdnsd_anysin_t* v4_clients;
+static gdnsd_anysin_t* v6_clients;
+static ntree_t* tree;
+static dnsp_ctx_t* ctx;
+static pkt_t* pkt;
+static unsigned optrr_len;
+static uint8_t full_cookie[16];
+static gdnsd_anysin_t cookie_client;
+static uint8_t comp_names[4][256];
+static uint8_t shuffle_rdata[SHUFFLE_ADDRS * 16U];
+
+// Results are folded into this, so that no benchmarked call can be optimized
+// away as unused
+static volatile uintptr_t sink;
+
+// Stubs for the main.h interfaces which the core code expects gdnsd's main.c
+// to provide.  Nothing here reloads zones or tears down at exit.
+void gdnsd_atexit(void (*f)(void) V_UNUSED)
+{
+}
+
+void spawn_async_zones_reloader_thread(void)
+{
+    gdnsd_assert(0);
+}
+
+void notify_reload_zones_done(void)
+{
+    gdnsd_assert(0);
+}
+
+F_NONNULL F_NORETURN
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+            PACKAGE_NAME " version " PACKAGE_VERSION "\n"
+            "Usage: %s [-n ops] [-r runs] [-C cpu] [-b benchmark]\n"
+            "  -n - Operations per timed run, default 2000000\n"
+            "  -r - Timed runs per benchmark, default 7\n"
+            "  -C - Pin to this CPU number for stabler results\n"
+            "  -b - Only run benchmarks whose names contain this string\n",
+            argv0);
+    exit(2);
+}
+
+F_NONNULL
+static unsigned long parse_num(const char* argv0, const char* arg, const unsigned long min, const unsigned long max)
+{
+    char* endptr;
+    errno = 0;
+    const unsigned long rv = strtoul(arg, &endptr, 10);
+    if (errno || !*arg || *endptr || rv < min || rv > max)
+        usage(argv0);
+    return rv;
+}
+
+/**************
+ * Benchmarks *
+ **************/
+
+static void bench_hash_mm3_sz(const unsigned long ops)
+{
+    uintptr_t acc = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        const uint8_t* label = labels[i & (POOL_SIZE - 1U)];
+        acc += hash_mm3_sz(&label[1], label[0]);
+    }
+    sink = acc;
+}
+
+static void bench_ltree_node_find_child(const unsigned long ops)
+{
+    uintptr_t acc = 0;
+    for (unsigned long i = 0; i < ops; i++)
+        acc += (uintptr_t)ltree_node_find_child(zone_apex, labels[i & (POOL_SIZE - 1U)]);
+    sink = acc;
+}
+
+static void bench_search_hit(const unsigned long ops)
+{
+    uintptr_t acc = 0;
+    search_result_t res;
+    for (unsigned long i = 0; i < ops; i++) {
+        acc += search_ltree_for_dname(hit_names[i & (POOL_SIZE - 1U)], &res);
+        acc += (uintptr_t)res.dom;
+    }
+    sink = acc;
+}
+
+static void bench_search_nx(const unsigned long ops)
+{
+    uintptr_t acc = 0;
+    search_result_t res;
+    for (unsigned long i = 0; i < ops; i++) {
+        acc += search_ltree_for_dname(nx_names[i & (POOL_SIZE - 1U)], &res);
+        acc += (uintptr_t)res.auth;
+    }
+    sink = acc;
+}
+
+// Each operation is one store of a name into a response, with the compression
+// target list starting fresh every 4 names as it would for a new response
+static void bench_store_dname_comp(const unsigned long ops)
+{
+    txn_t* txn = &ctx->txn;
+    uintptr_t acc = 0;
+    unsigned offset = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        const unsigned which = i & 3U;
+        if (!which) {
+            txn->ctarget_count = 0;
+            offset = sizeof(wire_dns_header_t) + txn->lqname[0] + 4U;
+        }
+        offset += store_dname_comp(txn, comp_names[which], offset, true) + 10U;
+    }
+    acc += offset;
+    sink = acc;
+}
+
+static void bench_shuffle_addrs_rdata(const unsigned long ops)
+{
+    for (unsigned long i = 0; i < ops; i++)
+        shuffle_addrs_rdata(&ctx->rand_state, shuffle_rdata, SHUFFLE_ADDRS, 16U);
+    sink = shuffle_rdata[2];
+}
+
+static void bench_cookie_process(const unsigned long ops)
+{
+    uint8_t out[16];
+    uintptr_t acc = 0;
+    for (unsigned long i = 0; i < ops; i++)
+        acc += cookie_process(out, full_cookie, &cookie_client, sizeof(full_cookie));
+    sink = acc;
+}
+
+static void bench_ntree_lookup_v4(const unsigned long ops)
+{
+    client_info_t client;
+    memset(&client, 0, sizeof(client));
+    uintptr_t acc = 0;
+    unsigned scope;
+    for (unsigned long i = 0; i < ops; i++) {
+        memcpy(&client.dns_source, &v4_clients[i & (POOL_SIZE - 1U)], sizeof(client.dns_source));
+        acc += ntree_lookup(tree, &client, &scope, true);
+    }
+    sink = acc;
+}
+
+static void bench_ntree_lookup_v6(const unsigned long ops)
+{
+    client_info_t client;
+    memset(&client, 0, sizeof(client));
+    uintptr_t acc = 0;
+    unsigned scope;
+    for (unsigned long i = 0; i < ops; i++) {
+        memcpy(&client.dns_source, &v6_clients[i & (POOL_SIZE - 1U)], sizeof(client.dns_source));
+        acc += ntree_lookup(tree, &client, &scope, true);
+    }
+    sink = acc;
+}
+
+// The OPT RR carries a client cookie and an ECS option, and the per-request
+// EDNS state is reset before each parse, as process_dns_query() does
+static void bench_parse_optrr(const unsigned long ops)
+{
+    uintptr_t acc = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        memset(&ctx->txn.edns, 0, sizeof(ctx->txn.edns));
+        memcpy(&ctx->txn.edns.client_info.dns_source, &cookie_client, sizeof(cookie_client));
+        unsigned offset = 0;
+        acc += (uintptr_t)parse_optrr(ctx, &offset, optrr_len);
+        acc += offset;
+    }
+    sink = acc;
+}
+
+static const struct {
+    const char* name;
+    void (*func)(const unsigned long ops);
+} benchmarks[] = {
+    { "hash_mm3_sz",                bench_hash_mm3_sz },
+    { "ltree_node_find_child",      bench_ltree_node_find_child },
+    { "search_ltree_for_dname_hit", bench_search_hit },
+    { "search_ltree_for_dname_nx",  bench_search_nx },
+    { "store_dname_comp",           bench_store_dname_comp },
+    { "shuffle_addrs_rdata",        bench_shuffle_addrs_rdata },
+    { "cookie_process",             bench_cookie_process },
+    { "ntree_lookup_v4",            bench_ntree_lookup_v4 },
+    { "ntree_lookup_v6",            bench_ntree_lookup_v6 },
+    { "parse_optrr",                bench_parse_optrr },
+};
+
+/*********
+ * Setup *
+ *********/
+
+F_NONNULL
+static void make_dname(uint8_t* dname, const char* name)
+{
+    if (gdnsd_dname_from_string(dname, name, (unsigned)strlen(name)) != DNAME_VALID)
+        log_fatal("BUG: invalid benchmark name '%s'", name);
+}
+
+F_NONNULL
+static void write_file(const char* dir, const char* fn, const char* data)
+{
+    char* path = gdnsd_str_combine_n(3, dir, "/", fn);
+    FILE* fp = fopen(path, "w");
+    if (!fp || fputs(data, fp) == EOF || fclose(fp))
+        log_fatal("Cannot write '%s': %s", path, logf_errno());
+    free(path);
+}
+
+// Creates the temporary configuration directory with the benchmark zone
+static char* make_config_dir(void)
+{
+    const char* tmp = getenv("TMPDIR");
+    char* dir = gdnsd_str_combine_n(2, tmp ? tmp : "/tmp", "/gdnsd_microbench.XXXXXX");
+    if (!mkdtemp(dir))
+        log_fatal("mkdtemp('%s') failed: %s", dir, logf_errno());
+
+    char* config = gdnsd_str_combine_n(5,
+                                       "options => {\n  run_dir = ", dir, "/run\n  state_dir = ", dir, "/state\n}\n");
+    write_file(dir, "config", config);
+    free(config);
+
+    char* zones_dir = gdnsd_str_combine_n(2, dir, "/zones");
+    if (mkdir(zones_dir, 0755))
+        log_fatal("mkdir('%s') failed: %s", zones_dir, logf_errno());
+
+    const size_t zsize = 256U + (ZONE_NAMES * 32U);
+    char* zone = xmalloc(zsize);
+    size_t zlen = (size_t)snprintf(zone, zsize,
+                                   "@ SOA ns1 hostmaster 1 7200 1800 259200 900\n"
+                                   "@ NS ns1\n"
+                                   "@ NS ns2\n"
+                                   "ns1 A 192.0.2.1\n"
+                                   "ns2 A 192.0.2.2\n"
+                                   "*.wild A 192.0.2.3\n");
+    for (unsigned i = 0; i < ZONE_NAMES; i++)
+        zlen += (size_t)snprintf(&zone[zlen], zsize - zlen, "h%u A 192.0.2.%u\n", i, (i & 0x7FU) + 1U);
+    write_file(zones_dir, "bench.example", zone);
+    free(zone);
+    free(zones_dir);
+
+    return dir;
+}
+
+static int rm_cb(const char* fpath, const struct stat* sb V_UNUSED, int typeflag V_UNUSED, struct FTW* ftwbuf V_UNUSED)
+{
+    if (remove(fpath))
+        log_warn("Cannot remove '%s': %s", fpath, logf_errno());
+    return 0;
+}
+
+F_NONNULL
+static void remove_config_dir(char* dir)
+{
+    nftw(dir, rm_cb, 16, FTW_DEPTH | FTW_PHYS);
+    free(dir);
+}
+
+F_NONNULL
+static void setup_names(gdnsd_rstate32_t* rs)
+{
+    hit_names = xmalloc_n(POOL_SIZE, sizeof(*hit_names));
+    nx_names = xmalloc_n(POOL_SIZE, sizeof(*nx_names));
+    labels = xmalloc_n(POOL_SIZE, sizeof(*labels));
+    char buf[64];
+    for (unsigned i = 0; i < POOL_SIZE; i++) {
+        const unsigned n = gdnsd_rand32_bounded(rs, ZONE_NAMES);
+        hit_names[i] = xmalloc(256U);
+        snprintf(buf, sizeof(buf), "h%u.bench.example.", n);
+        make_dname(hit_names[i], buf);
+        nx_names[i] = xmalloc(256U);
+        snprintf(buf, sizeof(buf), "x%u.h%u.bench.example.", gdnsd_rand32_get(rs), n);
+        make_dname(nx_names[i], buf);
+        // The first label of each hit name, in the length-prefixed form that
+        // ltree_node_find_child() takes
+        labels[i] = &hit_names[i][1];
+    }
+
+    uint8_t root_label[32];
+    const ltree_node_t* n = rcu_dereference(root_tree);
+    root_label[0] = 7U;
+    memcpy(&root_label[1], "example", 7U);
+    n = ltree_node_find_child(n, root_label);
+    root_label[0] = 5U;
+    memcpy(&root_label[1], "bench", 5U);
+    zone_apex = n ? ltree_node_find_child(n, root_label) : NULL;
+    if (!zone_apex)
+        log_fatal("BUG: benchmark zone did not load");
+}
+
+// The network number of the i-th of the distinct /24s (as a host-order IPv4
+// address) and /48s (as the top 48 bits of an IPv6 address) in the ntree.
+// The /48s are all within 3000::/4, clear of the v4-like IPv6 spaces.
+static uint32_t ntree_net_v4(const unsigned i)
+{
+    return ((i * 2654435761U) & 0xFFFFFFU) << 8;
+}
+
+static uint64_t ntree_net_v6(const unsigned i)
+{
+    return (UINT64_C(3) << 44) | ((i * UINT64_C(0x9E3779B97F4A7C15)) & ((UINT64_C(1) << 44) - 1U));
+}
+
+// Each network is mapped to one of a few dclists, and every client address
+// falls within one of them, so that lookups descend to real leaves rather
+// than mostly ending early in the default space
+F_NONNULL
+static void setup_ntree(gdnsd_rstate32_t* rs)
+{
+    nlist_t* nl = nlist_new("microbench", false);
+    uint8_t ipv6[16];
+    for (unsigned i = 0; i < NTREE_NETS; i++) {
+        memset(ipv6, 0, sizeof(ipv6));
+        gdnsd_put_una32(htonl(ntree_net_v4(i)), &ipv6[12]);
+        nlist_append(nl, ipv6, 120U, 1U + (i % 7U));
+
+        const uint64_t v6 = ntree_net_v6(i);
+        memset(ipv6, 0, sizeof(ipv6));
+        for (unsigned j = 0; j < 6U; j++)
+            ipv6[j] = (uint8_t)(v6 >> (40U - (8U * j)));
+        nlist_append(nl, ipv6, 48U, 1U + (i % 7U));
+    }
+    // The v4-like spaces which are never looked up directly, as nets.c does
+    nlist_append(nl, start_v4mapped, 96U, NN_UNDEF);
+    nlist_append(nl, start_siit, 96U, NN_UNDEF);
+    nlist_append(nl, start_wkp, 96U, NN_UNDEF);
+    nlist_append(nl, start_6to4, 16U, NN_UNDEF);
+    nlist_append(nl, start_teredo, 32U, NN_UNDEF);
+    nlist_finish(nl);
+    tree = nlist_xlate_tree(nl);
+    nlist_destroy(nl);
+
+    v4_clients = xcalloc_n(POOL_SIZE, sizeof(*v4_clients));
+    v6_clients = xcalloc_n(POOL_SIZE, sizeof(*v6_clients));
+    for (unsigned i = 0; i < POOL_SIZE; i++) {
+        const uint32_t v4 = ntree_net_v4(gdnsd_rand32_bounded(rs, NTREE_NETS)) | (gdnsd_rand32_get(rs) & 0xFFU);
+        v4_clients[i].sin4.sin_family = AF_INET;
+        v4_clients[i].sin4.sin_addr.s_addr = htonl(v4);
+        v4_clients[i].len = sizeof(v4_clients[i].sin4);
+
+        const uint64_t v6 = ntree_net_v6(gdnsd_rand32_bounded(rs, NTREE_NETS));
+        uint8_t* addr = v6_clients[i].sin6.sin6_addr.s6_addr;
+        for (unsigned j = 0; j < 6U; j++)
+            addr[j] = (uint8_t)(v6 >> (40U - (8U * j)));
+        gdnsd_put_una16((uint16_t)gdnsd_rand32_get(rs), &addr[6]);
+        for (unsigned j = 8U; j < 16U; j += 4U)
+            gdnsd_put_una32(gdnsd_rand32_get(rs), &addr[j]);
+        v6_clients[i].sin6.sin6_family = AF_INET6;
+        v6_clients[i].len = sizeof(v6_clients[i].sin6);
+    }
+}
+
+// A thread context and transaction state as process_dns_query() would have
+// them mid-request, for the query "www.bench.example A"
+static void setup_ctx(void)
+{
+    dnspacket_stats_t* stats;
+    ctx = dnspacket_ctx_init_udp(&stats, false);
+    pkt = xcalloc(sizeof(*pkt));
+    ctx->txn.pkt = pkt;
+    ctx->txn.this_max_response = 1232U;
+    make_dname(ctx->txn.lqname, "www.bench.example.");
+
+    make_dname(comp_names[0], "ns1.bench.example.");
+    make_dname(comp_names[1], "ns2.bench.example.");
+    make_dname(comp_names[2], "mail.bench.example.");
+    make_dname(comp_names[3], "mail.other.example.");
+
+    for (unsigned i = 0; i < SHUFFLE_ADDRS; i++) {
+        uint8_t* rr = &shuffle_rdata[i * 16U];
+        gdnsd_put_una16(htons(0xC00C), rr);
+        gdnsd_put_una32(DNS_RRFIXED_A, &rr[2]);
+        gdnsd_put_una32(htonl(86400U), &rr[6]);
+        gdnsd_put_una16(htons(4U), &rr[10]);
+        gdnsd_put_una32(htonl(0xC0000200U + i), &rr[12]);
+    }
+
+    cookie_client.sin4.sin_family = AF_INET;
+    cookie_client.sin4.sin_addr.s_addr = htonl(0xC6336401U);
+    cookie_client.len = sizeof(cookie_client.sin4);
+    static const uint8_t client_cookie[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t cookie_out[16];
+    cookie_process(full_cookie, client_cookie, &cookie_client, sizeof(client_cookie));
+    if (!cookie_process(cookie_out, full_cookie, &cookie_client, sizeof(full_cookie)))
+        log_fatal("BUG: server cookie did not validate");
+
+    // OPT RR: root name, type, size 1232, flags with DO, rdlen, then a client
+    // cookie option and an ECS option for 198.51.100.0/24
+    uint8_t* p = pkt->raw;
+    unsigned len = 0;
+    p[len++] = 0;
+    gdnsd_put_una16(htons(DNS_TYPE_OPT), &p[len]);
+    gdnsd_put_una16(htons(1232U), &p[len + 2U]);
+    gdnsd_put_una32(htonl(0x8000U), &p[len + 4U]);
+    gdnsd_put_una16(htons(12U + 11U), &p[len + 8U]);
+    len += 10U;
+    gdnsd_put_una16(htons(EDNS_COOKIE_OPTCODE), &p[len]);
+    gdnsd_put_una16(htons(8U), &p[len + 2U]);
+    memcpy(&p[len + 4U], client_cookie, 8U);
+    len += 12U;
+    gdnsd_put_una16(htons(EDNS_CLIENTSUB_OPTCODE), &p[len]);
+    gdnsd_put_una16(htons(7U), &p[len + 2U]);
+    gdnsd_put_una16(htons(1U), &p[len + 4U]);
+    p[len + 6U] = 24U;
+    p[len + 7U] = 0;
+    p[len + 8U] = 198U;
+    p[len + 9U] = 51U;
+    p[len + 10U] = 100U;
+    len += 11U;
+    optrr_len = len;
+}
+
+/**********
+ * Timing *
+ **********/
+
+static int cmp_u64(const void* a_v, const void* b_v)
+{
+    const uint64_t a = *(const uint64_t*)a_v;
+    const uint64_t b = *(const uint64_t*)b_v;
+    return (a > b) - (a < b);
+}
+
+F_NONNULL
+static void run_benchmark(const char* name, void (*func)(const unsigned long ops))
+{
+    uint64_t* run_ns = xmalloc_n(opts.runs, sizeof(*run_ns));
+
+    // The warm-up run faults in and caches the inputs and code
+    func(opts.ops / 10U + 1U);
+
+    for (unsigned r = 0; r < opts.runs; r++) {
+        const uint64_t start = latency_now(CLOCK_MONOTONIC);
+        func(opts.ops);
+        run_ns[r] = latency_now(CLOCK_MONOTONIC) - start;
+        rcu_quiescent_state();
+    }
+    qsort(run_ns, opts.runs, sizeof(*run_ns), cmp_u64);
+
+    const double ops = (double)opts.ops;
+    printf("%-28s %10.2f %10.2f %10.2f\n", name,
+           (double)run_ns[0] / ops,
+           (double)run_ns[opts.runs / 2U] / ops,
+           (double)run_ns[opts.runs - 1U] / ops);
+    free(run_ns);
+}
+
+int main(int argc, char** argv)
+{
+    int optchar;
+    while ((optchar = getopt(argc, argv, "n:r:C:b:")) != -1) {
+        switch (optchar) {
+        case 'n':
+            opts.ops = parse_num(argv[0], optarg, 1000LU, ULONG_MAX / 2U);
+            break;
+        case 'r':
+            opts.runs = (unsigned)parse_num(argv[0], optarg, 1LU, 1000LU);
+            break;
+        case 'C':
+            opts.cpu = (int)parse_num(argv[0], optarg, 0LU, CPU_SETSIZE - 1LU);
+            break;
+        case 'b':
+            opts.only = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc)
+        usage(argv[0]);
+
+    umask(022);
+    if (opts.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(opts.cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus))
+            log_fatal("Cannot pin to CPU %i: %s", opts.cpu, logf_errno());
+    }
+
+    // Load the generated configuration and zone as gdnsd_bench does, plus
+    // the per-thread context the packet functions need
+    char* cfg_dir = make_config_dir();
+    vscf_data_t* cfg_root = gdnsd_init_paths(cfg_dir, true);
+    gcfg = conf_load(cfg_root, false);
+    vscf_destroy(cfg_root);
+    chal_init();
+    ltree_init();
+    if (ltree_zones_reloader_thread((void*)true))
+        log_fatal("Loading zone data failed");
+    cookie_config(NULL);
+    struct ev_loop* loop = ev_loop_new(EVFLAG_AUTO);
+    if (!loop)
+        log_fatal("Could not initialize a libev loop");
+    cookie_runtime_init(loop);
+    socks_cfg_t socks_cfg;
+    memset(&socks_cfg, 0, sizeof(socks_cfg));
+    socks_cfg.num_dns_threads = 1U;
+    dnspacket_global_setup(&socks_cfg);
+    rcu_register_thread();
+
+    gdnsd_rstate32_t rs;
+    gdnsd_rand32_init(&rs);
+    setup_names(&rs);
+    setup_ntree(&rs);
+    setup_ctx();
+
+    printf("%lu operations per run, %u runs, ns/op:\n", opts.ops, opts.runs);
+    printf("%-28s %10s %10s %10s\n", "benchmark", "min", "median", "max");
+    for (unsigned i = 0; i < ARRAY_SIZE(benchmarks); i++)
+        if (!opts.only || strstr(benchmarks[i].name, opts.only))
+            run_benchmark(benchmarks[i].name, benchmarks[i].func);
+
+    rcu_unregister_thread();
+    remove_config_dir(cfg_dir);
+    return 0;
+}
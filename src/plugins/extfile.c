@@ -32,6 +32,13 @@
 //   reloaded on specified monitoring intervals, and the UP/DOWN data from the
 //   file feeds into normal anti-flap/TTL calculations, as we do with standard
 //   real monitors like http_status.
+// With format => lines, the file is instead one "name STATE[/TTL]" entry per
+//   line, which is mmapped and parsed directly without building a vscf tree.
+//   In this format, "delta" mode treats the file as append-only: each load
+//   only parses the complete lines appended since the last one, and builds
+//   on the results so far, unless the file was replaced or truncated.
+// In "direct" mode, only the results which actually changed since the last
+//   load are sent to the monitoring core.
 
 #include <config.h>
 
@@ -47,6 +54,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <ev.h>
 
@@ -60,9 +71,16 @@ typedef struct {
     const char* name;
     const char* path;
     extf_mon_t* mons;
+    gdnsd_sttl_t* sttls; // last results applied, indexed by midx
     ev_stat file_watcher; // only used in "direct" case
     ev_timer time_watcher; // used in both cases, differently
+    dev_t dev; // identity of the file last loaded in "delta" mode ...
+    ino_t ino;
+    size_t offset; // ... and the length of it consumed so far
     bool direct;
+    bool lines;
+    bool delta;
+    bool loaded;
     unsigned timeout;
     unsigned interval;
     unsigned num_mons;
@@ -121,6 +139,18 @@ static void plugin_extfile_add_svctype(const char* name, vscf_data_t* svc_cfg, c
     if (def_down)
         svc->def_sttl |= GDNSD_STTL_DOWN;
 
+    vscf_data_t* fmt_cfg = vscf_hash_get_data_byconstkey(svc_cfg, "format", true);
+    if (fmt_cfg) {
+        const char* fmt = vscf_is_simple(fmt_cfg) ? vscf_simple_get_data(fmt_cfg) : "";
+        if (!strcmp(fmt, "lines"))
+            svc->lines = true;
+        else if (strcmp(fmt, "vscf"))
+            log_fatal("plugin_extfile: Service type '%s': option 'format' must be 'vscf' or 'lines'", name);
+    }
+    SVC_OPT_BOOL(svc_cfg, name, delta, svc->delta);
+    if (svc->delta && !svc->lines)
+        log_fatal("plugin_extfile: Service type '%s': option 'delta' requires format 'lines'", name);
+
     svc->num_mons = 0;
     svc->mons = NULL;
 }
@@ -158,89 +188,251 @@ static int moncmp(const void* x, const void* y)
 }
 
 F_NONNULL
-static bool process_entry(const extf_svc_t* svc, const char* matchme, vscf_data_t* val, gdnsd_sttl_t* results)
+static bool process_entry(const extf_svc_t* svc, const char* matchme, const char* val, gdnsd_sttl_t* results)
 {
     bool success = false;
-    if (!vscf_is_simple(val)) {
-        log_err("plugin_extfile: Service type '%s': value for '%s' in file '%s' ignored, must be a simple string!", svc->name, matchme, svc->path);
+    gdnsd_sttl_t result;
+    const unsigned def_ttl = svc->def_sttl & GDNSD_STTL_TTL_MASK;
+    if (gdnsd_mon_parse_sttl(val, &result, def_ttl)) {
+        log_err("plugin_extfile: Service type '%s': value for '%s' in file '%s' ignored, must be of the form STATE[/TTL] (where STATE is 'UP' or 'DOWN', and the optional TTL is an unsigned integer in the range 0 - %u)", svc->name, matchme, svc->path, GDNSD_STTL_TTL_MAX);
     } else {
-        gdnsd_sttl_t result;
-        const unsigned def_ttl = svc->def_sttl & GDNSD_STTL_TTL_MASK;
-        if (gdnsd_mon_parse_sttl(vscf_simple_get_data(val), &result, def_ttl)) {
-            log_err("plugin_extfile: Service type '%s': value for '%s' in file '%s' ignored, must be of the form STATE[/TTL] (where STATE is 'UP' or 'DOWN', and the optional TTL is an unsigned integer in the range 0 - %u)", svc->name, matchme, svc->path, GDNSD_STTL_TTL_MAX);
+        if (!svc->direct && ((result & GDNSD_STTL_TTL_MASK) != def_ttl))
+            log_warn("plugin_extfile: Service type '%s': TTL value for '%s' in file '%s' ignored in 'monitor' mode", svc->name, matchme, svc->path);
+        const extf_mon_t findme = { matchme, 0, 0 };
+        const extf_mon_t* found = bsearch(&findme, svc->mons, svc->num_mons, sizeof(findme), moncmp);
+        if (found) {
+            results[found->midx] = result;
         } else {
-            if (!svc->direct && ((result & GDNSD_STTL_TTL_MASK) != def_ttl))
-                log_warn("plugin_extfile: Service type '%s': TTL value for '%s' in file '%s' ignored in 'monitor' mode", svc->name, matchme, svc->path);
-            const extf_mon_t findme = { matchme, 0, 0 };
-            const extf_mon_t* found = bsearch(&findme, svc->mons, svc->num_mons, sizeof(findme), moncmp);
-            if (found) {
-                results[found->midx] = result;
-            } else {
-                log_warn("plugin_extfile: Service type '%s': entry '%s' in file '%s' ignored, did not match any configured resource!", svc->name, matchme, svc->path);
-            }
-            success = true;
+            log_warn("plugin_extfile: Service type '%s': entry '%s' in file '%s' ignored, did not match any configured resource!", svc->name, matchme, svc->path);
         }
+        success = true;
     }
 
     return success;
 }
 
+// FORCED-bit below is temporary (within process_file()) as a flag
+//   to identify those entries which were not affected by file input.
+// It is cleared before copying the results out elsewhere.
 F_NONNULL
-static void process_file(const extf_svc_t* svc)
+static void init_results(const extf_svc_t* svc, gdnsd_sttl_t* results)
 {
-    if (!svc->num_mons) {
-        log_warn("plugin_extfile: Service type '%s': NOT loading file '%s'; no resources are configured to use this service_type!", svc->name, svc->path);
-        return;
-    }
+    for (unsigned i = 0; i < svc->num_mons; i++)
+        results[i] = svc->def_sttl | GDNSD_STTL_FORCED;
+}
 
+F_NONNULL
+static bool load_vscf(const extf_svc_t* svc, gdnsd_sttl_t* results)
+{
     vscf_data_t* raw = vscf_scan_filename(svc->path);
     if (!raw) {
         log_err("plugin_extfile: Service type '%s': loading file '%s' failed", svc->name, svc->path);
-        return;
+        return false;
     } else {
         if (!vscf_is_hash(raw)) {
             log_err("plugin_extfile: Service type '%s': top level of file '%s' must be a hash", svc->name, svc->path);
             vscf_destroy(raw);
-            return;
+            return false;
         }
     }
 
-    gdnsd_sttl_t* results = xmalloc_n(svc->num_mons, sizeof(*results));
-
-    // FORCED-bit below is temporary (within this function) as a flag
-    //   to identify those entries which were not affected by file input.
-    // It is cleared before copying the results out elsewhere.
-    for (unsigned i = 0; i < svc->num_mons; i++)
-        results[i] = svc->def_sttl | GDNSD_STTL_FORCED;
+    init_results(svc, results);
 
     const unsigned num_raw = vscf_hash_get_len(raw);
     bool success = true;
     for (unsigned i = 0; i < num_raw; i++) {
         const char* matchme = vscf_hash_get_key_byindex(raw, i, NULL);
         vscf_data_t* val = vscf_hash_get_data_byindex(raw, i);
-        if (!process_entry(svc, matchme, val, results)) {
+        if (!vscf_is_simple(val)) {
+            log_err("plugin_extfile: Service type '%s': value for '%s' in file '%s' ignored, must be a simple string!", svc->name, matchme, svc->path);
+            success = false;
+            break;
+        }
+        if (!process_entry(svc, matchme, vscf_simple_get_data(val), results)) {
             success = false;
             break;
         }
     }
 
     vscf_destroy(raw);
+    return success;
+}
+
+// Longest name and state strings accepted in "lines" format
+#define LINES_MAX_NAME 1024U
+#define LINES_MAX_STATE 32U
+
+// Splits one line (without its newline) into the name and state fields,
+//   NUL-terminated in the output buffers.  Returns false if it's blank or a
+//   comment, and sets *bad_p if it's malformed.
+F_NONNULL
+static bool split_line(const char* p, const char* eol, char* name, char* state, bool* bad_p)
+{
+    while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    if (p == eol || *p == '#')
+        return false;
+
+    const char* name_start = p;
+    while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+    const size_t name_len = (size_t)(p - name_start);
+    while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    const char* state_start = p;
+    while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+    const size_t state_len = (size_t)(p - state_start);
+    while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+
+    if (p != eol || !state_len || name_len >= LINES_MAX_NAME || state_len >= LINES_MAX_STATE) {
+        *bad_p = true;
+        return false;
+    }
+
+    memcpy(name, name_start, name_len);
+    name[name_len] = '\0';
+    memcpy(state, state_start, state_len);
+    state[state_len] = '\0';
+    return true;
+}
+
+// Loads a "lines" format file.  In "delta" mode, if the file is the same one
+//   as last time and hasn't shrunk, this starts from the results so far and
+//   only parses the complete lines appended since, and sets *full_p to false.
+//   Also in "delta" mode, bad lines are logged and skipped rather than
+//   failing the load, as an append-only file can't be fixed in place, and
+//   the load would otherwise keep failing on the same line.
+// Writers must replace the file via rename(), or in delta mode append to it,
+//   but never truncate or rewrite it in place, as it's mmapped while parsing.
+F_NONNULL
+static bool load_lines(extf_svc_t* svc, gdnsd_sttl_t* results, bool* full_p)
+{
+    const int fd = open(svc->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_err("plugin_extfile: Service type '%s': cannot open file '%s': %s", svc->name, svc->path, logf_errno());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size < 0) {
+        log_err("plugin_extfile: Service type '%s': file '%s' is not a readable regular file", svc->name, svc->path);
+        close(fd);
+        return false;
+    }
+
+    const size_t len = (size_t)st.st_size;
+    size_t start = 0;
+    if (svc->delta && svc->loaded && st.st_dev == svc->dev
+            && st.st_ino == svc->ino && len >= svc->offset)
+        start = svc->offset;
+
+    *full_p = !start;
+    if (start)
+        memcpy(results, svc->sttls, svc->num_mons * sizeof(*results));
+    else
+        init_results(svc, results);
+
+    const char* buf = NULL;
+    if (len > start) {
+        buf = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+        if (buf == MAP_FAILED) {
+            log_err("plugin_extfile: Service type '%s': cannot mmap file '%s': %s", svc->name, svc->path, logf_errno());
+            close(fd);
+            return false;
+        }
+        (void)posix_madvise((void*)buf, len, POSIX_MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    // In delta mode, a partial last line is still being appended, and is left
+    //   for the next load
+    size_t end = len;
+    if (svc->delta)
+        while (end > start && buf[end - 1] != '\n')
+            end--;
+
+    bool success = true;
+    char name[LINES_MAX_NAME];
+    char state[LINES_MAX_STATE];
+    const char* p = buf ? buf + start : NULL;
+    const char* buf_end = buf ? buf + end : NULL;
+    unsigned lnum = 0;
+    while (p < buf_end) {
+        lnum++;
+        const char* eol = memchr(p, '\n', (size_t)(buf_end - p));
+        if (!eol)
+            eol = buf_end;
+        bool bad = false;
+        if (split_line(p, eol, name, state, &bad)) {
+            if (!process_entry(svc, name, state, results) && !svc->delta) {
+                success = false;
+                break;
+            }
+        } else if (bad) {
+            log_err("plugin_extfile: Service type '%s': line %u of new data in file '%s' must be of the form 'name STATE[/TTL]'%s", svc->name, lnum, svc->path, svc->delta ? ", skipped" : "");
+            if (!svc->delta) {
+                success = false;
+                break;
+            }
+        }
+        p = eol + 1;
+    }
+
+    if (buf && munmap((void*)buf, len))
+        log_err("plugin_extfile: Service type '%s': cannot munmap file '%s': %s", svc->name, svc->path, logf_errno());
+
+    if (success) {
+        svc->dev = st.st_dev;
+        svc->ino = st.st_ino;
+        svc->offset = end;
+    }
+
+    return success;
+}
+
+F_NONNULL
+static void process_file(extf_svc_t* svc)
+{
+    if (!svc->num_mons) {
+        log_warn("plugin_extfile: Service type '%s': NOT loading file '%s'; no resources are configured to use this service_type!", svc->name, svc->path);
+        return;
+    }
+
+    gdnsd_sttl_t* results = xmalloc_n(svc->num_mons, sizeof(*results));
+
+    bool full = true;
+    const bool success = svc->lines
+                         ? load_lines(svc, results, &full)
+                         : load_vscf(svc, results);
 
     if (success) {
-        for (unsigned i = 0; i < svc->num_mons; i++) {
-            if (results[i] & GDNSD_STTL_FORCED) {
-                log_warn("plugin_extfile: Service type '%s': '%s' was defaulted! (not specified by input file)", svc->name, svc->mons[i].name);
-                results[i] &= ~GDNSD_STTL_FORCED;
-                gdnsd_assert(results[i] == svc->def_sttl);
+        if (full) {
+            for (unsigned i = 0; i < svc->num_mons; i++) {
+                if (results[i] & GDNSD_STTL_FORCED) {
+                    log_warn("plugin_extfile: Service type '%s': '%s' was defaulted! (not specified by input file)", svc->name, svc->mons[i].name);
+                    results[i] &= ~GDNSD_STTL_FORCED;
+                    gdnsd_assert(results[i] == svc->def_sttl);
+                }
             }
         }
-        if (svc->direct)
+        // Monitor mode feeds every result to the anti-flap counters on every
+        //   interval, but direct mode only needs to pass on the changes
+        if (svc->direct) {
             for (unsigned i = 0; i < svc->num_mons; i++)
-                gdnsd_mon_sttl_updater(svc->mons[i].sidx, results[i]);
-        else
+                if (!svc->loaded || results[i] != svc->sttls[i])
+                    gdnsd_mon_sttl_updater(svc->mons[i].sidx, results[i]);
+        } else {
             for (unsigned i = 0; i < svc->num_mons; i++)
                 gdnsd_mon_state_updater(svc->mons[i].sidx, !(results[i] & GDNSD_STTL_DOWN));
-        log_debug("plugin_extfile: Service type '%s': loaded new data from file '%s'", svc->name, svc->path);
+        }
+        memcpy(svc->sttls, results, svc->num_mons * sizeof(*results));
+        svc->loaded = true;
+        if (full)
+            log_debug("plugin_extfile: Service type '%s': loaded new data from file '%s'", svc->name, svc->path);
+        else
+            log_debug("plugin_extfile: Service type '%s': loaded appended data from file '%s'", svc->name, svc->path);
     } else {
         log_err("plugin_extfile: Service type '%s': file load failed, no updates applied", svc->name);
     }
@@ -320,6 +512,7 @@ static void plugin_extfile_init_monitors(struct ev_loop* mon_loop V_UNUSED)
             qsort(svc->mons, svc->num_mons, sizeof(*svc->mons), moncmp);
             for (unsigned j = 0; j < svc->num_mons; j++)
                 svc->mons[j].midx = j;
+            svc->sttls = xmalloc_n(svc->num_mons, sizeof(*svc->sttls));
         }
         process_file(svc);
     }
@@ -340,4 +533,5 @@ plugin_t plugin_extfile_funcs = {
     .add_mon_cname = plugin_extfile_add_mon_cname,
     .init_monitors = plugin_extfile_init_monitors,
     .start_monitors = plugin_extfile_start_monitors,
+    .get_metrics = NULL,
 };
@@ -50,6 +50,7 @@ typedef struct {
     unsigned interval;
     unsigned max_proc;
     bool direct;
+    bool persistent;
 } svc_t;
 
 typedef struct {
@@ -215,9 +216,15 @@ static void send_cmd(const unsigned idx, const mon_t* mon)
 {
     char** this_args = xmalloc_n(mon->svc->num_args, sizeof(*this_args));
 
+    // A persistent checker is shared by the whole service type, and is told
+    //   the item with each check instead
     const size_t thing_len = strlen(mon->thing);
-    for (unsigned i = 0; i < mon->svc->num_args; i++)
-        this_args[i] = gdnsd_str_subst(mon->svc->args[i], "%%ITEM%%", 8LU, mon->thing, thing_len);
+    for (unsigned i = 0; i < mon->svc->num_args; i++) {
+        if (mon->svc->persistent)
+            this_args[i] = xstrdup(mon->svc->args[i]);
+        else
+            this_args[i] = gdnsd_str_subst(mon->svc->args[i], "%%ITEM%%", 8LU, mon->thing, thing_len);
+    }
 
     extmon_cmd_t this_cmd = {
         .idx = idx,
@@ -225,8 +232,10 @@ static void send_cmd(const unsigned idx, const mon_t* mon)
         .interval = mon->svc->interval,
         .max_proc = mon->svc->max_proc,
         .num_args = mon->svc->num_args,
+        .persistent = mon->svc->persistent,
         .args = this_args,
         .desc = mon->desc,
+        .item = mon->thing,
     };
 
     if (emc_write_command(helper_write_fd, &this_cmd)
@@ -403,6 +412,11 @@ static void plugin_extmon_add_svctype(const char* name, vscf_data_t* svc_cfg, co
     vscf_data_t* direct_cfg = vscf_hash_get_data_byconstkey(svc_cfg, "direct", true);
     if (direct_cfg && !vscf_simple_get_as_bool(direct_cfg, &this_svc->direct))
         log_fatal("plugin_extmon: service type '%s': option 'direct' must have the value 'true' or 'false'", name);
+
+    this_svc->persistent = false;
+    vscf_data_t* persistent_cfg = vscf_hash_get_data_byconstkey(svc_cfg, "persistent", true);
+    if (persistent_cfg && !vscf_simple_get_as_bool(persistent_cfg, &this_svc->persistent))
+        log_fatal("plugin_extmon: service type '%s': option 'persistent' must have the value 'true' or 'false'", name);
 }
 
 static void add_mon_any(const char* desc, const char* svc_name, const char* thing, const unsigned idx)
@@ -486,4 +500,5 @@ plugin_t plugin_extmon_funcs = {
     .add_mon_cname = plugin_extmon_add_mon_cname,
     .init_monitors = plugin_extmon_init_monitors,
     .start_monitors = plugin_extmon_start_monitors,
+    .get_metrics = NULL,
 };
@@ -89,7 +89,8 @@ bool emc_write_command(const int fd, const extmon_cmd_t* cmd)
     memcpy(buf, "CMD:", 4);
     len += 4;
 
-    // 2-byte index, 2-byte timeout, 2-byte interval, 2-byte max_proc
+    // 2-byte index, 2-byte timeout, 2-byte interval, 2-byte max_proc,
+    //   2-byte flags
     buf[len++] = (char)(cmd->idx >> 8);
     buf[len++] = (char)(cmd->idx & 0xFF);
     buf[len++] = (char)(cmd->timeout >> 8);
@@ -98,8 +99,10 @@ bool emc_write_command(const int fd, const extmon_cmd_t* cmd)
     buf[len++] = (char)(cmd->interval & 0xFF);
     buf[len++] = (char)(cmd->max_proc >> 8);
     buf[len++] = (char)(cmd->max_proc & 0xFF);
+    buf[len++] = 0;
+    buf[len++] = cmd->persistent ? EMC_FLAG_PERSISTENT : 0;
 
-    // skip 2-byte len for rest of packet at offset 12
+    // skip 2-byte len for rest of packet at offset 14
     len += 2;
 
     // arg count + NUL-terminated arguments
@@ -123,11 +126,20 @@ bool emc_write_command(const int fd, const extmon_cmd_t* cmd)
     memcpy(&buf[len], cmd->desc, desc_len);
     len += desc_len;
 
+    // NUL-terminated item string
+    const unsigned item_len = strlen(cmd->item) + 1;
+    while ((len + item_len + 16) > alloc) {
+        alloc *= 2;
+        buf = xrealloc(buf, alloc);
+    }
+    memcpy(&buf[len], cmd->item, item_len);
+    len += item_len;
+
     // now go back and fill in the overall len
-    //   of the variable area for desc/args.
-    const unsigned var_len = len - 14;
-    buf[12] = (char)(var_len >> 8);
-    buf[13] = (char)(var_len & 0xFF);
+    //   of the variable area for args/desc/item.
+    const unsigned var_len = len - 16;
+    buf[14] = (char)(var_len >> 8);
+    buf[15] = (char)(var_len & 0xFF);
 
     bool rv = emc_write_string(fd, buf, len);
     free(buf);
@@ -153,8 +165,8 @@ extmon_cmd_t* emc_read_command(const int fd)
     uint8_t* var_part = NULL;
 
     {
-        uint8_t fixed_part[14];
-        if (emc_read_nbytes(fd, 14, fixed_part)
+        uint8_t fixed_part[16];
+        if (emc_read_nbytes(fd, 16, fixed_part)
                 || strncmp((char*)fixed_part, "CMD:", 4)) {
             log_debug("emc_read_command() failed to read CMD: prefix");
             goto out_error;
@@ -165,14 +177,16 @@ extmon_cmd_t* emc_read_command(const int fd)
         cmd->timeout = ((unsigned)fixed_part[6] << 8) + fixed_part[7];
         cmd->interval = ((unsigned)fixed_part[8] << 8) + fixed_part[9];
         cmd->max_proc = ((unsigned)fixed_part[10] << 8) + fixed_part[11];
+        cmd->persistent = !!(fixed_part[13] & EMC_FLAG_PERSISTENT);
         cmd->args = NULL;
         cmd->num_args = 0;
 
         // note we add an extra NULL at the end of args here, for execl()
-        const unsigned var_len = ((unsigned)fixed_part[12] << 8) + fixed_part[13];
-        if (var_len < 4) {
-            // 4 bytes would be enough for num_args, a single 1-byte argument
-            //   and its NUL termiantor, and a zero-length NUL-terminated desc
+        const unsigned var_len = ((unsigned)fixed_part[14] << 8) + fixed_part[15];
+        if (var_len < 5) {
+            // 5 bytes would be enough for num_args, a single 1-byte argument
+            //   and its NUL termiantor, and zero-length NUL-terminated desc
+            //   and item
             log_debug("emc_read_command() variable section too short (%u)!", var_len);
             goto out_error;
         }
@@ -212,6 +226,15 @@ extmon_cmd_t* emc_read_command(const int fd)
         cmd->desc = xstrdup((const char*)current);
         current += strlen((const char*)current);
         current++;
+        len_remain = (unsigned)(var_part + var_len - current);
+
+        if (!nul_within_n_bytes(current, len_remain)) {
+            log_debug("emc_read_command(): item runs off end of buffer");
+            goto out_error;
+        }
+        cmd->item = xstrdup((const char*)current);
+        current += strlen((const char*)current);
+        current++;
 
         if (current != (var_part + var_len)) {
             log_debug("emc_read_command(): unused len at end of buffer!");
@@ -34,11 +34,16 @@ typedef struct {
     unsigned interval;
     unsigned max_proc;
     unsigned num_args;
+    bool persistent; // args are a shared checker, which is sent item per check
     // all strings NUL-terminated
     char** args; // array-of-strings NULL-terminated
     const char* desc; // NUL-terminated, and we don't own it in plugin
+    const char* item; // same as desc
 } extmon_cmd_t;
 
+// flag bits in the CMD: message
+#define EMC_FLAG_PERSISTENT 1U
+
 // these are used for simple protocol messages during
 //   initial plugin<->helper setup.  They automatically
 //   retry/restart read/write on e.g. EINTR, etc, and they
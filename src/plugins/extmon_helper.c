@@ -38,12 +38,52 @@
 
 #include <ev.h>
 
+// Persistent checkers: one long-running process per distinct persistent
+//   command, instead of a fork/exec of the command per check.  It reads one
+//   check request per line on its stdin:
+//     "<token> <item>\n"
+//   and writes one result line per request to its stdout, in any order:
+//     "<token> OK\n" (any other word than "OK" is a failure)
+// The token is "<index>.<sequence>", but is opaque to the checker.  It
+//   identifies the monitor and the check, so that a late result for a check
+//   which already timed out is ignored rather than mistaken for the result of
+//   a later one.  A checker which exits or breaks the protocol is killed, its
+//   pending checks fail immediately, and it's restarted after a backoff
+//   delay (1s doubling up to 60s, reset by any valid result), during which
+//   its checks also fail immediately.
+
+#define CHK_RBUF_SIZE 4096U
+#define CHK_BACKOFF_MAX 60U
+
+typedef struct {
+    char** args;
+    unsigned num_args;
+    ev_io read_watcher;
+    ev_io write_watcher;
+    ev_child child_watcher;
+    ev_timer restart_timer;
+    char* wbuf;
+    size_t wbuf_len;
+    size_t wbuf_alloc;
+    size_t rbuf_len;
+    char rbuf[CHK_RBUF_SIZE];
+    pid_t pid;
+    int in_fd; // checker's stdin
+    int out_fd; // checker's stdout
+    unsigned restarts; // consecutive, for the backoff delay
+} checker_t;
+
+static unsigned num_checkers = 0;
+static checker_t** checkers = NULL;
+
 typedef struct {
     extmon_cmd_t* cmd;
+    checker_t* checker; // NULL unless cmd->persistent
     ev_timer interval_timer;
     ev_timer cmd_timeout;
     ev_child child_watcher;
     pid_t cmd_pid;
+    unsigned seq; // for persistent checker tokens
     bool result_pending;
 } mon_t;
 
@@ -135,6 +175,16 @@ static void sendq_deq_commit(void)
 
 /*************************************************************************/
 
+F_NONNULL
+static void send_result(struct ev_loop* loop, const mon_t* this_mon, const bool failed)
+{
+    if (!killed_by) {
+        sendq_enq(emc_encode_mon(this_mon->cmd->idx, failed));
+        ev_io* pww = &plugin_write_watcher;
+        ev_io_start(loop, pww);
+    }
+}
+
 static void mon_timeout_cb(struct ev_loop* loop, ev_timer* w, int revents V_UNUSED)
 {
     gdnsd_assert(loop);
@@ -143,6 +193,13 @@ static void mon_timeout_cb(struct ev_loop* loop, ev_timer* w, int revents V_UNUS
 
     mon_t* this_mon = w->data;
     gdnsd_assert(this_mon->result_pending);
+    if (this_mon->checker) {
+        // Any late result is ignored, thanks to the sequence in the token
+        log_warn("Persistent checker result for '%s' timed out after %u seconds.  Marking failed", this_mon->cmd->desc, this_mon->cmd->timeout);
+        this_mon->result_pending = false;
+        send_result(loop, this_mon, true);
+        return;
+    }
     log_warn("Monitor child process for '%s' timed out after %u seconds.  Marking failed and sending SIGKILL...", this_mon->cmd->desc, this_mon->cmd->timeout);
     kill(this_mon->cmd_pid, SIGKILL);
     // note we don't stop the child_watcher because we still
@@ -203,6 +260,340 @@ static void mon_child_cb(struct ev_loop* loop, ev_child* w, int revents V_UNUSED
     }
 }
 
+// In a forked child before exec, reset to default any signal handlers that we
+//   actually listen to in the helper process, as well as PIPE and HUP that we
+//   may be ignoring in the main daemon and thus also the helper, and unblock
+//   all signals.
+static void child_reset_signals(void)
+{
+    struct sigaction defaultme;
+    sigemptyset(&defaultme.sa_mask);
+    defaultme.sa_handler = SIG_DFL;
+    defaultme.sa_flags = 0;
+    if (sigaction(SIGTERM, &defaultme, NULL))
+        log_fatal("sigaction() failed: %s", logf_errno());
+    if (sigaction(SIGINT, &defaultme, NULL))
+        log_fatal("sigaction() failed: %s", logf_errno());
+    if (sigaction(SIGPIPE, &defaultme, NULL))
+        log_fatal("sigaction() failed: %s", logf_errno());
+    if (sigaction(SIGHUP, &defaultme, NULL))
+        log_fatal("sigaction() failed: %s", logf_errno());
+    if (sigaction(SIGCHLD, &defaultme, NULL))
+        log_fatal("sigaction() failed: %s", logf_errno());
+
+    // unblock all
+    sigset_t no_sigs;
+    sigemptyset(&no_sigs);
+    if (pthread_sigmask(SIG_SETMASK, &no_sigs, NULL))
+        log_fatal("pthread_sigmask() failed");
+}
+
+/*************************************************************************/
+// Persistent checkers, see checker_t above
+
+F_NONNULL
+static void checker_start(struct ev_loop* loop, checker_t* ch)
+{
+    gdnsd_assert(!ch->pid);
+    gdnsd_assert(ch->in_fd == -1 && ch->out_fd == -1);
+
+    int to_child[2];
+    int from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) || pipe2(from_child, O_CLOEXEC))
+        log_fatal("pipe2(O_CLOEXEC) failed: %s", logf_errno());
+
+    // As in mon_interval_cb(), block signals across the fork
+    sigset_t all_sigs;
+    sigfillset(&all_sigs);
+    sigset_t saved_mask;
+    sigemptyset(&saved_mask);
+    if (pthread_sigmask(SIG_SETMASK, &all_sigs, &saved_mask))
+        log_fatal("pthread_sigmask() failed");
+
+    ch->pid = fork();
+    if (ch->pid == -1)
+        log_fatal("fork() failed: %s", logf_errno());
+
+    if (!ch->pid) { // child
+        child_reset_signals();
+        // dup2() clears FD_CLOEXEC on the copies
+        if (dup2(to_child[0], 0) < 0 || dup2(from_child[1], 1) < 0)
+            log_fatal("dup2() failed: %s", logf_errno());
+        execv(ch->args[0], ch->args);
+        log_fatal("execv(%s, ...) failed: %s", ch->args[0], logf_errno());
+    }
+
+    if (pthread_sigmask(SIG_SETMASK, &saved_mask, NULL))
+        log_fatal("pthread_sigmask() failed");
+
+    close(to_child[0]);
+    close(from_child[1]);
+    ch->in_fd = to_child[1];
+    ch->out_fd = from_child[0];
+    if (fcntl(ch->in_fd, F_SETFL, (fcntl(ch->in_fd, F_GETFL, 0)) | O_NONBLOCK) == -1
+            || fcntl(ch->out_fd, F_SETFL, (fcntl(ch->out_fd, F_GETFL, 0)) | O_NONBLOCK) == -1)
+        log_fatal("Failed to set O_NONBLOCK on checker pipe: %s", logf_errno());
+    ch->wbuf_len = 0;
+    ch->rbuf_len = 0;
+
+    ev_io* rw = &ch->read_watcher;
+    ev_io_set(rw, ch->out_fd, EV_READ);
+    ev_io_start(loop, rw);
+    ev_io* ww = &ch->write_watcher;
+    ev_io_set(ww, ch->in_fd, EV_WRITE);
+    ev_child* cw = &ch->child_watcher;
+    ev_child_set(cw, ch->pid, 0);
+    ev_child_start(loop, cw);
+
+    log_info("Started persistent checker '%s' as pid %li", ch->args[0], (long)ch->pid);
+}
+
+// Takes a checker out of service after it broke its pipes or the protocol:
+//   closes the pipes, kills the process (which is reaped and restarted by
+//   checker_child_cb()), and fails all of its pending checks.
+F_NONNULL
+static void checker_down(struct ev_loop* loop, checker_t* ch)
+{
+    if (ch->in_fd == -1)
+        return;
+
+    ev_io* rw = &ch->read_watcher;
+    ev_io_stop(loop, rw);
+    ev_io* ww = &ch->write_watcher;
+    ev_io_stop(loop, ww);
+    close(ch->in_fd);
+    close(ch->out_fd);
+    ch->in_fd = -1;
+    ch->out_fd = -1;
+    if (ch->pid)
+        kill(ch->pid, SIGKILL);
+
+    for (unsigned i = 0; i < num_mons; i++) {
+        mon_t* this_mon = &mons[i];
+        if (this_mon->checker == ch && this_mon->result_pending) {
+            ev_timer* ct = &this_mon->cmd_timeout;
+            ev_timer_stop(loop, ct);
+            this_mon->result_pending = false;
+            send_result(loop, this_mon, true);
+        }
+    }
+}
+
+static void checker_read_cb(struct ev_loop* loop, ev_io* w, int revents);
+
+static void checker_child_cb(struct ev_loop* loop, ev_child* w, int revents V_UNUSED)
+{
+    gdnsd_assert(loop);
+    gdnsd_assert(w);
+    gdnsd_assert(revents == EV_CHILD);
+
+    ev_child_stop(loop, w);
+    checker_t* ch = w->data;
+    ch->pid = 0;
+
+    const int status = w->rstatus;
+    if (WIFSIGNALED(status))
+        log_warn("Persistent checker '%s' terminated by signal %i", ch->args[0], WTERMSIG(status));
+    else
+        log_warn("Persistent checker '%s' exited with status %i", ch->args[0], WEXITSTATUS(status));
+
+    // Take any results it wrote before exiting, then close up
+    if (ch->out_fd != -1) {
+        ev_io* rw = &ch->read_watcher;
+        checker_read_cb(loop, rw, EV_READ);
+    }
+    checker_down(loop, ch);
+
+    if (!killed_by) {
+        const unsigned delay = ch->restarts < 6U ? (1U << ch->restarts) : CHK_BACKOFF_MAX;
+        ch->restarts++;
+        log_info("Restarting persistent checker '%s' in %us", ch->args[0], delay);
+        ev_timer* rt = &ch->restart_timer;
+        ev_timer_set(rt, delay, 0.);
+        ev_timer_start(loop, rt);
+    }
+}
+
+static void checker_restart_cb(struct ev_loop* loop, ev_timer* w, int revents V_UNUSED)
+{
+    gdnsd_assert(loop);
+    gdnsd_assert(w);
+    gdnsd_assert(revents == EV_TIMER);
+
+    checker_t* ch = w->data;
+    if (!killed_by)
+        checker_start(loop, ch);
+}
+
+static void checker_write_cb(struct ev_loop* loop, ev_io* w, int revents V_UNUSED)
+{
+    gdnsd_assert(loop);
+    gdnsd_assert(w);
+    gdnsd_assert(revents == EV_WRITE);
+
+    checker_t* ch = w->data;
+    while (ch->wbuf_len) {
+        const ssize_t write_rv = write(ch->in_fd, ch->wbuf, ch->wbuf_len);
+        if (write_rv < 0) {
+            if (ERRNO_WOULDBLOCK)
+                return;
+            if (errno == EINTR)
+                continue;
+            log_warn("Write to persistent checker '%s' failed: %s", ch->args[0], logf_errno());
+            checker_down(loop, ch);
+            return;
+        }
+        const size_t written = (size_t)write_rv;
+        ch->wbuf_len -= written;
+        memmove(ch->wbuf, &ch->wbuf[written], ch->wbuf_len);
+    }
+    ev_io_stop(loop, w);
+}
+
+// Handles one NUL-terminated result line
+F_NONNULL
+static void checker_result(struct ev_loop* loop, checker_t* ch, const char* line)
+{
+    char* endptr;
+    const unsigned long idx = strtoul(line, &endptr, 10);
+    if (endptr == line || *endptr != '.')
+        goto bad;
+    const char* seq_str = endptr + 1;
+    const unsigned long seq = strtoul(seq_str, &endptr, 10);
+    if (endptr == seq_str || *endptr != ' ' || idx >= num_mons || mons[idx].checker != ch)
+        goto bad;
+
+    mon_t* this_mon = &mons[idx];
+    if (!this_mon->result_pending || this_mon->seq != seq) {
+        log_debug("Ignoring late result from persistent checker for '%s'", this_mon->cmd->desc);
+        return;
+    }
+
+    const char* word = endptr + 1;
+    const size_t word_len = strcspn(word, "\r");
+    ch->restarts = 0;
+    ev_timer* ct = &this_mon->cmd_timeout;
+    ev_timer_stop(loop, ct);
+    this_mon->result_pending = false;
+    send_result(loop, this_mon, word_len != 2U || strncmp(word, "OK", 2U));
+    return;
+
+bad:
+    log_err("Persistent checker '%s' sent an invalid result line, ignoring it", ch->args[0]);
+}
+
+static void checker_read_cb(struct ev_loop* loop, ev_io* w, int revents V_UNUSED)
+{
+    gdnsd_assert(loop);
+    gdnsd_assert(w);
+    gdnsd_assert(revents == EV_READ);
+
+    checker_t* ch = w->data;
+    while (1) {
+        const ssize_t read_rv = read(ch->out_fd, &ch->rbuf[ch->rbuf_len], CHK_RBUF_SIZE - ch->rbuf_len);
+        if (read_rv <= 0) {
+            if (read_rv < 0 && ERRNO_WOULDBLOCK)
+                return;
+            if (read_rv < 0 && errno == EINTR)
+                continue;
+            if (read_rv < 0)
+                log_warn("Read from persistent checker '%s' failed: %s", ch->args[0], logf_errno());
+            else
+                log_warn("Persistent checker '%s' closed its output", ch->args[0]);
+            checker_down(loop, ch);
+            return;
+        }
+        ch->rbuf_len += (size_t)read_rv;
+
+        char* start = ch->rbuf;
+        char* nl;
+        while ((nl = memchr(start, '\n', ch->rbuf_len - (size_t)(start - ch->rbuf)))) {
+            *nl = '\0';
+            checker_result(loop, ch, start);
+            start = nl + 1;
+        }
+        const size_t left = ch->rbuf_len - (size_t)(start - ch->rbuf);
+        if (left == CHK_RBUF_SIZE) {
+            log_err("Persistent checker '%s' sent an overlong line", ch->args[0]);
+            checker_down(loop, ch);
+            return;
+        }
+        memmove(ch->rbuf, start, left);
+        ch->rbuf_len = left;
+    }
+}
+
+// Sends a check request to the monitor's checker, or fails it immediately if
+//   the checker is down and waiting to restart
+F_NONNULL
+static void checker_send(struct ev_loop* loop, mon_t* this_mon)
+{
+    checker_t* ch = this_mon->checker;
+    if (ch->in_fd == -1) {
+        log_debug("Persistent checker for '%s' is down, marking failed", this_mon->cmd->desc);
+        send_result(loop, this_mon, true);
+        return;
+    }
+
+    this_mon->seq++;
+    const size_t max_line = 32U + strlen(this_mon->cmd->item);
+    while (ch->wbuf_len + max_line > ch->wbuf_alloc) {
+        ch->wbuf_alloc = ch->wbuf_alloc ? ch->wbuf_alloc << 1 : 1024U;
+        ch->wbuf = xrealloc(ch->wbuf, ch->wbuf_alloc);
+    }
+    const int snp_rv = snprintf(&ch->wbuf[ch->wbuf_len], max_line, "%u.%u %s\n",
+                                this_mon->cmd->idx, this_mon->seq, this_mon->cmd->item);
+    gdnsd_assert(snp_rv > 0 && (size_t)snp_rv < max_line);
+    ch->wbuf_len += (size_t)snp_rv;
+    ev_io* ww = &ch->write_watcher;
+    ev_io_start(loop, ww);
+
+    this_mon->result_pending = true;
+    ev_timer* ct = &this_mon->cmd_timeout;
+    ev_timer_set(ct, this_mon->cmd->timeout, 0);
+    ev_timer_start(loop, ct);
+}
+
+// Finds or creates the checker for a persistent command
+F_NONNULL F_RETNN
+static checker_t* checker_get(const extmon_cmd_t* cmd)
+{
+    for (unsigned i = 0; i < num_checkers; i++) {
+        checker_t* ch = checkers[i];
+        if (ch->num_args != cmd->num_args)
+            continue;
+        unsigned j = 0;
+        while (j < cmd->num_args && !strcmp(ch->args[j], cmd->args[j]))
+            j++;
+        if (j == cmd->num_args)
+            return ch;
+    }
+
+    checker_t* ch = xcalloc(sizeof(*ch));
+    ch->args = cmd->args;
+    ch->num_args = cmd->num_args;
+    ch->in_fd = -1;
+    ch->out_fd = -1;
+    ev_io* rw = &ch->read_watcher;
+    ev_io_init(rw, checker_read_cb, -1, 0);
+    rw->data = ch;
+    ev_io* ww = &ch->write_watcher;
+    ev_io_init(ww, checker_write_cb, -1, 0);
+    ww->data = ch;
+    ev_child* cw = &ch->child_watcher;
+    ev_child_init(cw, checker_child_cb, 0, 0);
+    cw->data = ch;
+    ev_timer* rt = &ch->restart_timer;
+    ev_timer_init(rt, checker_restart_cb, 0., 0.);
+    rt->data = ch;
+
+    checkers = xrealloc_n(checkers, num_checkers + 1, sizeof(*checkers));
+    checkers[num_checkers++] = ch;
+    return ch;
+}
+
+/*************************************************************************/
+
 static void mon_interval_cb(struct ev_loop* loop, ev_timer* w, int revents V_UNUSED)
 {
     gdnsd_assert(loop);
@@ -212,6 +603,11 @@ static void mon_interval_cb(struct ev_loop* loop, ev_timer* w, int revents V_UNU
     mon_t* this_mon = w->data;
     gdnsd_assert(!this_mon->result_pending);
 
+    if (this_mon->checker) {
+        checker_send(loop, this_mon);
+        return;
+    }
+
     if (this_mon->cmd->max_proc > 0 && num_proc >= this_mon->cmd->max_proc) {
         // If more than max_proc processes are running, reschedule excess
         //   checks to run 0.1 seconds later. After a few passes, this will
@@ -238,29 +634,7 @@ static void mon_interval_cb(struct ev_loop* loop, ev_timer* w, int revents V_UNU
         log_fatal("fork() failed: %s", logf_errno());
 
     if (!this_mon->cmd_pid) { // child
-        // reset to default any signal handlers that we actually listen to in
-        // the helper process, as well as PIPE and HUP that we may be ignoring
-        // in the main daemon and thus also the helper.
-        struct sigaction defaultme;
-        sigemptyset(&defaultme.sa_mask);
-        defaultme.sa_handler = SIG_DFL;
-        defaultme.sa_flags = 0;
-        if (sigaction(SIGTERM, &defaultme, NULL))
-            log_fatal("sigaction() failed: %s", logf_errno());
-        if (sigaction(SIGINT, &defaultme, NULL))
-            log_fatal("sigaction() failed: %s", logf_errno());
-        if (sigaction(SIGPIPE, &defaultme, NULL))
-            log_fatal("sigaction() failed: %s", logf_errno());
-        if (sigaction(SIGHUP, &defaultme, NULL))
-            log_fatal("sigaction() failed: %s", logf_errno());
-        if (sigaction(SIGCHLD, &defaultme, NULL))
-            log_fatal("sigaction() failed: %s", logf_errno());
-
-        // unblock all
-        sigset_t no_sigs;
-        sigemptyset(&no_sigs);
-        if (pthread_sigmask(SIG_SETMASK, &no_sigs, NULL))
-            log_fatal("pthread_sigmask() failed");
+        child_reset_signals();
 
         // technically, we could go ahead and close off stdout/stderr
         //   here for the "start" case, but why bother?  If the user
@@ -344,6 +718,14 @@ static void die_gracefully(struct ev_loop* loop)
                 ev_timer_start(loop, ct);
             }
         }
+        // persistent checkers get SIGTERM, and are not restarted
+        for (unsigned i = 0; i < num_checkers; i++) {
+            checker_t* ch = checkers[i];
+            ev_timer* rt = &ch->restart_timer;
+            ev_timer_stop(loop, rt);
+            if (ch->pid)
+                kill(ch->pid, SIGTERM);
+        }
     }
 }
 
@@ -424,6 +806,8 @@ int main(int argc, char** argv)
             log_fatal("BUG: plugin index issues, %u vs %u", i, mons[i].cmd->idx);
         if (emc_write_string(plugin_write_fd, "CMD_ACK", 7))
             log_fatal("Failed to write CMD_ACK for command %u to plugin", i);
+        if (mons[i].cmd->persistent)
+            mons[i].checker = checker_get(mons[i].cmd);
     }
 
     if (emc_read_exact(plugin_read_fd, "END_CMDS"))
@@ -488,6 +872,9 @@ int main(int argc, char** argv)
         cw->data = this_mon;
     }
 
+    for (unsigned i = 0; i < num_checkers; i++)
+        checker_start(def_loop, checkers[i]);
+
     log_info("gdnsd_extmon_helper running");
     ev_run(def_loop, 0);
 
@@ -503,6 +890,13 @@ int main(int argc, char** argv)
             needs_wait = true;
         }
     }
+    for (unsigned i = 0; i < num_checkers; i++) {
+        if (checkers[i]->pid) {
+            log_debug("not-so-graceful shutdown: sending SIGKILL to checker %li", (long)checkers[i]->pid);
+            kill(checkers[i]->pid, SIGKILL);
+            needs_wait = true;
+        }
+    }
 
     if (needs_wait) {
         unsigned i = 500; // 5s for OS to give us all the SIGKILL'd zombies
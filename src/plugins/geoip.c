@@ -23,6 +23,7 @@
 #include <gdnsd/alloc.h>
 #include <gdnsd/log.h>
 #include <gdnsd/vscf.h>
+#include <gdnsd/paths.h>
 #include "mon.h"
 #include "plugapi.h"
 #include <gdmaps.h>
@@ -76,6 +77,16 @@ static bool top_config_hook(vscf_data_t* top_config)
 
     gdmaps = gdmaps_new(maps, gdnsd_mon_admin);
 
+    bool map_cache = false;
+    vscf_data_t* map_cache_vscf = vscf_hash_get_data_byconstkey(top_config, "map_cache", true);
+    if (map_cache_vscf && (!vscf_is_simple(map_cache_vscf) || !vscf_simple_get_as_bool(map_cache_vscf, &map_cache)))
+        log_fatal("plugin_geoip: 'map_cache' must be a boolean value ('true' or 'false')");
+    if (map_cache) {
+        char* cache_dir = gdnsd_resolve_path_state("geoip_cache", NULL);
+        gdmaps_set_cache_dir(gdmaps, cache_dir);
+        free(cache_dir);
+    }
+
     bool undef_dc_ok = false;
     vscf_data_t* undef_dc_ok_vscf = vscf_hash_get_data_byconstkey(top_config, "undefined_datacenters_ok", true);
     if (undef_dc_ok_vscf && (!vscf_is_simple(undef_dc_ok_vscf) || !vscf_simple_get_as_bool(undef_dc_ok_vscf, &undef_dc_ok)))
@@ -108,10 +119,32 @@ static unsigned map_get_mon_idx(const unsigned mapnum, const unsigned dcnum)
     return gdmaps_map_mon_idx(gdmaps, mapnum, dcnum);
 }
 
+static unsigned map_get_gen(const unsigned mapnum)
+{
+    gdnsd_assert(gdmaps);
+    return gdmaps_get_gen(gdmaps, mapnum);
+}
+
+// The client address the map lookup for this client depends on, and whether
+//   it came from EDNS Client Subnet (which changes the scope of the result)
+F_NONNULL
+static const gdnsd_anysin_t* map_get_cache_addr(const unsigned mapnum, const client_info_t* cinfo, bool* ecs_out)
+{
+    gdnsd_assert(gdmaps);
+    if (cinfo->edns_client_mask && !gdmaps_ignores_ecs(gdmaps, mapnum)) {
+        *ecs_out = true;
+        return &cinfo->edns_client;
+    }
+    *ecs_out = false;
+    return &cinfo->dns_source;
+}
+
 #define PNSTR "geoip"
 #define CB_LOAD_CONFIG plugin_geoip_load_config
 #define CB_MAP plugin_geoip_map_res
 #define CB_RES plugin_geoip_resolve
+#define CB_IOTH_INIT plugin_geoip_iothread_init
+#define CB_IOTH_CLEANUP plugin_geoip_iothread_cleanup
 #define META_MAP_ADMIN 1
 #include "meta_core.inc"
 
@@ -122,12 +155,13 @@ plugin_t plugin_geoip_funcs = {
     .load_config = plugin_geoip_load_config,
     .map_res = plugin_geoip_map_res,
     .pre_run = plugin_geoip_pre_run,
-    .iothread_init = NULL,
-    .iothread_cleanup = NULL,
+    .iothread_init = plugin_geoip_iothread_init,
+    .iothread_cleanup = plugin_geoip_iothread_cleanup,
     .resolve = plugin_geoip_resolve,
     .add_svctype = NULL,
     .add_mon_addr = NULL,
     .add_mon_cname = NULL,
     .init_monitors = NULL,
     .start_monitors = NULL,
+    .get_metrics = NULL,
 };
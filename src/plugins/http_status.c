@@ -29,6 +29,7 @@
 
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <netinet/in_systm.h>
 #include <netinet/in.h>
@@ -40,16 +41,28 @@
 #include <fcntl.h>
 
 #include <ev.h>
+#include <urcu/uatomic.h>
+
+// Keepalive response headers must fit in this buffer (with a NUL), which is
+//   also the scratch space for discarding response bodies, and connections
+//   are only kept through bodies up to KA_MAX_BODY bytes long
+#define KA_BUF_SIZE 1024U
+#define KA_MAX_BODY 65536LU
 
 typedef struct {
     const char* name;
     unsigned* ok_codes;
     char* req_data;
+    char* url_path; // these three only for keepalive
+    char* vhost;
+    char* method;
     unsigned req_data_len;
     unsigned num_ok_codes;
     unsigned port;
     unsigned timeout;
     unsigned interval;
+    bool keepalive;
+    bool head;
 } http_svc_t;
 
 typedef enum {
@@ -63,60 +76,59 @@ typedef struct {
     http_svc_t* http_svc;
     ev_io read_watcher;
     ev_io write_watcher;
-    ev_timer timeout_watcher;
-    ev_timer interval_watcher;
+    gdnsd_mon_probe_t probe;
     unsigned idx;
     gdnsd_anysin_t addr;
     char res_buf[14];
+    const char* req_data;
+    unsigned req_data_len;
     int sock;
     http_state_t hstate;
     unsigned done;
     bool already_connected;
+    // keepalive response state
+    bool reused; // this probe is on a connection kept from an earlier one
+    bool in_body;
+    bool ka_status;
+    unsigned ka_len;
+    unsigned long body_left;
+    char* ka_buf;
 } http_events_t;
 
 static unsigned num_http_svcs = 0;
 static unsigned num_mons = 0;
+static unsigned num_ka_mons = 0;
 static http_svc_t* service_types = NULL;
 static http_events_t** mons = NULL;
 
+// keepalive stats, from all monitoring threads
+static unsigned long stat_ka_connects = 0;
+static unsigned long stat_ka_reuses = 0;
+static unsigned long stat_ka_reconnects = 0;
+
 F_NONNULL
-static void mon_quick_fail(http_events_t* md)
+static void mon_quick_fail(struct ev_loop* loop, http_events_t* md)
 {
     log_debug("plugin_http_status: State poll of %s failed very quickly", md->desc);
     md->hstate = HTTP_STATE_WAITING;
     gdnsd_mon_state_updater(md->idx, false);
+    gdnsd_mon_probe_done(loop, &md->probe);
 }
 
+// Opens a new connection for a probe, or for its retry after a kept-alive
+//   connection turned out to be closed
 F_NONNULL
-static void mon_interval_cb(struct ev_loop* loop, struct ev_timer* t, const int revents V_UNUSED)
+static void mon_connect(struct ev_loop* loop, http_events_t* md)
 {
-    gdnsd_assert(revents == EV_TIMER);
-
-    http_events_t* md = t->data;
-
-    gdnsd_assert(md);
-
-    if (md->hstate != HTTP_STATE_WAITING) {
-        log_warn("plugin_http_status: A monitoring request attempt seems to have "
-                 "lasted longer than the monitoring interval. "
-                 "Skipping this round of monitoring - are you "
-                 "starved for CPU time?");
-        return;
-    }
-
     ev_io* w_watcher = &md->write_watcher;
-    ev_timer* t_watcher = &md->timeout_watcher;
 
     gdnsd_assert(md->sock == -1);
     gdnsd_assert(!ev_is_active(w_watcher));
-    gdnsd_assert(!ev_is_active(t_watcher) && !ev_is_pending(t_watcher));
-
-    log_debug("plugin_http_status: Starting state poll of %s", md->desc);
 
     const int sock = socket(md->addr.sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
     if (sock < 0) {
         log_err("plugin_http_status: Failed to create monitoring socket: %s", logf_errno());
-        mon_quick_fail(md);
+        mon_quick_fail(loop, md);
         return;
     }
 
@@ -138,18 +150,80 @@ static void mon_interval_cb(struct ev_loop* loop, struct ev_timer* t, const int
             }
 
             close(sock);
-            mon_quick_fail(md);
+            mon_quick_fail(loop, md);
             return;
         }
     }
 
+    if (md->http_svc->keepalive)
+        uatomic_inc(&stat_ka_connects);
     md->sock = sock;
     md->hstate = HTTP_STATE_WRITING;
     md->done = 0;
+    md->reused = false;
     ev_io_set(w_watcher, sock, EV_WRITE);
     ev_io_start(loop, w_watcher);
-    ev_timer_set(t_watcher, md->http_svc->timeout, 0);
-    ev_timer_start(loop, t_watcher);
+}
+
+// The server may close a kept-alive connection while it's idle, which shows
+//   up as pending data or EOF before the probe reuses it, or else as a
+//   failure to send on it or an EOF before any response.  That says nothing
+//   about the health of the service, so rather than counting against it, the
+//   probe starts over on a new connection (within the same timeout).  The
+//   caller has already stopped the socket's watcher.
+F_NONNULL
+static void mon_ka_retry(struct ev_loop* loop, http_events_t* md)
+{
+    log_debug("plugin_http_status: Kept-alive connection for %s was closed, reconnecting", md->desc);
+    uatomic_inc(&stat_ka_reconnects);
+    close(md->sock);
+    md->sock = -1;
+    mon_connect(loop, md);
+}
+
+// An idle kept-alive connection has no read watcher, so anything the server
+//   sent on it since the last response (e.g. a 408, or just the EOF of its
+//   idle timeout) is still waiting there, and would be mistaken for the
+//   response to the next request.  Returns whether it's clean to reuse.
+F_NONNULL
+static bool mon_ka_idle_clean(const http_events_t* md)
+{
+    char c;
+    const ssize_t rv = recv(md->sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+F_NONNULL
+static void mon_probe_cb(struct ev_loop* loop, gdnsd_mon_probe_t* probe)
+{
+    http_events_t* md = probe->data;
+
+    gdnsd_assert(md);
+    gdnsd_assert(md->hstate == HTTP_STATE_WAITING);
+    gdnsd_assert(md->sock == -1 || md->http_svc->keepalive);
+
+    log_debug("plugin_http_status: Starting state poll of %s", md->desc);
+
+    md->in_body = false;
+    md->ka_len = 0;
+    if (md->sock == -1) {
+        mon_connect(loop, md);
+        return;
+    }
+
+    if (!mon_ka_idle_clean(md)) {
+        mon_ka_retry(loop, md);
+        return;
+    }
+
+    uatomic_inc(&stat_ka_reuses);
+    md->hstate = HTTP_STATE_WRITING;
+    md->done = 0;
+    md->reused = true;
+    md->already_connected = true;
+    ev_io* w_watcher = &md->write_watcher;
+    ev_io_set(w_watcher, md->sock, EV_WRITE);
+    ev_io_start(loop, w_watcher);
 }
 
 F_NONNULL
@@ -161,13 +235,11 @@ static void mon_write_cb(struct ev_loop* loop, struct ev_io* io, const int reven
 
     ev_io* r_watcher = &md->read_watcher;
     ev_io* w_watcher = &md->write_watcher;
-    ev_timer* t_watcher = &md->timeout_watcher;
 
     gdnsd_assert(md);
     gdnsd_assert(md->hstate == HTTP_STATE_WRITING);
     gdnsd_assert(!ev_is_active(r_watcher));
     gdnsd_assert(ev_is_active(w_watcher));
-    gdnsd_assert(ev_is_active(t_watcher) || ev_is_pending(t_watcher));
     gdnsd_assert(md->sock > -1);
 
     int sock = md->sock;
@@ -193,19 +265,19 @@ static void mon_write_cb(struct ev_loop* loop, struct ev_io* io, const int reven
             close(sock);
             md->sock = -1;
             ev_io_stop(loop, w_watcher);
-            ev_timer_stop(loop, t_watcher);
             md->hstate = HTTP_STATE_WAITING;
             gdnsd_mon_state_updater(md->idx, false);
+            gdnsd_mon_probe_done(loop, &md->probe);
             return;
         }
         md->already_connected = true;
     }
 
-    gdnsd_assert(md->done < md->http_svc->req_data_len);
-    const unsigned to_send = md->http_svc->req_data_len - md->done;
+    gdnsd_assert(md->done < md->req_data_len);
+    const unsigned to_send = md->req_data_len - md->done;
     gdnsd_assert(to_send > 0);
 
-    const ssize_t send_rv = send(sock, md->http_svc->req_data + md->done, to_send, 0);
+    const ssize_t send_rv = send(sock, md->req_data + md->done, to_send, 0);
     if (unlikely(send_rv < 0)) {
         switch (errno) {
         case EAGAIN:
@@ -224,13 +296,18 @@ static void mon_write_cb(struct ev_loop* loop, struct ev_io* io, const int reven
         default:
             log_err("plugin_http_status: send() to monitoring socket failed, possible local problem: %s", logf_errno());
         }
+        if (md->reused) {
+            ev_io_stop(loop, w_watcher);
+            mon_ka_retry(loop, md);
+            return;
+        }
         shutdown(sock, SHUT_RDWR);
         close(sock);
         md->sock = -1;
         ev_io_stop(loop, w_watcher);
-        ev_timer_stop(loop, t_watcher);
         md->hstate = HTTP_STATE_WAITING;
         gdnsd_mon_state_updater(md->idx, false);
+        gdnsd_mon_probe_done(loop, &md->probe);
         return;
     }
 
@@ -249,6 +326,27 @@ static void mon_write_cb(struct ev_loop* loop, struct ev_io* io, const int reven
     ev_io_start(loop, r_watcher);
 }
 
+// Checks the status line at the start of buf (which must be NUL-terminated and
+//   at least 13 bytes for success) against the service's ok_codes.  The code
+//   is stored in *code_out, or zero if the status line couldn't be parsed.
+F_NONNULL
+static bool mon_check_status(const http_events_t* md, const char* buf, unsigned* code_out)
+{
+    *code_out = 0;
+    char code_str[4] = { 0 };
+    if (1 == sscanf(buf, "HTTP/1.%*1[01]%*1[ ]%3c%*1[ ]", code_str)) {
+        errno = 0;
+        unsigned lcode = (unsigned)strtoul(code_str, NULL, 10);
+        if (!errno) {
+            *code_out = lcode;
+            for (unsigned i = 0; i < md->http_svc->num_ok_codes; i++)
+                if (lcode == md->http_svc->ok_codes[i])
+                    return true;
+        }
+    }
+    return false;
+}
+
 F_NONNULL
 static void mon_read_cb(struct ev_loop* loop, struct ev_io* io, const int revents V_UNUSED)
 {
@@ -257,7 +355,6 @@ static void mon_read_cb(struct ev_loop* loop, struct ev_io* io, const int revent
     http_events_t* md = io->data;
 
     ev_io* r_watcher = &md->read_watcher;
-    ev_timer* t_watcher = &md->timeout_watcher;
 
     gdnsd_assert(md);
     gdnsd_assert(md->hstate == HTTP_STATE_READING);
@@ -290,19 +387,8 @@ static void mon_read_cb(struct ev_loop* loop, struct ev_io* io, const int revent
             return;
         }
         md->res_buf[13] = '\0';
-        char code_str[4] = { 0 };
-        if (1 == sscanf(md->res_buf, "HTTP/1.%*1[01]%*1[ ]%3c%*1[ ]", code_str)) {
-            errno = 0;
-            unsigned lcode = (unsigned)strtoul(code_str, NULL, 10);
-            if (!errno) {
-                for (unsigned i = 0; i < md->http_svc->num_ok_codes; i++) {
-                    if (lcode == md->http_svc->ok_codes[i]) {
-                        final_status = true;
-                        break;
-                    }
-                }
-            }
-        }
+        unsigned code;
+        final_status = mon_check_status(md, md->res_buf, &code);
     }
 
     // I don't believe we actually need to read the rest of the response before
@@ -313,17 +399,170 @@ static void mon_read_cb(struct ev_loop* loop, struct ev_io* io, const int revent
     close(md->sock);
     md->sock = -1;
     ev_io_stop(loop, r_watcher);
-    ev_timer_stop(loop, t_watcher);
     md->hstate = HTTP_STATE_WAITING;
     gdnsd_mon_state_updater(md->idx, final_status);
+    gdnsd_mon_probe_done(loop, &md->probe);
+}
+
+F_NONNULL
+static void mon_ka_finish(struct ev_loop* loop, http_events_t* md, const bool final_status, const bool keep)
+{
+    ev_io* r_watcher = &md->read_watcher;
+
+    log_debug("plugin_http_status: State poll of %s %s", md->desc, final_status ? "succeeded" : "failed");
+    ev_io_stop(loop, r_watcher);
+    if (!keep) {
+        shutdown(md->sock, SHUT_RDWR);
+        close(md->sock);
+        md->sock = -1;
+    }
+    md->hstate = HTTP_STATE_WAITING;
+    gdnsd_mon_state_updater(md->idx, final_status);
+    gdnsd_mon_probe_done(loop, &md->probe);
+}
+
+// Whether the header value from v up to eol contains the given token
+F_NONNULL F_PURE
+static bool hdr_has_token(const char* v, const char* eol, const char* token)
+{
+    const size_t tlen = strlen(token);
+    for (; v + tlen <= eol; v++)
+        if (!strncasecmp(v, token, tlen))
+            return true;
+    return false;
+}
+
+// Given the complete response header in ka_buf ending at eoh (the final CRLF
+//   pair), returns whether the connection can be kept once the body has been
+//   read, and the length of the body in *body_len.  Only HTTP/1.1 responses
+//   without "Connection: close" and with a body of a known length (or none at
+//   all) qualify, as anything else must be read until EOF.
+F_NONNULL
+static bool mon_ka_parse(const http_events_t* md, const char* eoh, const unsigned code, unsigned long* body_len)
+{
+    const char* buf = md->ka_buf;
+    bool keep = !strncmp(buf, "HTTP/1.1 ", 9U);
+    bool have_len = false;
+    unsigned long len = 0;
+
+    const char* line = strstr(buf, "\r\n") + 2U;
+    while (line < eoh) {
+        const char* eol = strstr(line, "\r\n");
+        gdnsd_assert(eol);
+        if (!strncasecmp(line, "Content-Length:", 15U)) {
+            char* endptr;
+            errno = 0;
+            len = strtoul(line + 15U, &endptr, 10);
+            if (errno || endptr == line + 15U || (have_len && len != *body_len))
+                return false;
+            have_len = true;
+            *body_len = len;
+        } else if (!strncasecmp(line, "Connection:", 11U)) {
+            if (hdr_has_token(line + 11U, eol, "close"))
+                keep = false;
+        } else if (!strncasecmp(line, "Transfer-Encoding:", 18U)) {
+            keep = false;
+        }
+        line = eol + 2U;
+    }
+
+    if (md->http_svc->head || code == 204U || code == 304U) {
+        *body_len = 0;
+        return keep;
+    }
+    if (!have_len || len > KA_MAX_BODY)
+        return false;
+    *body_len = len;
+    return keep;
 }
 
+// The read callback for keepalive service types, which has to read the whole
+//   response rather than just the status line to keep the connection
 F_NONNULL
-static void mon_timeout_cb(struct ev_loop* loop, struct ev_timer* t, const int revents V_UNUSED)
+static void mon_read_ka_cb(struct ev_loop* loop, struct ev_io* io, const int revents V_UNUSED)
 {
-    gdnsd_assert(revents == EV_TIMER);
+    gdnsd_assert(revents == EV_READ);
+
+    http_events_t* md = io->data;
+
+    gdnsd_assert(md);
+    gdnsd_assert(md->hstate == HTTP_STATE_READING);
+    gdnsd_assert(ev_is_active(io));
+    gdnsd_assert(md->sock > -1);
+
+    char* buf = md->ka_buf;
+    size_t to_recv;
+    if (md->in_body)
+        to_recv = md->body_left < KA_BUF_SIZE ? md->body_left : KA_BUF_SIZE;
+    else
+        to_recv = KA_BUF_SIZE - 1U - md->ka_len;
+    const ssize_t recv_rv = recv(md->sock, md->in_body ? buf : &buf[md->ka_len], to_recv, 0);
+
+    if (recv_rv <= 0) {
+        if (recv_rv < 0) {
+            switch (errno) {
+            case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+            case EWOULDBLOCK:
+#endif
+            case EINTR:
+                return;
+            case ETIMEDOUT:
+            case ENOTCONN:
+            case ECONNRESET:
+            case EPIPE:
+                break;
+            default:
+                log_err("plugin_http_status: read() from monitoring socket failed, possible local problem: %s", logf_errno());
+            }
+        }
+        if (md->reused && !md->in_body && !md->ka_len) {
+            ev_io_stop(loop, io);
+            mon_ka_retry(loop, md);
+            return;
+        }
+        // The status is already known if the body was cut short
+        mon_ka_finish(loop, md, md->in_body && md->ka_status, false);
+        return;
+    }
+
+    const size_t recvd = (size_t)recv_rv;
+    if (md->in_body) {
+        md->body_left -= recvd;
+        if (!md->body_left)
+            mon_ka_finish(loop, md, md->ka_status, true);
+        return;
+    }
+
+    md->ka_len += recvd;
+    buf[md->ka_len] = '\0';
+    unsigned code;
+    const char* eoh = strstr(buf, "\r\n\r\n");
+    if (!eoh) {
+        // Judge an oversized header by its status line alone
+        if (md->ka_len == KA_BUF_SIZE - 1U)
+            mon_ka_finish(loop, md, mon_check_status(md, buf, &code), false);
+        return;
+    }
+
+    md->ka_status = mon_check_status(md, buf, &code);
+    unsigned long body_len = 0;
+    const bool keep = mon_ka_parse(md, eoh, code, &body_len);
+    const size_t extra = md->ka_len - (size_t)(eoh + 4U - buf);
+    if (!keep || extra > body_len) {
+        mon_ka_finish(loop, md, md->ka_status, false);
+    } else if (extra == body_len) {
+        mon_ka_finish(loop, md, md->ka_status, true);
+    } else {
+        md->body_left = body_len - extra;
+        md->in_body = true;
+    }
+}
 
-    http_events_t* md = t->data;
+F_NONNULL
+static void mon_timeout_cb(struct ev_loop* loop, gdnsd_mon_probe_t* probe)
+{
+    http_events_t* md = probe->data;
 
     ev_io* r_watcher = &md->read_watcher;
     ev_io* w_watcher = &md->write_watcher;
@@ -376,8 +615,10 @@ static void mon_timeout_cb(struct ev_loop* loop, struct ev_timer* t, const int r
 
 static const char REQ_TMPL[] = "%s %s HTTP/1.0\r\nUser-Agent: gdnsd-monitor\r\n\r\n";
 static const char REQ_TMPL_VHOST[] = "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\nUser-Agent: gdnsd-monitor\r\n\r\n";
+static const char REQ_TMPL_KA[] = "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: gdnsd-monitor\r\n\r\n";
 #define REQ_TMPL_LEN (sizeof(REQ_TMPL) - 2U - 1U)
 #define REQ_TMPL_VHOST_LEN (sizeof(REQ_TMPL_VHOST) - 2U - 2U - 1U)
+#define REQ_TMPL_KA_LEN (sizeof(REQ_TMPL_KA) - 2U - 2U - 2U - 1U)
 
 F_NONNULLX(1, 2)
 static void make_req_data(http_svc_t* s, const char* url_path, const char* vhost, const char* method)
@@ -394,6 +635,26 @@ static void make_req_data(http_svc_t* s, const char* url_path, const char* vhost
     }
 }
 
+// Keepalive requests are per-monitor, as without a vhost the Host header
+//   is the monitored address and port
+F_NONNULL
+static void make_ka_req_data(http_events_t* md)
+{
+    const http_svc_t* s = md->http_svc;
+    char addr_str[GDNSD_ANYSIN_MAXSTR];
+    const char* host = s->vhost;
+    if (!host) {
+        const int name_err = gdnsd_anysin2str(&md->addr, addr_str);
+        if (name_err)
+            log_fatal("plugin_http_status: Cannot format address for '%s': %s", md->desc, gai_strerror(name_err));
+        host = addr_str;
+    }
+    md->req_data_len = REQ_TMPL_KA_LEN + strlen(s->method) + strlen(s->url_path) + strlen(host);
+    char* req_data = xmalloc(md->req_data_len + 1);
+    snprintf(req_data, md->req_data_len + 1, REQ_TMPL_KA, s->method, s->url_path, host);
+    md->req_data = req_data;
+}
+
 static void plugin_http_status_add_svctype(const char* name, vscf_data_t* svc_cfg, const unsigned interval, const unsigned timeout)
 {
     // defaults
@@ -401,6 +662,7 @@ static void plugin_http_status_add_svctype(const char* name, vscf_data_t* svc_cf
     const char* vhost = NULL;
     const char* method = "GET";
     unsigned port = 80;
+    bool keepalive = false;
 
     service_types = xrealloc_n(service_types, num_http_svcs + 1, sizeof(*service_types));
     http_svc_t* this_svc = &service_types[num_http_svcs++];
@@ -414,6 +676,9 @@ static void plugin_http_status_add_svctype(const char* name, vscf_data_t* svc_cf
     SVC_OPT_STR(svc_cfg, name, vhost);
     SVC_OPT_STR(svc_cfg, name, method);
     SVC_OPT_UINT(svc_cfg, name, port, 1LU, 65534LU);
+    vscf_data_t* keepalive_cfg = vscf_hash_get_data_byconstkey(svc_cfg, "keepalive", true);
+    if (keepalive_cfg && (!vscf_is_simple(keepalive_cfg) || !vscf_simple_get_as_bool(keepalive_cfg, &keepalive)))
+        log_fatal("plugin_http_status: service type '%s': option 'keepalive' must have the value 'true' or 'false'", name);
     vscf_data_t* ok_codes_cfg = vscf_hash_get_data_byconstkey(svc_cfg, "ok_codes", true);
     if (ok_codes_cfg) {
         ok_codes_set = true;
@@ -439,7 +704,15 @@ static void plugin_http_status_add_svctype(const char* name, vscf_data_t* svc_cf
         this_svc->ok_codes[0] = 200LU;
     }
 
-    make_req_data(this_svc, url_path, vhost, method);
+    this_svc->keepalive = keepalive;
+    this_svc->head = !strcmp(method, "HEAD");
+    if (keepalive) {
+        this_svc->url_path = xstrdup(url_path);
+        this_svc->vhost = vhost ? xstrdup(vhost) : NULL;
+        this_svc->method = xstrdup(method);
+    } else {
+        make_req_data(this_svc, url_path, vhost, method);
+    }
     this_svc->port = port;
     this_svc->timeout = timeout;
     this_svc->interval = interval;
@@ -472,20 +745,24 @@ static void plugin_http_status_add_mon_addr(const char* desc, const char* svc_na
     this_mon->sock = -1;
 
     ev_io* r_watcher = &this_mon->read_watcher;
-    ev_io_init(r_watcher, mon_read_cb, -1, 0);
+    if (this_mon->http_svc->keepalive) {
+        make_ka_req_data(this_mon);
+        this_mon->ka_buf = xmalloc(KA_BUF_SIZE);
+        ev_io_init(r_watcher, mon_read_ka_cb, -1, 0);
+        num_ka_mons++;
+    } else {
+        this_mon->req_data = this_mon->http_svc->req_data;
+        this_mon->req_data_len = this_mon->http_svc->req_data_len;
+        ev_io_init(r_watcher, mon_read_cb, -1, 0);
+    }
     r_watcher->data = this_mon;
 
     ev_io* w_watcher = &this_mon->write_watcher;
     ev_io_init(w_watcher, mon_write_cb, -1, 0);
     w_watcher->data = this_mon;
 
-    ev_timer* t_watcher = &this_mon->timeout_watcher;
-    ev_timer_init(t_watcher, mon_timeout_cb, 0, 0);
-    t_watcher->data = this_mon;
-
-    ev_timer* i_watcher = &this_mon->interval_watcher;
-    ev_timer_init(i_watcher, mon_interval_cb, 0, 0);
-    i_watcher->data = this_mon;
+    gdnsd_mon_probe_init(&this_mon->probe, idx, this_mon->http_svc->interval,
+                         this_mon->http_svc->timeout, mon_probe_cb, mon_timeout_cb, this_mon);
 
     mons = xrealloc_n(mons, num_mons + 1, sizeof(*mons));
     mons[num_mons++] = this_mon;
@@ -494,26 +771,38 @@ static void plugin_http_status_add_mon_addr(const char* desc, const char* svc_na
 static void plugin_http_status_init_monitors(struct ev_loop* mon_loop)
 {
     for (unsigned i = 0; i < num_mons; i++) {
-        ev_timer* ival_watcher = &mons[i]->interval_watcher;
         gdnsd_assert(mons[i]->sock == -1);
-        ev_timer_set(ival_watcher, 0, 0);
-        ev_timer_start(mon_loop, ival_watcher);
+        gdnsd_mon_probe_start(mon_loop, &mons[i]->probe);
     }
 }
 
-static void plugin_http_status_start_monitors(struct ev_loop* mon_loop)
+static void plugin_http_status_start_monitors(struct ev_loop* mon_loop V_UNUSED)
 {
     for (unsigned i = 0; i < num_mons; i++) {
         http_events_t* mon = mons[i];
-        gdnsd_assert(mon->sock == -1);
-        const unsigned ival = mon->http_svc->interval;
-        const double stagger = (((double)i) / ((double)num_mons)) * ((double)ival);
-        ev_timer* ival_watcher = &mon->interval_watcher;
-        ev_timer_set(ival_watcher, stagger, ival);
-        ev_timer_start(mon_loop, ival_watcher);
+        gdnsd_assert(mon->sock == -1 || mon->http_svc->keepalive);
+        gdnsd_mon_probe_start(gdnsd_mon_get_loop(mon->idx), &mon->probe);
     }
 }
 
+// Keepalive connection stats, for the HTTP metrics listeners
+F_NONNULL
+static void plugin_http_status_get_metrics(metrics_buf_t* mb)
+{
+    if (!num_ka_mons)
+        return;
+
+    metrics_family(mb, "gdnsd_http_status_connections", METRIC_COUNTER,
+                   "Connections opened by keepalive http_status monitors");
+    metrics_printf(mb, "gdnsd_http_status_connections_total %lu\n", uatomic_read(&stat_ka_connects));
+    metrics_family(mb, "gdnsd_http_status_connection_reuses", METRIC_COUNTER,
+                   "Keepalive http_status probes sent on a connection kept from an earlier probe");
+    metrics_printf(mb, "gdnsd_http_status_connection_reuses_total %lu\n", uatomic_read(&stat_ka_reuses));
+    metrics_family(mb, "gdnsd_http_status_reconnects", METRIC_COUNTER,
+                   "Keepalive http_status probes retried after finding their kept connection closed");
+    metrics_printf(mb, "gdnsd_http_status_reconnects_total %lu\n", uatomic_read(&stat_ka_reconnects));
+}
+
 plugin_t plugin_http_status_funcs = {
     .name = "http_status",
     .config_loaded = false,
@@ -529,4 +818,5 @@ plugin_t plugin_http_status_funcs = {
     .add_mon_cname = NULL,
     .init_monitors = plugin_http_status_init_monitors,
     .start_monitors = plugin_http_status_start_monitors,
+    .get_metrics = plugin_http_status_get_metrics,
 };
@@ -0,0 +1,721 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// plugin_maglev chooses a subset of a monitored address set for each client
+//   by consistent hashing on the client's network, so that a given client
+//   keeps getting the same addresses, and when an address goes down only its
+//   own clients move elsewhere.  Each address set has a Maglev lookup table
+//   (Eisenbud et al., NSDI '16) of "table_size" slots, filled from a
+//   per-address permutation of the slots, and a lookup is one hash of the
+//   client network to a slot.  The table over all of the addresses is built
+//   at config time, and a table over just the live ones is only built (per
+//   I/O thread) when some are down, and rebuilt only when that set changes.
+
+#include <config.h>
+
+#include <gdnsd/compiler.h>
+#include <gdnsd/alloc.h>
+#include <gdnsd/log.h>
+#include <gdnsd/vscf.h>
+#include <gdnsd/mm3.h>
+#include "mon.h"
+#include "plugapi.h"
+#include "plugins.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+static const char DEFAULT_SVCNAME[] = "up";
+#define DEF_UP_THRESH 0.5
+
+// Table slots hold address indices as bytes, with 0xFF for an empty slot
+//   during construction, which limits a set to 255 addresses
+#define MAX_ADDRS_PER_SET 255U
+#define SLOT_EMPTY 0xFFU
+#define LIVE_WORDS 4U // 64-bit words for a bitmask of MAX_ADDRS_PER_SET
+
+// Table sizes must be prime, and at least the address count
+#define DEF_TABLE_SIZE 4093U
+#define MIN_TABLE_SIZE 101U
+#define MAX_TABLE_SIZE 65537U
+
+// Clients are grouped by these prefix lengths of their address (or their
+//   edns-client-subnet, if shorter), so that a whole network shares one
+//   answer, which is also what an edns-client-subnet scope can express
+#define CLIENT_PREFIX_V4 24U
+#define CLIENT_PREFIX_V6 56U
+
+static unsigned v4_max = 0;
+static unsigned v6_max = 0;
+
+typedef struct {
+    gdnsd_anysin_t addr;
+    unsigned* indices;
+    unsigned offset; // first table slot in this address's permutation
+    unsigned skip; // step between the slots of the permutation
+} addrstate_t;
+
+typedef struct {
+    addrstate_t* as;
+    uint8_t* table_all; // the table over all addresses
+    unsigned num_svcs;
+    unsigned count;
+    unsigned up_thresh;
+    unsigned answer_count;
+    unsigned table_size;
+    unsigned sel_idx; // index of this set's sel_t in each thread's sels[]
+} addrset_t;
+
+typedef struct {
+    const char* name;
+    addrset_t* aset_v4;
+    addrset_t* aset_v6;
+} res_t;
+
+static res_t* resources = NULL;
+static unsigned num_resources = 0;
+static unsigned num_sels = 0;
+static gdnsd_res_index_t res_index;
+
+// The current lookup table and result state of an address set, derived from
+//   the monitored states.  These are only recomputed when the monitoring
+//   state table changes, and the table is only rebuilt when the set of live
+//   addresses does.
+typedef struct {
+    unsigned gen; // sttl table generation these were computed from
+    bool valid;
+    gdnsd_sttl_t rv;
+    unsigned num_live;
+    uint64_t live[LIVE_WORDS]; // the addresses in "table"
+    const uint8_t* table; // table_all, or own_table
+    uint8_t* own_table; // built for a subset of live addresses
+} sel_t;
+
+// Per-thread sel_t for every addrset, indexed by their sel_idx, so that
+//   rebuilds don't need any synchronization
+static __thread sel_t* sels = NULL;
+
+/*********************************/
+/* Local, static functions       */
+/*********************************/
+
+F_NONNULL F_PURE
+static bool live_test(const uint64_t* live, const unsigned i)
+{
+    return live[i >> 6] & (UINT64_C(1) << (i & 63U));
+}
+
+F_NONNULL
+static void live_set(uint64_t* live, const unsigned i)
+{
+    live[i >> 6] |= (UINT64_C(1) << (i & 63U));
+}
+
+F_NONNULL
+static void live_set_all(uint64_t* live, const unsigned count)
+{
+    memset(live, 0, LIVE_WORDS * sizeof(*live));
+    for (unsigned i = 0; i < count; i++)
+        live_set(live, i);
+}
+
+// Fills the table by having each live address in turn take the next free
+//   slot in its own permutation of the slots, until all are taken.  Every
+//   live address gets a near-equal share of the slots, and the slots an
+//   address takes depend only on which others are live, so that removing one
+//   address mostly just hands its own slots to the others.
+F_NONNULL
+static void table_build(uint8_t* table, const addrset_t* aset, const uint64_t* live)
+{
+    const unsigned tsize = aset->table_size;
+    unsigned pos[MAX_ADDRS_PER_SET];
+    for (unsigned i = 0; i < aset->count; i++)
+        pos[i] = aset->as[i].offset;
+
+    memset(table, SLOT_EMPTY, tsize);
+    unsigned filled = 0;
+    while (1) {
+        for (unsigned i = 0; i < aset->count; i++) {
+            if (!live_test(live, i))
+                continue;
+            const unsigned skip = aset->as[i].skip;
+            unsigned p = pos[i];
+            while (table[p] != SLOT_EMPTY) {
+                p += skip;
+                if (p >= tsize)
+                    p -= tsize;
+            }
+            table[p] = (uint8_t)i;
+            p += skip;
+            if (p >= tsize)
+                p -= tsize;
+            pos[i] = p;
+            if (++filled == tsize)
+                return;
+        }
+    }
+}
+
+F_CONST
+static bool is_prime(const unsigned n)
+{
+    if (n < 2U)
+        return false;
+    for (unsigned d = 2U; d * d <= n; d++)
+        if (!(n % d))
+            return false;
+    return true;
+}
+
+// The permutation of an address depends only on the address and the table
+//   size, so that it's unaffected by labels or config ordering
+F_NONNULL
+static void addr_permutation(addrstate_t* as, const unsigned tsize)
+{
+    uint8_t key[17];
+    size_t klen;
+    if (as->addr.sa.sa_family == AF_INET6) {
+        memcpy(key, as->addr.sin6.sin6_addr.s6_addr, 16U);
+        klen = 16U;
+    } else {
+        memcpy(key, &as->addr.sin4.sin_addr.s_addr, 4U);
+        klen = 4U;
+    }
+    key[klen] = 0;
+    as->offset = hash_mm3_u32(key, klen + 1U) % tsize;
+    key[klen] = 1;
+    as->skip = (hash_mm3_u32(key, klen + 1U) % (tsize - 1U)) + 1U;
+}
+
+// Hashes the client network, setting *scope_out to the edns-client-subnet
+//   scope of anything derived from the hash, if it was from edns-client-subnet
+F_NONNULL
+static uint32_t client_hash(const client_info_t* cinfo, unsigned* scope_out)
+{
+    const gdnsd_anysin_t* client = &cinfo->dns_source;
+    if (cinfo->edns_client_mask)
+        client = &cinfo->edns_client;
+
+    uint8_t key[17];
+    unsigned prefix;
+    if (client->sa.sa_family == AF_INET6) {
+        key[0] = 6;
+        memcpy(&key[1], client->sin6.sin6_addr.s6_addr, 16U);
+        prefix = CLIENT_PREFIX_V6;
+    } else {
+        key[0] = 4;
+        memcpy(&key[1], &client->sin4.sin_addr.s_addr, 4U);
+        prefix = CLIENT_PREFIX_V4;
+    }
+
+    *scope_out = 0;
+    if (cinfo->edns_client_mask) {
+        if (cinfo->edns_client_mask < prefix)
+            prefix = cinfo->edns_client_mask;
+        *scope_out = prefix;
+    }
+
+    const unsigned whole = prefix >> 3;
+    const unsigned bits = prefix & 7U;
+    size_t klen = 1U + whole;
+    if (bits) {
+        key[klen] &= (uint8_t)(0xFFU << (8U - bits));
+        klen++;
+    }
+    return hash_mm3_u32(key, klen);
+}
+
+F_NONNULL F_NORETURN
+static bool bad_res_opt(const char* key, unsigned klen V_UNUSED, vscf_data_t* d V_UNUSED, const void* resname_asvoid)
+{
+    const char* resname = resname_asvoid;
+    log_fatal("plugin_maglev: resource '%s': bad option '%s'", resname, key);
+}
+
+// given an array (or actually, even a single value), construct
+//  an addrs_vN hash inheriting params from the parent as usual.
+// also works for direct config, even though some of the work is redundant.
+F_NONNULL
+static vscf_data_t* addrs_hash_from_array(vscf_data_t* ary, const char* resname, const char* stanza)
+{
+    gdnsd_assert(!vscf_is_hash(ary));
+
+    vscf_data_t* parent = vscf_get_parent(ary);
+    gdnsd_assert(vscf_is_hash(parent));
+
+    vscf_data_t* newhash = vscf_hash_new();
+    const unsigned alen = vscf_array_get_len(ary);
+    for (unsigned i = 0; i < alen; i++) {
+        vscf_data_t* this_addr_cfg = vscf_array_get_data(ary, i);
+        if (!vscf_is_simple(this_addr_cfg))
+            log_fatal("plugin_maglev: resource '%s' (%s): if defined as an array, array values must all be address strings", resname, stanza);
+        const unsigned lnum = i + 1;
+        char lbuf[12];
+        snprintf(lbuf, 12, "%u", lnum);
+        vscf_hash_add_val(lbuf, strlen(lbuf), newhash, vscf_clone(this_addr_cfg, false));
+    }
+
+    vscf_hash_inherit(parent, newhash, "up_thresh", false);
+    vscf_hash_inherit(parent, newhash, "service_types", false);
+    vscf_hash_inherit(parent, newhash, "answer_count", false);
+    vscf_hash_inherit(parent, newhash, "table_size", false);
+    return newhash;
+}
+
+typedef struct {
+    const char* resname;
+    const char* stanza;
+    const char** svc_names;
+    addrset_t* aset;
+    unsigned idx;
+    bool ipv6;
+} addrs_iter_data_t;
+
+F_NONNULL
+static bool addr_setup(const char* addr_desc, unsigned klen V_UNUSED, vscf_data_t* addr_data, void* aid_asvoid)
+{
+    addrs_iter_data_t* aid = aid_asvoid;
+
+    const char* resname = aid->resname;
+    const char* stanza = aid->stanza;
+    const char** svc_names = aid->svc_names;
+    addrset_t* aset = aid->aset;
+    const unsigned idx = aid->idx;
+    aid->idx++;
+    const bool ipv6 = aid->ipv6;
+    addrstate_t* as = &aset->as[idx];
+
+    if (!vscf_is_simple(addr_data))
+        log_fatal("plugin_maglev: resource %s (%s): address %s: all addresses must be string values", resname, stanza, addr_desc);
+    const char* addr_txt = vscf_simple_get_data(addr_data);
+
+    const int addr_err = gdnsd_anysin_getaddrinfo(addr_txt, NULL, &as->addr);
+    if (addr_err)
+        log_fatal("plugin_maglev: resource %s (%s): failed to parse address '%s' for '%s': %s", resname, stanza, addr_txt, addr_desc, gai_strerror(addr_err));
+    if (ipv6 && as->addr.sa.sa_family != AF_INET6)
+        log_fatal("plugin_maglev: resource %s (%s): address '%s' for '%s' is not IPv6", resname, stanza, addr_txt, addr_desc);
+    else if (!ipv6 && as->addr.sa.sa_family != AF_INET)
+        log_fatal("plugin_maglev: resource %s (%s): address '%s' for '%s' is not IPv4", resname, stanza, addr_txt, addr_desc);
+
+    addr_permutation(as, aset->table_size);
+
+    if (aset->num_svcs) {
+        as->indices = xmalloc_n(aset->num_svcs, sizeof(*as->indices));
+        for (unsigned i = 0; i < aset->num_svcs; i++)
+            as->indices[i] = gdnsd_mon_addr(svc_names[i], &as->addr);
+    }
+
+    return true;
+}
+
+F_NONNULL
+static void config_addrs(const char* resname, const char* stanza, addrset_t* aset, const bool ipv6, vscf_data_t* cfg)
+{
+    bool destroy_cfg = false;
+    if (!vscf_is_hash(cfg)) {
+        cfg = addrs_hash_from_array(cfg, resname, stanza);
+        destroy_cfg = true;
+    }
+
+    unsigned num_addrs = vscf_hash_get_len(cfg);
+
+    aset->num_svcs = 0;
+    const char** svc_names = NULL;
+    vscf_data_t* svctypes_data = vscf_hash_get_data_byconstkey(cfg, "service_types", true);
+    if (svctypes_data) {
+        num_addrs--;
+        aset->num_svcs = vscf_array_get_len(svctypes_data);
+        if (aset->num_svcs) {
+            svc_names = xmalloc_n(aset->num_svcs, sizeof(*svc_names));
+            for (unsigned i = 0; i < aset->num_svcs; i++) {
+                vscf_data_t* svctype_cfg = vscf_array_get_data(svctypes_data, i);
+                if (!vscf_is_simple(svctype_cfg))
+                    log_fatal("plugin_maglev: resource %s (%s): 'service_types' values must be strings", resname, stanza);
+                svc_names[i] = vscf_simple_get_data(svctype_cfg);
+            }
+        }
+    } else {
+        aset->num_svcs = 1;
+        svc_names = xmalloc(sizeof(*svc_names));
+        svc_names[0] = DEFAULT_SVCNAME;
+    }
+
+    double up_thresh = DEF_UP_THRESH;
+    vscf_data_t* up_thresh_cfg = vscf_hash_get_data_byconstkey(cfg, "up_thresh", true);
+    if (up_thresh_cfg) {
+        num_addrs--;
+        if (!vscf_is_simple(up_thresh_cfg) || !vscf_simple_get_as_double(up_thresh_cfg, &up_thresh)
+                || up_thresh <= 0.0 || up_thresh > 1.0)
+            log_fatal("plugin_maglev: resource %s (%s): 'up_thresh' must be a floating point value in the range (0.0 - 1.0]", resname, stanza);
+    }
+
+    unsigned long answer_count = 1;
+    vscf_data_t* answer_count_cfg = vscf_hash_get_data_byconstkey(cfg, "answer_count", true);
+    if (answer_count_cfg) {
+        num_addrs--;
+        if (!vscf_is_simple(answer_count_cfg) || !vscf_simple_get_as_ulong(answer_count_cfg, &answer_count)
+                || !answer_count || answer_count > MAX_ADDRS_PER_SET)
+            log_fatal("plugin_maglev: resource %s (%s): 'answer_count' must be an integer in the range 1 - %u", resname, stanza, MAX_ADDRS_PER_SET);
+    }
+
+    unsigned long table_size = DEF_TABLE_SIZE;
+    vscf_data_t* table_size_cfg = vscf_hash_get_data_byconstkey(cfg, "table_size", true);
+    if (table_size_cfg) {
+        num_addrs--;
+        if (!vscf_is_simple(table_size_cfg) || !vscf_simple_get_as_ulong(table_size_cfg, &table_size)
+                || table_size < MIN_TABLE_SIZE || table_size > MAX_TABLE_SIZE
+                || !is_prime((unsigned)table_size))
+            log_fatal("plugin_maglev: resource %s (%s): 'table_size' must be a prime number in the range %u - %u", resname, stanza, MIN_TABLE_SIZE, MAX_TABLE_SIZE);
+    }
+
+    if (!num_addrs)
+        log_fatal("plugin_maglev: resource '%s' (%s): must define one or more 'desc => IP' mappings, either directly or inside a subhash named 'addrs'", resname, stanza);
+    if (num_addrs > MAX_ADDRS_PER_SET)
+        log_fatal("plugin_maglev: resource '%s' (%s): number of addresses within one family cannot be more than %u", resname, stanza, MAX_ADDRS_PER_SET);
+    if (num_addrs > table_size)
+        log_fatal("plugin_maglev: resource '%s' (%s): 'table_size' (%lu) must be at least the number of addresses (%u)", resname, stanza, table_size, num_addrs);
+
+    aset->count = num_addrs;
+    aset->as = xcalloc_n(num_addrs, sizeof(*aset->as));
+    aset->up_thresh = gdnsd_uscale_ceil(aset->count, up_thresh);
+    aset->answer_count = answer_count < num_addrs ? (unsigned)answer_count : num_addrs;
+    aset->table_size = (unsigned)table_size;
+
+    addrs_iter_data_t aid = {
+        .resname = resname,
+        .stanza = stanza,
+        .svc_names = svc_names,
+        .aset = aset,
+        .idx = 0,
+        .ipv6 = ipv6,
+    };
+    vscf_hash_iterate(cfg, true, addr_setup, &aid);
+
+    free(svc_names);
+
+    if (destroy_cfg)
+        vscf_destroy(cfg);
+
+    uint64_t live[LIVE_WORDS];
+    live_set_all(live, aset->count);
+    aset->table_all = xmalloc(aset->table_size);
+    table_build(aset->table_all, aset, live);
+    aset->sel_idx = num_sels++;
+
+    if (ipv6) {
+        if (aset->answer_count > v6_max)
+            v6_max = aset->answer_count;
+    } else {
+        if (aset->answer_count > v4_max)
+            v4_max = aset->answer_count;
+    }
+}
+
+static void config_auto(res_t* res, const char* stanza, vscf_data_t* auto_cfg)
+{
+    bool destroy_cfg = false;
+    if (!vscf_is_hash(auto_cfg)) {
+        auto_cfg = addrs_hash_from_array(auto_cfg, res->name, stanza);
+        destroy_cfg = true;
+    }
+
+    // mark parameters
+    vscf_hash_get_data_byconstkey(auto_cfg, "up_thresh", true);
+    vscf_hash_get_data_byconstkey(auto_cfg, "service_types", true);
+    vscf_hash_get_data_byconstkey(auto_cfg, "answer_count", true);
+    vscf_hash_get_data_byconstkey(auto_cfg, "table_size", true);
+
+    // clone down to just address-label keys
+    vscf_data_t* auto_cfg_noparams = vscf_clone(auto_cfg, true);
+
+    if (!vscf_hash_get_len(auto_cfg_noparams))
+        log_fatal("plugin_maglev: resource '%s' (%s): no addresses defined!", res->name, stanza);
+
+    const char* first_name = vscf_hash_get_key_byindex(auto_cfg_noparams, 0, NULL);
+    vscf_data_t* first_cfg = vscf_hash_get_data_byindex(auto_cfg_noparams, 0);
+    if (!vscf_is_simple(first_cfg))
+        log_fatal("plugin_maglev: resource '%s' (%s): The value of '%s' must be an IP address in string form", res->name, stanza, first_name);
+    const char* addr_txt = vscf_simple_get_data(first_cfg);
+    gdnsd_anysin_t temp_asin;
+    const int addr_err = gdnsd_anysin_getaddrinfo(addr_txt, NULL, &temp_asin);
+    if (addr_err)
+        log_fatal("plugin_maglev: resource %s (%s): failed to parse address '%s' for '%s': %s", res->name, stanza, addr_txt, first_name, gai_strerror(addr_err));
+
+    if (temp_asin.sa.sa_family == AF_INET6) {
+        res->aset_v6 = xcalloc(sizeof(*res->aset_v6));
+        config_addrs(res->name, stanza, res->aset_v6, true, auto_cfg);
+    } else {
+        gdnsd_assert(temp_asin.sa.sa_family == AF_INET);
+        res->aset_v4 = xcalloc(sizeof(*res->aset_v4));
+        config_addrs(res->name, stanza, res->aset_v4, false, auto_cfg);
+    }
+
+    vscf_destroy(auto_cfg_noparams);
+    if (destroy_cfg)
+        vscf_destroy(auto_cfg);
+}
+
+F_NONNULL
+static bool config_res(const char* resname, unsigned resname_len V_UNUSED, vscf_data_t* opts, void* data)
+{
+    unsigned* residx_ptr = data;
+    unsigned rnum = *residx_ptr;
+    (*residx_ptr)++;
+    res_t* res = &resources[rnum];
+    res->name = xstrdup(resname);
+    gdnsd_res_index_add(&res_index, res->name, rnum);
+
+    vscf_data_t* addrs_v4_cfg = NULL;
+    vscf_data_t* addrs_v6_cfg = NULL;
+
+    if (vscf_is_hash(opts)) {
+        // inherit params downhill if applicable
+        vscf_hash_bequeath_all(opts, "up_thresh", true, false);
+        vscf_hash_bequeath_all(opts, "service_types", true, false);
+        vscf_hash_bequeath_all(opts, "answer_count", true, false);
+        vscf_hash_bequeath_all(opts, "table_size", true, false);
+
+        addrs_v4_cfg = vscf_hash_get_data_byconstkey(opts, "addrs_v4", true);
+        addrs_v6_cfg = vscf_hash_get_data_byconstkey(opts, "addrs_v6", true);
+
+        if (addrs_v4_cfg) {
+            res->aset_v4 = xcalloc(sizeof(*res->aset_v4));
+            config_addrs(resname, "addrs_v4", res->aset_v4, false, addrs_v4_cfg);
+        }
+
+        if (addrs_v6_cfg) {
+            res->aset_v6 = xcalloc(sizeof(*res->aset_v6));
+            config_addrs(resname, "addrs_v6", res->aset_v6, true, addrs_v6_cfg);
+        }
+    }
+
+    if (!addrs_v4_cfg && !addrs_v6_cfg)
+        config_auto(res, "direct", opts);
+    else if (vscf_is_hash(opts))
+        vscf_hash_iterate_const(opts, true, bad_res_opt, resname);
+    else
+        log_fatal("plugin_maglev: resource '%s': an empty array is not a valid resource config", resname);
+
+    return true;
+}
+
+// Recomputes an addrset's sel_t for a new sttl table generation
+F_NONNULL
+static void sel_update(sel_t* sel, const gdnsd_sttl_t* sttl_tbl, const addrset_t* aset, const unsigned gen)
+{
+    gdnsd_sttl_t rv = GDNSD_STTL_TTL_MAX;
+    uint64_t live[LIVE_WORDS];
+    memset(live, 0, sizeof(live));
+    unsigned num_live = 0;
+    for (unsigned i = 0; i < aset->count; i++) {
+        const addrstate_t* as = &aset->as[i];
+        const gdnsd_sttl_t as_sttl = gdnsd_sttl_min(sttl_tbl, as->indices, aset->num_svcs);
+        rv = gdnsd_sttl_min2(rv, as_sttl);
+        if (!(as_sttl & GDNSD_STTL_DOWN)) {
+            live_set(live, i);
+            num_live++;
+        }
+    }
+
+    // if up_thresh was not met, signal upstream failure through rv and use
+    //   all addresses, else force non-down response in retval, even if "rv"
+    //   currently has the down flag from the individual addrs
+    if (num_live < aset->up_thresh) {
+        rv |= GDNSD_STTL_DOWN;
+        live_set_all(live, aset->count);
+        num_live = aset->count;
+    } else {
+        rv &= ~GDNSD_STTL_DOWN;
+    }
+
+    if (num_live == aset->count) {
+        sel->table = aset->table_all;
+    } else if (!sel->own_table || sel->table != sel->own_table || memcmp(live, sel->live, sizeof(live))) {
+        if (!sel->own_table)
+            sel->own_table = xmalloc(aset->table_size);
+        table_build(sel->own_table, aset, live);
+        sel->table = sel->own_table;
+    }
+
+    memcpy(sel->live, live, sizeof(live));
+    sel->num_live = num_live;
+    sel->rv = rv;
+    sel->gen = gen;
+    sel->valid = true;
+}
+
+F_NONNULL
+static gdnsd_sttl_t resolve(const gdnsd_sttl_t* sttl_tbl, const unsigned gen, const addrset_t* aset, const uint32_t chash, dyn_result_t* result)
+{
+    sel_t* sel = &sels[aset->sel_idx];
+    if (!sel->valid || sel->gen != gen)
+        sel_update(sel, sttl_tbl, aset, gen);
+
+    const uint8_t* table = sel->table;
+    const unsigned tsize = aset->table_size;
+    unsigned slot = chash % tsize;
+
+    // The client keeps the address it has in the table over all addresses
+    //   for as long as that one is live, as a rebuilt table over the live
+    //   ones also moves a few slots between the live addresses.  Only the
+    //   clients of down addresses use the rebuilt table.
+    unsigned idx = aset->table_all[slot];
+    if (!live_test(sel->live, idx))
+        idx = table[slot];
+    gdnsd_result_add_anysin(result, &aset->as[idx].addr);
+
+    // Further addresses are the next distinct ones in the current table,
+    //   which are just as consistent while the set of live ones is unchanged
+    const unsigned want = aset->answer_count < sel->num_live
+                          ? aset->answer_count : sel->num_live;
+    if (want > 1U) {
+        uint64_t seen[LIVE_WORDS];
+        memset(seen, 0, sizeof(seen));
+        live_set(seen, idx);
+        unsigned have = 1;
+        while (have < want) {
+            if (++slot == tsize)
+                slot = 0;
+            idx = table[slot];
+            if (!live_test(seen, idx)) {
+                live_set(seen, idx);
+                gdnsd_result_add_anysin(result, &aset->as[idx].addr);
+                have++;
+            }
+        }
+    }
+
+    assert_valid_sttl(sel->rv);
+    return sel->rv;
+}
+
+/*********************************/
+/* Exported callbacks start here */
+/*********************************/
+
+static void plugin_maglev_load_config(vscf_data_t* config)
+{
+    if (!config)
+        log_fatal("maglev plugin requires a 'plugins' configuration stanza");
+
+    gdnsd_assert(vscf_is_hash(config));
+
+    num_resources = vscf_hash_get_len(config);
+
+    // inherit params downhill
+    if (vscf_hash_bequeath_all(config, "up_thresh", true, false))
+        num_resources--;
+    if (vscf_hash_bequeath_all(config, "service_types", true, false))
+        num_resources--;
+    if (vscf_hash_bequeath_all(config, "answer_count", true, false))
+        num_resources--;
+    if (vscf_hash_bequeath_all(config, "table_size", true, false))
+        num_resources--;
+
+    if (num_resources) {
+        resources = xcalloc_n(num_resources, sizeof(*resources));
+        unsigned residx = 0;
+        vscf_hash_iterate(config, true, config_res, &residx);
+        gdnsd_dyn_addr_max(v4_max, v6_max);
+    }
+}
+
+static int plugin_maglev_map_res(const char* resname, const uint8_t* zone_name)
+{
+    if (resname) {
+        if (zone_name)
+            log_warn("plugin_maglev: resource %s used from zone %s: DYNC configurations which can return IP address results are DEPRECATED and will be removed in a future version!", resname, logf_dname(zone_name));
+        const int rnum = gdnsd_res_index_find(&res_index, resname);
+        if (rnum >= 0)
+            return rnum;
+        log_err("plugin_maglev: Unknown resource '%s'", resname);
+    } else {
+        log_err("plugin_maglev: resource name required");
+    }
+
+    return -1;
+}
+
+static void plugin_maglev_iothread_init(void)
+{
+    if (num_sels)
+        sels = xcalloc_n(num_sels, sizeof(*sels));
+}
+
+static void plugin_maglev_iothread_cleanup(void)
+{
+    for (unsigned i = 0; i < num_sels; i++)
+        free(sels[i].own_table);
+    free(sels);
+    sels = NULL;
+}
+
+static gdnsd_sttl_t plugin_maglev_resolve(unsigned resnum, const client_info_t* cinfo, dyn_result_t* result)
+{
+    // The generation must be read before the table it covers
+    const unsigned gen = gdnsd_mon_get_sttl_gen();
+    const gdnsd_sttl_t* sttl_tbl = gdnsd_mon_get_sttl_table();
+
+    res_t* res = &resources[resnum];
+
+    unsigned scope;
+    const uint32_t chash = client_hash(cinfo, &scope);
+
+    gdnsd_sttl_t rv;
+
+    if (res->aset_v4) {
+        rv = resolve(sttl_tbl, gen, res->aset_v4, chash, result);
+        if (res->aset_v6) {
+            const unsigned v6_rv = resolve(sttl_tbl, gen, res->aset_v6, chash, result);
+            rv = gdnsd_sttl_min2(rv, v6_rv);
+        }
+    } else {
+        gdnsd_assert(res->aset_v6);
+        rv = resolve(sttl_tbl, gen, res->aset_v6, chash, result);
+    }
+
+    if (scope)
+        gdnsd_result_add_scope_mask(result, scope);
+
+    assert_valid_sttl(rv);
+    return rv;
+}
+
+plugin_t plugin_maglev_funcs = {
+    .name = "maglev",
+    .config_loaded = false,
+    .used = false,
+    .load_config = plugin_maglev_load_config,
+    .map_res = plugin_maglev_map_res,
+    .pre_run = NULL,
+    .iothread_init = plugin_maglev_iothread_init,
+    .iothread_cleanup = plugin_maglev_iothread_cleanup,
+    .resolve = plugin_maglev_resolve,
+    .add_svctype = NULL,
+    .add_mon_addr = NULL,
+    .add_mon_cname = NULL,
+    .init_monitors = NULL,
+    .start_monitors = NULL,
+    .get_metrics = NULL,
+};
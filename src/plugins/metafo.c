@@ -116,10 +116,24 @@ static const uint8_t* map_get_dclist(const unsigned mapnum, const client_info_t*
     return dclists[mapnum]->dc_list;
 }
 
+static unsigned map_get_gen(const unsigned mapnum V_UNUSED)
+{
+    return 0; // metafo's dclists never change at runtime
+}
+
+F_NONNULL
+static const gdnsd_anysin_t* map_get_cache_addr(const unsigned mapnum V_UNUSED, const client_info_t* cinfo V_UNUSED, bool* ecs_out)
+{
+    *ecs_out = false;
+    return NULL; // metafo's dclists don't depend on the client at all
+}
+
 #define PNSTR "metafo"
 #define CB_LOAD_CONFIG plugin_metafo_load_config
 #define CB_MAP plugin_metafo_map_res
 #define CB_RES plugin_metafo_resolve
+#define CB_IOTH_INIT plugin_metafo_iothread_init
+#define CB_IOTH_CLEANUP plugin_metafo_iothread_cleanup
 #define META_MAP_ADMIN 0
 #include "meta_core.inc"
 
@@ -130,12 +144,13 @@ plugin_t plugin_metafo_funcs = {
     .load_config = plugin_metafo_load_config,
     .map_res = plugin_metafo_map_res,
     .pre_run = NULL,
-    .iothread_init = NULL,
-    .iothread_cleanup = NULL,
+    .iothread_init = plugin_metafo_iothread_init,
+    .iothread_cleanup = plugin_metafo_iothread_cleanup,
     .resolve = plugin_metafo_resolve,
     .add_svctype = NULL,
     .add_mon_addr = NULL,
     .add_mon_cname = NULL,
     .init_monitors = NULL,
     .start_monitors = NULL,
+    .get_metrics = NULL,
 };
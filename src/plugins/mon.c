@@ -26,14 +26,19 @@
 #include "plugapi.h"
 #include <gdnsd/vscf.h>
 #include <gdnsd/misc.h>
+#include <gdnsd/mm3.h>
 
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
 #include <fnmatch.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 
 #include <ev.h>
 #include <urcu-qsbr.h>
+#include <urcu/uatomic.h>
 
 typedef struct {
     const char* name;
@@ -51,6 +56,10 @@ typedef struct {
 //   via mon_add_admin(), and cname/addr/dname
 //   are invalid.  Otherwise is_cname flags which
 //   member of the union is valid.
+// At runtime, n_failure, n_success, and mon_sttl belong to the monitoring
+//   thread which runs the smgr's monitor, q_sttl and q_pend are shared
+//   with the main thread (see mon_submit()), and the rest belong to the
+//   main thread.
 typedef struct {
     const char* desc;
     service_type_t* type;
@@ -62,73 +71,334 @@ typedef struct {
     unsigned n_failure;
     unsigned n_success;
     bool is_cname;
+    bool sttl_pend; // listed in sttl_pend[]
     gdnsd_sttl_t real_sttl;
+    gdnsd_sttl_t mon_sttl; // latest result, as seen by the monitoring thread
+    gdnsd_sttl_t q_sttl; // latest result handed to the main thread
+    unsigned q_pend; // listed in a shard's results ring
 } smgr_t;
 
 static unsigned num_svc_types = 0;
 static service_type_t* service_types = NULL;
 
 static unsigned num_smgrs = 0;
+static unsigned smgrs_alloc = 0; // allocated size of smgrs and the sttl tables and lists
 static smgr_t* smgrs = NULL;
 
-// There are two copies of the sttl table.
-// The "consumer" copy is always ready for consumption
-//   (via rcu deref) by other threads, and does not
-//   get mutated directly.  The updates flow into
-//   the non-consumer table and the tables are later
-//   rcu swapped (with the old copy updated to new values)
-// There are only ever the two chunks of memory that are
-//   first allocated for these, they just get swapped around
-//   and copied over each other.
-// (see sttl_table_update() below)
+// Hash index of the monitored (non-admin) smgrs by service type and address
+//   or CNAME, used to de-duplicate monitoring requests.  Entries are smgr
+//   index + 1, zero is empty, and it doubles in size whenever it would become
+//   more than half full.
+#define SMGR_INDEX_INIT 1024U // power of two
+static unsigned* smgr_index = NULL;
+static unsigned smgr_index_mask = 0;
+
+// There are three copies of the sttl table.
+// smgr_sttl is the working copy, which is only ever accessed from the main
+//   thread, and is where all updates land first.
+// The "consumer" copy is always ready for consumption (via rcu deref) by
+//   other threads, and does not get mutated directly.
+// The "spare" copy is the previous consumer copy, once a grace period has
+//   passed since it was replaced.  A publication brings the spare up to date
+//   with the working copy and rcu-swaps it in as the new consumer copy, and
+//   the old consumer copy becomes the spare again once the grace period
+//   thread (see sttl_grace_thread() below) says that it's no longer in use.
+//   While that's pending, there is no spare, and publications wait for it.
+// Only the changed entries are copied: each smgr index changed since the
+//   last publication is listed in sttl_pend, and the spare's list of entries
+//   it lacks (sttl_spare_chg) is exactly what was pending when it was
+//   retired, so the two lists together bring it up to date.
+// (see sttl_publish() below)
 static gdnsd_sttl_t* smgr_sttl = NULL;
+static gdnsd_sttl_t* sttl_spare = NULL;
+static gdnsd_sttl_t* sttl_retired = NULL; // in a grace period, if non-NULL
 gdnsd_sttl_t* smgr_sttl_consumer_ = NULL;
+unsigned smgr_sttl_gen_ = 0; // bumped after each swap
+
+static unsigned* sttl_pend = NULL;
+static unsigned num_sttl_pend = 0;
+static unsigned* sttl_spare_chg = NULL;
+static unsigned num_sttl_spare_chg = 0;
 
 static size_t max_states_len = 0;
 
 static bool initial_round = false;
 static bool testsuite_nodelay = false;
+// The testsuite normally also publishes state changes synchronously, but
+//   GDNSD_TESTSUITE_ASYNC_PUBLISH keeps the real, asynchronous publication
+//   path (with the configured delay) for the tests of that path itself.
+static bool testsuite_sync_publish = false;
 
 static struct ev_loop* mon_loop = NULL;
 static ev_timer sttl_update_timer;
+static ev_async sttl_grace_async;
+static double sttl_publish_delay = 0.2;
+static bool sttl_publish_deferred = false;
+
+// After the initial round, monitoring runs on dedicated threads, each with
+//   its own loop.  The smgrs are sharded over them by index for the plugins
+//   which have separate watchers per monitor, and other plugins run all of
+//   their watchers on the first shard's loop.  Each thread hands its results
+//   to the main thread through its shard's single-producer ring of smgr
+//   indices.  An smgr is listed at most once in the rings at any time (via
+//   q_pend), with only its latest result (q_sttl) applied when the main
+//   thread gets to it, so the rings can't overflow.
+// The probe timer wheel for one loop (see gdnsd_mon_probe_t in mon.h).
+//   Each level has 64 slots, which are 64 times as long as the ones in the
+//   level below, and the bottom level's slots are one tick.  Three levels
+//   cover a bit over 7 hours, which is more than the longest possible
+//   interval plus timeout.  Probes move down the levels as their expiry
+//   gets closer (the "cascade" in wheel_tick_cb()), so each probe is only
+//   touched a few times per interval, and each tick only looks at one slot.
+#define WHEEL_BITS 6U
+#define WHEEL_SLOTS (1U << WHEEL_BITS)
+#define WHEEL_MASK ((uint64_t)WHEEL_SLOTS - 1U)
+#define WHEEL_LEVELS 3U
+#define WHEEL_TICKS_PER_SEC 10U
+
+typedef enum {
+    PROBE_IDLE = 0,
+    PROBE_SCHEDULED, // in the wheel until due to start
+    PROBE_WAITING,   // due, but queued until an in-flight slot is free
+    PROBE_READY,     // given a freed slot, in the wheel to start next tick
+    PROBE_RUNNING,   // in the wheel until it times out
+} probe_state_t;
+
+typedef struct {
+    gdnsd_mon_probe_t* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    gdnsd_mon_probe_t* wait_head;
+    gdnsd_mon_probe_t* wait_tail;
+    struct ev_loop* loop;
+    ev_timer tick_timer;
+    ev_tstamp base;
+    uint64_t now; // current tick, counting from base
+    unsigned count; // probes in the wheel, the timer only runs if non-zero
+    unsigned inflight; // probes running or ready
+} mon_wheel_t;
+
+static mon_wheel_t main_wheel; // for the initial round on the main loop
+static unsigned cfg_max_inflight = 0;
+
+typedef struct {
+    struct ev_loop* loop;
+    unsigned* ring;
+    unsigned mask;
+    unsigned head; // written by producer only
+    unsigned tail; // written by consumer only
+    unsigned applied; // written by consumer only, see mon_submit()
+    mon_wheel_t wheel;
+} mon_shard_t;
+
+static mon_shard_t* shards = NULL;
+static unsigned num_shards = 0;
+static unsigned cfg_mon_threads = 1;
+static ev_async mon_results_async;
+static __thread mon_shard_t* this_shard = NULL;
+
+// Signalling from the main thread to the grace period thread
+static pthread_mutex_t sttl_grace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sttl_grace_cond = PTHREAD_COND_INITIALIZER;
+static bool sttl_grace_wanted = false;
+
+// Publication stats, for the metrics output.  Only the main thread touches
+//   these.
+static ev_tstamp sttl_first_pend_at = 0.0;
+static ev_tstamp sttl_published_at = 0.0;
+static uint64_t sttl_stat_publications = 0;
+static uint64_t sttl_stat_entries = 0;
+static double sttl_stat_propagation = 0.0;
+static double sttl_stat_propagation_max = 0.0;
+static double sttl_stat_grace = 0.0;
+static double sttl_stat_grace_max = 0.0;
 
 #define DEF_UP_THRESH 20
 #define DEF_OK_THRESH 10
 #define DEF_DOWN_THRESH 10
 #define DEF_INTERVAL 10
 
+// Runs a grace period for each table retired by sttl_publish(), so that the
+//   main thread never blocks in synchronize_rcu() itself, which can take as
+//   long as the slowest I/O thread's receive timeout.
+F_NORETURN
+static void* sttl_grace_thread(void* unused V_UNUSED)
+{
+    gdnsd_thread_setname("gdnsd-mon-rcu");
+    while (1) {
+        pthread_mutex_lock(&sttl_grace_lock);
+        while (!sttl_grace_wanted)
+            pthread_cond_wait(&sttl_grace_cond, &sttl_grace_lock);
+        sttl_grace_wanted = false;
+        pthread_mutex_unlock(&sttl_grace_lock);
+        synchronize_rcu();
+        ev_async* sga = &sttl_grace_async;
+        ev_async_send(mon_loop, sga);
+    }
+}
+
+F_NONNULLX(1, 3)
+static void mon_spawn_thread(void* (*func)(void*), void* arg, const char* what)
+{
+    sigset_t sigmask_all;
+    sigfillset(&sigmask_all);
+    sigset_t sigmask_prev;
+    sigemptyset(&sigmask_prev);
+    if (pthread_sigmask(SIG_SETMASK, &sigmask_all, &sigmask_prev))
+        log_fatal("pthread_sigmask() failed");
+
+    pthread_attr_t attribs;
+    pthread_attr_init(&attribs);
+    pthread_attr_setdetachstate(&attribs, PTHREAD_CREATE_DETACHED);
+    pthread_t threadid;
+    const int pthread_err = pthread_create(&threadid, &attribs, func, arg);
+    if (pthread_err)
+        log_fatal("pthread_create() of %s thread failed: %s", what, logf_strerror(pthread_err));
+
+    if (pthread_sigmask(SIG_SETMASK, &sigmask_prev, NULL))
+        log_fatal("pthread_sigmask() failed");
+    pthread_attr_destroy(&attribs);
+}
+
+// Records a change to the working table, for the next publication
+static void sttl_set(const unsigned idx, const gdnsd_sttl_t val)
+{
+    gdnsd_assert(idx < num_smgrs);
+    smgr_sttl[idx] = val;
+    if (!smgrs[idx].sttl_pend) {
+        smgrs[idx].sttl_pend = true;
+        if (!num_sttl_pend)
+            sttl_first_pend_at = ev_time();
+        sttl_pend[num_sttl_pend++] = idx;
+    }
+}
+
+// The retired table becomes the spare once its grace period is over
+static void sttl_recycle(void)
+{
+    gdnsd_assert(sttl_retired);
+    gdnsd_assert(!sttl_spare);
+
+    const double grace = ev_time() - sttl_published_at;
+    sttl_stat_grace += grace;
+    if (grace > sttl_stat_grace_max)
+        sttl_stat_grace_max = grace;
+
+    sttl_spare = sttl_retired;
+    sttl_retired = NULL;
+}
+
+static void sttl_publish(void)
+{
+    gdnsd_assert(sttl_spare);
+    gdnsd_assert(!sttl_retired);
+
+    // bring the spare up to date with the working table
+    for (unsigned i = 0; i < num_sttl_spare_chg; i++) {
+        const unsigned idx = sttl_spare_chg[i];
+        sttl_spare[idx] = smgr_sttl[idx];
+    }
+    for (unsigned i = 0; i < num_sttl_pend; i++) {
+        const unsigned idx = sttl_pend[i];
+        sttl_spare[idx] = smgr_sttl[idx];
+        smgrs[idx].sttl_pend = false;
+    }
+    sttl_stat_entries += num_sttl_spare_chg + num_sttl_pend;
+
+    // rcu-swap it in, and retire the old consumer table
+    sttl_retired = smgr_sttl_consumer_;
+    rcu_assign_pointer(smgr_sttl_consumer_, sttl_spare);
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(smgr_sttl_gen_, smgr_sttl_gen_ + 1U);
+    sttl_spare = NULL;
+
+    // The retired table lacks exactly the changes that were just pending
+    unsigned* old_spare_chg = sttl_spare_chg;
+    sttl_spare_chg = sttl_pend;
+    num_sttl_spare_chg = num_sttl_pend;
+    sttl_pend = old_spare_chg;
+    num_sttl_pend = 0;
+
+    sttl_published_at = ev_time();
+    const double prop = sttl_published_at - sttl_first_pend_at;
+    sttl_stat_publications++;
+    sttl_stat_propagation += prop;
+    if (prop > sttl_stat_propagation_max)
+        sttl_stat_propagation_max = prop;
+
+    if (testsuite_sync_publish) {
+        // the testsuite expects changes to be visible as soon as they're
+        //   logged, so it waits out the grace period right here
+        synchronize_rcu();
+        sttl_recycle();
+    } else {
+        pthread_mutex_lock(&sttl_grace_lock);
+        sttl_grace_wanted = true;
+        pthread_cond_signal(&sttl_grace_cond);
+        pthread_mutex_unlock(&sttl_grace_lock);
+    }
+}
+
 F_NONNULL
-static void sttl_table_update(struct ev_loop* loop V_UNUSED, ev_timer* w V_UNUSED, int revents V_UNUSED) // cppcheck-suppress constParameter
+static void sttl_update_timer_cb(struct ev_loop* loop V_UNUSED, ev_timer* w V_UNUSED, int revents V_UNUSED) // cppcheck-suppress constParameter
 {
     gdnsd_assert(w == &sttl_update_timer);
     gdnsd_assert(revents == EV_TIMER);
 
-    // rcu-swap of the two tables
-    gdnsd_sttl_t* saved_old_consumer = smgr_sttl_consumer_;
-    rcu_assign_pointer(smgr_sttl_consumer_, smgr_sttl);
-    synchronize_rcu();
-    smgr_sttl = saved_old_consumer;
+    if (!num_sttl_pend)
+        return;
+    if (sttl_retired)
+        sttl_publish_deferred = true;
+    else
+        sttl_publish();
+}
+
+F_NONNULL
+static void sttl_grace_done(struct ev_loop* loop V_UNUSED, ev_async* w V_UNUSED, int revents V_UNUSED) // cppcheck-suppress constParameter
+{
+    gdnsd_assert(w == &sttl_grace_async);
+    gdnsd_assert(revents == EV_ASYNC);
+
+    sttl_recycle();
 
-    // now copy the (new) consumer table back over the old one
-    //   that we're using for future offline updates until the next swap
-    memcpy(smgr_sttl, smgr_sttl_consumer_, sizeof(*smgr_sttl) * num_smgrs);
+    // a publication that came due during the grace period goes out now
+    if (sttl_publish_deferred) {
+        sttl_publish_deferred = false;
+        if (num_sttl_pend)
+            sttl_publish();
+    }
 }
 
 // anything that ends up changing a value in smgr_sttl[] calls
 //   this to push the updates towards visibility to consumers.
-// the timer coalesces rapid-fire updates into at most one table-swap
-//   per second, at the cost of a second of latency on updates.
+// the timer coalesces rapid-fire updates into at most one publication
+//   per sttl_publish_delay, at the cost of that much latency on updates,
+//   and publications are further limited to one per grace period.
 static void kick_sttl_update_timer(void)
 {
     ev_timer* sut = &sttl_update_timer;
-    if (testsuite_nodelay) {
-        sttl_table_update(mon_loop, sut, EV_TIMER);
+    if (testsuite_sync_publish) {
+        sttl_publish();
     } else if (!ev_is_active(sut) && !ev_is_pending(sut)) {
-        ev_timer_set(sut, 1.0, 0.0);
+        ev_timer_set(sut, sttl_publish_delay, 0.0);
         ev_timer_start(mon_loop, sut);
     }
 }
 
+void gdnsd_mon_cfg_publish_delay(const double delay)
+{
+    sttl_publish_delay = delay;
+}
+
+void gdnsd_mon_cfg_threads(const unsigned threads)
+{
+    gdnsd_assert(threads);
+    cfg_mon_threads = threads;
+}
+
+void gdnsd_mon_cfg_max_inflight(const unsigned max_inflight)
+{
+    cfg_max_inflight = max_inflight;
+}
+
 const char* gdnsd_logf_sttl(const gdnsd_sttl_t s)
 {
     // the maximal length here is "DOWN/268435455"
@@ -157,6 +427,13 @@ const char* gdnsd_logf_sttl(const gdnsd_sttl_t s)
 static ev_stat admin_file_watcher;
 static ev_timer admin_quiesce_timer;
 
+// The smgr indices sorted by desc, so that admin_state entries only have to
+//   look at the descs which start with their literal prefix (all of an
+//   exact-match entry), instead of fnmatch()-ing every smgr.  It's rebuilt
+//   whenever the count of smgrs has changed since it was last built.
+static unsigned* admin_index = NULL;
+static unsigned admin_index_len = 0;
+
 // shared with plugin_extfile!
 bool gdnsd_mon_parse_sttl(const char* sttl_str, gdnsd_sttl_t* sttl_out, unsigned def_ttl)
 {
@@ -194,6 +471,40 @@ bool gdnsd_mon_parse_sttl(const char* sttl_str, gdnsd_sttl_t* sttl_out, unsigned
     return failed;
 }
 
+F_NONNULL F_PURE
+static int admin_index_cmp(const void* x, const void* y)
+{
+    const unsigned* xi = x;
+    const unsigned* yi = y;
+    return strcmp(smgrs[*xi].desc, smgrs[*yi].desc);
+}
+
+static void admin_index_build(void)
+{
+    admin_index = xrealloc_n(admin_index, num_smgrs, sizeof(*admin_index));
+    for (unsigned i = 0; i < num_smgrs; i++)
+        admin_index[i] = i;
+    qsort(admin_index, num_smgrs, sizeof(*admin_index), admin_index_cmp);
+    admin_index_len = num_smgrs;
+}
+
+// The first position in admin_index whose desc is not less than the first
+//   "len" bytes of "prefix"
+F_NONNULL F_PURE
+static unsigned admin_index_lower(const char* prefix, const size_t len)
+{
+    unsigned lo = 0;
+    unsigned hi = admin_index_len;
+    while (lo < hi) {
+        const unsigned mid = lo + ((hi - lo) >> 1);
+        if (strncmp(smgrs[admin_index[mid]].desc, prefix, len) < 0)
+            lo = mid + 1U;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
 F_NONNULL
 static bool admin_process_entry(const char* matchme, gdnsd_sttl_t* updates, gdnsd_sttl_t update_val)
 {
@@ -203,18 +514,32 @@ static bool admin_process_entry(const char* matchme, gdnsd_sttl_t* updates, gdns
     bool success = true;
     bool matched = false;
 
-    for (unsigned i = 0; i < num_smgrs; i++) {
-        smgr_t* smgr = &smgrs[i];
-        int err = fnmatch(matchme, smgr->desc, 0);
-        if (err && err != FNM_NOMATCH) {
-            log_err("admin_state: fnmatch() failed with error code %i: probably glob-parsing error on '%s'", err, matchme);
-            success = false;
+    // Only descs starting with the part of matchme before any glob
+    //   metacharacters can match, and they're contiguous in the index.  If
+    //   that's all of matchme, it's an exact match and fnmatch() isn't needed.
+    const size_t plen = strcspn(matchme, "*?[\\");
+    const bool exact = !matchme[plen];
+
+    for (unsigned j = admin_index_lower(matchme, plen); j < admin_index_len; j++) {
+        const unsigned i = admin_index[j];
+        const smgr_t* smgr = &smgrs[i];
+        if (strncmp(smgr->desc, matchme, plen))
             break;
+        if (exact) {
+            if (smgr->desc[plen])
+                break; // longer descs with matchme as a prefix sort after
+        } else {
+            int err = fnmatch(matchme, smgr->desc, 0);
+            if (err && err != FNM_NOMATCH) {
+                log_err("admin_state: fnmatch() failed with error code %i: probably glob-parsing error on '%s'", err, matchme);
+                success = false;
+                break;
+            }
+            if (err)
+                continue;
         }
-        if (!err) { // matched!
-            matched = true;
-            updates[i] = update_val;
-        }
+        matched = true;
+        updates[i] = update_val;
     }
 
     if (success && !matched)
@@ -231,6 +556,9 @@ static bool admin_process_hash(vscf_data_t* raw, const bool check_only)
     if (!num_smgrs)
         return true;
 
+    if (admin_index_len != num_smgrs)
+        admin_index_build();
+
     gdnsd_sttl_t* updates = xcalloc_n(num_smgrs, sizeof(*updates));
 
     const unsigned num_raw = vscf_hash_get_len(raw);
@@ -267,12 +595,12 @@ static bool admin_process_hash(vscf_data_t* raw, const bool check_only)
                         log_info("admin_state: state of '%s' re-forced from %s to %s, real state is %s", smgrs[i].desc, logf_sttl(smgr_sttl[i]), logf_sttl(updates[i]), smgrs[i].type ? logf_sttl(smgrs[i].real_sttl) : "NA");
                     else
                         log_info("admin_state: state of '%s' forced to %s, real state is %s", smgrs[i].desc, logf_sttl(updates[i]), smgrs[i].type ? logf_sttl(smgrs[i].real_sttl) : "NA");
-                    smgr_sttl[i] = updates[i];
+                    sttl_set(i, updates[i]);
                     affected = true;
                 }
             } else if (smgr_sttl[i] & GDNSD_STTL_FORCED) { // was forced before, isn't now
                 log_info("admin_state: state of '%s' no longer forced (was forced to %s), real and current state is %s", smgrs[i].desc, logf_sttl(smgr_sttl[i]), smgrs[i].type ? logf_sttl(smgrs[i].real_sttl) : "NA");
-                smgr_sttl[i] = smgrs[i].real_sttl;
+                sttl_set(i, smgrs[i].real_sttl);
                 gdnsd_assert(!(smgr_sttl[i] & GDNSD_STTL_FORCED));
                 affected = true;
             }
@@ -327,7 +655,7 @@ static void admin_deleted_file(const char* pathname)
     for (unsigned i = 0; i < num_smgrs; i++) {
         if (smgr_sttl[i] & GDNSD_STTL_FORCED) {
             log_info("admin_state: state of '%s' no longer forced (was forced to %s), real and current state is %s", smgrs[i].desc, logf_sttl(smgr_sttl[i]), smgrs[i].type ? logf_sttl(smgrs[i].real_sttl) : "NA");
-            smgr_sttl[i] = smgrs[i].real_sttl;
+            sttl_set(i, smgrs[i].real_sttl);
             gdnsd_assert(!(smgr_sttl[i] & GDNSD_STTL_FORCED));
             affected = true;
         }
@@ -385,6 +713,234 @@ static void admin_init(struct ev_loop* mloop)
         log_info("admin_state: state file '%s' does not yet exist at startup", pathname);
 }
 
+//--------------------------------------------------
+// probe scheduling
+//--------------------------------------------------
+
+F_NONNULL F_PURE
+static uint64_t wheel_cur_tick(const mon_wheel_t* w)
+{
+    const ev_tstamp elapsed = ev_now(w->loop) - w->base;
+    return elapsed > 0.0 ? (uint64_t)(elapsed * WHEEL_TICKS_PER_SEC) : 0U;
+}
+
+// An idle wheel's clock stops, so catch it up before scheduling
+F_NONNULL
+static void wheel_sync(mon_wheel_t* w)
+{
+    if (!w->count) {
+        const uint64_t cur = wheel_cur_tick(w);
+        if (cur > w->now)
+            w->now = cur;
+    }
+}
+
+F_NONNULL
+static void wheel_link(mon_wheel_t* w, gdnsd_mon_probe_t* p)
+{
+    if (p->expires <= w->now)
+        p->expires = w->now + 1U;
+    const uint64_t delta = p->expires - w->now;
+    gdnsd_assert(delta < (1ULL << (WHEEL_BITS * WHEEL_LEVELS)));
+    unsigned lvl = 0;
+    while (delta >= (1ULL << (WHEEL_BITS * (lvl + 1U))))
+        lvl++;
+    gdnsd_mon_probe_t** head = &w->slots[lvl][(p->expires >> (WHEEL_BITS * lvl)) & WHEEL_MASK];
+    p->next = *head;
+    if (p->next)
+        p->next->pprev = &p->next;
+    p->pprev = head;
+    *head = p;
+}
+
+F_NONNULL
+static void wheel_insert(mon_wheel_t* w, gdnsd_mon_probe_t* p)
+{
+    wheel_sync(w);
+    wheel_link(w, p);
+    if (!w->count++) {
+        ev_timer* tt = &w->tick_timer;
+        ev_timer_start(w->loop, tt);
+    }
+}
+
+F_NONNULL
+static void wheel_remove(mon_wheel_t* w, gdnsd_mon_probe_t* p)
+{
+    gdnsd_assert(p->pprev);
+    *p->pprev = p->next;
+    if (p->next)
+        p->next->pprev = p->pprev;
+    p->next = NULL;
+    p->pprev = NULL;
+    gdnsd_assert(w->count);
+    if (!--w->count) {
+        ev_timer* tt = &w->tick_timer;
+        ev_timer_stop(w->loop, tt);
+    }
+}
+
+// Schedules the next start of a probe which just finished, skipping any
+//   rounds it has overrun.  There's no next start during the initial round.
+F_NONNULL
+static void probe_next(mon_wheel_t* w, gdnsd_mon_probe_t* p)
+{
+    if (initial_round) {
+        p->state = PROBE_IDLE;
+        return;
+    }
+    const uint64_t ival = (uint64_t)p->interval * WHEEL_TICKS_PER_SEC;
+    p->due += ival;
+    if (p->due <= w->now)
+        p->due += ((w->now - p->due) / ival + 1U) * ival;
+    p->state = PROBE_SCHEDULED;
+    p->expires = p->due;
+    wheel_insert(w, p);
+}
+
+// Passes a finished probe's in-flight slot on to the next waiting probe
+F_NONNULL
+static void probe_release_slot(mon_wheel_t* w)
+{
+    gdnsd_mon_probe_t* p = w->wait_head;
+    if (p) {
+        w->wait_head = p->next;
+        if (!w->wait_head)
+            w->wait_tail = NULL;
+        p->next = NULL;
+        p->state = PROBE_READY;
+        p->expires = w->now + 1U;
+        wheel_insert(w, p);
+    } else {
+        gdnsd_assert(w->inflight);
+        w->inflight--;
+    }
+}
+
+F_NONNULL
+static void probe_fire(mon_wheel_t* w, gdnsd_mon_probe_t* p)
+{
+    switch (p->state) {
+    case PROBE_SCHEDULED:
+        if (!initial_round && cfg_max_inflight && w->inflight >= cfg_max_inflight) {
+            p->state = PROBE_WAITING;
+            p->next = NULL;
+            if (w->wait_tail)
+                w->wait_tail->next = p;
+            else
+                w->wait_head = p;
+            w->wait_tail = p;
+            return;
+        }
+        w->inflight++;
+    // fall through
+    case PROBE_READY:
+        p->state = PROBE_RUNNING;
+        p->expires = w->now + (uint64_t)p->timeout * WHEEL_TICKS_PER_SEC;
+        wheel_insert(w, p);
+        p->start_cb(w->loop, p);
+        break;
+    case PROBE_RUNNING:
+        p->timeout_cb(w->loop, p);
+        probe_release_slot(w);
+        probe_next(w, p);
+        break;
+    default:
+        gdnsd_assert(0);
+    }
+}
+
+F_NONNULL
+static void wheel_tick_cb(struct ev_loop* loop V_UNUSED, ev_timer* t, int revents V_UNUSED)
+{
+    gdnsd_assert(revents == EV_TIMER);
+    mon_wheel_t* w = t->data;
+    gdnsd_assert(w->loop == loop);
+
+    const uint64_t target = wheel_cur_tick(w);
+    while (w->count && w->now < target) {
+        w->now++;
+
+        // When a level's slot index wraps, move the next slot of the level
+        //   above down into the lower levels
+        uint64_t upper = w->now;
+        for (unsigned lvl = 1; lvl < WHEEL_LEVELS && !(upper & WHEEL_MASK); lvl++) {
+            upper >>= WHEEL_BITS;
+            gdnsd_mon_probe_t** head = &w->slots[lvl][upper & WHEEL_MASK];
+            gdnsd_mon_probe_t* p = *head;
+            *head = NULL;
+            while (p) {
+                gdnsd_mon_probe_t* next = p->next;
+                wheel_link(w, p);
+                p = next;
+            }
+        }
+
+        gdnsd_mon_probe_t** head = &w->slots[0][w->now & WHEEL_MASK];
+        while (*head) {
+            gdnsd_mon_probe_t* p = *head;
+            gdnsd_assert(p->expires == w->now);
+            wheel_remove(w, p);
+            probe_fire(w, p);
+        }
+    }
+
+    if (w->now < target)
+        w->now = target;
+}
+
+F_NONNULL
+static void wheel_init(mon_wheel_t* w, struct ev_loop* loop)
+{
+    memset(w, 0, sizeof(*w));
+    w->loop = loop;
+    w->base = ev_now(loop);
+    ev_timer* tt = &w->tick_timer;
+    ev_timer_init(tt, wheel_tick_cb, 1.0 / WHEEL_TICKS_PER_SEC, 1.0 / WHEEL_TICKS_PER_SEC);
+    tt->data = w;
+    ev_set_userdata(loop, w);
+}
+
+void gdnsd_mon_probe_init(gdnsd_mon_probe_t* probe, const unsigned idx, const unsigned interval, const unsigned timeout, gdnsd_mon_probe_cb_t start_cb, gdnsd_mon_probe_cb_t timeout_cb, void* data)
+{
+    memset(probe, 0, sizeof(*probe));
+    probe->start_cb = start_cb;
+    probe->timeout_cb = timeout_cb;
+    probe->data = data;
+    probe->idx = idx;
+    probe->interval = interval;
+    probe->timeout = timeout;
+    probe->state = PROBE_IDLE;
+}
+
+void gdnsd_mon_probe_start(struct ev_loop* loop, gdnsd_mon_probe_t* probe)
+{
+    mon_wheel_t* w = ev_userdata(loop);
+    gdnsd_assert(w && w->loop == loop);
+    gdnsd_assert(probe->state == PROBE_IDLE);
+
+    wheel_sync(w);
+    probe->due = w->now;
+    if (!initial_round) {
+        const unsigned ival = probe->interval * WHEEL_TICKS_PER_SEC;
+        probe->due += hash_mm3_u32((const uint8_t*)&probe->idx, sizeof(probe->idx)) % ival;
+    }
+    probe->state = PROBE_SCHEDULED;
+    probe->expires = probe->due;
+    wheel_insert(w, probe);
+}
+
+void gdnsd_mon_probe_done(struct ev_loop* loop, gdnsd_mon_probe_t* probe)
+{
+    mon_wheel_t* w = ev_userdata(loop);
+    gdnsd_assert(w && w->loop == loop);
+    gdnsd_assert(probe->state == PROBE_RUNNING);
+
+    wheel_remove(w, probe);
+    probe_release_slot(w);
+    probe_next(w, probe);
+}
+
 //--------------------------------------------------
 // core monitoring stuff
 //--------------------------------------------------
@@ -409,6 +965,10 @@ void gdnsd_mon_check_admin_file(void)
 // from JSON states output stuff below
 static void init_max_states_len(void);
 
+// from the monitoring results stuff below
+F_NONNULL
+static void mon_results_cb(struct ev_loop* loop, ev_async* w, int revents);
+
 // Called once after all servicetypes and monitored stuff
 //  have been configured, from main thread.  mloop happens
 //  to be the default loop currently, and should be empty of
@@ -422,8 +982,11 @@ void gdnsd_mon_start(struct ev_loop* mloop)
     if (!num_smgrs)
         return;
 
-    if (getenv("GDNSD_TESTSUITE_NODELAY"))
+    if (getenv("GDNSD_TESTSUITE_NODELAY")) {
         testsuite_nodelay = true;
+        if (!getenv("GDNSD_TESTSUITE_ASYNC_PUBLISH"))
+            testsuite_sync_publish = true;
+    }
 
     // saved for timer usage later
     mon_loop = mloop;
@@ -433,6 +996,7 @@ void gdnsd_mon_start(struct ev_loop* mloop)
     // any artificial delays).
     log_info("Starting initial round of monitoring ...");
     initial_round = true;
+    wheel_init(&main_wheel, mloop);
     gdnsd_plugins_action_init_monitors(mloop);
     ev_run(mloop, 0);
     log_info("Initial round of monitoring complete");
@@ -443,18 +1007,74 @@ void gdnsd_mon_start(struct ev_loop* mloop)
     // this flag prevents table update timers for admin_init stuff as well!
     initial_round = false;
 
-    // set up the table-update coalescing timer
+    // Publish the initial round results directly.  There are no I/O
+    //   threads reading the tables yet, so no grace period is needed, and
+    //   nothing is pending afterwards.
+    memcpy(smgr_sttl_consumer_, smgr_sttl, sizeof(*smgr_sttl) * num_smgrs);
+    memcpy(sttl_spare, smgr_sttl, sizeof(*smgr_sttl) * num_smgrs);
+    for (unsigned i = 0; i < num_sttl_pend; i++)
+        smgrs[sttl_pend[i]].sttl_pend = false;
+    num_sttl_pend = 0;
+    num_sttl_spare_chg = 0;
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(smgr_sttl_gen_, smgr_sttl_gen_ + 1U);
+
+    // set up the table-update coalescing timer, and the grace period
+    //   thread and its completion notification
     ev_timer* sut = &sttl_update_timer;
-    ev_timer_init(sut, sttl_table_update, 1.0, 0.0);
+    ev_timer_init(sut, sttl_update_timer_cb, sttl_publish_delay, 0.0);
+    if (!testsuite_sync_publish) {
+        ev_async* sga = &sttl_grace_async;
+        ev_async_init(sga, sttl_grace_done);
+        ev_async_start(mloop, sga);
+        mon_spawn_thread(sttl_grace_thread, NULL, "monitoring grace period");
+    }
+
+    // Set up the monitoring shards, each with a results ring big enough
+    //   for every smgr, as plugins on the first shard's loop can update any
+    //   of them
+    num_shards = cfg_mon_threads < num_smgrs ? cfg_mon_threads : num_smgrs;
+    unsigned ring_size = 1U;
+    while (ring_size < num_smgrs)
+        ring_size <<= 1U;
+    shards = xcalloc_n(num_shards, sizeof(*shards));
+    for (unsigned i = 0; i < num_shards; i++) {
+        shards[i].loop = ev_loop_new(EVFLAG_AUTO);
+        if (!shards[i].loop)
+            log_fatal("Could not initialize a libev loop for monitoring");
+        shards[i].ring = xmalloc_n(ring_size, sizeof(*shards[i].ring));
+        shards[i].mask = ring_size - 1U;
+        wheel_init(&shards[i].wheel, shards[i].loop);
+    }
+    ev_async* mra = &mon_results_async;
+    ev_async_init(mra, mon_results_cb);
+    ev_async_start(mloop, mra);
 
-    // trigger it once manually to invoke rcu stuff
-    //   for the initial round results to ensure there's
-    //   no confusion.
-    sttl_table_update(mloop, sut, EV_TIMER);
+    // add real watchers to the shard loops for runtime
+    //   (the loops themselves begin execution in gdnsd_mon_start_threads())
+    gdnsd_plugins_action_start_monitors(shards[0].loop);
+}
+
+F_NONNULL
+static void* mon_shard_thread(void* arg)
+{
+    gdnsd_thread_setname("gdnsd-mon");
+    this_shard = arg;
+    ev_run(this_shard->loop, 0);
+    return NULL;
+}
+
+void gdnsd_mon_start_threads(void)
+{
+    for (unsigned i = 0; i < num_shards; i++)
+        mon_spawn_thread(mon_shard_thread, &shards[i], "monitoring");
+}
 
-    // add real watchers to the monitor loop for runtime
-    //   (the loop itself begins execution later back in main.c)
-    gdnsd_plugins_action_start_monitors(mloop);
+struct ev_loop* gdnsd_mon_get_loop(const unsigned idx)
+{
+    gdnsd_assert(idx < num_smgrs);
+    gdnsd_assert(num_shards);
+    return shards[idx % num_shards].loop;
 }
 
 // We only have to check the address, because the port
@@ -474,6 +1094,64 @@ static bool addr_eq(const gdnsd_anysin_t* a, const gdnsd_anysin_t* b)
     return rv;
 }
 
+// Exactly one of addr or dname is non-NULL
+F_NONNULLX(1)
+static unsigned smgr_hash(const service_type_t* type, const gdnsd_anysin_t* addr, const uint8_t* dname)
+{
+    size_t h;
+    if (addr) {
+        if (addr->sa.sa_family == AF_INET)
+            h = hash_mm3_sz((const uint8_t*)&addr->sin4.sin_addr.s_addr, sizeof(addr->sin4.sin_addr.s_addr));
+        else
+            h = hash_mm3_sz(addr->sin6.sin6_addr.s6_addr, 16U);
+    } else {
+        h = ~hash_mm3_sz(dname, dname[0] + 1U);
+    }
+    return (unsigned)h ^ ((unsigned)(type - service_types) * 0x9E3779B1U);
+}
+
+F_NONNULL F_PURE
+static unsigned smgr_hash_existing(const smgr_t* smgr)
+{
+    gdnsd_assert(smgr->type);
+    return smgr->is_cname
+           ? smgr_hash(smgr->type, NULL, smgr->dname)
+           : smgr_hash(smgr->type, &smgr->addr, NULL);
+}
+
+static void smgr_index_grow(void)
+{
+    const unsigned old_size = smgr_index ? smgr_index_mask + 1U : 0;
+    const unsigned new_size = old_size ? old_size << 1 : SMGR_INDEX_INIT;
+    unsigned* old_index = smgr_index;
+    smgr_index = xcalloc_n(new_size, sizeof(*smgr_index));
+    smgr_index_mask = new_size - 1U;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_index[i]) {
+            unsigned slot = smgr_hash_existing(&smgrs[old_index[i] - 1U]) & smgr_index_mask;
+            while (smgr_index[slot])
+                slot = (slot + 1U) & smgr_index_mask;
+            smgr_index[slot] = old_index[i];
+        }
+    }
+    free(old_index);
+}
+
+// Returns the index of a new smgr, growing the arrays by doubling
+static unsigned smgr_alloc(void)
+{
+    if (num_smgrs == smgrs_alloc) {
+        smgrs_alloc = smgrs_alloc ? smgrs_alloc << 1 : 64U;
+        smgrs = xrealloc_n(smgrs, smgrs_alloc, sizeof(*smgrs));
+        smgr_sttl = xrealloc_n(smgr_sttl, smgrs_alloc, sizeof(*smgr_sttl));
+        smgr_sttl_consumer_ = xrealloc_n(smgr_sttl_consumer_, smgrs_alloc, sizeof(*smgr_sttl_consumer_));
+        sttl_spare = xrealloc_n(sttl_spare, smgrs_alloc, sizeof(*sttl_spare));
+        sttl_pend = xrealloc_n(sttl_pend, smgrs_alloc, sizeof(*sttl_pend));
+        sttl_spare_chg = xrealloc_n(sttl_spare_chg, smgrs_alloc, sizeof(*sttl_spare_chg));
+    }
+    return num_smgrs++;
+}
+
 F_NONNULLX(1)
 static unsigned mon_thing(const char* svctype_name, const gdnsd_anysin_t* addr, const char* cname, const uint8_t* dname)
 {
@@ -498,24 +1176,26 @@ static unsigned mon_thing(const char* svctype_name, const gdnsd_anysin_t* addr,
     // next, check if this is a duplicate of a request issued earlier
     //   by some other plugin/resource, in which case we can just give
     //   them the existing index
-    if (addr) {
-        for (unsigned i = 0; i < num_smgrs; i++) {
-            smgr_t* that_smgr = &smgrs[i];
-            if (!that_smgr->is_cname && addr_eq(addr, &that_smgr->addr) && this_svc == that_smgr->type)
-                return i;
-        }
-    } else {
-        for (unsigned i = 0; i < num_smgrs; i++) {
-            smgr_t* that_smgr = &smgrs[i];
-            if (that_smgr->is_cname && !gdnsd_dname_cmp(dname, that_smgr->dname) && this_svc == that_smgr->type)
-                return i;
+    if (!smgr_index)
+        smgr_index_grow();
+    unsigned slot = smgr_hash(this_svc, addr, dname) & smgr_index_mask;
+    while (smgr_index[slot]) {
+        const unsigned i = smgr_index[slot] - 1U;
+        const smgr_t* that_smgr = &smgrs[i];
+        if (this_svc == that_smgr->type) {
+            if (addr) {
+                if (!that_smgr->is_cname && addr_eq(addr, &that_smgr->addr))
+                    return i;
+            } else {
+                if (that_smgr->is_cname && !gdnsd_dname_cmp(dname, that_smgr->dname))
+                    return i;
+            }
         }
+        slot = (slot + 1U) & smgr_index_mask;
     }
 
     // allocate the new smgr/sttl
-    const unsigned idx = num_smgrs;
-    num_smgrs++;
-    smgrs = xrealloc_n(smgrs, num_smgrs, sizeof(*smgrs));
+    const unsigned idx = smgr_alloc();
     smgr_t* this_smgr = &smgrs[idx];
     this_smgr->type = this_svc;
 
@@ -552,15 +1232,20 @@ static unsigned mon_thing(const char* svctype_name, const gdnsd_anysin_t* addr,
 
     this_smgr->n_failure = 0;
     this_smgr->n_success = 0;
+    this_smgr->sttl_pend = false;
+    this_smgr->q_pend = 0;
     this_smgr->real_sttl = GDNSD_STTL_TTL_MAX;
 
     // the "down" special gets a different default than the rest
     if (!strcmp(svctype_name, "down"))
         this_smgr->real_sttl |= GDNSD_STTL_DOWN;
+    this_smgr->q_sttl = this_smgr->mon_sttl = this_smgr->real_sttl;
 
-    smgr_sttl = xrealloc_n(smgr_sttl, num_smgrs, sizeof(*smgr_sttl));
-    smgr_sttl_consumer_ = xrealloc_n(smgr_sttl_consumer_, num_smgrs, sizeof(*smgr_sttl_consumer_));
-    smgr_sttl_consumer_[idx] = smgr_sttl[idx] = this_smgr->real_sttl;
+    sttl_spare[idx] = smgr_sttl_consumer_[idx] = smgr_sttl[idx] = this_smgr->real_sttl;
+
+    smgr_index[slot] = idx + 1U;
+    if (num_smgrs > (smgr_index_mask >> 1))
+        smgr_index_grow();
 
     return idx;
 }
@@ -581,16 +1266,13 @@ unsigned gdnsd_mon_cname(const char* svctype_name, const char* cname, const uint
 // .. for virtual entities (e.g. datacenters), which have no service_type
 unsigned gdnsd_mon_admin(const char* desc)
 {
-    const unsigned idx = num_smgrs;
-    num_smgrs++;
-    smgrs = xrealloc_n(smgrs, num_smgrs, sizeof(*smgrs));
-    smgr_sttl = xrealloc_n(smgr_sttl, num_smgrs, sizeof(*smgr_sttl));
-    smgr_sttl_consumer_ = xrealloc_n(smgr_sttl_consumer_, num_smgrs, sizeof(*smgr_sttl_consumer_));
+    const unsigned idx = smgr_alloc();
     smgr_t* this_smgr = &smgrs[idx];
     memset(this_smgr, 0, sizeof(*this_smgr));
     this_smgr->desc = xstrdup(desc);
     this_smgr->real_sttl = GDNSD_STTL_TTL_MAX;
-    smgr_sttl_consumer_[idx] = smgr_sttl[idx] = this_smgr->real_sttl;
+    this_smgr->q_sttl = this_smgr->mon_sttl = this_smgr->real_sttl;
+    sttl_spare[idx] = smgr_sttl_consumer_[idx] = smgr_sttl[idx] = this_smgr->real_sttl;
     return idx;
 }
 
@@ -728,22 +1410,11 @@ void gdnsd_mon_cfg_stypes_p2(vscf_data_t* svctypes_cfg)
     }
 }
 
-F_NONNULL
-static void raw_sttl_update(smgr_t* smgr, unsigned idx, gdnsd_sttl_t new_sttl)
+// Main thread: applies a monitoring result to the real and current state
+static void mon_apply_sttl(const unsigned idx, const gdnsd_sttl_t new_sttl)
 {
-    gdnsd_assert(idx < num_smgrs);
-
-    // Note that the updater interfaces from monitoring plugins cannot set
-    //  the FORCED bit - only the admin-state interface can do that.
-    assert_valid_sttl(new_sttl);
-    gdnsd_assert(!(new_sttl & GDNSD_STTL_FORCED));
-
-    if (initial_round) {
-        log_info("state of '%s' initialized to %s", smgr->desc, logf_sttl(new_sttl));
-        smgr_sttl[idx] = smgr->real_sttl = new_sttl;
-        // table update taken care of in gdnsd_mon_start()
-        //  after all initial monitors complete
-    } else if (new_sttl != smgr->real_sttl) {
+    smgr_t* smgr = &smgrs[idx];
+    if (new_sttl != smgr->real_sttl) {
         if ((new_sttl & GDNSD_STTL_DOWN) != (smgr->real_sttl & GDNSD_STTL_DOWN)) {
             if (smgr_sttl[idx] & GDNSD_STTL_FORCED)
                 log_info("state of '%s' changed from %s to %s,"
@@ -756,12 +1427,92 @@ static void raw_sttl_update(smgr_t* smgr, unsigned idx, gdnsd_sttl_t new_sttl)
         }
         smgr->real_sttl = new_sttl;
         if (new_sttl != smgr_sttl[idx] && !(smgr_sttl[idx] & GDNSD_STTL_FORCED)) {
-            smgr_sttl[idx] = new_sttl;
+            sttl_set(idx, new_sttl);
             kick_sttl_update_timer();
         }
     }
 }
 
+// Monitoring thread: hands a new result to the main thread
+static void mon_submit(const unsigned idx, const gdnsd_sttl_t new_sttl)
+{
+    mon_shard_t* shard = this_shard;
+    gdnsd_assert(shard);
+    smgr_t* smgr = &smgrs[idx];
+
+    uatomic_set(&smgr->q_sttl, new_sttl);
+    if (uatomic_xchg(&smgr->q_pend, 1U))
+        return; // still listed, and the main thread will see the new value
+
+    const unsigned head = shard->head;
+    gdnsd_assert(head - CMM_LOAD_SHARED(shard->tail) <= shard->mask);
+    shard->ring[head & shard->mask] = idx;
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(shard->head, head + 1U);
+    ev_async* mra = &mon_results_async;
+    ev_async_send(mon_loop, mra);
+
+    // In the testsuite, wait until the main thread has applied the result,
+    //   so that anything the plugin logs after an update (e.g. extfile's
+    //   "loaded ... data") is only seen by the tests once the update is in
+    //   effect.  Every earlier submit has waited the same way, so q_pend
+    //   can't have been set above in this case.
+    if (testsuite_nodelay) {
+        const struct timespec ms_1 = { 0, 1000000 };
+        while ((int)(CMM_LOAD_SHARED(shard->applied) - (head + 1U)) < 0)
+            nanosleep(&ms_1, NULL);
+    }
+}
+
+// Main thread: applies everything the monitoring threads have submitted
+F_NONNULL
+static void mon_results_cb(struct ev_loop* loop V_UNUSED, ev_async* w V_UNUSED, int revents V_UNUSED) // cppcheck-suppress constParameter
+{
+    gdnsd_assert(w == &mon_results_async);
+    gdnsd_assert(revents == EV_ASYNC);
+
+    for (unsigned i = 0; i < num_shards; i++) {
+        mon_shard_t* shard = &shards[i];
+        const unsigned head = CMM_LOAD_SHARED(shard->head);
+        cmm_smp_rmb();
+        unsigned tail = shard->tail;
+        while (tail != head) {
+            const unsigned idx = shard->ring[tail & shard->mask];
+            // The slot is released before q_pend is cleared, so that the
+            //   ring never holds more than one entry per smgr
+            cmm_smp_mb();
+            CMM_STORE_SHARED(shard->tail, ++tail);
+            // The full barrier of the xchg orders the clearing before the
+            //   load of the value, so a newer value is either seen here or
+            //   re-listed by the producer
+            uatomic_xchg(&smgrs[idx].q_pend, 0U);
+            mon_apply_sttl(idx, uatomic_read(&smgrs[idx].q_sttl));
+            CMM_STORE_SHARED(shard->applied, shard->applied + 1U);
+        }
+    }
+}
+
+F_NONNULL
+static void raw_sttl_update(smgr_t* smgr, unsigned idx, gdnsd_sttl_t new_sttl)
+{
+    gdnsd_assert(idx < num_smgrs);
+
+    // Note that the updater interfaces from monitoring plugins cannot set
+    //  the FORCED bit - only the admin-state interface can do that.
+    assert_valid_sttl(new_sttl);
+    gdnsd_assert(!(new_sttl & GDNSD_STTL_FORCED));
+
+    if (initial_round) {
+        log_info("state of '%s' initialized to %s", smgr->desc, logf_sttl(new_sttl));
+        smgr_sttl[idx] = smgr->real_sttl = smgr->mon_sttl = new_sttl;
+        // table update taken care of in gdnsd_mon_start()
+        //  after all initial monitors complete
+    } else if (new_sttl != smgr->mon_sttl) {
+        smgr->mon_sttl = new_sttl;
+        mon_submit(idx, new_sttl);
+    }
+}
+
 void gdnsd_mon_sttl_updater(unsigned idx, gdnsd_sttl_t new_sttl)
 {
     gdnsd_assert(idx < num_smgrs);
@@ -790,7 +1541,7 @@ void gdnsd_mon_state_updater(unsigned idx, const bool latest)
         down = !latest;
     } else {
         // First handle basic up/down state and the counters
-        down = smgr->real_sttl & GDNSD_STTL_DOWN;
+        down = smgr->mon_sttl & GDNSD_STTL_DOWN;
         if (down) { // Currently DOWN
             if (latest) { // New Success
                 smgr->n_success++;
@@ -948,3 +1699,55 @@ char* gdnsd_mon_states_get_json(size_t* len)
     *len = written;
     return buf_start;
 }
+
+void gdnsd_mon_states_get_metrics(metrics_buf_t* mb)
+{
+    if (!num_smgrs)
+        return;
+
+    metrics_family(mb, "gdnsd_monitor_down", METRIC_GAUGE,
+                   "Current state of each monitored service, including admin_state overrides (1 = DOWN)");
+    for (unsigned i = 0; i < num_smgrs; i++) {
+        metrics_printf(mb, "gdnsd_monitor_down{service=\"");
+        metrics_label_value(mb, smgrs[i].desc);
+        metrics_printf(mb, "\"} %u\n", (smgr_sttl[i] & GDNSD_STTL_DOWN) ? 1U : 0U);
+    }
+
+    metrics_family(mb, "gdnsd_monitor_forced", METRIC_GAUGE,
+                   "Whether the current state of each monitored service is forced by admin_state");
+    for (unsigned i = 0; i < num_smgrs; i++) {
+        metrics_printf(mb, "gdnsd_monitor_forced{service=\"");
+        metrics_label_value(mb, smgrs[i].desc);
+        metrics_printf(mb, "\"} %u\n", (smgr_sttl[i] & GDNSD_STTL_FORCED) ? 1U : 0U);
+    }
+
+    // Admin-only virtual services have no real state to report
+    metrics_family(mb, "gdnsd_monitor_real_down", METRIC_GAUGE,
+                   "Actual monitored state of each monitored service, ignoring admin_state (1 = DOWN)");
+    for (unsigned i = 0; i < num_smgrs; i++) {
+        if (!smgrs[i].type)
+            continue;
+        metrics_printf(mb, "gdnsd_monitor_real_down{service=\"");
+        metrics_label_value(mb, smgrs[i].desc);
+        metrics_printf(mb, "\"} %u\n", (smgrs[i].real_sttl & GDNSD_STTL_DOWN) ? 1U : 0U);
+    }
+
+    metrics_family(mb, "gdnsd_monitor_publications", METRIC_COUNTER,
+                   "Publications of changed monitored states to the DNS I/O threads");
+    metrics_printf(mb, "gdnsd_monitor_publications_total %" PRIu64 "\n", sttl_stat_publications);
+    metrics_family(mb, "gdnsd_monitor_published_entries", METRIC_COUNTER,
+                   "State table entries copied by publications");
+    metrics_printf(mb, "gdnsd_monitor_published_entries_total %" PRIu64 "\n", sttl_stat_entries);
+    metrics_family(mb, "gdnsd_monitor_propagation_seconds", METRIC_COUNTER,
+                   "Total time from the first change in each publication to the publication");
+    metrics_printf(mb, "gdnsd_monitor_propagation_seconds_total %.6f\n", sttl_stat_propagation);
+    metrics_family(mb, "gdnsd_monitor_propagation_max_seconds", METRIC_GAUGE,
+                   "Longest time from the first change in a publication to the publication");
+    metrics_printf(mb, "gdnsd_monitor_propagation_max_seconds %.6f\n", sttl_stat_propagation_max);
+    metrics_family(mb, "gdnsd_monitor_grace_seconds", METRIC_COUNTER,
+                   "Total time spent waiting for RCU grace periods after publications");
+    metrics_printf(mb, "gdnsd_monitor_grace_seconds_total %.6f\n", sttl_stat_grace);
+    metrics_family(mb, "gdnsd_monitor_grace_max_seconds", METRIC_GAUGE,
+                   "Longest RCU grace period after a publication");
+    metrics_printf(mb, "gdnsd_monitor_grace_max_seconds %.6f\n", sttl_stat_grace_max);
+}
@@ -20,6 +20,8 @@
 #ifndef GDNSD_MON_H
 #define GDNSD_MON_H
 
+#include "metrics.h"
+
 #include <gdnsd/compiler.h>
 #include <gdnsd/vscf.h>
 #include <gdnsd/net.h>
@@ -27,6 +29,8 @@
 #include <inttypes.h>
 
 #include <urcu-qsbr.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
 #include <ev.h>
 
 // gdnsd_sttl_t
@@ -78,6 +82,50 @@ void gdnsd_mon_state_updater(unsigned idx, const bool latest);
 //   bit in "new_sttl" - this is checked as an assertion!
 void gdnsd_mon_sttl_updater(unsigned idx, gdnsd_sttl_t new_sttl);
 
+// Probe scheduling, for monitoring plugins which run one probe at a time
+//   per monitor, once per interval, with a timeout.  All of the probes on
+//   a loop share one hierarchical timer wheel instead of each having its
+//   own interval and timeout watchers.  Runtime probes start at a fixed
+//   per-monitor offset within their interval, so that they're spread out
+//   rather than in lockstep, and the "monitor_max_inflight" option can cap
+//   the count of probes running at once on each loop, which queues the
+//   rest until others finish.
+// The members are all private to mon.c.
+typedef struct gdnsd_mon_probe_s gdnsd_mon_probe_t;
+typedef void (*gdnsd_mon_probe_cb_t)(struct ev_loop* loop, gdnsd_mon_probe_t* probe);
+struct gdnsd_mon_probe_s {
+    gdnsd_mon_probe_t* next;
+    gdnsd_mon_probe_t** pprev;
+    gdnsd_mon_probe_cb_t start_cb;
+    gdnsd_mon_probe_cb_t timeout_cb;
+    void* data;
+    uint64_t expires;
+    uint64_t due;
+    unsigned idx;
+    unsigned interval;
+    unsigned timeout;
+    unsigned state;
+};
+
+// Sets up a probe for monitor "idx", with the interval and timeout of its
+//   service type in seconds.  start_cb is called to begin each probe, which
+//   the plugin ends by calling gdnsd_mon_probe_done() (possibly from within
+//   start_cb), unless timeout_cb is called first, in which case the probe
+//   is already over and the plugin only cleans up.  "data" is for the
+//   plugin's use.
+F_NONNULLX(1, 5, 6)
+void gdnsd_mon_probe_init(gdnsd_mon_probe_t* probe, const unsigned idx, const unsigned interval, const unsigned timeout, gdnsd_mon_probe_cb_t start_cb, gdnsd_mon_probe_cb_t timeout_cb, void* data);
+
+// Schedules an idle probe on a loop: immediately during the initial round
+//   of monitoring (from init_monitors()), and at its offset within the
+//   interval at runtime (from start_monitors(), on gdnsd_mon_get_loop()).
+F_NONNULL
+void gdnsd_mon_probe_start(struct ev_loop* loop, gdnsd_mon_probe_t* probe);
+
+// Ends a running probe, and schedules the next one
+F_NONNULL
+void gdnsd_mon_probe_done(struct ev_loop* loop, gdnsd_mon_probe_t* probe);
+
 // called during load_config to register address healthchecks, returns
 //   an index to check state with...
 F_NONNULL
@@ -94,9 +142,10 @@ unsigned gdnsd_mon_cname(const char* svctype_name, const char* cname, const uint
 F_NONNULL
 unsigned gdnsd_mon_admin(const char* desc);
 
-// do not ref this directly in a plugin!
-// use gdnsd_mon_get_sttl_table() below for access!
+// do not ref these directly in a plugin!
+// use gdnsd_mon_get_sttl_table() and gdnsd_mon_get_sttl_gen() below for access!
 extern gdnsd_sttl_t* smgr_sttl_consumer_;
+extern unsigned smgr_sttl_gen_;
 
 // conf.c calls these.  the order of execution is important due
 //   to chicken-and-egg problems with explicit plugin configuration
@@ -118,19 +167,48 @@ extern gdnsd_sttl_t* smgr_sttl_consumer_;
 void gdnsd_mon_cfg_stypes_p1(vscf_data_t* svctypes_cfg);
 void gdnsd_mon_cfg_stypes_p2(vscf_data_t* svctypes_cfg);
 
+// conf.c calls this with the "monitor_publish_delay" option, the most time
+//   (in seconds) that a state change waits to be published, so that
+//   nearby changes are published together
+void gdnsd_mon_cfg_publish_delay(const double delay);
+
+// ... and this with the "monitor_threads" option
+void gdnsd_mon_cfg_threads(const unsigned threads);
+
+// ... and this with the "monitor_max_inflight" option
+void gdnsd_mon_cfg_max_inflight(const unsigned max_inflight);
+
 // conf can call this to pre-check the admin_state syntax
 // fails fatally if the admin_state pathname exists
 //    but can't be loaded correctly
 void gdnsd_mon_check_admin_file(void);
 
-// main.c calls this for adding monio events to the main thread's eventloop
+// main.c calls this to run the initial round of monitoring on the main
+//   thread's eventloop, and to set up the runtime monitoring threads' loops
+//   and the main loop's handling of their results
 F_NONNULL
 void gdnsd_mon_start(struct ev_loop* mon_loop);
 
+// main.c calls this after the above to start the monitoring threads
+void gdnsd_mon_start_threads(void);
+
+// Monitoring plugins' start_monitors() callbacks start each monitor's own
+//   watchers on the loop returned here for its smgr index, which spreads
+//   them over the monitoring threads.  Watchers shared by many monitors go
+//   on the loop passed to start_monitors(), and every callback on these
+//   loops may call the state updaters above.
+F_RETNN
+struct ev_loop* gdnsd_mon_get_loop(const unsigned idx);
+
 // JSON monitored-state output for control socket
 F_NONNULL F_RETNN
 char* gdnsd_mon_states_get_json(size_t* len);
 
+// Same as above, appended in the text exposition format for the HTTP metrics
+// listeners
+F_NONNULL
+void gdnsd_mon_states_get_metrics(metrics_buf_t* mb);
+
 // State-fetching (one table call per resolve invocation, reused
 //   for as many index fetches as necc)
 F_UNUSED
@@ -139,6 +217,17 @@ static const gdnsd_sttl_t* gdnsd_mon_get_sttl_table(void)
     return rcu_dereference(smgr_sttl_consumer_);
 }
 
+// The generation of the state table, which changes whenever the table does.
+//   Anything derived from the table may be cached under the generation read
+//   before the table itself.
+F_UNUSED
+static unsigned gdnsd_mon_get_sttl_gen(void)
+{
+    const unsigned rv = CMM_LOAD_SHARED(smgr_sttl_gen_);
+    cmm_smp_rmb(); // pairs with the wmb in mon.c's table swap
+    return rv;
+}
+
 // Given two sttl values, combine them according to the following rules:
 //   1) result TTL is the lesser of both TTLs
 //   2) if either is down, result is down
@@ -136,7 +136,7 @@ static void plugin_null_init_monitors(struct ev_loop* mon_loop)
     }
 }
 
-static void plugin_null_start_monitors(struct ev_loop* mon_loop)
+static void plugin_null_start_monitors(struct ev_loop* mon_loop V_UNUSED)
 {
     for (unsigned i = 0; i < num_mons; i++) {
         null_mon_t* mon = null_mons[i];
@@ -144,7 +144,7 @@ static void plugin_null_start_monitors(struct ev_loop* mon_loop)
         const double stagger = (((double)i) / ((double)num_mons)) * ((double)ival);
         ev_timer* ival_watcher = &mon->interval_watcher;
         ev_timer_set(ival_watcher, stagger, ival);
-        ev_timer_start(mon_loop, ival_watcher);
+        ev_timer_start(gdnsd_mon_get_loop(mon->idx), ival_watcher);
     }
 }
 
@@ -163,4 +163,5 @@ plugin_t plugin_null_funcs = {
     .add_mon_cname = plugin_null_add_mon_cname,
     .init_monitors = plugin_null_init_monitors,
     .start_monitors = plugin_null_start_monitors,
+    .get_metrics = NULL,
 };
@@ -24,6 +24,7 @@
 #include <gdnsd/log.h>
 #include <gdnsd/net.h>
 #include <gdnsd/misc.h>
+#include <gdnsd/mm3.h>
 
 #include <string.h>
 #include <stdlib.h>
@@ -31,12 +32,13 @@
 
 #include "plugins.h"
 
-#define NUM_PLUGINS 12
+#define NUM_PLUGINS 13
 
 static plugin_t* plugins[NUM_PLUGINS] = {
     &plugin_geoip_funcs,
     &plugin_metafo_funcs,
     &plugin_http_status_funcs,
+    &plugin_maglev_funcs,
     &plugin_multifo_funcs,
     &plugin_null_funcs,
     &plugin_reflect_funcs,
@@ -159,6 +161,63 @@ plugin_t* gdnsd_plugin_find(const char* pname)
     log_fatal("No such plugin '%s'", pname);
 }
 
+// Initial size of a resource index, a power of two.  It doubles whenever it
+//   would become more than half full.
+#define RES_INDEX_INIT 16U
+
+F_NONNULL F_PURE
+static unsigned res_index_hash(const char* name)
+{
+    return hash_mm3_u32((const uint8_t*)name, strlen(name));
+}
+
+F_NONNULL
+static void res_index_grow(gdnsd_res_index_t* ri)
+{
+    const unsigned old_size = ri->items ? ri->mask + 1U : 0;
+    const unsigned new_size = old_size ? old_size << 1 : RES_INDEX_INIT;
+    gdnsd_res_index_item_t* old_items = ri->items;
+    ri->items = xcalloc_n(new_size, sizeof(*ri->items));
+    ri->mask = new_size - 1U;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_items[i].name) {
+            unsigned slot = res_index_hash(old_items[i].name) & ri->mask;
+            while (ri->items[slot].name)
+                slot = (slot + 1U) & ri->mask;
+            ri->items[slot] = old_items[i];
+        }
+    }
+    free(old_items);
+}
+
+void gdnsd_res_index_add(gdnsd_res_index_t* ri, const char* name, const unsigned num)
+{
+    gdnsd_assert(num <= INT32_MAX);
+    if ((ri->count + 1U) * 2U > (ri->items ? ri->mask + 1U : 0))
+        res_index_grow(ri);
+    unsigned slot = res_index_hash(name) & ri->mask;
+    while (ri->items[slot].name) {
+        gdnsd_assert(strcmp(name, ri->items[slot].name));
+        slot = (slot + 1U) & ri->mask;
+    }
+    ri->items[slot].name = name;
+    ri->items[slot].num = num;
+    ri->count++;
+}
+
+int gdnsd_res_index_find(const gdnsd_res_index_t* ri, const char* name)
+{
+    if (!ri->items)
+        return -1;
+    unsigned slot = res_index_hash(name) & ri->mask;
+    while (ri->items[slot].name) {
+        if (!strcmp(name, ri->items[slot].name))
+            return (int)ri->items[slot].num;
+        slot = (slot + 1U) & ri->mask;
+    }
+    return -1;
+}
+
 // The action iterators...
 
 void gdnsd_plugins_configure_all(void)
@@ -185,6 +244,13 @@ void gdnsd_plugins_action_start_monitors(struct ev_loop* mon_loop)
             plugins[i]->start_monitors(mon_loop);
 }
 
+void gdnsd_plugins_action_get_metrics(metrics_buf_t* mb)
+{
+    for (unsigned i = 0; i < NUM_PLUGINS; i++)
+        if (plugins[i]->used && plugins[i]->get_metrics)
+            plugins[i]->get_metrics(mb);
+}
+
 void gdnsd_plugins_action_pre_run(void)
 {
     for (unsigned i = 0; i < NUM_PLUGINS; i++)
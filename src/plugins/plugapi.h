@@ -103,6 +103,10 @@ typedef void (*gdnsd_add_mon_cname_cb_t)(const char* desc, const char* svc_name,
 typedef void (*gdnsd_init_monitors_cb_t)(struct ev_loop* mon_loop);
 typedef void (*gdnsd_start_monitors_cb_t)(struct ev_loop* mon_loop);
 
+// Appends the plugin's own metrics to the output of the HTTP metrics
+//   listeners, from the main thread
+typedef void (*gdnsd_get_metrics_cb_t)(metrics_buf_t* mb);
+
 // This is the data type for a plugin itself, holding function
 //  pointers for all of the possibly-documented callbacks
 typedef struct {
@@ -120,12 +124,33 @@ typedef struct {
     gdnsd_add_mon_cname_cb_t add_mon_cname;
     gdnsd_init_monitors_cb_t init_monitors;
     gdnsd_start_monitors_cb_t start_monitors;
+    gdnsd_get_metrics_cb_t get_metrics;
 } plugin_t;
 
 // Find a(nother) plugin by name.
 F_NONNULL F_PURE F_RETNN
 plugin_t* gdnsd_plugin_find(const char* plugin_name);
 
+// A hash index of a resolver plugin's resource names, for the lookups in its
+//  map_res() callback.  A zeroed index is empty.  The names are not copied,
+//  and must not change while the index is in use.
+typedef struct {
+    const char* name;
+    unsigned num;
+} gdnsd_res_index_item_t;
+
+typedef struct {
+    gdnsd_res_index_item_t* items;
+    unsigned mask;
+    unsigned count;
+} gdnsd_res_index_t;
+
+F_NONNULL
+void gdnsd_res_index_add(gdnsd_res_index_t* ri, const char* name, const unsigned num);
+// Returns the resource number for name, or -1 if it's not in the index
+F_NONNULL F_PURE
+int gdnsd_res_index_find(const gdnsd_res_index_t* ri, const char* name);
+
 // convenient macro for logging a config error and returning
 //  the error value -1 in a resolver plugin's map_res() callback
 //  without a bunch of extra clutter and bracing
@@ -183,5 +208,7 @@ F_NONNULL
 void gdnsd_plugins_action_init_monitors(struct ev_loop* mon_loop);
 F_NONNULL
 void gdnsd_plugins_action_start_monitors(struct ev_loop* mon_loop);
+F_NONNULL
+void gdnsd_plugins_action_get_metrics(metrics_buf_t* mb);
 
 #endif // GDNSD_PLUGINAPI_H
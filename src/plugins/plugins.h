@@ -27,6 +27,7 @@
 extern plugin_t plugin_geoip_funcs;
 extern plugin_t plugin_metafo_funcs;
 extern plugin_t plugin_http_status_funcs;
+extern plugin_t plugin_maglev_funcs;
 extern plugin_t plugin_multifo_funcs;
 extern plugin_t plugin_null_funcs;
 extern plugin_t plugin_reflect_funcs;
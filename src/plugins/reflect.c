@@ -104,4 +104,5 @@ plugin_t plugin_reflect_funcs = {
     .add_mon_cname = NULL,
     .init_monitors = NULL,
     .start_monitors = NULL,
+    .get_metrics = NULL,
 };
@@ -64,6 +64,7 @@ typedef struct {
 
 static res_t* resources = NULL;
 static unsigned num_resources = 0;
+static gdnsd_res_index_t res_index;
 
 static const char DEFAULT_SVCNAME[] = "up";
 
@@ -147,6 +148,7 @@ static bool config_res(const char* resname, unsigned resname_len V_UNUSED, vscf_
     (*residx_ptr)++;
     res_t* res = &resources[rnum];
     res->name = xstrdup(resname);
+    gdnsd_res_index_add(&res_index, res->name, rnum);
 
     if (vscf_get_type(opts) != VSCF_HASH_T)
         log_fatal("plugin_simplefo: resource %s: value must be a hash", resname);
@@ -215,9 +217,9 @@ static int plugin_simplefo_map_res(const char* resname, const uint8_t* zone_name
     if (resname) {
         if (zone_name)
             log_warn("plugin_simplefo: resource %s used from zone %s: DYNC configurations which can return IP address results are DEPRECATED and will be removed in a future version!", resname, logf_dname(zone_name));
-        for (unsigned i = 0; i < num_resources; i++)
-            if (!strcmp(resname, resources[i].name))
-                return (int)i;
+        const int rnum = gdnsd_res_index_find(&res_index, resname);
+        if (rnum >= 0)
+            return rnum;
         log_err("plugin_simplefo: Unknown resource '%s'", resname);
     } else {
         log_err("plugin_simplfo: resource name required");
@@ -301,4 +303,5 @@ plugin_t plugin_simplefo_funcs = {
     .add_mon_cname = NULL,
     .init_monitors = NULL,
     .start_monitors = NULL,
+    .get_metrics = NULL,
 };
@@ -46,6 +46,7 @@ typedef struct {
 
 static static_resource_t* resources = NULL;
 static unsigned num_resources = 0;
+static gdnsd_res_index_t res_index;
 
 static bool config_res(const char* resname, unsigned resname_len V_UNUSED, vscf_data_t* addr, void* data)
 {
@@ -57,6 +58,7 @@ static bool config_res(const char* resname, unsigned resname_len V_UNUSED, vscf_
     unsigned res = *residx_ptr;
     (*residx_ptr)++;
     resources[res].name = xstrdup(resname);
+    gdnsd_res_index_add(&res_index, resources[res].name, res);
 
     const char* addr_txt = vscf_simple_get_data(addr);
     if (gdnsd_anysin_fromstr(addr_txt, 0, &resources[res].addr)) {
@@ -95,22 +97,21 @@ static void plugin_static_load_config(vscf_data_t* config)
 static int plugin_static_map_res(const char* resname, const uint8_t* zone_name)
 {
     if (resname) {
-        for (unsigned i = 0; i < num_resources; i++) {
-            if (!strcmp(resname, resources[i].name)) {
-                if (resources[i].is_addr) {
-                    if (zone_name)
-                        log_warn("plugin_static: resource %s used from zone %s: DYNC configurations which can return IP address results are DEPRECATED and will be removed in a future version!", resname, logf_dname(zone_name));
-                    return (int)i;
-                }
-                if (!zone_name)
-                    map_res_err("plugin_static: CNAME resource '%s' cannot be used for a DYNA record", resources[i].name);
-                uint8_t* dname = resources[i].dname;
-                if (dname_isinzone(zone_name, dname))
-                    map_res_err("plugin_static: Resource '%s' CNAME value '%s' cannot be used within zone '%s'", resources[i].name, logf_dname(dname), logf_dname(zone_name));
-                return (int)i;
-            }
+        const int found = gdnsd_res_index_find(&res_index, resname);
+        if (found < 0)
+            map_res_err("plugin_static: Unknown resource '%s'", resname);
+        const unsigned i = (unsigned)found;
+        if (resources[i].is_addr) {
+            if (zone_name)
+                log_warn("plugin_static: resource %s used from zone %s: DYNC configurations which can return IP address results are DEPRECATED and will be removed in a future version!", resname, logf_dname(zone_name));
+            return found;
         }
-        map_res_err("plugin_static: Unknown resource '%s'", resname);
+        if (!zone_name)
+            map_res_err("plugin_static: CNAME resource '%s' cannot be used for a DYNA record", resources[i].name);
+        uint8_t* dname = resources[i].dname;
+        if (dname_isinzone(zone_name, dname))
+            map_res_err("plugin_static: Resource '%s' CNAME value '%s' cannot be used within zone '%s'", resources[i].name, logf_dname(dname), logf_dname(zone_name));
+        return found;
     }
 
     map_res_err("plugin_static: resource name required");
@@ -228,4 +229,5 @@ plugin_t plugin_static_funcs = {
     .add_mon_cname = plugin_static_add_mon_cname,
     .init_monitors = plugin_static_init_monitors,
     .start_monitors = NULL,
+    .get_metrics = NULL,
 };
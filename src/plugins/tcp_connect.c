@@ -59,8 +59,7 @@ typedef struct {
     const char* desc;
     tcp_svc_t* tcp_svc;
     ev_io connect_watcher;
-    ev_timer timeout_watcher;
-    ev_timer interval_watcher;
+    gdnsd_mon_probe_t probe;
     gdnsd_anysin_t addr;
     unsigned idx;
     tcp_state_t tcp_state;
@@ -73,34 +72,24 @@ static tcp_svc_t* service_types = NULL;
 static tcp_events_t** mons = NULL;
 
 F_NONNULL
-static void mon_interval_cb(struct ev_loop* loop, struct ev_timer* t, const int revents V_UNUSED)
+static void mon_probe_cb(struct ev_loop* loop, gdnsd_mon_probe_t* probe)
 {
-    gdnsd_assert(revents == EV_TIMER);
-
-    tcp_events_t* md = t->data;
+    tcp_events_t* md = probe->data;
 
     gdnsd_assert(md);
-
-    if (md->tcp_state != TCP_STATE_WAITING) {
-        log_warn("plugin_tcp_connect: A monitoring request attempt seems to have "
-                 "lasted longer than the monitoring interval. "
-                 "Skipping this round of monitoring - are you "
-                 "starved for CPU time?");
-        return;
-    }
+    gdnsd_assert(md->tcp_state == TCP_STATE_WAITING);
 
     ev_io* c_watcher = &md->connect_watcher;
-    ev_timer* t_watcher = &md->timeout_watcher;
 
     gdnsd_assert(md->sock == -1);
     gdnsd_assert(!ev_is_active(c_watcher));
-    gdnsd_assert(!ev_is_active(t_watcher) && !ev_is_pending(t_watcher));
 
     log_debug("plugin_tcp_connect: Starting state poll of %s", md->desc);
 
     const int sock = socket(md->addr.sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
     if (sock == -1) {
         log_err("plugin_tcp_connect: Failed to create monitoring socket: %s", logf_errno());
+        gdnsd_mon_probe_done(loop, probe);
         return;
     }
 
@@ -114,8 +103,6 @@ static void mon_interval_cb(struct ev_loop* loop, struct ev_timer* t, const int
             md->tcp_state = TCP_STATE_CONNECTING;
             ev_io_set(c_watcher, sock, EV_WRITE);
             ev_io_start(loop, c_watcher);
-            ev_timer_set(t_watcher, md->tcp_svc->timeout, 0);
-            ev_timer_start(loop, t_watcher);
             return; // don't do socket/status finishing actions below...
         case EPIPE:
         case ECONNREFUSED:
@@ -135,6 +122,7 @@ static void mon_interval_cb(struct ev_loop* loop, struct ev_timer* t, const int
 
     close(sock);
     gdnsd_mon_state_updater(md->idx, success);
+    gdnsd_mon_probe_done(loop, probe);
 }
 
 F_NONNULL
@@ -143,12 +131,10 @@ static void mon_connect_cb(struct ev_loop* loop, struct ev_io* w, const int reve
     gdnsd_assert(revents == EV_WRITE);
 
     tcp_events_t* md = w->data;
-    ev_timer* t_watcher = &md->timeout_watcher;
 
     gdnsd_assert(md);
     gdnsd_assert(md->tcp_state == TCP_STATE_CONNECTING);
     gdnsd_assert(ev_is_active(w));
-    gdnsd_assert(ev_is_active(t_watcher) || ev_is_pending(t_watcher));
     gdnsd_assert(md->sock > -1);
 
     // nonblocking connect() just finished, need to check status
@@ -178,17 +164,15 @@ static void mon_connect_cb(struct ev_loop* loop, struct ev_io* w, const int reve
     close(sock);
     md->sock = -1;
     ev_io_stop(loop, w);
-    ev_timer_stop(loop, t_watcher);
     md->tcp_state = TCP_STATE_WAITING;
     gdnsd_mon_state_updater(md->idx, success);
+    gdnsd_mon_probe_done(loop, &md->probe);
 }
 
 F_NONNULL
-static void mon_timeout_cb(struct ev_loop* loop, struct ev_timer* t, const int revents V_UNUSED)
+static void mon_timeout_cb(struct ev_loop* loop, gdnsd_mon_probe_t* probe)
 {
-    gdnsd_assert(revents == EV_TIMER);
-
-    tcp_events_t* md = t->data;
+    tcp_events_t* md = probe->data;
     ev_io* c_watcher = &md->connect_watcher;
 
     gdnsd_assert(md);
@@ -266,13 +250,8 @@ static void plugin_tcp_connect_add_mon_addr(const char* desc, const char* svc_na
     ev_io_init(c_watcher, mon_connect_cb, -1, 0);
     c_watcher->data = this_mon;
 
-    ev_timer* t_watcher = &this_mon->timeout_watcher;
-    ev_timer_init(t_watcher, mon_timeout_cb, 0, 0);
-    t_watcher->data = this_mon;
-
-    ev_timer* i_watcher = &this_mon->interval_watcher;
-    ev_timer_init(i_watcher, mon_interval_cb, 0, 0);
-    i_watcher->data = this_mon;
+    gdnsd_mon_probe_init(&this_mon->probe, idx, this_mon->tcp_svc->interval,
+                         this_mon->tcp_svc->timeout, mon_probe_cb, mon_timeout_cb, this_mon);
 
     mons = xrealloc_n(mons, num_mons + 1, sizeof(*mons));
     mons[num_mons++] = this_mon;
@@ -281,23 +260,17 @@ static void plugin_tcp_connect_add_mon_addr(const char* desc, const char* svc_na
 static void plugin_tcp_connect_init_monitors(struct ev_loop* mon_loop)
 {
     for (unsigned i = 0; i < num_mons; i++) {
-        ev_timer* ival_watcher = &mons[i]->interval_watcher;
         gdnsd_assert(mons[i]->sock == -1);
-        ev_timer_set(ival_watcher, 0, 0);
-        ev_timer_start(mon_loop, ival_watcher);
+        gdnsd_mon_probe_start(mon_loop, &mons[i]->probe);
     }
 }
 
-static void plugin_tcp_connect_start_monitors(struct ev_loop* mon_loop)
+static void plugin_tcp_connect_start_monitors(struct ev_loop* mon_loop V_UNUSED)
 {
     for (unsigned i = 0; i < num_mons; i++) {
         tcp_events_t* mon = mons[i];
         gdnsd_assert(mon->sock == -1);
-        const unsigned ival = mon->tcp_svc->interval;
-        const double stagger = (((double)i) / ((double)num_mons)) * ((double)ival);
-        ev_timer* ival_watcher = &mon->interval_watcher;
-        ev_timer_set(ival_watcher, stagger, ival);
-        ev_timer_start(mon_loop, ival_watcher);
+        gdnsd_mon_probe_start(gdnsd_mon_get_loop(mon->idx), &mon->probe);
     }
 }
 
@@ -316,4 +289,5 @@ plugin_t plugin_tcp_connect_funcs = {
     .add_mon_cname = NULL,
     .init_monitors = plugin_tcp_connect_init_monitors,
     .start_monitors = plugin_tcp_connect_start_monitors,
+    .get_metrics = NULL,
 };
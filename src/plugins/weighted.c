@@ -81,10 +81,13 @@ typedef struct {
     char** svc_names;
     unsigned count;
     unsigned max_addrs_pergroup;
+    unsigned num_addrs; // sum of items[].count
+    unsigned* addr_offs; // start of each item's addrs in a sel_t, the prefix sums of items[].count
     unsigned weight;
     unsigned up_weight;
     unsigned max_weight;
     unsigned num_svcs;
+    unsigned sel_idx; // index of this set's sel_t in each thread's sels[]
     res_aset_mode_t gmode;
     bool multi;
 } addrset_t;
@@ -102,6 +105,7 @@ typedef struct {
     unsigned weight;
     unsigned up_weight;
     unsigned num_svcs;
+    unsigned sel_idx; // index of this set's sel_t in each thread's sels[]
 } cnset_t;
 
 typedef struct {
@@ -113,6 +117,8 @@ typedef struct {
 
 static resource_t* resources = NULL;
 static unsigned num_resources = 0;
+static unsigned num_sels = 0;
+static gdnsd_res_index_t res_index;
 
 // Per-thread PRNGs
 static __thread gdnsd_rstate32_t rstate;
@@ -128,26 +134,141 @@ static uint64_t get_rand(const uint64_t modval)
     return gdnsd_rand32_bounded(&rstate, modval);
 }
 
-// This is a per-thread 2D array of unsigneds which is indexed like:
-//   dyn_addr_weights[item][addr]
-// It's used to store temporary outputs while calculating our response during
-// runtime lookups in resolve().  It would be a stack buffer like others near
-// the top of resolve(), but:
-// (1) the size of this buffer ends up being ~16KB even though few of those
-//     bytes are commonly used, which seems too high to toss on the stack.
-// (2) malloc during resolve() is undesirable in perf terms.
-// The values set here are either the configured weight or zero, depending on
-// the runtime-variable monitored status of the items in question.
-static __thread unsigned(*dyn_addr_weights)[MAX_ADDRS_PER_GROUP] = NULL;
-
-static void init_dyn_addr_weights(void)
+// One column of a Vose alias table over N weights summing to S: a uniform
+// pick of a column, then a uniform pick below S, chooses the column itself if
+// the latter is below "thresh", otherwise its "alias".  This chooses each
+// index with probability exactly weight/S, in constant time.
+typedef struct {
+    unsigned thresh;
+    unsigned alias;
+} alias_ent_t;
+
+// The dynamic weights of a set, derived from the monitored states, and the
+// alias tables for the weighted choices made from them, which are all only
+// rebuilt when the monitoring state table changes.  The arrays indexed by
+// addr hold all of the items' addrs back to back, with each item's starting
+// at its addr_offs[] in the addrset.
+typedef struct {
+    unsigned gen; // sttl table generation these were computed from
+    bool valid;
+    gdnsd_sttl_t rv;
+    unsigned items_sum; // sum of item_sums[]
+    unsigned items_max; // max of item_sums[]
+    unsigned* item_sums; // sum of addr_weights[N][]
+    unsigned* item_maxs; // max of addr_weights[N][]
+    unsigned* addr_weights;
+    alias_ent_t* item_alias; // choice of one item, by item_sums[]
+    alias_ent_t* addr_alias; // choice of one addr per item, by addr_weights[N][]
+} sel_t;
+
+// Per-thread sel_t for every addrset and cnset, indexed by their sel_idx.
+// These are per-thread so that the rebuilds don't need any synchronization,
+// and each thread only rebuilds a set once per state table generation, on
+// the first lookup which uses it.  They're all allocated up front by
+// iothread_init, so that resolve() never has to malloc().
+static __thread sel_t* sels = NULL;
+
+F_NONNULL
+static void init_sel_addr(sel_t* sel, const addrset_t* aset)
+{
+    sel->item_sums = xmalloc_n(aset->count, sizeof(*sel->item_sums));
+    sel->item_maxs = xmalloc_n(aset->count, sizeof(*sel->item_maxs));
+    sel->addr_weights = xmalloc_n(aset->num_addrs, sizeof(*sel->addr_weights));
+    if (aset->multi)
+        sel->addr_alias = xmalloc_n(aset->num_addrs, sizeof(*sel->addr_alias));
+    else
+        sel->item_alias = xmalloc_n(aset->count, sizeof(*sel->item_alias));
+}
+
+F_NONNULL
+static void init_sel_cname(sel_t* sel, const cnset_t* cnset)
 {
-    dyn_addr_weights = xmalloc_n(MAX_ITEMS_PER_SET, sizeof(*dyn_addr_weights));
+    sel->item_sums = xmalloc_n(cnset->count, sizeof(*sel->item_sums));
+    sel->item_alias = xmalloc_n(cnset->count, sizeof(*sel->item_alias));
 }
 
-static void clear_dyn_addr_weights(void)
+static void init_sels(void)
 {
-    memset(dyn_addr_weights, 0, sizeof(*dyn_addr_weights) * MAX_ITEMS_PER_SET);
+    if (!num_sels)
+        return;
+    sels = xcalloc_n(num_sels, sizeof(*sels));
+    for (unsigned i = 0; i < num_resources; i++) {
+        const resource_t* res = &resources[i];
+        if (res->cnames)
+            init_sel_cname(&sels[res->cnames->sel_idx], res->cnames);
+        if (res->addrs_v4)
+            init_sel_addr(&sels[res->addrs_v4->sel_idx], res->addrs_v4);
+        if (res->addrs_v6)
+            init_sel_addr(&sels[res->addrs_v6->sel_idx], res->addrs_v6);
+    }
+}
+
+static void cleanup_sels(void)
+{
+    for (unsigned i = 0; i < num_sels; i++) {
+        free(sels[i].item_sums);
+        free(sels[i].item_maxs);
+        free(sels[i].addr_weights);
+        free(sels[i].item_alias);
+        free(sels[i].addr_alias);
+    }
+    free(sels);
+    sels = NULL;
+}
+
+// Builds the Vose alias table for the "n" weights in w[], which sum to "sum".
+// The weights are scaled by n so that each column holds exactly "sum", which
+// keeps the arithmetic exact.
+F_NONNULL
+static void alias_build(alias_ent_t* tbl, const unsigned* w, const unsigned n, const unsigned sum)
+{
+    gdnsd_assert(n && n <= MAX_ITEMS_PER_SET);
+    gdnsd_assert(sum);
+
+    uint64_t scaled[MAX_ITEMS_PER_SET];
+    unsigned small[MAX_ITEMS_PER_SET];
+    unsigned large[MAX_ITEMS_PER_SET];
+    unsigned num_small = 0;
+    unsigned num_large = 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        scaled[i] = (uint64_t)w[i] * n;
+        if (scaled[i] < sum)
+            small[num_small++] = i;
+        else
+            large[num_large++] = i;
+    }
+
+    while (num_small && num_large) {
+        const unsigned sm = small[--num_small];
+        const unsigned lg = large[num_large - 1U];
+        tbl[sm].thresh = (unsigned)scaled[sm];
+        tbl[sm].alias = lg;
+        scaled[lg] -= sum - scaled[sm];
+        if (scaled[lg] < sum) {
+            num_large--;
+            small[num_small++] = lg;
+        }
+    }
+
+    // Whatever remains is exactly full
+    while (num_large) {
+        const unsigned lg = large[--num_large];
+        tbl[lg].thresh = sum;
+        tbl[lg].alias = lg;
+    }
+    while (num_small) {
+        const unsigned sm = small[--num_small];
+        tbl[sm].thresh = sum;
+        tbl[sm].alias = sm;
+    }
+}
+
+F_NONNULL
+static unsigned alias_pick(const alias_ent_t* tbl, const unsigned n, const unsigned sum)
+{
+    const unsigned col = get_rand(n);
+    return (get_rand(sum) < tbl[col].thresh) ? col : tbl[col].alias;
 }
 
 // Main config code starts here
@@ -403,9 +524,13 @@ static void config_addrset(const char* res_name, const char* stanza, const bool
 
     addrset->weight = 0;
     addrset->max_weight = 0;
+    addrset->num_addrs = 0;
+    addrset->addr_offs = xmalloc_n(addrset->count, sizeof(*addrset->addr_offs));
     for (unsigned i = 0; i < addrset->count; i++) {
         const unsigned iwt = addrset->items[i].weight;
         const unsigned num_addrs = addrset->items[i].count;
+        addrset->addr_offs[i] = addrset->num_addrs;
+        addrset->num_addrs += num_addrs;
         gdnsd_assert(iwt);
         gdnsd_assert(addrset->items[i].max_weight);
         addrset->weight += iwt;
@@ -420,6 +545,8 @@ static void config_addrset(const char* res_name, const char* stanza, const bool
 
     addrset->up_weight = gdnsd_uscale_ceil(addrset->weight, up_thresh);
     gdnsd_assert(addrset->up_weight);
+
+    addrset->sel_idx = num_sels++;
 }
 
 typedef struct {
@@ -542,6 +669,8 @@ static void config_cnameset(const char* res_name, const char* stanza, cnset_t* c
     gdnsd_assert(cnset->weight);
 
     cnset->up_weight = gdnsd_uscale_ceil(cnset->weight, up_thresh);
+
+    cnset->sel_idx = num_sels++;
 }
 
 F_NONNULL
@@ -619,8 +748,10 @@ static bool res_mixed_fail(const char* item_name, unsigned klen V_UNUSED, vscf_d
 static bool config_res(const char* res_name, unsigned klen V_UNUSED, vscf_data_t* res_cfg, void* idx_asvoid)
 {
     unsigned* idx_ptr = idx_asvoid;
-    resource_t* res = &resources[(*idx_ptr)++];
+    const unsigned idx = (*idx_ptr)++;
+    resource_t* res = &resources[idx];
     res->name = xstrdup(res_name);
+    gdnsd_res_index_add(&res_index, res->name, idx);
     if (!vscf_is_hash(res_cfg))
         log_fatal("plugin_weighted: the value of resource '%s' must be a hash", res_name);
 
@@ -711,46 +842,42 @@ static int plugin_weighted_map_res(const char* resname, const uint8_t* zone_name
     if (!resname)
         map_res_err("plugin_weighted: resource name required");
 
-    for (unsigned i = 0; i < num_resources; i++) {
-        if (!strcmp(resname, resources[i].name)) {
-            cnset_t* cnset = resources[i].cnames;
-            if (cnset) {
-                if (!zone_name)
-                    map_res_err("plugin_weighted: Resource '%s' used in a DYNA RR, but has CNAME data", resources[i].name);
-                for (unsigned j = 0; j < cnset->count; j++) {
-                    const uint8_t* dname = cnset->items[j].cname;
-                    if (dname_isinzone(zone_name, dname))
-                        map_res_err("plugin_weighted: Resource '%s' CNAME value '%s' cannot be used within zone '%s'", resources[i].name, logf_dname(dname), logf_dname(zone_name));
-                }
-            } else if (zone_name) {
-                log_warn("plugin_weighted: resource %s used from zone %s: DYNC configurations which can return IP address results are DEPRECATED and will be removed in a future version!", resname, logf_dname(zone_name));
-            }
-            log_debug("plugin_weighted: resource '%s' mapped", resources[i].name);
-            return (int)i;
+    const int found = gdnsd_res_index_find(&res_index, resname);
+    if (found < 0)
+        map_res_err("plugin_weighted: unknown resource '%s'", resname);
+
+    const unsigned i = (unsigned)found;
+    cnset_t* cnset = resources[i].cnames;
+    if (cnset) {
+        if (!zone_name)
+            map_res_err("plugin_weighted: Resource '%s' used in a DYNA RR, but has CNAME data", resources[i].name);
+        for (unsigned j = 0; j < cnset->count; j++) {
+            const uint8_t* dname = cnset->items[j].cname;
+            if (dname_isinzone(zone_name, dname))
+                map_res_err("plugin_weighted: Resource '%s' CNAME value '%s' cannot be used within zone '%s'", resources[i].name, logf_dname(dname), logf_dname(zone_name));
         }
+    } else if (zone_name) {
+        log_warn("plugin_weighted: resource %s used from zone %s: DYNC configurations which can return IP address results are DEPRECATED and will be removed in a future version!", resname, logf_dname(zone_name));
     }
-
-    map_res_err("plugin_weighted: unknown resource '%s'", resname);
+    log_debug("plugin_weighted: resource '%s' mapped", resources[i].name);
+    return found;
 }
 
 static void plugin_weighted_iothread_init(void)
 {
     init_rand();
-    init_dyn_addr_weights();
+    init_sels();
 }
 
 static void plugin_weighted_iothread_cleanup(void)
 {
-    free(dyn_addr_weights);
+    cleanup_sels();
 }
 
+// Recomputes a cnset's sel_t for a new sttl table generation
 F_NONNULL
-static gdnsd_sttl_t resolve_cname(const gdnsd_sttl_t* sttl_tbl, const resource_t* resource, dyn_result_t* result)
+static void sel_update_cname(sel_t* sel, const gdnsd_sttl_t* sttl_tbl, const cnset_t* cnset, const unsigned gen)
 {
-    cnset_t* cnset = resource->cnames;
-    gdnsd_assert(cnset);
-    gdnsd_assert(cnset->weight);
-
     gdnsd_sttl_t rv = GDNSD_STTL_TTL_MAX;
 
     // first, iterate the CNAMEs and build an array of
@@ -758,7 +885,7 @@ static gdnsd_sttl_t resolve_cname(const gdnsd_sttl_t* sttl_tbl, const resource_t
     //   as well as a sum of all dynamic weights
     const unsigned ct = cnset->count;
     unsigned dyn_sum = 0;
-    unsigned dyn_weights[MAX_ITEMS_PER_SET];
+    unsigned* dyn_weights = sel->item_sums;
     for (unsigned i = 0; i < ct; i++) {
         const res_citem_t* citem = &cnset->items[i];
         const gdnsd_sttl_t citem_sttl
@@ -791,41 +918,50 @@ static gdnsd_sttl_t resolve_cname(const gdnsd_sttl_t* sttl_tbl, const resource_t
     }
 
     gdnsd_assert(dyn_sum);
+    alias_build(sel->item_alias, dyn_weights, ct, dyn_sum);
 
-    // choose the first item that breaks the random threshold
-    const unsigned item_rand = get_rand(dyn_sum);
-    unsigned running_total = 0;
-    unsigned chosen = 0;
-    for (unsigned i = 0; i < ct; i++) {
-        running_total += dyn_weights[i];
-        if (item_rand < running_total) {
-            chosen = i;
-            break;
-        }
-    }
+    sel->items_sum = dyn_sum;
+    sel->rv = rv;
+    sel->gen = gen;
+    sel->valid = true;
+}
+
+F_NONNULL
+static gdnsd_sttl_t resolve_cname(const gdnsd_sttl_t* sttl_tbl, const unsigned gen, const resource_t* resource, dyn_result_t* result)
+{
+    cnset_t* cnset = resource->cnames;
+    gdnsd_assert(cnset);
+    gdnsd_assert(cnset->weight);
+
+    sel_t* sel = &sels[cnset->sel_idx];
+    if (!sel->valid || sel->gen != gen)
+        sel_update_cname(sel, sttl_tbl, cnset, gen);
+
+    const unsigned chosen = alias_pick(sel->item_alias, cnset->count, sel->items_sum);
 
     // set the output stuff
     gdnsd_result_add_cname(result, cnset->items[chosen].cname);
 
-    return rv;
+    return sel->rv;
 }
 
+// Recomputes an addrset's sel_t for a new sttl table generation
 F_NONNULL
-static gdnsd_sttl_t resolve(const gdnsd_sttl_t* sttl_tbl, const addrset_t* aset, dyn_result_t* result)
+static void sel_update_addr(sel_t* sel, const gdnsd_sttl_t* sttl_tbl, const addrset_t* aset, const unsigned gen)
 {
     const unsigned num_items = aset->count;
+
     unsigned dyn_items_sum = 0; // sum of dyn_item_sums[]
     unsigned dyn_items_max = 0; // max of dyn_item_sums[]
-    unsigned dyn_item_sums[MAX_ITEMS_PER_SET]; // sum of dyn_addr_weights[N][]
-    unsigned dyn_item_maxs[MAX_ITEMS_PER_SET]; // max of dyn_addr_weights[N][]
-
-    clear_dyn_addr_weights();
+    unsigned* dyn_item_sums = sel->item_sums;
+    unsigned* dyn_item_maxs = sel->item_maxs;
 
     gdnsd_sttl_t rv = GDNSD_STTL_TTL_MAX;
 
     // Get dynamic info about each item
     for (unsigned item_idx = 0; item_idx < num_items; item_idx++) {
         const res_aitem_t* res_item = &aset->items[item_idx];
+        unsigned* dyn_addr_weights = &sel->addr_weights[aset->addr_offs[item_idx]];
         dyn_item_sums[item_idx] = 0;
         dyn_item_maxs[item_idx] = 0;
         for (unsigned addr_idx = 0; addr_idx < res_item->count; addr_idx++) {
@@ -833,8 +969,10 @@ static gdnsd_sttl_t resolve(const gdnsd_sttl_t* sttl_tbl, const addrset_t* aset,
             const gdnsd_sttl_t addr_sttl
                 = gdnsd_sttl_min(sttl_tbl, addr->indices, aset->num_svcs);
             rv = gdnsd_sttl_min2(rv, addr_sttl);
-            if (!(addr_sttl & GDNSD_STTL_DOWN)) {
-                dyn_addr_weights[item_idx][addr_idx] = addr->weight;
+            if (addr_sttl & GDNSD_STTL_DOWN) {
+                dyn_addr_weights[addr_idx] = 0;
+            } else {
+                dyn_addr_weights[addr_idx] = addr->weight;
                 dyn_item_sums[item_idx] += addr->weight;
                 if (addr->weight > dyn_item_maxs[item_idx])
                     dyn_item_maxs[item_idx] = addr->weight;
@@ -857,10 +995,11 @@ static gdnsd_sttl_t resolve(const gdnsd_sttl_t* sttl_tbl, const addrset_t* aset,
         dyn_items_max = aset->max_weight;
         for (unsigned item_idx = 0; item_idx < num_items; item_idx++) {
             const res_aitem_t* res_item = &aset->items[item_idx];
+            unsigned* dyn_addr_weights = &sel->addr_weights[aset->addr_offs[item_idx]];
             dyn_item_sums[item_idx] = res_item->weight;
             dyn_item_maxs[item_idx] = res_item->max_weight;
             for (unsigned addr_idx = 0; addr_idx < res_item->count; addr_idx++)
-                dyn_addr_weights[item_idx][addr_idx] = res_item->as[addr_idx].weight;
+                dyn_addr_weights[addr_idx] = res_item->as[addr_idx].weight;
         }
     } else {
         rv &= ~GDNSD_STTL_DOWN;
@@ -869,65 +1008,80 @@ static gdnsd_sttl_t resolve(const gdnsd_sttl_t* sttl_tbl, const addrset_t* aset,
     gdnsd_assert(dyn_items_sum);
     gdnsd_assert(dyn_items_max);
 
+    if (aset->multi) {
+        // Each item with any dynamic weight chooses one of its addrs
+        for (unsigned item_idx = 0; item_idx < num_items; item_idx++)
+            if (dyn_item_sums[item_idx])
+                alias_build(&sel->addr_alias[aset->addr_offs[item_idx]],
+                            &sel->addr_weights[aset->addr_offs[item_idx]],
+                            aset->items[item_idx].count, dyn_item_sums[item_idx]);
+    } else {
+        // One item is chosen by its dynamic sum
+        alias_build(sel->item_alias, dyn_item_sums, num_items, dyn_items_sum);
+    }
+
+    sel->items_sum = dyn_items_sum;
+    sel->items_max = dyn_items_max;
+    sel->rv = rv;
+    sel->gen = gen;
+    sel->valid = true;
+}
+
+F_NONNULL
+static gdnsd_sttl_t resolve(const gdnsd_sttl_t* sttl_tbl, const unsigned gen, const addrset_t* aset, dyn_result_t* result)
+{
+    sel_t* sel = &sels[aset->sel_idx];
+    if (!sel->valid || sel->gen != gen)
+        sel_update_addr(sel, sttl_tbl, aset, gen);
+
+    const unsigned num_items = aset->count;
+
     if (aset->multi) {
         // Outer decision: choose multiple items based on dyn_items_max
         for (unsigned item_idx = 0; item_idx < num_items; item_idx++) {
             const res_aitem_t* res_item = &aset->items[item_idx];
-            const unsigned item_rand = get_rand(dyn_items_max);
-            const unsigned isum = dyn_item_sums[item_idx];
+            const unsigned item_rand = get_rand(sel->items_max);
+            const unsigned isum = sel->item_sums[item_idx];
             if (item_rand < isum) {
                 gdnsd_assert(isum); // given that they're both uints
                 // Inner decision: choose one addr based on dyn_item->sum
-                const unsigned addr_rand = get_rand(isum);
-                unsigned addr_running_total = 0;
-                for (unsigned addr_idx = 0; addr_idx < res_item->count; addr_idx++) {
-                    addr_running_total += dyn_addr_weights[item_idx][addr_idx];
-                    if (addr_rand < addr_running_total) {
-                        gdnsd_result_add_anysin(result, &res_item->as[addr_idx].addr);
-                        break;
-                    }
-                }
+                const unsigned addr_idx = alias_pick(&sel->addr_alias[aset->addr_offs[item_idx]], res_item->count, isum);
+                gdnsd_result_add_anysin(result, &res_item->as[addr_idx].addr);
             }
         }
     } else {
         // Outer decision: choose one item based on dyn_items_sum
-        const unsigned item_rand = get_rand(dyn_items_sum);
-        unsigned item_running_total = 0;
-        for (unsigned item_idx = 0; item_idx < num_items; item_idx++) {
-            item_running_total += dyn_item_sums[item_idx];
-            if (item_rand < item_running_total) {
-                const res_aitem_t* chosen = &aset->items[item_idx];
-                // Inner decision: choose multiple addrs based on chosen's dynamic max
-                const unsigned addr_max = dyn_item_maxs[item_idx];
-                gdnsd_assert(addr_max);
-                for (unsigned addr_idx = 0; addr_idx < chosen->count; addr_idx++) {
-                    const unsigned addr_rand = get_rand(addr_max);
-                    if (addr_rand < dyn_addr_weights[item_idx][addr_idx])
-                        gdnsd_result_add_anysin(result, &chosen->as[addr_idx].addr);
-                }
-                break;
-            }
+        const unsigned item_idx = alias_pick(sel->item_alias, num_items, sel->items_sum);
+        const res_aitem_t* chosen = &aset->items[item_idx];
+        const unsigned* dyn_addr_weights = &sel->addr_weights[aset->addr_offs[item_idx]];
+        // Inner decision: choose multiple addrs based on chosen's dynamic max
+        const unsigned addr_max = sel->item_maxs[item_idx];
+        gdnsd_assert(addr_max);
+        for (unsigned addr_idx = 0; addr_idx < chosen->count; addr_idx++) {
+            const unsigned addr_rand = get_rand(addr_max);
+            if (addr_rand < dyn_addr_weights[addr_idx])
+                gdnsd_result_add_anysin(result, &chosen->as[addr_idx].addr);
         }
     }
 
-    assert_valid_sttl(rv);
-    return rv;
+    assert_valid_sttl(sel->rv);
+    return sel->rv;
 }
 
 F_NONNULL
-static gdnsd_sttl_t resolve_addr(const gdnsd_sttl_t* sttl_tbl, const resource_t* res, dyn_result_t* result)
+static gdnsd_sttl_t resolve_addr(const gdnsd_sttl_t* sttl_tbl, const unsigned gen, const resource_t* res, dyn_result_t* result)
 {
     gdnsd_sttl_t rv;
 
     if (res->addrs_v4) {
-        rv = resolve(sttl_tbl, res->addrs_v4, result);
+        rv = resolve(sttl_tbl, gen, res->addrs_v4, result);
         if (res->addrs_v6) {
-            const gdnsd_sttl_t v6_rv = resolve(sttl_tbl, res->addrs_v6, result);
+            const gdnsd_sttl_t v6_rv = resolve(sttl_tbl, gen, res->addrs_v6, result);
             rv = gdnsd_sttl_min2(rv, v6_rv);
         }
     } else {
         gdnsd_assert(res->addrs_v6);
-        rv = resolve(sttl_tbl, res->addrs_v6, result);
+        rv = resolve(sttl_tbl, gen, res->addrs_v6, result);
     }
 
     assert_valid_sttl(rv);
@@ -941,12 +1095,14 @@ static gdnsd_sttl_t plugin_weighted_resolve(unsigned resnum, const client_info_t
 
     gdnsd_sttl_t rv;
 
+    // The generation must be read before the table it covers
+    const unsigned gen = gdnsd_mon_get_sttl_gen();
     const gdnsd_sttl_t* sttl_tbl = gdnsd_mon_get_sttl_table();
 
     if (resource->cnames) {
-        rv = resolve_cname(sttl_tbl, resource, result);
+        rv = resolve_cname(sttl_tbl, gen, resource, result);
     } else {
-        rv = resolve_addr(sttl_tbl, resource, result);
+        rv = resolve_addr(sttl_tbl, gen, resource, result);
     }
 
     assert_valid_sttl(rv);
@@ -968,4 +1124,5 @@ plugin_t plugin_weighted_funcs = {
     .add_mon_cname = NULL,
     .init_monitors = NULL,
     .start_monitors = NULL,
+    .get_metrics = NULL,
 };
@@ -22,10 +22,12 @@
 
 #include "dnsio_udp.h"
 #include "dnsio_tcp.h"
+#include "metrics.h"
 
 #include <gdnsd/alloc.h>
 #include <gdnsd/misc.h>
 #include <gdnsd/log.h>
+#include <gdnsd/paths.h>
 
 #include <unistd.h>
 #include <string.h>
@@ -53,15 +55,19 @@ static const dns_addr_t addr_defs_defaults = {
     .tcp_threads = 2U,
     .tcp_proxy = false,
     .tcp_pad = false,
+    .tls = false,
+    .tls_ctx = NULL,
 };
 
 static const socks_cfg_t socks_cfg_defaults = {
     .dns_addrs = NULL,
     .dns_threads = NULL,
     .ctl_addrs = NULL,
+    .metrics_addrs = NULL,
     .num_dns_addrs = 0U,
     .num_dns_threads = 0U,
     .num_ctl_addrs = 0U,
+    .num_metrics_addrs = 0U,
     .fd_estimate = 0LU,
 };
 
@@ -121,6 +127,16 @@ static void make_addr(const char* lspec_txt, const unsigned def_port, gdnsd_anys
         } \
     } while (0)
 
+#define CFG_OPT_STR_NOCOPY(_opt_set, _name, _store_at) \
+    do { \
+        vscf_data_t* _opt_setting = vscf_hash_get_data_byconstkey(_opt_set, #_name, true); \
+        if (_opt_setting) { \
+            if (!vscf_is_simple(_opt_setting)) \
+                log_fatal("Config option %s: Wrong type (should be string)", #_name); \
+            _store_at = vscf_simple_get_data(_opt_setting); \
+        } \
+    } while (0)
+
 #define CFG_OPT_REMOVED(_opt_set, _gconf_loc) \
     do { \
         vscf_data_t* _opt_setting = vscf_hash_get_data_byconstkey(_opt_set, #_gconf_loc, true); \
@@ -141,6 +157,22 @@ static void dns_listen_any(socks_cfg_t* socks_cfg, const dns_addr_t* addr_defs)
     make_addr("::", addr_defs->dns_port, &ac_v6->addr);
 }
 
+F_NONNULL
+static void process_listen_tls(dns_addr_t* addrconf, const char* lspec, vscf_data_t* addr_opts)
+{
+    const char* tls_cert = NULL;
+    const char* tls_key = NULL;
+    CFG_OPT_STR_NOCOPY(addr_opts, tls_cert, tls_cert);
+    CFG_OPT_STR_NOCOPY(addr_opts, tls_key, tls_key);
+    if (!tls_cert || !tls_key)
+        log_fatal("DNS listen address '%s': tls requires both tls_cert and tls_key", lspec);
+    char* cert_path = gdnsd_resolve_path_cfg(tls_cert, NULL);
+    char* key_path = gdnsd_resolve_path_cfg(tls_key, NULL);
+    addrconf->tls_ctx = dnstls_ctx_new(cert_path, key_path);
+    free(key_path);
+    free(cert_path);
+}
+
 F_NONNULL
 static void process_listen_hashentry(dns_addr_t* addrconf, const char* lspec, vscf_data_t* addr_opts)
 {
@@ -148,12 +180,13 @@ static void process_listen_hashentry(dns_addr_t* addrconf, const char* lspec, vs
         log_fatal("DNS listen address '%s': per-address options must be a hash", lspec);
     CFG_OPT_REMOVED(addr_opts, udp_recv_width);
     CFG_OPT_BOOL_ALTSTORE(addr_opts, tcp_proxy, addrconf->tcp_proxy);
+    CFG_OPT_BOOL_ALTSTORE(addr_opts, tls, addrconf->tls);
     CFG_OPT_UINT_ALTSTORE(addr_opts, tcp_timeout, 5LU, 1800LU, addrconf->tcp_timeout);
     CFG_OPT_UINT_ALTSTORE_NOMIN(addr_opts, tcp_fastopen, 1048576LU, addrconf->tcp_fastopen);
     CFG_OPT_UINT_ALTSTORE(addr_opts, tcp_clients_per_thread, 16LU, 65535LU, addrconf->tcp_clients_per_thread);
     CFG_OPT_UINT_ALTSTORE_NOMIN(addr_opts, tcp_backlog, 65535LU, addrconf->tcp_backlog);
     CFG_OPT_UINT_ALTSTORE(addr_opts, tcp_threads, 1LU, 1024LU, addrconf->tcp_threads);
-    if (addrconf->tcp_proxy) {
+    if (addrconf->tcp_proxy || addrconf->tls) {
         addrconf->udp_threads = 0U;
         addrconf->tcp_pad = true;
     } else {
@@ -162,21 +195,25 @@ static void process_listen_hashentry(dns_addr_t* addrconf, const char* lspec, vs
         CFG_OPT_UINT_ALTSTORE(addr_opts, udp_threads, 1LU, 1024LU, addrconf->udp_threads);
     }
     CFG_OPT_BOOL_ALTSTORE(addr_opts, tcp_pad, addrconf->tcp_pad);
+    if (addrconf->tls)
+        process_listen_tls(addrconf, lspec, addr_opts);
 
     make_addr(lspec, addrconf->dns_port, &addrconf->addr);
-    if (addrconf->tcp_proxy) {
+    if (addrconf->tcp_proxy || addrconf->tls) {
         unsigned lport;
         if (addrconf->addr.sa.sa_family == AF_INET) {
-            lport = addrconf->addr.sin4.sin_port;
+            lport = ntohs(addrconf->addr.sin4.sin_port);
         } else {
             gdnsd_assert(addrconf->addr.sa.sa_family == AF_INET6);
-            lport = addrconf->addr.sin6.sin6_port;
+            lport = ntohs(addrconf->addr.sin6.sin6_port);
         }
         if (lport == 53U)
-            log_fatal("Cannot configure tcp_proxy mode on port 53");
+            log_fatal("Cannot configure %s mode on port 53", addrconf->tls ? "tls" : "tcp_proxy");
     }
     vscf_hash_iterate_const(addr_opts, true, bad_key, addrconf->tcp_proxy
                             ? "per-address listen option with tcp_proxy"
+                            : addrconf->tls
+                            ? "per-address listen option with tls"
                             : "per-address listen option");
 }
 
@@ -259,10 +296,11 @@ static void process_listen(socks_cfg_t* socks_cfg, vscf_data_t* listen_opt, cons
             t->sock = -1;
         }
 
-        if (a->tcp_proxy) {
+        if (a->tcp_proxy || a->tls) {
             gdnsd_assert(!a->udp_threads);
-            log_info("DNS listener threads (%u TCP PROXY) configured for %s",
-                     a->tcp_threads, logf_anysin(&a->addr));
+            log_info("DNS listener threads (%u TCP%s%s) configured for %s",
+                     a->tcp_threads, a->tcp_proxy ? " PROXY" : "",
+                     a->tls ? " TLS" : "", logf_anysin(&a->addr));
         } else {
             log_info("DNS listener threads (%u UDP + %u TCP) configured for %s",
                      a->udp_threads, a->tcp_threads, logf_anysin(&a->addr));
@@ -326,6 +364,31 @@ static void process_tcp_control(socks_cfg_t* socks_cfg, vscf_data_t* ctl_opt)
     }
 }
 
+F_NONNULL
+static void process_metrics_listen(socks_cfg_t* socks_cfg, vscf_data_t* metrics_opt)
+{
+    if (vscf_is_hash(metrics_opt))
+        log_fatal("Config option 'metrics_listen': must be a single listen spec or an array of them");
+    socks_cfg->num_metrics_addrs = vscf_array_get_len(metrics_opt);
+    if (!socks_cfg->num_metrics_addrs)
+        return;
+    socks_cfg->metrics_addrs = xcalloc_n(socks_cfg->num_metrics_addrs, sizeof(*socks_cfg->metrics_addrs));
+    for (unsigned i = 0; i < socks_cfg->num_metrics_addrs; i++) {
+        vscf_data_t* v_lspec = vscf_array_get_data(metrics_opt, i);
+        if (!vscf_is_simple(v_lspec))
+            log_fatal("Config option 'metrics_listen': all listen specs must be strings");
+        const char* lspec = vscf_simple_get_data(v_lspec);
+        gdnsd_anysin_t* addr = &socks_cfg->metrics_addrs[i];
+        const int addr_err = gdnsd_anysin_fromstr(lspec, 0, addr);
+        if (addr_err)
+            log_fatal("Could not process metrics_listen address spec '%s': %s", lspec, gai_strerror(addr_err));
+        const unsigned lport = (addr->sa.sa_family == AF_INET)
+                               ? addr->sin4.sin_port : addr->sin6.sin6_port;
+        if (!lport)
+            log_fatal("Could not process metrics_listen address spec '%s': port number required", lspec);
+    }
+}
+
 socks_cfg_t* socks_conf_load(const vscf_data_t* cfg_root)
 {
     gdnsd_assert(!cfg_root || vscf_is_hash(cfg_root));
@@ -335,6 +398,7 @@ socks_cfg_t* socks_conf_load(const vscf_data_t* cfg_root)
 
     vscf_data_t* listen_opt = NULL;
     vscf_data_t* ctl_opt = NULL;
+    vscf_data_t* metrics_opt = NULL;
 
     dns_addr_t addr_defs;
     memcpy(&addr_defs, &addr_defs_defaults, sizeof(addr_defs));
@@ -354,11 +418,14 @@ socks_cfg_t* socks_conf_load(const vscf_data_t* cfg_root)
 
         listen_opt = vscf_hash_get_data_byconstkey(options, "listen", true);
         ctl_opt = vscf_hash_get_data_byconstkey(options, "tcp_control", true);
+        metrics_opt = vscf_hash_get_data_byconstkey(options, "metrics_listen", true);
     }
 
     process_listen(socks_cfg, listen_opt, &addr_defs);
     if (ctl_opt)
         process_tcp_control(socks_cfg, ctl_opt);
+    if (metrics_opt)
+        process_metrics_listen(socks_cfg, metrics_opt);
 
     // Estimate the number of socket fds needed, for later rlimit auto-tuning:
     for (unsigned i = 0; i < socks_cfg->num_dns_addrs; i++) {
@@ -375,6 +442,12 @@ socks_cfg_t* socks_conf_load(const vscf_data_t* cfg_root)
     // let's estimate that 16 clients is enough for a default here.
     socks_cfg->fd_estimate += (socks_cfg->num_ctl_addrs * 17U);
 
+    // Metrics sockets share a hard limit of METRICS_MAX_CLIENTS clients for
+    // the whole daemon, plus one more briefly for each client accepted over
+    // the limit before it's closed
+    if (socks_cfg->num_metrics_addrs)
+        socks_cfg->fd_estimate += socks_cfg->num_metrics_addrs + METRICS_MAX_CLIENTS + 1U;
+
     return socks_cfg;
 }
 
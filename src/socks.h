@@ -20,6 +20,8 @@
 #ifndef GDNSD_SOCKS_H
 #define GDNSD_SOCKS_H
 
+#include "dnstls.h"
+
 #include <gdnsd/net.h>
 #include <gdnsd/vscf.h>
 
@@ -39,6 +41,8 @@ typedef struct {
     unsigned tcp_threads;
     bool     tcp_proxy;
     bool     tcp_pad;
+    bool     tls;
+    dnstls_ctx_t* tls_ctx; // non-NULL iff "tls" above
 } dns_addr_t;
 
 typedef struct {
@@ -58,9 +62,11 @@ typedef struct {
     dns_addr_t* dns_addrs;
     dns_thread_t* dns_threads;
     ctl_addr_t* ctl_addrs;
+    gdnsd_anysin_t* metrics_addrs;
     unsigned num_dns_addrs;
     unsigned num_dns_threads;
     unsigned num_ctl_addrs;
+    unsigned num_metrics_addrs;
     unsigned long fd_estimate;
 } socks_cfg_t;
 
@@ -25,9 +25,13 @@
 #include "dnsio_udp.h"
 #include "dnsio_tcp.h"
 #include "dnspacket.h"
+#include "dnstap.h"
 
 #include <gdnsd/alloc.h>
+#include <gdnsd/dname.h>
 #include <gdnsd/log.h>
+#include <gdnsd/misc.h>
+#include <gdnsd/mm3.h>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -35,6 +39,7 @@
 #include <string.h>
 #include <sys/uio.h>
 #include <pthread.h>
+#include <stdarg.h>
 
 typedef enum {
     UDP_RECVFAIL         = 0,
@@ -72,7 +77,37 @@ typedef enum {
     TCP_DSO_PROTOERR     = 32,
     TCP_DSO_TYPENI       = 33,
     TCP_ACCEPTFAIL       = 34,
-    SLOT_COUNT           = 35,
+    TCP_TLS              = 35,
+    TCP_TLS_FAIL         = 36,
+    TCP_AXFR             = 37,
+    TCP_IXFR             = 38,
+    TCP_XFR_REFUSED      = 39,
+    TCP_XFR_BUSY         = 40,
+    TCP_XFR_FAIL         = 41,
+    TCP_XFR_THROTTLED    = 42,
+    DNS_QTYPE_A             = 43,
+    DNS_QTYPE_NS            = 44,
+    DNS_QTYPE_CNAME         = 45,
+    DNS_QTYPE_SOA           = 46,
+    DNS_QTYPE_PTR           = 47,
+    DNS_QTYPE_MX            = 48,
+    DNS_QTYPE_TXT           = 49,
+    DNS_QTYPE_AAAA          = 50,
+    DNS_QTYPE_SRV           = 51,
+    DNS_QTYPE_NAPTR         = 52,
+    DNS_QTYPE_DS            = 53,
+    DNS_QTYPE_DNSKEY        = 54,
+    DNS_QTYPE_SVCB          = 55,
+    DNS_QTYPE_HTTPS         = 56,
+    DNS_QTYPE_CAA           = 57,
+    DNS_QTYPE_ANY           = 58,
+    DNS_QTYPE_IXFR          = 59,
+    DNS_QTYPE_AXFR          = 60,
+    DNS_QTYPE_OTHER         = 61,
+    DNSTAP_WRITTEN       = 62,
+    DNSTAP_DROPPED       = 63,
+    DNSTAP_LOST          = 64,
+    SLOT_COUNT           = 65,
 } slot_t;
 
 static const char json_fixed[] =
@@ -117,9 +152,159 @@ static const char json_fixed[] =
     "\t\t\"dso_estab\": %" PRISTATS ",\n"
     "\t\t\"dso_protoerr\": %" PRISTATS ",\n"
     "\t\t\"dso_typeni\": %" PRISTATS ",\n"
-    "\t\t\"acceptfail\": %" PRISTATS "\n"
-    "\t}\n"
-    "}\n";
+    "\t\t\"acceptfail\": %" PRISTATS ",\n"
+    "\t\t\"tls\": %" PRISTATS ",\n"
+    "\t\t\"tls_fail\": %" PRISTATS ",\n"
+    "\t\t\"axfr\": %" PRISTATS ",\n"
+    "\t\t\"ixfr\": %" PRISTATS ",\n"
+    "\t\t\"xfr_refused\": %" PRISTATS ",\n"
+    "\t\t\"xfr_busy\": %" PRISTATS ",\n"
+    "\t\t\"xfr_fail\": %" PRISTATS ",\n"
+    "\t\t\"xfr_throttled\": %" PRISTATS "\n"
+    "\t},\n"
+    "\t\"qtype\": {\n"
+    "\t\t\"a\": %" PRISTATS ",\n"
+    "\t\t\"ns\": %" PRISTATS ",\n"
+    "\t\t\"cname\": %" PRISTATS ",\n"
+    "\t\t\"soa\": %" PRISTATS ",\n"
+    "\t\t\"ptr\": %" PRISTATS ",\n"
+    "\t\t\"mx\": %" PRISTATS ",\n"
+    "\t\t\"txt\": %" PRISTATS ",\n"
+    "\t\t\"aaaa\": %" PRISTATS ",\n"
+    "\t\t\"srv\": %" PRISTATS ",\n"
+    "\t\t\"naptr\": %" PRISTATS ",\n"
+    "\t\t\"ds\": %" PRISTATS ",\n"
+    "\t\t\"dnskey\": %" PRISTATS ",\n"
+    "\t\t\"svcb\": %" PRISTATS ",\n"
+    "\t\t\"https\": %" PRISTATS ",\n"
+    "\t\t\"caa\": %" PRISTATS ",\n"
+    "\t\t\"any\": %" PRISTATS ",\n"
+    "\t\t\"ixfr\": %" PRISTATS ",\n"
+    "\t\t\"axfr\": %" PRISTATS ",\n"
+    "\t\t\"other\": %" PRISTATS "\n"
+    "\t},\n"
+    "\t\"dnstap\": {\n"
+    "\t\t\"written\": %" PRISTATS ",\n"
+    "\t\t\"dropped\": %" PRISTATS ",\n"
+    "\t\t\"lost\": %" PRISTATS "\n"
+    "\t},\n";
+
+// The latency histograms follow the fixed part above.  They aren't part of the
+// slot_t stats, and are not carried over from the daemon we replaced.
+typedef enum {
+    LAT_UDP_PDQ   = 0,
+    LAT_TCP_PDQ   = 1,
+    LAT_UDP_RX_TX = 2,
+    LAT_COUNT     = 3,
+} lat_t;
+
+static const char* const lat_names[LAT_COUNT] = {
+    "udp_pdq",
+    "tcp_pdq",
+    "udp_rx_tx",
+};
+
+// Reported percentiles, in units of 1/1000
+static const unsigned lat_pctls[] = { 500U, 900U, 990U, 999U };
+#define LAT_PCTL_COUNT (sizeof(lat_pctls) / sizeof(lat_pctls[0]))
+
+static const char json_lat_head[] = "\t\"latency\": {\n";
+static const char json_lat_hist[] =
+    "\t\t\"%s\": {\n"
+    "\t\t\t\"count\": %" PRIu64 ",\n"
+    "\t\t\t\"p50\": %" PRIu64 ",\n"
+    "\t\t\t\"p90\": %" PRIu64 ",\n"
+    "\t\t\t\"p99\": %" PRIu64 ",\n"
+    "\t\t\t\"p999\": %" PRIu64 ",\n"
+    "\t\t\t\"buckets\": [";
+static const char json_lat_bucket[] = "%s[%" PRIu64 ", %" PRISTATS "]";
+static const char json_lat_hist_tail[] = "]\n\t\t}%s\n";
+static const char json_lat_tail[] = "\t}";
+
+// The optional per-zone stats follow the latency histograms
+static const char json_zones_head[] = ",\n\t\"zones\": {\n";
+static const char json_zone[] = "\t\t\"%s\": { \"noerror\": %" PRISTATS ", \"nxdomain\": %" PRISTATS " }%s\n";
+static const char json_zone_other[] = "(other)";
+static const char json_zones_tail[] = "\t}";
+static const char json_tail[] = "\n}\n";
+
+// Metrics exposition of the slot_t counters above.  Consecutive entries with
+// the same name are the labeled members of one family.
+typedef struct {
+    const char* name;
+    const char* help;
+    const char* labels;
+    slot_t slot;
+} metric_slot_t;
+
+static const metric_slot_t metric_slots[] = {
+    { "gdnsd_dns_responses", "DNS requests by response code, including dropped requests", "rcode=\"noerror\"", DNS_NOERROR },
+    { "gdnsd_dns_responses", NULL, "rcode=\"refused\"", DNS_REFUSED },
+    { "gdnsd_dns_responses", NULL, "rcode=\"nxdomain\"", DNS_NXDOMAIN },
+    { "gdnsd_dns_responses", NULL, "rcode=\"notimp\"", DNS_NOTIMP },
+    { "gdnsd_dns_responses", NULL, "rcode=\"badvers\"", DNS_BADVERS },
+    { "gdnsd_dns_responses", NULL, "rcode=\"formerr\"", DNS_FORMERR },
+    { "gdnsd_dns_responses", NULL, "rcode=\"dropped\"", DNS_DROPPED },
+    { "gdnsd_dns_v6", "DNS requests from IPv6 clients", NULL, DNS_V6 },
+    { "gdnsd_dns_edns", "DNS requests with EDNS", NULL, DNS_EDNS },
+    { "gdnsd_dns_edns_clientsub", "DNS requests with the EDNS Client Subnet option", NULL, DNS_EDNS_CLIENTSUB },
+    { "gdnsd_dns_edns_do", "DNS requests with the EDNS DO bit", NULL, DNS_EDNS_DO },
+    { "gdnsd_dns_edns_cookie", "DNS requests with the EDNS Cookie option, by result", "result=\"formerr\"", DNS_EDNS_COOKIE_ERR },
+    { "gdnsd_dns_edns_cookie", NULL, "result=\"ok\"", DNS_EDNS_COOKIE_OK },
+    { "gdnsd_dns_edns_cookie", NULL, "result=\"init\"", DNS_EDNS_COOKIE_INIT },
+    { "gdnsd_dns_edns_cookie", NULL, "result=\"bad\"", DNS_EDNS_COOKIE_BAD },
+    { "gdnsd_dns_qtype", "DNS requests by query type", "qtype=\"a\"", DNS_QTYPE_A },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"ns\"", DNS_QTYPE_NS },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"cname\"", DNS_QTYPE_CNAME },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"soa\"", DNS_QTYPE_SOA },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"ptr\"", DNS_QTYPE_PTR },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"mx\"", DNS_QTYPE_MX },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"txt\"", DNS_QTYPE_TXT },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"aaaa\"", DNS_QTYPE_AAAA },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"srv\"", DNS_QTYPE_SRV },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"naptr\"", DNS_QTYPE_NAPTR },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"ds\"", DNS_QTYPE_DS },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"dnskey\"", DNS_QTYPE_DNSKEY },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"svcb\"", DNS_QTYPE_SVCB },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"https\"", DNS_QTYPE_HTTPS },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"caa\"", DNS_QTYPE_CAA },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"any\"", DNS_QTYPE_ANY },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"ixfr\"", DNS_QTYPE_IXFR },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"axfr\"", DNS_QTYPE_AXFR },
+    { "gdnsd_dns_qtype", NULL, "qtype=\"other\"", DNS_QTYPE_OTHER },
+    { "gdnsd_udp_reqs", "UDP requests", NULL, UDP_REQS },
+    { "gdnsd_udp_recvfail", "UDP receive failures", NULL, UDP_RECVFAIL },
+    { "gdnsd_udp_sendfail", "UDP send failures", NULL, UDP_SENDFAIL },
+    { "gdnsd_udp_tc", "UDP responses truncated", NULL, UDP_TC },
+    { "gdnsd_udp_edns_big", "UDP responses over 512 bytes sent to EDNS clients", NULL, UDP_EDNS_BIG },
+    { "gdnsd_udp_edns_tc", "UDP responses to EDNS clients truncated", NULL, UDP_EDNS_TC },
+    { "gdnsd_tcp_reqs", "TCP requests", NULL, TCP_REQS },
+    { "gdnsd_tcp_recvfail", "TCP receive failures", NULL, TCP_RECVFAIL },
+    { "gdnsd_tcp_sendfail", "TCP send failures", NULL, TCP_SENDFAIL },
+    { "gdnsd_tcp_conns", "TCP connections accepted", NULL, TCP_CONNS },
+    { "gdnsd_tcp_close", "TCP connections closed, by reason", "reason=\"client\"", TCP_CLOSE_C },
+    { "gdnsd_tcp_close", NULL, "reason=\"server_ok\"", TCP_CLOSE_S_OK },
+    { "gdnsd_tcp_close", NULL, "reason=\"server_err\"", TCP_CLOSE_S_ERR },
+    { "gdnsd_tcp_close", NULL, "reason=\"server_kill\"", TCP_CLOSE_S_KILL },
+    { "gdnsd_tcp_proxy", "TCP PROXY protocol headers accepted", NULL, TCP_PROXY },
+    { "gdnsd_tcp_proxy_fail", "TCP PROXY protocol header failures", NULL, TCP_PROXY_FAIL },
+    { "gdnsd_tcp_dso_estab", "TCP DSO sessions established", NULL, TCP_DSO_ESTAB },
+    { "gdnsd_tcp_dso_protoerr", "TCP DSO protocol errors", NULL, TCP_DSO_PROTOERR },
+    { "gdnsd_tcp_dso_typeni", "TCP DSO requests of unimplemented types", NULL, TCP_DSO_TYPENI },
+    { "gdnsd_tcp_acceptfail", "TCP accept failures", NULL, TCP_ACCEPTFAIL },
+    { "gdnsd_tcp_tls", "TLS handshakes completed", NULL, TCP_TLS },
+    { "gdnsd_tcp_tls_fail", "TLS handshake failures", NULL, TCP_TLS_FAIL },
+    { "gdnsd_tcp_xfr", "Zone transfers started, by type", "type=\"axfr\"", TCP_AXFR },
+    { "gdnsd_tcp_xfr", NULL, "type=\"ixfr\"", TCP_IXFR },
+    { "gdnsd_tcp_xfr_errors", "Zone transfers not completed, by reason", "reason=\"refused\"", TCP_XFR_REFUSED },
+    { "gdnsd_tcp_xfr_errors", NULL, "reason=\"busy\"", TCP_XFR_BUSY },
+    { "gdnsd_tcp_xfr_errors", NULL, "reason=\"fail\"", TCP_XFR_FAIL },
+    { "gdnsd_tcp_xfr_errors", NULL, "reason=\"throttled\"", TCP_XFR_THROTTLED },
+    { "gdnsd_dnstap_written", "dnstap records written to the output", NULL, DNSTAP_WRITTEN },
+    { "gdnsd_dnstap_dropped", "dnstap records dropped due to full rings", NULL, DNSTAP_DROPPED },
+    { "gdnsd_dnstap_lost", "dnstap records lost due to output failures", NULL, DNSTAP_LOST },
+};
+#define METRIC_SLOT_COUNT (sizeof(metric_slots) / sizeof(metric_slots[0]))
 
 static time_t start_time;
 static unsigned num_dns_threads;
@@ -132,7 +317,38 @@ static stats_uint_t statio_base[SLOT_COUNT];
 // This is reset to statio_base and used to accumulate thread stats for output
 static stats_uint_t statio[SLOT_COUNT];
 
+// Same as above for the latency histograms
+static stats_uint_t latency[LAT_COUNT][LATENCY_BUCKETS];
+
+// Per-zone stats registry.  Each distinct zone name that's ever loaded is
+// assigned the next id in the range 1 - zone_stats permanently, so that its
+// counters survive zone reloads.  The zones reloader thread adds names, and
+// statio reads them, under zone_names_lock.  Entries never change once added.
+typedef struct {
+    uint8_t* dname;
+    char* json_name; // escaped for use as a JSON key
+    unsigned json_name_len;
+} zone_name_t;
+
+static pthread_mutex_t zone_names_lock = PTHREAD_MUTEX_INITIALIZER;
+static zone_name_t* zone_names = NULL; // [zone_stats + 1], zero is unused
+static unsigned zone_names_count = 0;
+static size_t zone_names_json_len = 0; // sum of json_name_len above
+static uint32_t* zone_names_hash = NULL; // ids, open addressing, zero is empty
+static uint32_t zone_names_hash_mask = 0;
+
+// Accumulated like statio[] above, [zone_stats + 1][ZONE_STAT_COUNT]
+static stats_uint_t* zone_statio = NULL;
+
 static size_t json_buffer_max = 0;
+static size_t json_zone_max = 0;
+
+F_NONNULL
+static void accumulate_latency(stats_uint_t* out, const latency_hist_t* h)
+{
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+        out[i] += stats_get(&h->b[i]);
+}
 
 static void accumulate_statio(unsigned threadnum)
 {
@@ -164,6 +380,8 @@ static void accumulate_statio(unsigned threadnum)
         statio[UDP_TC]       += stats_get(&this_stats->udp.tc);
         statio[UDP_EDNS_BIG] += stats_get(&this_stats->udp.edns_big);
         statio[UDP_EDNS_TC]  += stats_get(&this_stats->udp.edns_tc);
+        accumulate_latency(latency[LAT_UDP_PDQ], &this_stats->pdq);
+        accumulate_latency(latency[LAT_UDP_RX_TX], &this_stats->rx_tx);
     } else {
         statio[TCP_REQS]         += this_reqs;
         statio[TCP_RECVFAIL]     += stats_get(&this_stats->tcp.recvfail);
@@ -179,8 +397,20 @@ static void accumulate_statio(unsigned threadnum)
         statio[TCP_DSO_PROTOERR] += stats_get(&this_stats->tcp.dso_protoerr);
         statio[TCP_DSO_TYPENI]   += stats_get(&this_stats->tcp.dso_typeni);
         statio[TCP_ACCEPTFAIL]   += stats_get(&this_stats->tcp.acceptfail);
+        statio[TCP_TLS]          += stats_get(&this_stats->tcp.tls);
+        statio[TCP_TLS_FAIL]     += stats_get(&this_stats->tcp.tls_fail);
+        statio[TCP_AXFR]         += stats_get(&this_stats->tcp.axfr);
+        statio[TCP_IXFR]         += stats_get(&this_stats->tcp.ixfr);
+        statio[TCP_XFR_REFUSED]  += stats_get(&this_stats->tcp.xfr_refused);
+        statio[TCP_XFR_BUSY]     += stats_get(&this_stats->tcp.xfr_busy);
+        statio[TCP_XFR_FAIL]     += stats_get(&this_stats->tcp.xfr_fail);
+        statio[TCP_XFR_THROTTLED] += stats_get(&this_stats->tcp.xfr_throttled);
+        accumulate_latency(latency[LAT_TCP_PDQ], &this_stats->pdq);
     }
 
+    for (unsigned i = 0; i < QTYPE_STAT_COUNT; i++)
+        statio[DNS_QTYPE_A + i] += stats_get(&this_stats->qtype[i]);
+
     statio[DNS_V6]               += stats_get(&this_stats->v6);
     statio[DNS_EDNS]             += stats_get(&this_stats->edns);
     statio[DNS_EDNS_CLIENTSUB]   += stats_get(&this_stats->edns_clientsub);
@@ -191,25 +421,265 @@ static void accumulate_statio(unsigned threadnum)
     statio[DNS_EDNS_COOKIE_BAD]  += stats_get(&this_stats->edns_cookie_bad);
 }
 
-static void populate_statio(void)
+F_NONNULL
+static void accumulate_zone_statio(const dnspacket_stats_t* this_stats, const unsigned rows)
+{
+    gdnsd_assert(this_stats->zone);
+    const unsigned count = rows * ZONE_STAT_COUNT;
+    for (unsigned i = 0; i < count; i++)
+        zone_statio[i] += stats_get(&this_stats->zone[i]);
+}
+
+// Returns the number of zone_statio rows populated, including the zero row
+static unsigned populate_statio(void)
 {
     memcpy(&statio, &statio_base, sizeof(statio));
+    memset(&latency, 0, sizeof(latency));
     for (unsigned i = 0; i < num_dns_threads; i++)
         accumulate_statio(i);
+
+    stats_uint_t dt_written, dt_dropped, dt_lost;
+    dnstap_get_stats(&dt_written, &dt_dropped, &dt_lost);
+    statio[DNSTAP_WRITTEN] += dt_written;
+    statio[DNSTAP_DROPPED] += dt_dropped;
+    statio[DNSTAP_LOST]    += dt_lost;
+
+    unsigned zone_rows = 0;
+    if (zone_statio) {
+        pthread_mutex_lock(&zone_names_lock);
+        zone_rows = zone_names_count + 1U;
+        pthread_mutex_unlock(&zone_names_lock);
+        memset(zone_statio, 0, zone_rows * ZONE_STAT_COUNT * sizeof(*zone_statio));
+        for (unsigned i = 0; i < num_dns_threads; i++)
+            accumulate_zone_statio(dnspacket_stats[i], zone_rows);
+    }
+    return zone_rows;
+}
+
+// gdnsd_dname_to_string() escapes everything outside of printable ASCII, so
+// only backslash and double-quote need further escaping for JSON
+F_NONNULL F_RETNN
+static char* zone_json_name(const uint8_t* dname, unsigned* len_out)
+{
+    char str[1024];
+    gdnsd_dname_to_string(dname, str);
+    char* out = xmalloc((strlen(str) * 2U) + 1U);
+    unsigned len = 0;
+    for (const char* c = str; *c; c++) {
+        if (*c == '\\' || *c == '"')
+            out[len++] = '\\';
+        out[len++] = *c;
+    }
+    out[len] = '\0';
+    *len_out = len;
+    return out;
+}
+
+unsigned statio_zone_id(const uint8_t* dname)
+{
+    gdnsd_assert(gcfg->zone_stats);
+    const unsigned dlen = *dname + 1U;
+    unsigned rv = 0;
+
+    pthread_mutex_lock(&zone_names_lock);
+    if (!zone_names) {
+        zone_names = xcalloc_n(gcfg->zone_stats + 1U, sizeof(*zone_names));
+        zone_names_hash_mask = count2mask(gcfg->zone_stats * 2U);
+        zone_names_hash = xcalloc_n(zone_names_hash_mask + 1U, sizeof(*zone_names_hash));
+    }
+
+    uint32_t slot = hash_mm3_u32(dname, dlen) & zone_names_hash_mask;
+    unsigned jmpby = 1U;
+    while (zone_names_hash[slot]) {
+        const uint32_t id = zone_names_hash[slot];
+        if (!memcmp(zone_names[id].dname, dname, dlen)) {
+            rv = id;
+            break;
+        }
+        slot += jmpby++;
+        slot &= zone_names_hash_mask;
+    }
+
+    if (!rv && zone_names_count < gcfg->zone_stats) {
+        rv = ++zone_names_count;
+        zone_name_t* zn = &zone_names[rv];
+        zn->dname = dname_dup(dname);
+        zn->json_name = zone_json_name(dname, &zn->json_name_len);
+        zone_names_json_len += zn->json_name_len;
+        zone_names_hash[slot] = rv;
+    } else if (!rv) {
+        log_warn("Zone '%s' is counted with others in zone_stats, which is limited to %u zones",
+                 logf_dname(dname), gcfg->zone_stats);
+    }
+    pthread_mutex_unlock(&zone_names_lock);
+
+    return rv;
+}
+
+F_NONNULL F_PRINTF(4, 5)
+static size_t json_append(char* buf, const size_t buf_max, size_t pos, const char* fmt, ...)
+{
+    gdnsd_assert(pos < buf_max);
+    va_list ap;
+    va_start(ap, fmt);
+    const int snp_rv = vsnprintf(&buf[pos], buf_max - pos, fmt, ap);
+    va_end(ap);
+    gdnsd_assert(snp_rv >= 0 && (size_t)snp_rv < buf_max - pos);
+    return pos + (size_t)snp_rv;
+}
+
+// Percentiles are reported as the upper bound of the bucket containing the
+// given rank, so that they're never an under-estimate.
+F_NONNULL
+static size_t json_latency_hist(char* buf, const size_t buf_max, size_t pos, const lat_t which)
+{
+    const stats_uint_t* hist = latency[which];
+    uint64_t count = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+        count += hist[i];
+
+    uint64_t pctl_vals[LAT_PCTL_COUNT] = { 0 };
+    if (count) {
+        unsigned p = 0;
+        uint64_t cumulative = 0;
+        for (unsigned i = 0; i < LATENCY_BUCKETS && p < LAT_PCTL_COUNT; i++) {
+            cumulative += hist[i];
+            while (p < LAT_PCTL_COUNT) {
+                uint64_t rank = ((count * lat_pctls[p]) + 999U) / 1000U;
+                if (!rank)
+                    rank = 1;
+                if (cumulative < rank)
+                    break;
+                pctl_vals[p++] = latency_bucket_upper(i);
+            }
+        }
+    }
+
+    pos = json_append(buf, buf_max, pos, json_lat_hist, lat_names[which], count,
+                      pctl_vals[0], pctl_vals[1], pctl_vals[2], pctl_vals[3]);
+    const char* sep = "";
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+        if (hist[i]) {
+            pos = json_append(buf, buf_max, pos, json_lat_bucket, sep, latency_bucket_lower(i), hist[i]);
+            sep = ", ";
+        }
+    }
+    return json_append(buf, buf_max, pos, json_lat_hist_tail, (which + 1U < LAT_COUNT) ? "," : "");
+}
+
+F_NONNULL
+static size_t json_zones(char* buf, const size_t buf_max, size_t pos, const unsigned rows)
+{
+    pos = json_append(buf, buf_max, pos, "%s", json_zones_head);
+    const bool other = (rows - 1U) == gcfg->zone_stats;
+    for (unsigned i = 1; i < rows; i++) {
+        const stats_uint_t* zs = &zone_statio[i * ZONE_STAT_COUNT];
+        pos = json_append(buf, buf_max, pos, json_zone, zone_names[i].json_name,
+                          zs[ZONE_STAT_NOERROR], zs[ZONE_STAT_NXDOMAIN],
+                          (other || i + 1U < rows) ? "," : "");
+    }
+    if (other)
+        pos = json_append(buf, buf_max, pos, json_zone, json_zone_other,
+                          zone_statio[ZONE_STAT_NOERROR], zone_statio[ZONE_STAT_NXDOMAIN], "");
+    return json_append(buf, buf_max, pos, "%s", json_zones_tail);
 }
 
 char* statio_get_json(time_t nowish, size_t* len)
 {
-    populate_statio();
+    const unsigned zone_rows = populate_statio();
+    size_t buf_max = json_buffer_max;
+    if (zone_rows) {
+        pthread_mutex_lock(&zone_names_lock);
+        buf_max += (zone_rows * json_zone_max) + zone_names_json_len;
+        pthread_mutex_unlock(&zone_names_lock);
+    }
+
     // fill json output buffer
     uint64_t uptime64 = (uint64_t)nowish - (uint64_t)start_time;
-    char* buf = xmalloc(json_buffer_max);
-    int snp_rv = snprintf(buf, json_buffer_max, json_fixed, uptime64, statio[DNS_NOERROR], statio[DNS_REFUSED], statio[DNS_NXDOMAIN], statio[DNS_NOTIMP], statio[DNS_BADVERS], statio[DNS_FORMERR], statio[DNS_DROPPED], statio[DNS_V6], statio[DNS_EDNS], statio[DNS_EDNS_CLIENTSUB], statio[DNS_EDNS_DO], statio[DNS_EDNS_COOKIE_ERR], statio[DNS_EDNS_COOKIE_OK], statio[DNS_EDNS_COOKIE_INIT], statio[DNS_EDNS_COOKIE_BAD], statio[UDP_REQS], statio[UDP_RECVFAIL], statio[UDP_SENDFAIL], statio[UDP_TC], statio[UDP_EDNS_BIG], statio[UDP_EDNS_TC], statio[TCP_REQS], statio[TCP_RECVFAIL], statio[TCP_SENDFAIL], statio[TCP_CONNS], statio[TCP_CLOSE_C], statio[TCP_CLOSE_S_OK], statio[TCP_CLOSE_S_ERR], statio[TCP_CLOSE_S_KILL], statio[TCP_PROXY], statio[TCP_PROXY_FAIL], statio[TCP_DSO_ESTAB], statio[TCP_DSO_PROTOERR], statio[TCP_DSO_TYPENI], statio[TCP_ACCEPTFAIL]);
-    gdnsd_assert(snp_rv > 0 && (size_t)snp_rv < json_buffer_max);
-    *len = (size_t)snp_rv;
+    char* buf = xmalloc(buf_max);
+    int snp_rv = snprintf(buf, buf_max, json_fixed, uptime64, statio[DNS_NOERROR], statio[DNS_REFUSED], statio[DNS_NXDOMAIN], statio[DNS_NOTIMP], statio[DNS_BADVERS], statio[DNS_FORMERR], statio[DNS_DROPPED], statio[DNS_V6], statio[DNS_EDNS], statio[DNS_EDNS_CLIENTSUB], statio[DNS_EDNS_DO], statio[DNS_EDNS_COOKIE_ERR], statio[DNS_EDNS_COOKIE_OK], statio[DNS_EDNS_COOKIE_INIT], statio[DNS_EDNS_COOKIE_BAD], statio[UDP_REQS], statio[UDP_RECVFAIL], statio[UDP_SENDFAIL], statio[UDP_TC], statio[UDP_EDNS_BIG], statio[UDP_EDNS_TC], statio[TCP_REQS], statio[TCP_RECVFAIL], statio[TCP_SENDFAIL], statio[TCP_CONNS], statio[TCP_CLOSE_C], statio[TCP_CLOSE_S_OK], statio[TCP_CLOSE_S_ERR], statio[TCP_CLOSE_S_KILL], statio[TCP_PROXY], statio[TCP_PROXY_FAIL], statio[TCP_DSO_ESTAB], statio[TCP_DSO_PROTOERR], statio[TCP_DSO_TYPENI], statio[TCP_ACCEPTFAIL], statio[TCP_TLS], statio[TCP_TLS_FAIL], statio[TCP_AXFR], statio[TCP_IXFR], statio[TCP_XFR_REFUSED], statio[TCP_XFR_BUSY], statio[TCP_XFR_FAIL], statio[TCP_XFR_THROTTLED], statio[DNS_QTYPE_A], statio[DNS_QTYPE_NS], statio[DNS_QTYPE_CNAME], statio[DNS_QTYPE_SOA], statio[DNS_QTYPE_PTR], statio[DNS_QTYPE_MX], statio[DNS_QTYPE_TXT], statio[DNS_QTYPE_AAAA], statio[DNS_QTYPE_SRV], statio[DNS_QTYPE_NAPTR], statio[DNS_QTYPE_DS], statio[DNS_QTYPE_DNSKEY], statio[DNS_QTYPE_SVCB], statio[DNS_QTYPE_HTTPS], statio[DNS_QTYPE_CAA], statio[DNS_QTYPE_ANY], statio[DNS_QTYPE_IXFR], statio[DNS_QTYPE_AXFR], statio[DNS_QTYPE_OTHER], statio[DNSTAP_WRITTEN], statio[DNSTAP_DROPPED], statio[DNSTAP_LOST]);
+    gdnsd_assert(snp_rv > 0 && (size_t)snp_rv < buf_max);
+    size_t pos = json_append(buf, buf_max, (size_t)snp_rv, "%s", json_lat_head);
+    for (unsigned i = 0; i < LAT_COUNT; i++)
+        pos = json_latency_hist(buf, buf_max, pos, (lat_t)i);
+    pos = json_append(buf, buf_max, pos, "%s", json_lat_tail);
+    if (zone_rows)
+        pos = json_zones(buf, buf_max, pos, zone_rows);
+    *len = json_append(buf, buf_max, pos, "%s", json_tail);
     return buf;
 }
 
+// Histogram buckets are reported at each power of two from 16ns through ~2.1s,
+// which is every LATENCY_SUB_COUNT of our internal buckets.  Samples are whole
+// nanoseconds, so each "le" bound is one less than the power of two, in order
+// to be exact.  Values beyond that are only in the +Inf bucket.  There is no
+// _sum, as we don't track one.
+F_NONNULL
+static void metrics_latency_hist(metrics_buf_t* mb, const lat_t which)
+{
+    const stats_uint_t* hist = latency[which];
+    uint64_t cumulative = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS - LATENCY_SUB_COUNT; i++) {
+        cumulative += hist[i];
+        if ((i & (LATENCY_SUB_COUNT - 1U)) == (LATENCY_SUB_COUNT - 1U)) {
+            const uint64_t le_ns = latency_bucket_upper(i);
+            metrics_printf(mb, "gdnsd_latency_seconds_bucket{type=\"%s\",le=\"%" PRIu64 ".%09" PRIu64 "\"} %" PRIu64 "\n",
+                           lat_names[which], le_ns / 1000000000U, le_ns % 1000000000U, cumulative);
+        }
+    }
+    for (unsigned i = LATENCY_BUCKETS - LATENCY_SUB_COUNT; i < LATENCY_BUCKETS; i++)
+        cumulative += hist[i];
+    metrics_printf(mb, "gdnsd_latency_seconds_bucket{type=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+                   "gdnsd_latency_seconds_count{type=\"%s\"} %" PRIu64 "\n",
+                   lat_names[which], cumulative, lat_names[which], cumulative);
+}
+
+void statio_get_metrics(metrics_buf_t* mb, time_t nowish)
+{
+    const unsigned zone_rows = populate_statio();
+
+    metrics_family(mb, "gdnsd_start_time_seconds", METRIC_GAUGE,
+                   "Start time of the first daemon in this replace sequence, in seconds since the epoch");
+    metrics_printf(mb, "gdnsd_start_time_seconds %" PRIu64 "\n", (uint64_t)start_time);
+    metrics_family(mb, "gdnsd_uptime_seconds", METRIC_GAUGE,
+                   "Seconds since the first daemon in this replace sequence started");
+    metrics_printf(mb, "gdnsd_uptime_seconds %" PRIu64 "\n", (uint64_t)nowish - (uint64_t)start_time);
+
+    const char* last_name = NULL;
+    for (unsigned i = 0; i < METRIC_SLOT_COUNT; i++) {
+        const metric_slot_t* ms = &metric_slots[i];
+        if (!last_name || strcmp(last_name, ms->name)) {
+            gdnsd_assert(ms->help);
+            metrics_family(mb, ms->name, METRIC_COUNTER, ms->help);
+            last_name = ms->name;
+        }
+        if (ms->labels)
+            metrics_printf(mb, "%s_total{%s} %" PRISTATS "\n", ms->name, ms->labels, statio[ms->slot]);
+        else
+            metrics_printf(mb, "%s_total %" PRISTATS "\n", ms->name, statio[ms->slot]);
+    }
+
+    metrics_family(mb, "gdnsd_latency_seconds", METRIC_HISTOGRAM,
+                   "Request latency, by type: udp_pdq and tcp_pdq for request processing, udp_rx_tx for kernel receive to send");
+    for (unsigned i = 0; i < LAT_COUNT; i++)
+        metrics_latency_hist(mb, (lat_t)i);
+
+    if (zone_rows) {
+        metrics_family(mb, "gdnsd_zone_responses", METRIC_COUNTER,
+                       "DNS responses by zone and response code, for the zones counted by zone_stats");
+        const bool other = (zone_rows - 1U) == gcfg->zone_stats;
+        // zone names are already JSON-escaped, which is identical to label
+        // value escaping for the characters that can appear in them
+        for (unsigned i = other ? 0 : 1; i < zone_rows; i++) {
+            const char* name = i ? zone_names[i].json_name : json_zone_other;
+            const stats_uint_t* zs = &zone_statio[i * ZONE_STAT_COUNT];
+            metrics_printf(mb, "gdnsd_zone_responses_total{zone=\"%s\",rcode=\"noerror\"} %" PRISTATS "\n"
+                           "gdnsd_zone_responses_total{zone=\"%s\",rcode=\"nxdomain\"} %" PRISTATS "\n",
+                           name, zs[ZONE_STAT_NOERROR], name, zs[ZONE_STAT_NXDOMAIN]);
+        }
+    }
+}
+
 // Serializes as a set of 8-byte uint64_t values, one for each stat slot,
 // followed by an extra one for the start_time value.
 // *dlen_p holds the raw size of the allocated, returned buffer in bytes.
@@ -251,13 +721,28 @@ void statio_init(unsigned arg_num_dns_threads)
     start_time = time(NULL);
     memset(&statio_base, 0, sizeof(statio_base));
     memset(&statio, 0, sizeof(statio_base));
+    if (gcfg->zone_stats)
+        zone_statio = xcalloc_n((gcfg->zone_stats + 1U) * ZONE_STAT_COUNT, sizeof(*zone_statio));
 
     // stats counters are 32-bit on 32-bit machines, and 64 on 64
     const unsigned stat_len = sizeof(stats_uint_t) == 8 ? 20 : 10;
     json_buffer_max =
         (sizeof(json_fixed) - 1)               // json_fixed format string
         + (20 - strlen(PRIu64))                // uint64_t uptime
-        + (SLOT_COUNT * (stat_len - strlen(PRISTATS))); // SLOT_COUNT stats, 10 or 20 bytes long each
+        + (SLOT_COUNT * (stat_len - strlen(PRISTATS))) // SLOT_COUNT stats, 10 or 20 bytes long each
+        + (sizeof(json_lat_head) - 1)
+        + (LAT_COUNT * (
+               (sizeof(json_lat_hist) - 1) + 20 // name, plus a few bytes
+               + ((1 + LAT_PCTL_COUNT) * 20)    // count and percentiles
+               + (LATENCY_BUCKETS * ((sizeof(json_lat_bucket) - 1) + 2 + 20 + stat_len))
+               + (sizeof(json_lat_hist_tail) - 1) + 1))
+        + (sizeof(json_lat_tail) - 1)
+        + (sizeof(json_zones_head) - 1) + (sizeof(json_zones_tail) - 1)
+        + (sizeof(json_tail) - 1);
+
+    // Per-zone entries, excluding the zone name itself
+    json_zone_max = (sizeof(json_zone) - 1) + (sizeof(json_zone_other) - 1)
+                    + (ZONE_STAT_COUNT * stat_len) + 1;
 
     // double it, because it's not that big and this gives us a lot of headroom for
     //   having made any stupid mistakes in the max len calcuations :P
@@ -20,6 +20,8 @@
 #ifndef GDSND_STATIO_H
 #define GDSND_STATIO_H
 
+#include "metrics.h"
+
 #include <gdnsd/compiler.h>
 #include <sys/types.h>
 #include <inttypes.h>
@@ -30,10 +32,21 @@ void statio_init(unsigned arg_num_dns_threads);
 F_NONNULL F_RETNN
 char* statio_get_json(time_t nowish, size_t* len);
 
+// Appends all of the above, in the text exposition format selected by
+// mb->openmetrics, for the HTTP metrics listeners
+F_NONNULL
+void statio_get_metrics(metrics_buf_t* mb, time_t nowish);
+
 F_NONNULL F_MALLOC
 char* statio_serialize(size_t* dlen_p);
 
 F_NONNULL
 void statio_deserialize(uint64_t* data, size_t dlen);
 
+// Zones reloader only, when "zone_stats" is set: returns the permanent stats
+// id of a zone name, assigning the next free id on the first call for each
+// name, or zero if all of the ids are already taken by other zones.
+F_NONNULL
+unsigned statio_zone_id(const uint8_t* dname);
+
 #endif // GDSND_STATIO_H
@@ -0,0 +1,919 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "xfr.h"
+
+#include "conf.h"
+#include "dnswire.h"
+#include "ltree.h"
+
+#include <gdnsd/alloc.h>
+#include <gdnsd/dname.h>
+#include <gdnsd/log.h>
+#include <gdnsd/misc.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <urcu-qsbr.h>
+#include <urcu/uatomic.h>
+
+// Message size limit for DNS over TCP, we always fill messages up to this
+#define XFR_MSG_MAX 65535U
+
+// Compression pointers can only reach targets in the first 16K of a message
+#define XFR_COMP_LIMIT 0x4000U
+
+// A name can be at most 127 labels below its zone root (the root zone)
+#define XFR_DEPTH_MAX 128U
+
+// Offset of the question name, which we copy into every message
+#define XFR_QNAME_OFFSET 12U
+
+// An IXFR change set, converting one version of a zone to the next
+typedef struct {
+    unsigned refcount; // only touched by the reloader thread
+    uint32_t from_serial; // host-order
+    uint32_t to_serial; // host-order
+    // Uncompressed RRs in the order they're sent: old SOA, deletions, new SOA,
+    // additions.
+    size_t len;
+    uint8_t* data;
+} xfr_cset_t;
+
+typedef struct {
+    uint8_t* dname;
+    const ltree_node_t* root;
+    const ltree_rrset_soa_t* soa;
+    uint32_t serial; // host-order
+    bool dynamic; // has DYNA/DYNC data, which can't be transferred
+    unsigned hist_count;
+    // Newest first, each one's from_serial is the next one's to_serial
+    xfr_cset_t** hist;
+} xfr_zone_t;
+
+struct xfr_zones {
+    unsigned long gen; // unique per reload, lets transfers detect reloads
+    unsigned count;
+    xfr_zone_t* zones; // sorted by dname_cmp()
+};
+
+typedef enum {
+    XP_SOA_FIRST = 0,
+    XP_AXFR_WALK,
+    XP_IXFR_CSETS,
+    XP_SOA_LAST,
+    XP_DONE,
+} xfr_phase_t;
+
+struct xfr {
+    // These refer to data from the xfr_zones_t with generation "gen", and are
+    // only valid while that's the current one
+    unsigned long gen;
+    const xfr_zone_t* zone;
+    // Zone name as a dname, for compressing rdata names, NULL for the root
+    const uint8_t* comp_zname;
+
+    xfr_phase_t phase;
+    bool incremental; // IXFR with a change set chain from the client serial
+
+    // IXFR change set iteration: hist index of the current change set (counts
+    // down to zero), and offset of the next RR in its data.
+    unsigned cset_idx;
+    size_t cset_pos;
+
+    // AXFR tree walk state, see walk_find().  nodes[] holds the current node
+    // and its ancestors below the zone root, and slots[] the next child table
+    // index to descend to at each depth.  owner_len[] is the uncompressed
+    // owner name length at each depth, and name_off[] is where the name at
+    // each depth was last stored in the current message, if anywhere.
+    unsigned depth;
+    const ltree_rrset_t* rrset;
+    unsigned rr_idx;
+    const ltree_node_t* nodes[XFR_DEPTH_MAX];
+    size_t slots[XFR_DEPTH_MAX];
+    unsigned owner_len[XFR_DEPTH_MAX];
+    uint16_t name_off[XFR_DEPTH_MAX];
+
+    // For log messages after the zone data may have gone away
+    uint8_t zname[256];
+
+    // Response header and the original question, copied to every message
+    unsigned qend;
+    uint8_t req[XFR_QNAME_OFFSET + 255U + 4U];
+
+    // Current message, including the 2-byte TCP length prefix
+    uint8_t buf[2U + XFR_MSG_MAX];
+};
+
+// RCU-managed, replaced by the zones reloader thread
+static xfr_zones_t* xfr_zones = NULL;
+
+// Only touched by the zones reloader thread
+static unsigned long xfr_zones_gen = 0;
+
+// Count of running transfers over all threads, for xfr_max_active
+static unsigned long xfr_active = 0;
+
+// RFC 1982 serial number arithmetic: true if "a" is newer than "b"
+F_CONST
+static bool serial_gt(const uint32_t a, const uint32_t b)
+{
+    return a != b && (uint32_t)(a - b) < 0x80000000U;
+}
+
+F_NONNULL F_PURE
+static unsigned rrset_count(const ltree_rrset_t* rrset)
+{
+    // CNAME and SOA are always singular, and ltree doesn't set the SOA count
+    if (rrset->gen.type == DNS_TYPE_SOA || rrset->gen.type == DNS_TYPE_CNAME)
+        return 1U;
+    return rrset->gen.count;
+}
+
+// Length of the rdata of RR "idx" of "rrset" without any compression
+F_NONNULL F_PURE
+static unsigned rdata_len(const ltree_rrset_t* rrset, const unsigned idx)
+{
+    switch (rrset->gen.type) {
+    case DNS_TYPE_A:
+        return 4U;
+    case DNS_TYPE_AAAA:
+        return 16U;
+    case DNS_TYPE_NS:
+        return rrset->ns.rdata[idx].dname[0];
+    case DNS_TYPE_CNAME:
+        return rrset->cname.dname[0];
+    case DNS_TYPE_PTR:
+        return rrset->ptr.rdata[idx][0];
+    case DNS_TYPE_MX:
+        return 2U + rrset->mx.rdata[idx].dname[0];
+    case DNS_TYPE_SRV:
+        return 6U + rrset->srv.rdata[idx].dname[0];
+    case DNS_TYPE_NAPTR:
+        return 4U + rrset->naptr.rdata[idx].text_len + rrset->naptr.rdata[idx].dname[0];
+    case DNS_TYPE_TXT:
+        return rrset->txt.rdata[idx].text_len;
+    case DNS_TYPE_SOA:
+        return rrset->soa.mname[0] + rrset->soa.rname[0] + 20U;
+    default:
+        return rrset->rfc3597.rdata[idx].rdlen;
+    }
+}
+
+// Stores "dn" at "offset", compressing any suffix matching the question's
+// zone name if "zname" is non-NULL.
+F_NONNULLX(1, 3)
+static unsigned put_rdata_name(uint8_t* buf, unsigned offset, const uint8_t* dn, const uint8_t* zname)
+{
+    if (zname && dname_isinzone(zname, dn)) {
+        const unsigned prefix_len = dn[0] - zname[0];
+        memcpy(&buf[offset], &dn[1], prefix_len);
+        offset += prefix_len;
+        gdnsd_put_una16(htons(0xC000U | XFR_QNAME_OFFSET), &buf[offset]);
+        return offset + 2U;
+    }
+    memcpy(&buf[offset], &dn[1], dn[0]);
+    return offset + dn[0];
+}
+
+F_NONNULLX(1, 3)
+static unsigned put_rdata(uint8_t* buf, unsigned offset, const ltree_rrset_t* rrset, const unsigned idx, const uint8_t* zname)
+{
+    switch (rrset->gen.type) {
+    case DNS_TYPE_A: {
+        const uint32_t* addrs = (rrset->gen.count <= LTREE_V4A_SIZE)
+                                ? rrset->a.v4a
+                                : rrset->a.addrs;
+        gdnsd_put_una32(addrs[idx], &buf[offset]);
+        return offset + 4U;
+    }
+    case DNS_TYPE_AAAA:
+        memcpy(&buf[offset], &rrset->aaaa.addrs[idx * 16U], 16U);
+        return offset + 16U;
+    case DNS_TYPE_NS:
+        return put_rdata_name(buf, offset, rrset->ns.rdata[idx].dname, zname);
+    case DNS_TYPE_CNAME:
+        return put_rdata_name(buf, offset, rrset->cname.dname, zname);
+    case DNS_TYPE_PTR:
+        return put_rdata_name(buf, offset, rrset->ptr.rdata[idx], zname);
+    case DNS_TYPE_MX:
+        gdnsd_put_una16(rrset->mx.rdata[idx].pref, &buf[offset]);
+        return put_rdata_name(buf, offset + 2U, rrset->mx.rdata[idx].dname, zname);
+    case DNS_TYPE_SRV: {
+        const ltree_rdata_srv_t* rd = &rrset->srv.rdata[idx];
+        gdnsd_put_una16(rd->priority, &buf[offset]);
+        gdnsd_put_una16(rd->weight, &buf[offset + 2U]);
+        gdnsd_put_una16(rd->port, &buf[offset + 4U]);
+        // SRV target can't be compressed
+        return put_rdata_name(buf, offset + 6U, rd->dname, NULL);
+    }
+    case DNS_TYPE_NAPTR: {
+        const ltree_rdata_naptr_t* rd = &rrset->naptr.rdata[idx];
+        gdnsd_put_una16(rd->order, &buf[offset]);
+        gdnsd_put_una16(rd->pref, &buf[offset + 2U]);
+        offset += 4U;
+        memcpy(&buf[offset], rd->text, rd->text_len);
+        // NAPTR target can't be compressed
+        return put_rdata_name(buf, offset + rd->text_len, rd->dname, NULL);
+    }
+    case DNS_TYPE_TXT:
+        memcpy(&buf[offset], rrset->txt.rdata[idx].text, rrset->txt.rdata[idx].text_len);
+        return offset + rrset->txt.rdata[idx].text_len;
+    case DNS_TYPE_SOA:
+        offset = put_rdata_name(buf, offset, rrset->soa.mname, zname);
+        offset = put_rdata_name(buf, offset, rrset->soa.rname, zname);
+        memcpy(&buf[offset], rrset->soa.times, 20U);
+        return offset + 20U;
+    default:
+        // Must never be reached for DYNC, zones with it are never transferred
+        gdnsd_assert(rrset->gen.type != DNS_TYPE_DYNC);
+        if (rrset->rfc3597.rdata[idx].rdlen)
+            memcpy(&buf[offset], rrset->rfc3597.rdata[idx].rd, rrset->rfc3597.rdata[idx].rdlen);
+        return offset + rrset->rfc3597.rdata[idx].rdlen;
+    }
+}
+
+// Stores everything after the owner name: type, class, TTL, rdlen, rdata
+F_NONNULLX(1, 3)
+static unsigned put_rr_data(uint8_t* buf, const unsigned offset, const ltree_rrset_t* rrset, const unsigned idx, const uint8_t* zname)
+{
+    gdnsd_put_una16(htons(rrset->gen.type), &buf[offset]);
+    gdnsd_put_una16(htons(DNS_CLASS_IN), &buf[offset + 2U]);
+    gdnsd_put_una32(rrset->gen.ttl, &buf[offset + 4U]);
+    const unsigned rdata_offset = offset + 10U;
+    const unsigned end = put_rdata(buf, rdata_offset, rrset, idx, zname);
+    gdnsd_put_una16(htons(end - rdata_offset), &buf[offset + 8U]);
+    return end;
+}
+
+// Total length of an uncompressed RR stored by put_rr_data()
+F_NONNULL F_PURE
+static size_t stored_rr_len(const uint8_t* rr)
+{
+    size_t pos = 0;
+    while (rr[pos])
+        pos += rr[pos] + 1U;
+    pos += 11U; // terminal label + type/class/ttl/rdlen
+    return pos + ntohs(gdnsd_get_una16(&rr[pos - 2U]));
+}
+
+/***** Per-reload zone index and IXFR change sets (reloader thread) *****/
+
+// Growable storage for the uncompressed RRs of a whole zone
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t alloc;
+    size_t* offsets;
+    size_t count;
+    size_t offsets_alloc;
+} rrvec_t;
+
+F_NONNULL
+static void rrvec_add_rr(rrvec_t* v, const uint8_t** lstack, unsigned depth, const uint8_t* zname, const ltree_rrset_t* rrset, const unsigned idx)
+{
+    const size_t max_len = 255U + 10U + rdata_len(rrset, idx);
+    if (v->len + max_len > v->alloc) {
+        while (v->len + max_len > v->alloc)
+            v->alloc = v->alloc ? (v->alloc << 1U) : 4096U;
+        v->data = xrealloc(v->data, v->alloc);
+    }
+    if (v->count == v->offsets_alloc) {
+        v->offsets_alloc = v->offsets_alloc ? (v->offsets_alloc << 1U) : 64U;
+        v->offsets = xrealloc_n(v->offsets, v->offsets_alloc, sizeof(*v->offsets));
+    }
+
+    uint8_t* out = &v->data[v->len];
+    unsigned offset = 0;
+    while (depth--) {
+        const unsigned llen = lstack[depth][0] + 1U;
+        memcpy(&out[offset], lstack[depth], llen);
+        offset += llen;
+    }
+    memcpy(&out[offset], &zname[1], zname[0]);
+    offset += zname[0];
+    offset = put_rr_data(out, offset, rrset, idx, NULL);
+
+    v->offsets[v->count++] = v->len;
+    v->len += offset;
+}
+
+// lstack[N] is the label at depth N+1 below the zone root
+F_NONNULL
+static void rrvec_add_node(rrvec_t* v, const ltree_node_t* node, const uint8_t** lstack, const unsigned depth, const uint8_t* zname)
+{
+    for (const ltree_rrset_t* rrset = node->rrsets; rrset; rrset = rrset->gen.next) {
+        // The apex SOA is handled separately
+        if (!depth && rrset->gen.type == DNS_TYPE_SOA)
+            continue;
+        const unsigned count = rrset_count(rrset);
+        for (unsigned i = 0; i < count; i++)
+            rrvec_add_rr(v, lstack, depth, zname, rrset, i);
+    }
+
+    if (node->child_table) {
+        const size_t mask = count2mask_sz(LTN_GET_CCOUNT(node));
+        for (size_t i = 0; i <= mask; i++) {
+            const ltree_node_t* child = node->child_table[i].node;
+            // Skip the hidden out-of-zone glue node under the zone root
+            if (child && (depth || child->label[0])) {
+                gdnsd_assert(depth < XFR_DEPTH_MAX - 1U);
+                lstack[depth] = child->label;
+                rrvec_add_node(v, child, lstack, depth + 1U, zname);
+            }
+        }
+    }
+}
+
+F_NONNULL F_PURE
+static int stored_rr_cmp(const void* a_v, const void* b_v)
+{
+    const uint8_t* a = *(const uint8_t* const*)a_v;
+    const uint8_t* b = *(const uint8_t* const*)b_v;
+    const size_t a_len = stored_rr_len(a);
+    const size_t b_len = stored_rr_len(b);
+    const int rv = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+    if (rv)
+        return rv;
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+// Returns a sorted array of pointers to the RRs stored in "v"
+F_NONNULL F_RETNN
+static const uint8_t** rrvec_sorted(const rrvec_t* v)
+{
+    const uint8_t** rrs = xmalloc_n(v->count + 1U, sizeof(*rrs));
+    for (size_t i = 0; i < v->count; i++)
+        rrs[i] = &v->data[v->offsets[i]];
+    qsort(rrs, v->count, sizeof(*rrs), stored_rr_cmp);
+    return rrs;
+}
+
+F_NONNULL
+static void rrvec_cleanup(rrvec_t* v)
+{
+    free(v->data);
+    free(v->offsets);
+}
+
+F_NONNULL
+static size_t put_soa_rr(uint8_t* buf, const xfr_zone_t* z)
+{
+    memcpy(buf, &z->dname[1], z->dname[0]);
+    return put_rr_data(buf, z->dname[0], (const ltree_rrset_t*)z->soa, 0, NULL);
+}
+
+// Builds the change set from zone version "oz" to "nz", by encoding all the
+// RRs of both as uncompressed wire data, sorting them, and merging the sorted
+// lists.  Returns NULL if the change set would be larger than the new zone,
+// in which case an AXFR-style full response is the better answer anyways.
+F_NONNULL
+static xfr_cset_t* cset_new(const xfr_zone_t* oz, const xfr_zone_t* nz)
+{
+    const uint8_t* lstack[XFR_DEPTH_MAX];
+    rrvec_t ov = { 0 };
+    rrvec_t nv = { 0 };
+    rrvec_add_node(&ov, oz->root, lstack, 0, oz->dname);
+    rrvec_add_node(&nv, nz->root, lstack, 0, nz->dname);
+    const uint8_t** orrs = rrvec_sorted(&ov);
+    const uint8_t** nrrs = rrvec_sorted(&nv);
+
+    // First pass just figures the sizes
+    size_t del_count = 0;
+    size_t del_len = 0;
+    size_t add_count = 0;
+    size_t add_len = 0;
+    size_t o = 0;
+    size_t n = 0;
+    while (o < ov.count || n < nv.count) {
+        const int cmp = (o == ov.count) ? 1
+                        : (n == nv.count) ? -1
+                        : stored_rr_cmp(&orrs[o], &nrrs[n]);
+        if (cmp < 0) {
+            del_count++;
+            del_len += stored_rr_len(orrs[o++]);
+        } else if (cmp > 0) {
+            add_count++;
+            add_len += stored_rr_len(nrrs[n++]);
+        } else {
+            o++;
+            n++;
+        }
+    }
+
+    xfr_cset_t* cset = NULL;
+    if (del_len + add_len > nv.len) {
+        log_debug("Zone %s: no IXFR change set for serial %u -> %u, larger than the zone itself",
+                  logf_dname(nz->dname), oz->serial, nz->serial);
+    } else {
+        uint8_t soa_buf[1024];
+        const size_t osoa_len = put_soa_rr(soa_buf, oz);
+        cset = xcalloc(sizeof(*cset));
+        cset->from_serial = oz->serial;
+        cset->to_serial = nz->serial;
+        cset->data = xmalloc(osoa_len + sizeof(soa_buf) + del_len + add_len);
+        memcpy(cset->data, soa_buf, osoa_len);
+        size_t len = osoa_len;
+        o = n = 0;
+        while (o < ov.count || n < nv.count) {
+            const int cmp = (o == ov.count) ? 1
+                            : (n == nv.count) ? -1
+                            : stored_rr_cmp(&orrs[o], &nrrs[n]);
+            if (cmp < 0) {
+                const size_t rr_len = stored_rr_len(orrs[o]);
+                memcpy(&cset->data[len], orrs[o++], rr_len);
+                len += rr_len;
+            } else {
+                if (!cmp)
+                    o++;
+                n++;
+            }
+        }
+        len += put_soa_rr(&cset->data[len], nz);
+        o = n = 0;
+        while (o < ov.count || n < nv.count) {
+            const int cmp = (o == ov.count) ? 1
+                            : (n == nv.count) ? -1
+                            : stored_rr_cmp(&orrs[o], &nrrs[n]);
+            if (cmp > 0) {
+                const size_t rr_len = stored_rr_len(nrrs[n]);
+                memcpy(&cset->data[len], nrrs[n++], rr_len);
+                len += rr_len;
+            } else {
+                if (!cmp)
+                    n++;
+                o++;
+            }
+        }
+        cset->len = len;
+        log_debug("Zone %s: IXFR change set for serial %u -> %u has %zu deletions and %zu additions",
+                  logf_dname(nz->dname), oz->serial, nz->serial, del_count, add_count);
+    }
+
+    free(orrs);
+    free(nrrs);
+    rrvec_cleanup(&ov);
+    rrvec_cleanup(&nv);
+    return cset;
+}
+
+F_NONNULL F_PURE
+static bool zone_is_dynamic(const ltree_node_t* node)
+{
+    for (const ltree_rrset_t* rrset = node->rrsets; rrset; rrset = rrset->gen.next) {
+        if (rrset->gen.type == DNS_TYPE_DYNC)
+            return true;
+        if ((rrset->gen.type == DNS_TYPE_A || rrset->gen.type == DNS_TYPE_AAAA) && !rrset->gen.count)
+            return true;
+    }
+
+    if (node->child_table) {
+        const size_t mask = count2mask_sz(LTN_GET_CCOUNT(node));
+        for (size_t i = 0; i <= mask; i++)
+            if (node->child_table[i].node && zone_is_dynamic(node->child_table[i].node))
+                return true;
+    }
+
+    return false;
+}
+
+// lstack[N] is the label at depth N+1 below the global root
+F_NONNULL
+static void find_zones(xfr_zones_t* zones, unsigned* alloc, const ltree_node_t* node, const uint8_t** lstack, const unsigned depth)
+{
+    if (LTN_GET_FLAG_ZCUT(node)) {
+        if (zones->count == *alloc) {
+            *alloc = *alloc ? (*alloc << 1U) : 16U;
+            zones->zones = xrealloc_n(zones->zones, *alloc, sizeof(*zones->zones));
+        }
+        xfr_zone_t* z = &zones->zones[zones->count++];
+        memset(z, 0, sizeof(*z));
+
+        uint8_t dname[256];
+        unsigned offset = 1;
+        unsigned d = depth;
+        while (d--) {
+            const unsigned llen = lstack[d][0] + 1U;
+            memcpy(&dname[offset], lstack[d], llen);
+            offset += llen;
+        }
+        dname[offset] = 0;
+        dname[0] = offset;
+        gdnsd_assert(dname_status(dname) == DNAME_VALID);
+        z->dname = dname_dup(dname);
+
+        z->root = node;
+        for (const ltree_rrset_t* rrset = node->rrsets; rrset; rrset = rrset->gen.next)
+            if (rrset->gen.type == DNS_TYPE_SOA)
+                z->soa = &rrset->soa;
+        gdnsd_assert(z->soa); // zone roots always have one
+        z->serial = ntohl(z->soa->times[0]);
+        z->dynamic = zone_is_dynamic(node);
+        return;
+    }
+
+    if (node->child_table) {
+        const size_t mask = count2mask_sz(LTN_GET_CCOUNT(node));
+        for (size_t i = 0; i <= mask; i++) {
+            const ltree_node_t* child = node->child_table[i].node;
+            if (child) {
+                lstack[depth] = child->label;
+                find_zones(zones, alloc, child, lstack, depth + 1U);
+            }
+        }
+    }
+}
+
+F_NONNULL F_PURE
+static int zone_cmp(const void* a_v, const void* b_v)
+{
+    const xfr_zone_t* a = a_v;
+    const xfr_zone_t* b = b_v;
+    return dname_cmp(a->dname, b->dname);
+}
+
+F_NONNULL F_PURE
+static int zone_key_cmp(const void* key_v, const void* z_v)
+{
+    const uint8_t* key = key_v;
+    const xfr_zone_t* z = z_v;
+    return dname_cmp(key, z->dname);
+}
+
+F_NONNULL
+static void zone_set_history(xfr_zone_t* z, const xfr_zone_t* oz)
+{
+    const unsigned max_hist = gcfg->xfr_ixfr_history;
+    xfr_cset_t* cset = NULL;
+
+    if (z->serial == oz->serial) {
+        // Assumed unchanged, since secondaries couldn't tell anyways
+    } else if (serial_gt(z->serial, oz->serial) && !z->dynamic && !oz->dynamic) {
+        cset = cset_new(oz, z);
+        if (!cset)
+            return;
+    } else {
+        return; // serial went backwards, history is useless
+    }
+
+    z->hist = xmalloc_n(max_hist, sizeof(*z->hist));
+    if (cset) {
+        cset->refcount = 1U;
+        z->hist[z->hist_count++] = cset;
+    }
+    for (unsigned i = 0; i < oz->hist_count && z->hist_count < max_hist; i++) {
+        oz->hist[i]->refcount++;
+        z->hist[z->hist_count++] = oz->hist[i];
+    }
+}
+
+xfr_zones_t* xfr_zones_new(const ltree_node_t* new_root_tree)
+{
+    if (!gcfg->xfr_allow_count)
+        return NULL;
+
+    xfr_zones_t* zones = xcalloc(sizeof(*zones));
+    zones->gen = ++xfr_zones_gen;
+    unsigned alloc = 0;
+    const uint8_t* lstack[XFR_DEPTH_MAX];
+    find_zones(zones, &alloc, new_root_tree, lstack, 0);
+    if (zones->count)
+        qsort(zones->zones, zones->count, sizeof(*zones->zones), zone_cmp);
+
+    // We're the only writer, so the current index is stable here
+    const xfr_zones_t* old_zones = xfr_zones;
+    if (old_zones && gcfg->xfr_ixfr_history) {
+        for (unsigned i = 0; i < zones->count; i++) {
+            xfr_zone_t* z = &zones->zones[i];
+            const xfr_zone_t* oz = bsearch(z->dname, old_zones->zones, old_zones->count, sizeof(*oz), zone_key_cmp);
+            if (oz)
+                zone_set_history(z, oz);
+        }
+    }
+
+    return zones;
+}
+
+xfr_zones_t* xfr_zones_swap(xfr_zones_t* new_zones)
+{
+    xfr_zones_t* old_zones = xfr_zones;
+    rcu_assign_pointer(xfr_zones, new_zones);
+    return old_zones;
+}
+
+void xfr_zones_destroy(xfr_zones_t* zones)
+{
+    for (unsigned i = 0; i < zones->count; i++) {
+        xfr_zone_t* z = &zones->zones[i];
+        for (unsigned j = 0; j < z->hist_count; j++) {
+            xfr_cset_t* cset = z->hist[j];
+            gdnsd_assert(cset->refcount);
+            if (!--cset->refcount) {
+                free(cset->data);
+                free(cset);
+            }
+        }
+        free(z->hist);
+        free(z->dname);
+    }
+    free(zones->zones);
+    free(zones);
+}
+
+/***** Transfers (DNS I/O threads) *****/
+
+F_NONNULL F_PURE
+static bool prefix_match(const uint8_t* a, const uint8_t* b, const unsigned bits)
+{
+    const unsigned bytes = bits >> 3U;
+    if (memcmp(a, b, bytes))
+        return false;
+    const unsigned rem = bits & 7U;
+    if (!rem)
+        return true;
+    const uint8_t mask = (uint8_t)(0xFF00U >> rem);
+    return !((a[bytes] ^ b[bytes]) & mask);
+}
+
+bool xfr_acl_check(const gdnsd_anysin_t* sa)
+{
+    for (unsigned i = 0; i < gcfg->xfr_allow_count; i++) {
+        const xfr_acl_t* acl = &gcfg->xfr_allow[i];
+        if (acl->addr.sa.sa_family != sa->sa.sa_family)
+            continue;
+        if (sa->sa.sa_family == AF_INET) {
+            if (prefix_match((const uint8_t*)&acl->addr.sin4.sin_addr.s_addr,
+                             (const uint8_t*)&sa->sin4.sin_addr.s_addr, acl->mask))
+                return true;
+        } else {
+            gdnsd_assert(sa->sa.sa_family == AF_INET6);
+            if (prefix_match(acl->addr.sin6.sin6_addr.s6_addr,
+                             sa->sin6.sin6_addr.s6_addr, acl->mask))
+                return true;
+        }
+    }
+    return false;
+}
+
+xfr_start_rv_t xfr_new(xfr_t** xfr_out, const uint8_t* req, const unsigned qend, const uint8_t* lqname, const bool ixfr, const uint32_t* client_serial)
+{
+    gdnsd_assert(qend > XFR_QNAME_OFFSET && qend <= XFR_QNAME_OFFSET + 255U + 4U);
+
+    const xfr_zones_t* zones = rcu_dereference(xfr_zones);
+    const xfr_zone_t* zone = zones
+                             ? bsearch(lqname, zones->zones, zones->count, sizeof(*zone), zone_key_cmp)
+                             : NULL;
+    if (!zone)
+        return XFR_START_NOZONE;
+    if (zone->dynamic)
+        return XFR_START_DYNAMIC;
+    if (uatomic_add_return(&xfr_active, 1) > gcfg->xfr_max_active) {
+        uatomic_dec(&xfr_active);
+        return XFR_START_BUSY;
+    }
+
+    xfr_t* x = xcalloc(sizeof(*x));
+    x->gen = zones->gen;
+    x->zone = zone;
+    dname_copy(x->zname, zone->dname);
+
+    // Response header: QR+AA with the request's ID, Opcode, and RD, and only
+    // the question and answer sections
+    memcpy(x->req, req, qend);
+    x->qend = qend;
+    x->req[2] = (x->req[2] & 0x79U) | 0x84U;
+    x->req[3] = DNS_RCODE_NOERROR;
+    gdnsd_put_una16(htons(1U), &x->req[4]);
+    memset(&x->req[6], 0, 6U);
+
+    // The root zone's name isn't worth compressing
+    const bool is_root = (zone->dname[0] == 1U);
+    x->comp_zname = is_root ? NULL : zone->dname;
+    x->nodes[0] = zone->root;
+    x->owner_len[0] = zone->dname[0];
+    x->name_off[0] = is_root ? 0 : XFR_QNAME_OFFSET;
+    x->rrset = zone->root->rrsets;
+    x->phase = XP_SOA_FIRST;
+
+    // For IXFR, if we have no change set chain from the client's serial, we
+    // send the full zone in the AXFR format, as allowed by RFC 1995.
+    if (ixfr && client_serial) {
+        if (!serial_gt(zone->serial, *client_serial)) {
+            // Client is up to date, the answer is just the current SOA
+            x->phase = XP_SOA_LAST;
+        } else {
+            for (unsigned i = 0; i < zone->hist_count; i++) {
+                if (zone->hist[i]->from_serial == *client_serial) {
+                    x->incremental = true;
+                    x->cset_idx = i;
+                    break;
+                }
+            }
+        }
+    }
+
+    *xfr_out = x;
+    return XFR_START_OK;
+}
+
+// Stores the owner name of an RR at "depth" in the AXFR walk, compressing it
+// against the deepest of its superdomains already in this message (at worst
+// the zone name in the question), and saving new compression targets for the
+// labels it had to store.
+F_NONNULL
+static unsigned put_owner(xfr_t* x, uint8_t* msg, unsigned offset, const unsigned depth)
+{
+    unsigned known = depth;
+    while (known && !x->name_off[known])
+        known--;
+
+    for (unsigned d = depth; d > known; d--) {
+        if (offset < XFR_COMP_LIMIT)
+            x->name_off[d] = (uint16_t)offset;
+        const uint8_t* label = x->nodes[d]->label;
+        memcpy(&msg[offset], label, label[0] + 1U);
+        offset += label[0] + 1U;
+    }
+
+    if (x->name_off[known]) {
+        gdnsd_put_una16(htons(0xC000U | x->name_off[known]), &msg[offset]);
+        return offset + 2U;
+    }
+
+    gdnsd_assert(!x->comp_zname); // root zone
+    msg[offset] = 0;
+    return offset + 1U;
+}
+
+// Stores RR "idx" of "rrset" belonging to the node at "depth", or returns
+// zero if it might not fit in the message.
+F_NONNULL
+static unsigned put_tree_rr(xfr_t* x, uint8_t* msg, unsigned offset, const unsigned depth, const ltree_rrset_t* rrset, const unsigned idx)
+{
+    if (offset + x->owner_len[depth] + 10U + rdata_len(rrset, idx) > XFR_MSG_MAX)
+        return 0;
+    offset = put_owner(x, msg, offset, depth);
+    return put_rr_data(msg, offset, rrset, idx, x->comp_zname);
+}
+
+// Advances the AXFR tree walk to the next RR to send (which may be the
+// current one), depth-first from the zone root.  Returns false when there are
+// no more.  The apex SOA and the hidden out-of-zone glue node are skipped.
+F_NONNULL
+static bool walk_find(xfr_t* x)
+{
+    while (1) {
+        if (x->rrset) {
+            if (x->rr_idx < rrset_count(x->rrset)
+                    && (x->depth || x->rrset->gen.type != DNS_TYPE_SOA))
+                return true;
+            x->rrset = x->rrset->gen.next;
+            x->rr_idx = 0;
+            continue;
+        }
+
+        const ltree_node_t* node = x->nodes[x->depth];
+        const ltree_node_t* child = NULL;
+        if (node->child_table) {
+            const size_t mask = count2mask_sz(LTN_GET_CCOUNT(node));
+            while (!child && x->slots[x->depth] <= mask) {
+                child = node->child_table[x->slots[x->depth]++].node;
+                if (child && !x->depth && !child->label[0])
+                    child = NULL;
+            }
+        }
+
+        if (child) {
+            gdnsd_assert(x->depth < XFR_DEPTH_MAX - 1U);
+            const unsigned d = ++x->depth;
+            x->nodes[d] = child;
+            x->slots[d] = 0;
+            x->owner_len[d] = x->owner_len[d - 1U] + child->label[0] + 1U;
+            x->name_off[d] = 0;
+            x->rrset = child->rrsets;
+            x->rr_idx = 0;
+        } else if (x->depth) {
+            x->depth--;
+        } else {
+            return false;
+        }
+    }
+}
+
+// Stores the next RR of the transfer in the message, advancing the state, or
+// returns zero without doing anything if it might not fit.
+F_NONNULL
+static unsigned put_next_rr(xfr_t* x, uint8_t* msg, const unsigned offset)
+{
+    const ltree_rrset_t* soa = (const ltree_rrset_t*)x->zone->soa;
+    unsigned rv;
+
+    switch (x->phase) {
+    case XP_SOA_FIRST:
+        rv = put_tree_rr(x, msg, offset, 0, soa, 0);
+        if (rv)
+            x->phase = x->incremental ? XP_IXFR_CSETS : XP_AXFR_WALK;
+        return rv;
+    case XP_AXFR_WALK:
+        if (walk_find(x)) {
+            rv = put_tree_rr(x, msg, offset, x->depth, x->rrset, x->rr_idx);
+            if (rv)
+                x->rr_idx++;
+            return rv;
+        }
+        x->phase = XP_SOA_LAST;
+        S_FALLTHROUGH; // FALLTHROUGH
+    case XP_SOA_LAST:
+        rv = put_tree_rr(x, msg, offset, 0, soa, 0);
+        if (rv)
+            x->phase = XP_DONE;
+        return rv;
+    case XP_IXFR_CSETS: {
+        const xfr_cset_t* cset = x->zone->hist[x->cset_idx];
+        const uint8_t* rr = &cset->data[x->cset_pos];
+        const size_t rr_len = stored_rr_len(rr);
+        if (offset + rr_len > XFR_MSG_MAX)
+            return 0;
+        memcpy(&msg[offset], rr, rr_len);
+        x->cset_pos += rr_len;
+        gdnsd_assert(x->cset_pos <= cset->len);
+        if (x->cset_pos == cset->len) {
+            x->cset_pos = 0;
+            if (x->cset_idx)
+                x->cset_idx--;
+            else
+                x->phase = XP_SOA_LAST;
+        }
+        return offset + (unsigned)rr_len;
+    }
+    case XP_DONE:
+    default:
+        gdnsd_assert(0); // unreachable
+        return 0;
+    }
+}
+
+xfr_next_rv_t xfr_next(xfr_t* x, const uint8_t** msg_out, size_t* len_out)
+{
+    if (x->phase == XP_DONE)
+        return XFR_NEXT_DONE;
+
+    const xfr_zones_t* zones = rcu_dereference(xfr_zones);
+    if (!zones || zones->gen != x->gen) {
+        log_debug("Transfer of zone %s aborted: zone data was reloaded mid-transfer", logf_dname(x->zname));
+        return XFR_NEXT_ABORT;
+    }
+
+    uint8_t* msg = &x->buf[2];
+    memcpy(msg, x->req, x->qend);
+    unsigned offset = x->qend;
+
+    // Compression targets from the previous message are useless now
+    for (unsigned d = 1; d <= x->depth; d++)
+        x->name_off[d] = 0;
+
+    unsigned ancount = 0;
+    while (x->phase != XP_DONE) {
+        const unsigned new_offset = put_next_rr(x, msg, offset);
+        if (!new_offset)
+            break;
+        offset = new_offset;
+        ancount++;
+    }
+
+    if (!ancount) {
+        log_err("Transfer of zone %s aborted: an RR is too large for a message", logf_dname(x->zname));
+        return XFR_NEXT_ABORT;
+    }
+
+    gdnsd_assert(offset <= XFR_MSG_MAX);
+    gdnsd_put_una16(htons(ancount), &msg[6]);
+    gdnsd_put_una16(htons(offset), x->buf);
+    *msg_out = x->buf;
+    *len_out = offset + 2U;
+    return XFR_NEXT_MSG;
+}
+
+void xfr_destroy(xfr_t* x)
+{
+    uatomic_dec(&xfr_active);
+    free(x);
+}
@@ -0,0 +1,103 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GDNSD_XFR_H
+#define GDNSD_XFR_H
+
+#include "ltree.h"
+
+#include <gdnsd/compiler.h>
+#include <gdnsd/net.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+
+  Outbound zone transfers (AXFR, RFC 5936, and IXFR, RFC 1995) over TCP.
+
+  The zones reloader builds an "xfr_zones_t" index of all zones in each new
+ltree alongside the tree itself, and publishes it via RCU right after the new
+tree.  Where a zone's serial has moved forward since the previous load, the
+differences between the old and new versions of the zone are retained as an
+IXFR change set, up to the configured history depth.
+
+  A transfer (xfr_t) is started by dnspacket within a normal query
+transaction, and is then handed to dnsio_tcp, which asks for one message at a
+time via xfr_next() as the socket drains, so that large zones are streamed
+directly from the ltree without blocking the thread's other connections.
+Because the thread is allowed to go RCU-offline between messages, each call
+to xfr_next() re-validates that the zone data it was walking hasn't been
+replaced by a reload in the meantime, and aborts the transfer if it has.
+
+*/
+
+typedef struct xfr_zones xfr_zones_t;
+typedef struct xfr xfr_t;
+
+typedef enum {
+    XFR_START_OK = 0,      // transfer created
+    XFR_START_NOZONE = 1,  // not the apex of one of our zones
+    XFR_START_DYNAMIC = 2, // zone contains DYNA/DYNC data
+    XFR_START_BUSY = 3,    // xfr_max_active transfers already running
+} xfr_start_rv_t;
+
+typedef enum {
+    XFR_NEXT_MSG = 0,   // a new message was placed in *msg_out
+    XFR_NEXT_DONE = 1,  // the transfer is complete, no message
+    XFR_NEXT_ABORT = 2, // the transfer cannot continue, no message
+} xfr_next_rv_t;
+
+// Reloader thread only: builds the index for a freshly-loaded root tree,
+// computing IXFR change sets against the currently-published index (whose
+// tree must still be intact).  Returns NULL if transfers are not configured.
+F_NONNULL
+xfr_zones_t* xfr_zones_new(const ltree_node_t* new_root_tree);
+
+// Reloader thread only: publishes a new index (which may be NULL) for
+// readers, returning the previous one (possibly NULL) for destruction after
+// the next RCU grace period.
+xfr_zones_t* xfr_zones_swap(xfr_zones_t* new_zones);
+
+F_NONNULL
+void xfr_zones_destroy(xfr_zones_t* zones);
+
+// True if the client address is allowed to transfer zones by "xfr_allow"
+F_NONNULL F_PURE
+bool xfr_acl_check(const gdnsd_anysin_t* sa);
+
+// Must be called from an RCU-online DNS I/O thread.  "req" is the raw query
+// packet and "qend" the offset just past its (single) question, which is
+// copied into every response message.  "lqname" is the lowercased query name
+// in dname format.  "client_serial" is only used (and may be NULL) for IXFR.
+F_NONNULLX(1, 2, 4) F_WUNUSED
+xfr_start_rv_t xfr_new(xfr_t** xfr_out, const uint8_t* req, const unsigned qend, const uint8_t* lqname, const bool ixfr, const uint32_t* client_serial);
+
+// Must be called with the thread RCU-online.  On XFR_NEXT_MSG, *msg_out and
+// *len_out describe the next complete message, including the 2-byte TCP
+// length prefix, which remains valid until the next call on this xfr.
+F_NONNULL F_WUNUSED
+xfr_next_rv_t xfr_next(xfr_t* xfr, const uint8_t** msg_out, size_t* len_out);
+
+// Can be called at any point in the transfer, without RCU.
+F_NONNULL
+void xfr_destroy(xfr_t* xfr);
+
+#endif // GDNSD_XFR_H
@@ -23,6 +23,7 @@
 #include "zscan_rfc1035.h"
 #include "conf.h"
 #include "ltree.h"
+#include "latency.h"
 #include "main.h"
 
 #include <gdnsd/alloc.h>
@@ -153,7 +154,11 @@ static void* zones_worker(void* list_asvoid)
         if (!z)
             return (void*)1;
         zfl->zone = z;
-        if (zscan_rfc1035(z, zfl->full_fn) || ltree_postproc_zone(z))
+        const uint64_t start = latency_now(CLOCK_MONOTONIC);
+        if (zscan_rfc1035(z, zfl->full_fn))
+            return (void*)1;
+        ltree_load_prof_add(LTREE_LOAD_SCAN, latency_now(CLOCK_MONOTONIC) - start);
+        if (ltree_postproc_zone(z))
             return (void*)1;
         zfl = zfl->next;
     }
@@ -175,7 +180,9 @@ static bool harvest_zone_worker(pthread_t threadid, zf_list_t* zfl, ltree_node_t
         free(zfl->full_fn);
         if (!failed) {
             gdnsd_assert(zfl->zone);
+            const uint64_t start = latency_now(CLOCK_MONOTONIC);
             failed = ltree_merge_zone(new_root_tree, new_root_arena, zfl->zone);
+            ltree_load_prof_add(LTREE_LOAD_MERGE, latency_now(CLOCK_MONOTONIC) - start);
         }
         if (failed && zfl->zone)
             ltree_destroy_zone(zfl->zone);
@@ -254,6 +261,7 @@ bool zsrc_rfc1035_load_zones(ltree_node_t* new_root_tree, ltarena_t* new_root_ar
     }
 
     zf_threads_t* zft = zf_threads_new(gcfg->zones_rfc1035_threads);
+    const uint64_t readdir_start = latency_now(CLOCK_MONOTONIC);
 
     bool failed = false;
     const struct dirent* result = NULL;
@@ -286,6 +294,8 @@ bool zsrc_rfc1035_load_zones(ltree_node_t* new_root_tree, ltarena_t* new_root_ar
         failed = true;
     }
 
+    ltree_load_prof_add(LTREE_LOAD_READDIR, latency_now(CLOCK_MONOTONIC) - readdir_start);
+
     if (failed)
         zf_threads_early_destroy(zft);
     else
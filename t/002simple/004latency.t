@@ -0,0 +1,51 @@
+# Sanity checks on the latency histograms in the stats output, against the
+#  same data as 002noerr.t.
+
+use _GDT ();
+use Test::More tests => 18;
+use strict;
+use warnings;
+
+my $pid = _GDT->test_spawn_daemon();
+
+_GDT->test_dns(
+    qname => 'foo.example.com', qtype => 'A',
+    answer => 'foo.example.com 515 A 192.0.2.4',
+    rep => 5,
+);
+
+_GDT->test_dns(
+    resopts => { usevc => 1, igntc => 0 },
+    qname => 'foo.example.com', qtype => 'A',
+    answer => 'foo.example.com 515 A 192.0.2.4',
+    stats => [qw/tcp_reqs noerror/],
+    rep => 3,
+);
+
+_GDT->test_stats;
+
+my $json = _GDT::_get_daemon_json_stats();
+my $lat = $json->{latency};
+is(ref $lat, 'HASH', 'stats have a latency object');
+
+is($lat->{udp_pdq}{count}, $json->{udp}{reqs}, 'one udp_pdq sample per UDP request');
+is($lat->{tcp_pdq}{count}, $json->{tcp}{reqs}, 'one tcp_pdq sample per TCP request');
+ok($lat->{udp_rx_tx}{count} <= $json->{udp}{reqs}, 'no more udp_rx_tx samples than UDP requests');
+
+foreach my $name (qw/udp_pdq tcp_pdq udp_rx_tx/) {
+    my $h = $lat->{$name};
+    my $sum = 0;
+    my $sorted = 1;
+    my $last = -1;
+    foreach my $b (@{$h->{buckets}}) {
+        $sum += $b->[1];
+        $sorted = 0 if $b->[0] <= $last || $b->[1] < 1;
+        $last = $b->[0];
+    }
+    is($sum, $h->{count}, "$name buckets sum to the count");
+    ok($sorted, "$name buckets are ascending and non-empty");
+    ok($h->{p50} <= $h->{p90} && $h->{p90} <= $h->{p99} && $h->{p99} <= $h->{p999},
+        "$name percentiles are ordered");
+}
+
+_GDT->test_kill_daemon($pid);
@@ -2,25 +2,44 @@
 
 use _GDT ();
 use File::Temp qw/tmpnam/;
-use Test::More tests => 14;
+use Test::More tests => 21;
 
 # We use dns_port_2 as a custom http listener
 #  for something to monitor
 my $http_port = $_GDT::EXTRA_PORT;
-my $state_file = tmpnam();
 my $server_script = File::Spec->catfile($FindBin::Bin, 'server.pl');
-my $http_pid = fork();
-if(!defined $http_pid) { diag "Fork failed: $!"; BAIL_OUT($!); }
-if(!$http_pid) { # child, execute test http server
-    exec($^X, $server_script, $http_port, $state_file);
+
+sub start_http_server {
+    my $state_file = tmpnam();
+    my $spid = fork();
+    if(!defined $spid) { diag "Fork failed: $!"; BAIL_OUT($!); }
+    if(!$spid) { # child, execute test http server
+        exec($^X, $server_script, $http_port, $state_file);
+    }
+
+    # Avoid racing the test http server
+    while(!-f $state_file) {
+        select(undef, undef, undef, 0.1); # 100ms
+    }
+
+    unlink($state_file);
+    return $spid;
 }
 
-# Avoid racing the test http server
-while(!-f $state_file) {
-    select(undef, undef, undef, 0.1); # 100ms
+# The states of the multi_lo monitors, from "gdnsdctl states"
+sub lo_states {
+    _GDT->test_run_gdnsdctl('states');
+    my %states;
+    if (open(my $fh, '<', $_GDT::OUTDIR . '/gdnsdctl.out')) {
+        while (<$fh>) {
+            $states{$1} = $2 if /^\s*"(127\.0\.0\.[234])\/www_fast":\s*\{"state":\s*"(\w+)"/;
+        }
+        close($fh);
+    }
+    return join(' ', map { $states{$_} // 'missing' } qw/127.0.0.2 127.0.0.3 127.0.0.4/);
 }
 
-unlink($state_file);
+my $http_pid = start_http_server();
 
 my $pid = _GDT->test_spawn_daemon();
 
@@ -125,6 +144,28 @@ _GDT->test_dns(
     ],
 );
 
+###### multi_lo -> state changes from all three monitoring threads
+
+# Stopping the http server takes down all three, each of which is monitored
+#   on a different thread
+_GDT->test_kill_other_daemon($http_pid);
+$http_pid = undef;
+_GDT->test_log_output([
+    q{state of '127.0.0.2/www_fast' changed from UP},
+    q{state of '127.0.0.3/www_fast' changed from UP},
+    q{state of '127.0.0.4/www_fast' changed from UP},
+]);
+is(lo_states(), 'DOWN DOWN DOWN', 'all multi_lo monitors down');
+
+# ... and restarting it brings them all back
+$http_pid = start_http_server();
+_GDT->test_log_output([
+    q{state of '127.0.0.2/www_fast' changed from DOWN},
+    q{state of '127.0.0.3/www_fast' changed from DOWN},
+    q{state of '127.0.0.4/www_fast' changed from DOWN},
+]);
+is(lo_states(), 'UP UP UP', 'all multi_lo monitors up again');
+
 _GDT->test_kill_daemon($pid);
 _GDT->test_kill_other_daemon($http_pid);
 
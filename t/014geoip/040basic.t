@@ -1,7 +1,7 @@
 # Basic geoip plugin tests
 
 use _GDT ();
-use Test::More tests => 61 * 2;
+use Test::More tests => 66 * 2;
 
 my $test_bin = $ENV{INSTALLCHECK_BINDIR}
     ? "$ENV{INSTALLCHECK_BINDIR}/gdnsd_geoip_test"
@@ -489,6 +489,43 @@ _GDT->test_dns(
     stats => [qw/udp_reqs edns edns_clientsub noerror/],
 );
 
+# res1 again for a client which has been answered before, so that its
+#   failover decision may be cached, which must not survive a change to
+#   the state of its datacenter
+_GDT->test_dns(
+    qname => 'res1.example.com', qtype => 'A',
+    q_optrr => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32),
+    answer => [ 'res1.example.com 86400 A 192.0.2.5', 'res1.example.com 86400 A 192.0.2.6' ],
+    addtl => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32, scope_mask => 1),
+    stats => [qw/udp_reqs edns edns_clientsub noerror/],
+);
+_GDT->write_statefile('admin_state', qq{
+    geoip/res1/eu => DOWN
+});
+_GDT->test_log_output([
+    q{admin_state: state of 'geoip/res1/eu' forced to DOWN/MAX, real state is NA},
+    q{admin_state: load complete},
+]);
+_GDT->test_dns(
+    qname => 'res1.example.com', qtype => 'A',
+    q_optrr => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32),
+    answer => 'res1.example.com 86400 A 192.0.2.1',
+    addtl => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32, scope_mask => 1),
+    stats => [qw/udp_reqs edns edns_clientsub noerror/],
+);
+unlink(${_GDT::OUTDIR} . "/var/lib/gdnsd/admin_state");
+_GDT->test_log_output([
+    q{admin_state: state of 'geoip/res1/eu' no longer forced},
+    q{admin_state: load complete (file deleted)},
+]);
+_GDT->test_dns(
+    qname => 'res1.example.com', qtype => 'A',
+    q_optrr => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32),
+    answer => [ 'res1.example.com 86400 A 192.0.2.5', 'res1.example.com 86400 A 192.0.2.6' ],
+    addtl => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32, scope_mask => 1),
+    stats => [qw/udp_reqs edns edns_clientsub noerror/],
+);
+
 _GDT->test_kill_daemon($pid);
 
 # This re-tests a couple of the same results checked above, but using
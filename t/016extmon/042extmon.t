@@ -2,7 +2,7 @@
 
 use _GDT ();
 use Net::DNS;
-use Test::More tests => 10;
+use Test::More tests => 13;
 
 my $pid = _GDT->test_spawn_daemon();
 
@@ -46,4 +46,21 @@ _GDT->test_dns(
     answer => 'down-21.example.com 21 A 127.0.0.1',
 );
 
+# persistent checkers
+_GDT->test_dns(
+    qname => 'pup.example.com', qtype => 'A',
+    answer => 'pup.example.com 50 A 127.0.0.1',
+);
+
+_GDT->test_dns(
+    qname => 'pfail.example.com', qtype => 'A',
+    answer => 'pfail.example.com 50 A 127.0.0.1',
+);
+
+# the one-shot checker exits after its first check, and is restarted
+_GDT->test_log_output([
+    q{Persistent checker '/bin/sh' exited with status 0},
+    q{Restarting persistent checker '/bin/sh' in 1s},
+]);
+
 _GDT->test_kill_daemon($pid);
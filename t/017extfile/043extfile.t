@@ -1,6 +1,6 @@
 use _GDT ();
 use Net::DNS;
-use Test::More tests => 7;
+use Test::More tests => 14;
 
 _GDT->test_spawn_daemon_setup();
 
@@ -23,6 +23,11 @@ _GDT->write_statefile('extfile/extf_u', qq{
     192.0.2.1 => up/41
 });
 
+_GDT->write_statefile('extfile/extf_l', qq{# initial states
+127.0.0.1 down/42
+192.0.2.1 up/41
+});
+
 my $pid = _GDT->test_spawn_daemon_execute();
 
 _GDT->test_dns(
@@ -47,4 +52,53 @@ _GDT->test_dns(
     answer => 'd.example.com 66 A 127.0.0.1',
 );
 
+_GDT->test_dns(
+    qname => 'l.example.com', qtype => 'A',
+    answer => 'l.example.com 41 A 192.0.2.1',
+);
+
+my $extf_l = $_GDT::OUTDIR . '/var/lib/gdnsd/extfile/extf_l';
+open(my $extf_l_fd, '>>', $extf_l)
+    or die "Cannot open '$extf_l' for appending: $!";
+print $extf_l_fd "127.0.0.1 UP/66\n192.0.2.1 DOWN/77\n";
+close($extf_l_fd)
+    or die "Cannot close '$extf_l': $!";
+
+_GDT->test_log_output(q{plugin_extfile: Service type 'extf_l': loaded appended data});
+
+_GDT->test_dns(
+    qname => 'l.example.com', qtype => 'A',
+    answer => 'l.example.com 66 A 127.0.0.1',
+);
+
+# A bad appended line is skipped, and doesn't stop later appends
+open($extf_l_fd, '>>', $extf_l)
+    or die "Cannot open '$extf_l' for appending: $!";
+print $extf_l_fd "this line is bad\n127.0.0.1 DOWN/55\n192.0.2.1 UP/44\n";
+close($extf_l_fd)
+    or die "Cannot close '$extf_l': $!";
+
+_GDT->test_log_output([
+    q{plugin_extfile: Service type 'extf_l': line 1 of new data in file},
+    q{plugin_extfile: Service type 'extf_l': loaded appended data},
+]);
+
+_GDT->test_dns(
+    qname => 'l.example.com', qtype => 'A',
+    answer => 'l.example.com 44 A 192.0.2.1',
+);
+
+open($extf_l_fd, '>>', $extf_l)
+    or die "Cannot open '$extf_l' for appending: $!";
+print $extf_l_fd "192.0.2.1 UP/33\n";
+close($extf_l_fd)
+    or die "Cannot close '$extf_l': $!";
+
+_GDT->test_log_output(q{plugin_extfile: Service type 'extf_l': loaded appended data});
+
+_GDT->test_dns(
+    qname => 'l.example.com', qtype => 'A',
+    answer => 'l.example.com 33 A 192.0.2.1',
+);
+
 _GDT->test_kill_daemon($pid);
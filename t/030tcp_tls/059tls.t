@@ -0,0 +1,151 @@
+# RFC 7858 DNS-over-TLS listener testing, with a self-signed certificate
+# generated on the fly.  The daemon requires kernel TLS offload, so this is
+# skipped when the build or the kernel lacks it.
+
+use _GDT ();
+use Test::More;
+use Socket qw/IPPROTO_TCP/;
+use IO::Socket::INET ();
+use strict;
+use warnings;
+
+# Linux's TCP_ULP sockopt, for probing kTLS availability
+my $TCP_ULP = 31;
+
+sub ktls_probe {
+    my $lsock = IO::Socket::INET->new(
+        Listen => 1,
+        LocalAddr => '127.0.0.1',
+        LocalPort => 0,
+        Proto => 'tcp',
+    ) or return 0;
+    my $csock = IO::Socket::INET->new(
+        PeerAddr => '127.0.0.1',
+        PeerPort => $lsock->sockport(),
+        Proto => 'tcp',
+    ) or return 0;
+    return setsockopt($csock, IPPROTO_TCP, $TCP_ULP, 'tls') ? 1 : 0;
+}
+
+my $skip_reason;
+{
+    my $usage = qx{$_GDT::GDNSD_BIN 2>&1};
+    if ($usage !~ /^Features:.*\bktls\b/m) {
+        $skip_reason = 'gdnsd was built without DNS-over-TLS support';
+    } elsif (!eval { require IO::Socket::SSL; 1 }) {
+        $skip_reason = 'IO::Socket::SSL is not available';
+    } elsif (system('openssl version >/dev/null 2>&1')) {
+        $skip_reason = 'openssl command is not available';
+    } elsif (!ktls_probe()) {
+        $skip_reason = 'kernel TLS offload is not available';
+    }
+}
+plan skip_all => $skip_reason if $skip_reason;
+plan tests => 9;
+
+# ID number incremented after each txn
+my $ID = 40404;
+
+sub wrap_tcp_prefix {
+    my $data = shift;
+    return pack("n", length($data)) . $data;
+}
+
+sub read_exact {
+    my ($sock, $len) = @_;
+    my $buf = '';
+    while (length($buf) < $len) {
+        my $chunk;
+        my $rv = sysread($sock, $chunk, $len - length($buf));
+        last if !$rv;
+        $buf .= $chunk;
+    }
+    return $buf;
+}
+
+sub recv_tcp {
+    my $sock = shift;
+    my $raw_len = read_exact($sock, 2);
+    return '' unless length($raw_len) == 2;
+    return $raw_len . read_exact($sock, unpack('n', $raw_len));
+}
+
+# Plain "ns1.example.com A" query without EDNS, so that the response isn't
+# padded, and its expected response with QR+AA bits and name compression
+sub test_ns1_query {
+    my $sock = shift;
+    my $q_ns1 = pack('nCCnnnna*nn',
+        $ID, 0, 0, 1, 0, 0, 0, "\x03ns1\x07example\x03com\x00", 1, 1
+    );
+    syswrite($sock, wrap_tcp_prefix($q_ns1));
+    my $recvbuf = recv_tcp($sock);
+    my $e_ns1 = pack('nCCnnnna*nna*nnNnN',
+        $ID, 132, 0, 1, 1, 0, 0, "\x03ns1\x07example\x03com\x00", 1, 1,
+        "\xC0\x0C", 1, 1, 86400, 4, 3221225985
+    );
+    $ID++;
+    return $recvbuf eq wrap_tcp_prefix($e_ns1);
+}
+
+# T1
+_GDT->test_spawn_daemon_setup();
+
+# T2
+{
+    my $tls_dir = $_GDT::OUTDIR . '/etc/tls';
+    mkdir $tls_dir or die "Cannot create directory $tls_dir: $!";
+    ok(!system('openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1'
+        . " -nodes -days 2 -subj /CN=localhost -keyout $tls_dir/key.pem"
+        . " -out $tls_dir/cert.pem >/dev/null 2>&1"));
+}
+
+# T3
+my $pid = _GDT->test_spawn_daemon_execute();
+
+{ # T4-5
+    # Two transactions over one DoT connection, then a clean close
+    my $tls_sock = IO::Socket::SSL->new(
+        PeerAddr => '127.0.0.1:' . $_GDT::EXTRA_PORT,
+        SSL_verify_mode => IO::Socket::SSL::SSL_VERIFY_NONE(),
+        Timeout => 3,
+    );
+    ok(test_ns1_query($tls_sock)) or diag "TLS connect/query failed: $IO::Socket::SSL::SSL_ERROR";
+    ok(test_ns1_query($tls_sock));
+    $tls_sock->close();
+}
+
+# T6
+eval {_GDT->check_stats(
+    tcp_conns => 1,
+    tcp_close_c => 1,
+    tcp_reqs => 2,
+    noerror => 2,
+    tcp_tls => 1,
+    tcp_tls_fail => 0,
+)};
+ok(!$@) or diag $@;
+
+{ # T7
+    # Cleartext DNS to the TLS port fails the handshake and gets reset
+    my $tcp_sock = IO::Socket::INET->new(
+        PeerAddr => '127.0.0.1:' . $_GDT::EXTRA_PORT,
+        Proto => 'tcp',
+        Timeout => 3,
+    );
+    ok(!test_ns1_query($tcp_sock));
+}
+
+# T8
+eval {_GDT->check_stats(
+    tcp_conns => 2,
+    tcp_close_c => 1,
+    tcp_close_s_err => 1,
+    tcp_reqs => 2,
+    noerror => 2,
+    tcp_tls => 2,
+    tcp_tls_fail => 1,
+)};
+ok(!$@) or diag $@;
+
+# T9
+_GDT->test_kill_daemon($pid);
@@ -0,0 +1,117 @@
+# Outbound AXFR/IXFR over TCP with xfr_allow set for the test addresses
+
+use _GDT ();
+use Test::More tests => 11;
+use strict;
+use warnings;
+
+my $pid = _GDT->test_spawn_daemon();
+
+sub xfr_resolver {
+    return Net::DNS::Resolver->new(
+        recurse => 0,
+        nameservers => [ '127.0.0.1' ],
+        port => $_GDT::DNS_PORT,
+        srcaddr => '127.0.0.1',
+        force_v4 => 1,
+        usevc => 1,
+        tcp_timeout => 3,
+        retry => 1,
+    );
+}
+
+# Uses an SOA in the authority section to tell the server our serial
+sub send_ixfr {
+    my ($zone, $serial) = @_;
+    my $q = Net::DNS::Packet->new($zone, 'IXFR');
+    $q->push(authority => Net::DNS::RR->new(
+        "$zone 900 SOA ns1.$zone dns-admin.$zone $serial 7200 1800 259200 900"
+    ));
+    return xfr_resolver()->send($q);
+}
+
+my @axfr_expect = sort map { Net::DNS::RR->new($_)->string } (
+    'example.com 86400 SOA ns1.example.com dns-admin.example.com 1 7200 1800 259200 900',
+    'example.com 86400 NS ns1.example.com',
+    'example.com 86400 NS ns2.example.com',
+    'example.com 86400 MX 10 mail.example.com',
+    'ns1.example.com 86400 A 192.0.2.1',
+    'ns2.example.com 86400 A 192.0.2.2',
+    'mail.example.com 86400 A 192.0.2.3',
+    'www.example.com 86400 CNAME mail.example.com',
+    'txt.example.com 86400 TXT "foo bar" "baz"',
+    '_sip._tcp.example.com 86400 SRV 5 10 5060 mail.example.net',
+    'sub.example.com 86400 NS ns1.sub.example.com',
+    'ns1.sub.example.com 86400 A 192.0.2.4',
+);
+
+# Full transfer of a static zone.  Net::DNS strips the final SOA.
+{
+    my @zone = xfr_resolver()->axfr('example.com');
+    is($zone[0] && $zone[0]->type, 'SOA', 'AXFR starts with the SOA');
+    my @got = sort map { $_->string } @zone;
+    is_deeply(\@got, \@axfr_expect, 'AXFR has the whole zone');
+}
+
+# Not a zone apex
+{
+    my $resp = xfr_resolver()->send('www.example.com', 'AXFR');
+    is($resp && $resp->header->rcode, 'REFUSED', 'AXFR of non-apex refused');
+}
+
+# Zones with dynamic data are never transferred
+{
+    my $resp = xfr_resolver()->send('example.org', 'AXFR');
+    is($resp && $resp->header->rcode, 'REFUSED', 'AXFR of DYNA zone refused');
+}
+
+# Client is already current: a single SOA
+{
+    my $resp = send_ixfr('example.com', 1);
+    my @ans = $resp ? $resp->answer : ();
+    ok(@ans == 1 && $ans[0]->type eq 'SOA' && $ans[0]->serial == 1, 'IXFR from current serial is one SOA')
+        or diag(join("\n", map { $_->string } @ans));
+}
+
+# Update the zone, and the serial 1 -> 2 change set should exist
+_GDT->insert_altzone('example.com-2', 'example.com');
+_GDT->daemon_reload_zones();
+{
+    my $resp = send_ixfr('example.com', 1);
+    my @got = map { $_->string } ($resp ? $resp->answer : ());
+    my @want = map { Net::DNS::RR->new($_)->string } (
+        'example.com 86400 SOA ns1.example.com dns-admin.example.com 2 7200 1800 259200 900',
+        'example.com 86400 SOA ns1.example.com dns-admin.example.com 1 7200 1800 259200 900',
+        'mail.example.com 86400 A 192.0.2.3',
+        'example.com 86400 SOA ns1.example.com dns-admin.example.com 2 7200 1800 259200 900',
+        'new.example.com 86400 AAAA 2001:db8::1',
+        'mail.example.com 86400 A 192.0.2.33',
+        'example.com 86400 SOA ns1.example.com dns-admin.example.com 2 7200 1800 259200 900',
+    );
+    is_deeply(\@got, \@want, 'IXFR 1 -> 2 is incremental');
+}
+
+# Unknown client serial falls back to a full AXFR-style answer
+{
+    my $resp = send_ixfr('example.com', 0);
+    my @ans = $resp ? $resp->answer : ();
+    ok(@ans == 14 && $ans[0]->type eq 'SOA' && $ans[1]->type ne 'SOA' && $ans[-1]->type eq 'SOA',
+        'IXFR from unknown serial is a full transfer')
+        or diag(join("\n", map { $_->string } @ans));
+}
+
+eval { _GDT->check_stats(
+    tcp_axfr => 1,
+    tcp_ixfr => 3,
+    tcp_xfr_refused => 2,
+    tcp_xfr_fail => 0,
+)};
+ok(!$@) or diag $@;
+
+# AXFR of the root of a delegation is not a zone either
+{
+    my $resp = xfr_resolver()->send('sub.example.com', 'AXFR');
+    is($resp && $resp->header->rcode, 'REFUSED', 'AXFR of delegation refused');
+}
+
+_GDT->test_kill_daemon($pid);
@@ -0,0 +1,61 @@
+# Per-zone and per-qtype stats, with zone_stats limited to fewer
+#  zones than we have, so that one of them is counted as "(other)"
+
+use _GDT ();
+use Test::More tests => 15;
+use strict;
+use warnings;
+
+my $pid = _GDT->test_spawn_daemon();
+
+# example.com: 4x noerror (2x each of v4 + v6), 2x nxdomain
+_GDT->test_dns(
+    qname => 'www.example.com', qtype => 'AAAA',
+    answer => 'www.example.com 86400 AAAA 2001:db8::1',
+    rep => 2,
+);
+
+_GDT->test_dns(
+    qname => 'nx.example.com', qtype => 'A',
+    header => { rcode => 'NXDOMAIN' },
+    auth => 'example.com 900 SOA ns1.example.com dns-admin.example.com 1 7200 1800 259200 900',
+    stats => [qw/udp_reqs nxdomain/],
+);
+
+# example.net: 2x noerror
+_GDT->test_dns(
+    qname => 'ns1.example.net', qtype => 'A',
+    answer => 'ns1.example.net 86400 A 192.0.2.2',
+);
+
+# Not one of our zones, not counted per-zone
+_GDT->test_dns(
+    qname => 'example.org', qtype => 'TXT',
+    header => { rcode => 'REFUSED', aa => 0 },
+    stats => [qw/udp_reqs refused/],
+);
+
+_GDT->test_stats;
+
+my $json = _GDT::_get_daemon_json_stats();
+
+is($json->{qtype}{aaaa}, 4, 'qtype aaaa count');
+is($json->{qtype}{a}, 4, 'qtype a count');
+is($json->{qtype}{txt}, 2, 'qtype txt count');
+
+my %want = (
+    'example.com.' => { noerror => 4, nxdomain => 2 },
+    'example.net.' => { noerror => 2, nxdomain => 0 },
+);
+
+my $zones = $json->{zones};
+my @named = grep { $_ ne '(other)' } keys %$zones;
+is(scalar(keys %$zones), 2, 'two per-zone entries');
+ok(exists $zones->{'(other)'}, 'zones beyond the limit are "(other)"');
+ok(@named == 1 && exists $want{$named[0]}, 'one zone has its own entry')
+    or diag(join(' ', keys %$zones));
+my ($other_name) = grep { $_ ne $named[0] } keys %want;
+is_deeply($zones->{$named[0]}, $want{$named[0]}, 'named zone counters');
+is_deeply($zones->{'(other)'}, $want{$other_name}, 'other zone counters');
+
+_GDT->test_kill_daemon($pid);
@@ -0,0 +1,87 @@
+# The HTTP metrics listener, in both exposition formats, over one keepalive
+#  connection, including the publication of a monitored state change
+
+use _GDT ();
+use IO::Socket::INET ();
+use Test::More tests => 25;
+use strict;
+use warnings;
+
+# Sends one request on an open socket and returns (status, headers, body)
+sub http_req {
+    my ($sock, $req) = @_;
+    $sock->print($req);
+    my $status = $sock->getline();
+    $status = '' unless defined $status;
+    $status =~ s/\r?\n$//;
+    my %hdrs;
+    while (defined(my $line = $sock->getline())) {
+        $line =~ s/\r?\n$//;
+        last if $line eq '';
+        my ($k, $v) = split(/:\s*/, $line, 2);
+        $hdrs{lc $k} = $v;
+    }
+    my $body = '';
+    $sock->read($body, $hdrs{'content-length'} || 0);
+    return ($status, \%hdrs, $body);
+}
+
+my $pid = _GDT->test_spawn_daemon();
+
+_GDT->test_dns(
+    qname => 'www.example.com', qtype => 'AAAA',
+    answer => 'www.example.com 86400 AAAA 2001:db8::1',
+);
+
+my $sock = IO::Socket::INET->new(
+    PeerAddr => '127.0.0.1',
+    PeerPort => $_GDT::EXTRA_PORT,
+    Proto => 'tcp',
+    Timeout => 10,
+) or die "Cannot connect to metrics listener: $!";
+
+my ($status, $hdrs, $body) = http_req($sock, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+is($status, 'HTTP/1.1 200 OK', 'prometheus: status');
+like($hdrs->{'content-type'}, qr{^text/plain; version=0\.0\.4}, 'prometheus: content type');
+is($hdrs->{'connection'}, 'keep-alive', 'prometheus: keepalive');
+like($body, qr/^# TYPE gdnsd_dns_responses_total counter$/m, 'prometheus: counter TYPE names the samples');
+like($body, qr/^gdnsd_dns_responses_total\{rcode="noerror"\} 2$/m, 'prometheus: noerror count');
+like($body, qr/^gdnsd_udp_reqs_total 2$/m, 'prometheus: udp reqs count');
+like($body, qr/^gdnsd_latency_seconds_count\{type="udp_pdq"\} 2$/m, 'prometheus: udp_pdq histogram count');
+like($body, qr/^gdnsd_dns_qtype_total\{qtype="aaaa"\} 2$/m, 'prometheus: qtype count');
+like($body, qr/^gdnsd_monitor_publications_total 0$/m, 'prometheus: no state publications yet');
+
+($status, $hdrs, $body) = http_req($sock, "GET /metrics HTTP/1.1\r\nHost: localhost\r\nAccept: application/openmetrics-text; version=1.0.0\r\n\r\n");
+is($status, 'HTTP/1.1 200 OK', 'openmetrics: status');
+like($hdrs->{'content-type'}, qr{^application/openmetrics-text; version=1\.0\.0}, 'openmetrics: content type');
+like($body, qr/^# TYPE gdnsd_dns_responses counter$/m, 'openmetrics: counter TYPE names the family');
+like($body, qr/\n# EOF\n\z/, 'openmetrics: EOF marker');
+
+_GDT->write_statefile('admin_state', qq{
+    192.0.2.10/up => DOWN/86400
+});
+_GDT->test_log_output([
+    q{admin_state: state of '192.0.2.10/up' forced to DOWN/86400, real state is UP/MAX},
+    q{admin_state: load complete},
+]);
+_GDT->test_dns(
+    qname => 'mfo.example.com', qtype => 'A',
+    answer => [
+        'mfo.example.com 86400 A 192.0.2.11',
+        'mfo.example.com 86400 A 192.0.2.12',
+    ],
+);
+
+($status, $hdrs, $body) = http_req($sock, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+is($status, 'HTTP/1.1 200 OK', 'monitor: status');
+like($body, qr/^gdnsd_monitor_down\{service="192\.0\.2\.10\/up"\} 1$/m, 'monitor: forced down');
+like($body, qr/^gdnsd_monitor_publications_total 1$/m, 'monitor: one publication');
+like($body, qr/^gdnsd_monitor_published_entries_total 1$/m, 'monitor: one entry copied');
+like($body, qr/^gdnsd_monitor_propagation_max_seconds [0-9.]+$/m, 'monitor: propagation stats');
+
+($status, $hdrs, $body) = http_req($sock, "GET /nonexistent HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+is($status, 'HTTP/1.1 404 Not Found', 'unknown path');
+is($hdrs->{'connection'}, 'close', 'client-requested close');
+close($sock);
+
+_GDT->test_kill_daemon($pid);
@@ -0,0 +1,89 @@
+# dnstap file output: the Frame Streams framing, and the query and response
+#  messages for requests over both UDP and TCP
+
+use _GDT ();
+use Test::More tests => 15;
+use strict;
+use warnings;
+
+# Decodes a protobuf message into a hash of field number => [values]
+sub pb_decode {
+    my $buf = shift;
+    my %fields;
+    my $varint = sub {
+        my ($v, $shift) = (0, 0);
+        while (1) {
+            my $byte = ord(substr($buf, 0, 1, ''));
+            $v |= ($byte & 0x7F) << $shift;
+            $shift += 7;
+            return $v if $byte < 0x80;
+        }
+    };
+    while (length($buf)) {
+        my $tag = $varint->();
+        my ($field, $wtype) = ($tag >> 3, $tag & 7);
+        my $val;
+        if ($wtype == 0) {
+            $val = $varint->();
+        } elsif ($wtype == 2) {
+            $val = substr($buf, 0, $varint->(), '');
+        } elsif ($wtype == 5) {
+            $val = unpack('V', substr($buf, 0, 4, ''));
+        } else {
+            die "Unexpected protobuf wire type $wtype";
+        }
+        push(@{$fields{$field}}, $val);
+    }
+    return \%fields;
+}
+
+my $pid = _GDT->test_spawn_daemon();
+
+_GDT->test_dns(
+    qname => 'www.example.com', qtype => 'AAAA',
+    answer => 'www.example.com 86400 AAAA 2001:db8::1',
+);
+
+_GDT->test_dns(
+    resopts => { usevc => 1 },
+    qname => 'www.example.com', qtype => 'AAAA',
+    answer => 'www.example.com 86400 AAAA 2001:db8::1',
+    stats => [qw/tcp_reqs noerror/],
+);
+
+# The writer flushes everything out before the daemon exits
+_GDT->test_kill_daemon($pid);
+
+open(my $fh, '<:raw', "$_GDT::RUNDIR/dnstap.fstrm")
+    or die "Cannot open dnstap output: $!";
+my $data = do { local $/; <$fh> };
+close($fh);
+
+my ($escape, $clen, $ctype) = unpack('NNN', substr($data, 0, 12));
+is($escape, 0, 'stream starts with a control frame');
+is($ctype, 2, 'first control frame is START');
+like(substr($data, 12, $clen - 4), qr/protobuf:dnstap\.Dnstap\z/, 'START has the dnstap content type');
+substr($data, 0, 8 + $clen, '');
+
+my @msgs;
+while (length($data)) {
+    my $len = unpack('N', substr($data, 0, 4, ''));
+    last if !$len;
+    my $dt = pb_decode(substr($data, 0, $len, ''));
+    my $msg = pb_decode($dt->{14}[0]);
+    push(@msgs, { dt => $dt, msg => $msg });
+}
+is(unpack('N', substr($data, 4, 4)), 3, 'stream ends with STOP');
+
+is(scalar(@msgs), 8, 'eight data frames');
+like($msgs[0]{dt}{2}[0], qr/^gdnsd /, 'version');
+
+my @queries = grep { $_->{msg}{1}[0] == 1 } @msgs;
+my @responses = grep { $_->{msg}{1}[0] == 2 } @msgs;
+is(scalar(@queries), 4, 'four AUTH_QUERY messages');
+is(scalar(@responses), 4, 'four AUTH_RESPONSE messages');
+
+my $qname = "\x03www\x07example\x03com\x00";
+is(scalar(grep { index($_->{msg}{10}[0], $qname) >= 0 } @queries), 4, 'queries contain the qname');
+is(scalar(grep { index($_->{msg}{14}[0], $qname) >= 0 } @responses), 4, 'responses contain the qname');
+is(scalar(grep { $_->{msg}{3}[0] == 2 } @msgs), 4, 'half of the messages are TCP');
@@ -0,0 +1,72 @@
+# Loopback load generation with tools/gdnsd_loadgen over both UDP and TCP,
+#  checking that every query is answered with its expected rcode.  If
+#  GDNSD_PERF_QPS is set, a timed UDP run must also sustain at least that
+#  many queries per second.
+
+use _GDT ();
+use Test::More;
+use strict;
+use warnings;
+
+plan skip_all => 'gdnsd_loadgen is not available'
+    unless $_GDT::LOADGEN_BIN && -x $_GDT::LOADGEN_BIN;
+plan tests => 18;
+
+my @queries = (
+    'www.example.com AAAA NOERROR',
+    'ns1.example.com A NOERROR',
+    'example.com SOA NOERROR',
+    'nx.example.com A NXDOMAIN',
+    'www.example.net A REFUSED',
+);
+
+# Generous timeouts, for running under valgrind and the like
+my $timeout = $_GDT::TEST_RUNNER ? 30000 : 10000;
+
+my $pid = _GDT->test_spawn_daemon();
+
+_GDT->test_dns(
+    qname => 'www.example.com', qtype => 'AAAA',
+    answer => 'www.example.com 86400 AAAA 2001:db8::1',
+);
+
+my $udp = _GDT->run_loadgen(
+    queries => \@queries,
+    opts => "-n 1000 -w 20 -W $timeout -e",
+);
+is($udp->{sent}, 1000, 'udp: sent');
+is($udp->{lost}, 0, 'udp: nothing lost');
+is($udp->{bad}, 0, 'udp: no bad responses');
+is($udp->{rcode_mismatch}, 0, 'udp: all rcodes as expected');
+is($udp->{rcode_noerror}, 600, 'udp: noerror count');
+is($udp->{rcode_nxdomain}, 200, 'udp: nxdomain count');
+is($udp->{rcode_refused}, 200, 'udp: refused count');
+
+my $tcp = _GDT->run_loadgen(
+    queries => \@queries,
+    opts => "-T -c 2 -w 5 -n 500 -W $timeout",
+);
+is($tcp->{received}, 500, 'tcp: received');
+is($tcp->{lost}, 0, 'tcp: nothing lost');
+is($tcp->{bad}, 0, 'tcp: no bad responses');
+is($tcp->{rcode_mismatch}, 0, 'tcp: all rcodes as expected');
+is($tcp->{connections}, 2, 'tcp: no reconnects');
+
+SKIP: {
+    skip 'GDNSD_PERF_QPS is not set', 2 unless $ENV{GDNSD_PERF_QPS};
+    my $perf = _GDT->run_loadgen(
+        queries => \@queries,
+        opts => "-l 3 -t 2 -w 100 -W $timeout",
+    );
+    is($perf->{rcode_mismatch}, 0, 'perf: all rcodes as expected');
+    cmp_ok($perf->{qps}, '>=', $ENV{GDNSD_PERF_QPS}, 'perf: queries/sec')
+        or diag("latency p50/p99/p999 (ns): $perf->{latency_p50_ns}/$perf->{latency_p99_ns}/$perf->{latency_p999_ns}");
+}
+
+# Re-checks the accumulated stats, including all of the above
+_GDT->test_dns(
+    qname => 'www.example.com', qtype => 'AAAA',
+    answer => 'www.example.com 86400 AAAA 2001:db8::1',
+);
+
+_GDT->test_kill_daemon($pid);
@@ -0,0 +1,70 @@
+# geoip map_cache: the compiled map is saved once the daemon is running,
+#  re-used by the next start, and rebuilt if the cache file is damaged.
+
+use strict;
+use warnings;
+use _GDT ();
+use Test::More tests => 20;
+
+my $cache_file = $_GDT::OUTDIR . '/var/lib/gdnsd/geoip_cache/map.';
+
+sub test_answers {
+    # NA by geoip
+    _GDT->test_dns(
+        qname => 'res1.example.com', qtype => 'A',
+        q_optrr => _GDT::optrr_clientsub(addr_v4 => '64.0.0.1', src_mask => 32),
+        answer => 'res1.example.com 86400 A 192.0.2.1',
+        addtl => _GDT::optrr_clientsub(addr_v4 => '64.0.0.1', src_mask => 32, scope_mask => 2),
+    );
+    # NA by geoip, but EU by the nets override
+    _GDT->test_dns(
+        qname => 'res1.example.com', qtype => 'A',
+        q_optrr => _GDT::optrr_clientsub(addr_v4 => '10.10.0.0', src_mask => 16),
+        answer => 'res1.example.com 86400 A 192.0.2.2',
+        addtl => _GDT::optrr_clientsub(addr_v4 => '10.10.0.0', src_mask => 16, scope_mask => 16),
+    );
+    # EU by geoip
+    _GDT->test_dns(
+        qname => 'res1.example.com', qtype => 'A',
+        q_optrr => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32),
+        answer => 'res1.example.com 86400 A 192.0.2.2',
+        addtl => _GDT::optrr_clientsub(addr_v4 => '192.0.2.1', src_mask => 32, scope_mask => 1),
+    );
+}
+
+# Whether the daemon's startup output contains $text
+sub startup_logged {
+    my $text = shift;
+    open(my $fh, '<', $_GDT::OUTDIR . '/gdnsd.out')
+        or die "Cannot open gdnsd.out: $!";
+    my $found = grep { /\Q$text\E/ } <$fh>;
+    close($fh);
+    return $found;
+}
+
+# 1) No cache yet: full build, then the cache is written by the reload thread
+_GDT->test_spawn_daemon_setup();
+my $pid = _GDT->test_spawn_daemon_execute();
+test_answers();
+_GDT->test_log_output(q{plugin_geoip: map 'map1': saved compiled map to cache file});
+_GDT->test_kill_daemon($pid);
+my @cache_files = glob($cache_file . '*');
+
+# 2) Started from the cache
+$pid = _GDT->test_spawn_daemon_execute();
+ok(startup_logged(q{plugin_geoip: map 'map1': loaded compiled map from cache file}), 'map loaded from cache');
+test_answers();
+_GDT->test_kill_daemon($pid);
+
+# 3) Damaged cache: rejected, the map is rebuilt and the cache rewritten
+ok(@cache_files == 1, 'one cache file');
+if (open(my $fh, '+<', $cache_files[0])) {
+    binmode($fh);
+    seek($fh, -4, 2);
+    print $fh "\xDE\xAD\xBE\xEF";
+    close($fh);
+}
+$pid = _GDT->test_spawn_daemon_execute();
+test_answers();
+_GDT->test_log_output(q{plugin_geoip: map 'map1': saved compiled map to cache file});
+_GDT->test_kill_daemon($pid);
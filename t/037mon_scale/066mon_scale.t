@@ -0,0 +1,79 @@
+# A generated configuration with tens of thousands of monitored addresses
+#  and CNAMEs, each shared by two resources, and thousands of resources
+#  referenced from the zone.  This checks that every (service type, address)
+#  and (service type, CNAME) pair gets exactly one monitor, and would take
+#  a very long time to start up if monitor de-duplication or resolver
+#  resource lookup were quadratic.
+
+use _GDT ();
+use Test::More tests => 9;
+
+my $num_addrs = 25000;
+my $num_mfo = 5000;  # 10 addresses each, so each address is used twice
+my $num_cnames = 3000;
+my $num_wtd = 3000;  # 2 CNAMEs each, so each CNAME is used twice
+
+sub addr_str {
+    my $n = shift;
+    return sprintf('10.%u.%u.%u', ($n >> 16) & 255, ($n >> 8) & 255, $n & 255);
+}
+
+sub append_file {
+    my ($path, $text) = @_;
+    open(my $fh, '>>', $path) or die "Cannot open '$path' for appending: $!";
+    print $fh $text;
+    close($fh) or die "Cannot close '$path': $!";
+}
+
+_GDT->test_spawn_daemon_setup();
+
+my $cfg = "plugins => {\n  multifo => {\n    service_types => up\n";
+my $zone = '';
+foreach my $i (0 .. $num_mfo - 1) {
+    $cfg .= "    r$i => {";
+    $cfg .= " a$_ => " . addr_str(($i * 10 + $_) % $num_addrs) for (0 .. 9);
+    $cfg .= " }\n";
+    $zone .= "m$i\tDYNA\tmultifo!r$i\n";
+}
+$cfg .= "  }\n  weighted => {\n    service_types => up\n";
+foreach my $i (0 .. $num_wtd - 1) {
+    my $c1 = $i % $num_cnames;
+    my $c2 = ($i + 1) % $num_cnames;
+    $cfg .= "    w$i => { c1 => [ c$c1.example.net., 1 ], c2 => [ c$c2.example.net., 1 ] }\n";
+    $zone .= "w$i\tDYNC\tweighted!w$i\n";
+}
+$cfg .= "  }\n}\n";
+append_file($_GDT::OUTDIR . '/etc/config', $cfg);
+append_file($_GDT::OUTDIR . '/etc/zones/example.com', $zone);
+
+my $pid = _GDT->test_spawn_daemon_execute();
+
+_GDT->test_dns(
+    qname => 'm0.example.com', qtype => 'A',
+    answer => [ map { 'm0.example.com 86400 A ' . addr_str($_) } (0 .. 9) ],
+);
+
+my $last = $num_mfo - 1;
+_GDT->test_dns(
+    qname => "m$last.example.com", qtype => 'A',
+    answer => [ map { "m$last.example.com 86400 A " . addr_str(($last * 10 + $_) % $num_addrs) } (0 .. 9) ],
+);
+
+_GDT->test_run_gdnsdctl('states');
+my %addr_mons;
+my %cname_mons;
+if (open(my $fh, '<', $_GDT::OUTDIR . '/gdnsdctl.out')) {
+    while (<$fh>) {
+        if (/^\s*"(10\.[0-9.]+)\/up":/) {
+            $addr_mons{$1}++;
+        } elsif (/^\s*"(c[0-9]+\.example\.net\.?)\/up":/) {
+            $cname_mons{$1}++;
+        }
+    }
+    close($fh);
+}
+is(scalar(keys %addr_mons), $num_addrs, 'one monitor per address');
+is(scalar(keys %cname_mons), $num_cnames, 'one monitor per CNAME');
+ok(!grep({ $_ != 1 } values(%addr_mons), values(%cname_mons)), 'no duplicate monitors');
+
+_GDT->test_kill_daemon($pid);
@@ -0,0 +1,64 @@
+# http_status keepalive: probes reuse one connection, and a connection
+#  closed by the server while idle is replaced without a state change
+
+use _GDT ();
+use File::Spec;
+use File::Temp qw/tmpnam/;
+use Test::More tests => 7;
+use strict;
+use warnings;
+
+my $state_file = tmpnam();
+my $server_script = File::Spec->catfile($FindBin::Bin, 'server.pl');
+my $http_pid = fork();
+if(!defined $http_pid) { diag "Fork failed: $!"; BAIL_OUT($!); }
+if(!$http_pid) { # child, execute test http server
+    exec($^X, $server_script, $_GDT::EXTRA_PORT, $state_file);
+}
+
+sub read_stats {
+    open(my $fh, '<', $state_file) or return (0, 0);
+    my $line = <$fh>;
+    close($fh);
+    return (0, 0) unless defined $line && $line =~ /^(\d+) (\d+)$/;
+    return ($1, $2);
+}
+
+# Avoid racing the test http server
+while(!-f $state_file) {
+    select(undef, undef, undef, 0.1); # 100ms
+}
+
+my $pid = _GDT->test_spawn_daemon();
+
+_GDT->test_dns(
+    qname => 'dyn.example.com', qtype => 'A',
+    answer => 'dyn.example.com 120 A 127.0.0.1',
+);
+
+# The server closes each connection after three requests, so the fifth
+# request is the second one on the second connection
+my ($conns, $reqs) = (0, 0);
+for (1..300) {
+    ($conns, $reqs) = read_stats();
+    last if $reqs >= 5;
+    select(undef, undef, undef, 0.1); # 100ms
+}
+cmp_ok($reqs, '>=', 5, 'monitor kept probing');
+is($conns, 2, 'one new connection per three requests');
+
+# With down_thresh = 1 and up_thresh = 20, a failure counted for the closed
+# connection (e.g. from taking the server's idle 408 as the response to the
+# next request) would leave the secondary in place for the rest of the test
+_GDT->test_dns(
+    qname => 'dyn.example.com', qtype => 'A',
+    answer => 'dyn.example.com 120 A 127.0.0.1',
+);
+
+_GDT->test_kill_daemon($pid);
+_GDT->test_kill_other_daemon($http_pid);
+
+END {
+    kill(9, $http_pid) if($http_pid && kill(0, $http_pid));
+    unlink($state_file) if $state_file;
+}
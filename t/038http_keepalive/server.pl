@@ -0,0 +1,51 @@
+# A minimal HTTP/1.1 keepalive server for the http_status keepalive test.
+# It answers every request with a small fixed body, and after the third
+# request on a connection sends an unsolicited 408 and closes it, like a
+# server whose idle timeout expired.  "connections requests" counts are kept
+# in statef.
+
+use strict;
+use warnings;
+use IO::Socket::INET;
+
+my ($portnum, $statef) = @ARGV;
+
+$SIG{PIPE} = 'IGNORE';
+
+my $d = IO::Socket::INET->new(
+    LocalAddr => '127.0.0.1',
+    LocalPort => $portnum,
+    Proto => 'tcp',
+    Listen => 16,
+    ReuseAddr => 1,
+) or die "Cannot listen at 127.0.0.1:${portnum}: $!";
+
+my $conns = 0;
+my $reqs = 0;
+
+sub write_stats {
+    open(my $fh, '>', "${statef}.tmp") or die "Cannot write ${statef}.tmp: $!";
+    print $fh "$conns $reqs\n";
+    close($fh);
+    rename("${statef}.tmp", $statef) or die "Cannot rename to $statef: $!";
+}
+
+write_stats();
+
+while (my $c = $d->accept) {
+    $conns++;
+    my $on_conn = 0;
+    while (defined(my $line = $c->getline())) {
+        next unless $line =~ /^\r?\n$/;
+        $reqs++;
+        $on_conn++;
+        $c->print("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 3\r\n\r\nok\n");
+        write_stats();
+        if ($on_conn == 3) {
+            sleep(1);
+            $c->print("HTTP/1.1 408 Request Timeout\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            last;
+        }
+    }
+    $c->close;
+}
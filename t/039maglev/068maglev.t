@@ -0,0 +1,145 @@
+# maglev: answers are sticky per client network, and edns-client-subnet
+#  scopes reflect the prefix that was hashed.  When an address is down,
+#  only its own clients move, and they move back when it's up again.
+
+use strict;
+use warnings;
+use _GDT ();
+use Test::More tests => 19;
+
+my @pick_addrs = qw/192.0.2.11 192.0.2.12 192.0.2.13/;
+
+# Maps each of 64 client networks (via edns-client-subnet) to its answer
+#   for pick.example.com
+sub pick_map {
+    my $res = _GDT->get_resolver();
+    my %map;
+    foreach my $n (0..63) {
+        my $net = "10.0.$n.0";
+        my $query = Net::DNS::Packet->new('pick.example.com', 'A');
+        $query->push(additional => _GDT::optrr_clientsub(addr_v4 => $net, src_mask => 24));
+        my $resp = $res->send($query);
+        $map{$net} = $resp
+            ? join(' ', sort(map { $_->address } grep { $_->type eq 'A' } $resp->answer))
+            : 'no response';
+        _GDT->stats_inc(qw/udp_reqs edns edns_clientsub noerror/);
+    }
+    _GDT->test_stats();
+    return \%map;
+}
+
+# Checks that only the clients of $down moved, and that they all moved to
+#   one of the other addresses
+sub check_moved {
+    my ($base, $now, $down) = @_;
+    my @bad;
+    foreach my $net (sort keys %$base) {
+        if ($base->{$net} eq $down) {
+            push(@bad, "$net: $now->{$net}")
+                if $now->{$net} eq $down || !grep { $_ eq $now->{$net} } @pick_addrs;
+        } elsif ($now->{$net} ne $base->{$net}) {
+            push(@bad, "$net: $base->{$net} -> $now->{$net}");
+        }
+    }
+    ok(!@bad, "only the clients of $down moved") or diag join("\n", @bad);
+}
+
+my $pid = _GDT->test_spawn_daemon();
+
+_GDT->test_dns(
+    qname => 'all.example.com', qtype => 'A',
+    answer => [
+        'all.example.com 86400 A 192.0.2.1',
+        'all.example.com 86400 A 192.0.2.2',
+        'all.example.com 86400 A 192.0.2.3',
+    ],
+);
+
+_GDT->test_dns(
+    qname => 'pick.example.com', qtype => 'A',
+    limit_v4 => 1,
+    answer => [
+        'pick.example.com 86400 A 192.0.2.11',
+        'pick.example.com 86400 A 192.0.2.12',
+        'pick.example.com 86400 A 192.0.2.13',
+    ],
+);
+
+# Every query from the same client network gets the same address
+{
+    my %seen;
+    my $res = _GDT->get_resolver();
+    for (1..10) {
+        my $resp = $res->send('pick.example.com', 'A');
+        $seen{$_->address}++ for grep { $_->type eq 'A' } $resp->answer;
+        _GDT->stats_inc(qw/udp_reqs noerror/);
+    }
+    is(scalar(keys %seen), 1) or diag "Got addresses: " . join(' ', keys %seen);
+    _GDT->test_stats();
+}
+
+_GDT->test_dns(
+    qname => 'all.example.com', qtype => 'A',
+    q_optrr => _GDT::optrr_clientsub(addr_v4 => '192.0.2.0', src_mask => 24),
+    answer => [
+        'all.example.com 86400 A 192.0.2.1',
+        'all.example.com 86400 A 192.0.2.2',
+        'all.example.com 86400 A 192.0.2.3',
+    ],
+    addtl => _GDT::optrr_clientsub(addr_v4 => '192.0.2.0', src_mask => 24, scope_mask => 24),
+    stats => [qw/udp_reqs edns edns_clientsub noerror/],
+);
+
+# A source prefix shorter than /24 is hashed as-is
+_GDT->test_dns(
+    qname => 'all.example.com', qtype => 'A',
+    q_optrr => _GDT::optrr_clientsub(addr_v4 => '192.0.0.0', src_mask => 16),
+    answer => [
+        'all.example.com 86400 A 192.0.2.1',
+        'all.example.com 86400 A 192.0.2.2',
+        'all.example.com 86400 A 192.0.2.3',
+    ],
+    addtl => _GDT::optrr_clientsub(addr_v4 => '192.0.0.0', src_mask => 16, scope_mask => 16),
+    stats => [qw/udp_reqs edns edns_clientsub noerror/],
+);
+
+# Every address has some of the 64 networks as clients
+my $base = pick_map();
+my %per_addr;
+$per_addr{$_}++ for values(%$base);
+is(join(' ', map { $per_addr{$_} ? 'used' : 'unused' } @pick_addrs), 'used used used')
+    or diag explain \%per_addr;
+
+# Failover: with .12 down, its clients move to the others
+_GDT->write_statefile('admin_state', qq{
+    192.0.2.12/up => DOWN/86400
+});
+_GDT->test_log_output([
+    q{admin_state: state of '192.0.2.12/up' forced to DOWN/86400, real state is UP/MAX},
+    q{admin_state: load complete},
+]);
+check_moved($base, pick_map(), '192.0.2.12');
+
+# A different down address rebuilds the table: .12's clients are back,
+#   and only .11's have moved
+_GDT->write_statefile('admin_state', qq{
+    192.0.2.11/up => DOWN/86400
+});
+_GDT->test_log_output([
+    q{admin_state: state of '192.0.2.11/up' forced to DOWN/86400, real state is UP/MAX},
+    q{admin_state: state of '192.0.2.12/up' no longer forced},
+    q{admin_state: load complete},
+]);
+check_moved($base, pick_map(), '192.0.2.11');
+
+# With all of them up again, every client has its original address
+_GDT->write_statefile('admin_state', qq{
+    192.0.2.1/up => UP/86400
+});
+_GDT->test_log_output([
+    q{admin_state: state of '192.0.2.11/up' no longer forced},
+    q{admin_state: load complete},
+]);
+is_deeply(pick_map(), $base, 'all clients back on their original addresses');
+
+_GDT->test_kill_daemon($pid);
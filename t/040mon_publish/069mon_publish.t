@@ -0,0 +1,93 @@
+# Asynchronous monitor state publication: unlike the rest of the testsuite,
+#  changes go through the publication delay, the grace period thread, and
+#  its wakeup of the main loop, and nearby changes are coalesced
+
+use _GDT ();
+use IO::Socket::INET ();
+use Test::More tests => 12;
+use strict;
+use warnings;
+
+# Fetches the metrics text, or '' on failure
+sub get_metrics {
+    my $sock = IO::Socket::INET->new(
+        PeerAddr => '127.0.0.1',
+        PeerPort => $_GDT::EXTRA_PORT,
+        Proto => 'tcp',
+        Timeout => 10,
+    ) or return '';
+    $sock->print("GET /metrics HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+    my $resp = do { local $/; <$sock> };
+    close($sock);
+    return '' unless defined $resp;
+    $resp =~ s/^.*?\r\n\r\n//s;
+    return $resp;
+}
+
+# Waits for the metrics to report a given count of publications, and
+#  returns the metrics text at that point, or '' on timeout
+sub wait_publications {
+    my $want = shift;
+    my $tries = $_GDT::TEST_RUNNER ? 300 : 100;
+    while ($tries--) {
+        my $body = get_metrics();
+        return $body if $body =~ /^gdnsd_monitor_publications_total $want$/m;
+        select(undef, undef, undef, 0.1);
+    }
+    return '';
+}
+
+$ENV{GDNSD_TESTSUITE_ASYNC_PUBLISH} = 1;
+my $pid = _GDT->test_spawn_daemon();
+
+_GDT->test_dns(
+    qname => 'mfo.example.com', qtype => 'A',
+    answer => [
+        'mfo.example.com 86400 A 192.0.2.10',
+        'mfo.example.com 86400 A 192.0.2.11',
+        'mfo.example.com 86400 A 192.0.2.12',
+    ],
+);
+
+like(get_metrics(), qr/^gdnsd_monitor_publications_total 0$/m, 'no publications yet');
+
+# Two changes in one admin_state load go out in a single publication
+_GDT->write_statefile('admin_state', qq{
+    192.0.2.10/up => DOWN/86400
+    192.0.2.11/up => DOWN/86400
+});
+_GDT->test_log_output([
+    q{admin_state: state of '192.0.2.10/up' forced to DOWN/86400, real state is UP/MAX},
+    q{admin_state: state of '192.0.2.11/up' forced to DOWN/86400, real state is UP/MAX},
+    q{admin_state: load complete},
+]);
+my $body = wait_publications(1);
+ok($body, 'first publication');
+like($body, qr/^gdnsd_monitor_published_entries_total 2$/m, 'both changes in one publication');
+_GDT->test_dns(
+    qname => 'mfo.example.com', qtype => 'A',
+    answer => 'mfo.example.com 86400 A 192.0.2.12',
+);
+
+# The second publication needs the table retired by the first, which only
+#  comes back once the grace period thread has woken up the main loop
+_GDT->write_statefile('admin_state', qq{
+    192.0.2.11/up => DOWN/86400
+});
+_GDT->test_log_output([
+    q{admin_state: state of '192.0.2.10/up' no longer forced (was forced to DOWN/86400), real and current state is UP/MAX},
+    q{admin_state: load complete},
+]);
+$body = wait_publications(2);
+ok($body, 'second publication');
+# The recycled table also catches up on the first publication's 2 entries
+like($body, qr/^gdnsd_monitor_published_entries_total 5$/m, 'recycled table caught up');
+_GDT->test_dns(
+    qname => 'mfo.example.com', qtype => 'A',
+    answer => [
+        'mfo.example.com 86400 A 192.0.2.10',
+        'mfo.example.com 86400 A 192.0.2.12',
+    ],
+);
+
+_GDT->test_kill_daemon($pid);
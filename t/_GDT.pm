@@ -125,6 +125,12 @@ our $GDNSDCTL_BIN = $ENV{INSTALLCHECK_BINDIR}
     ? "$ENV{INSTALLCHECK_BINDIR}/gdnsdctl"
     : "$ENV{TOP_BUILDDIR}/src/gdnsdctl";
 
+# The loopback load generator is never installed, so it's only available
+# for a regular "check" of a full build tree
+our $LOADGEN_BIN = $ENV{INSTALLCHECK_SBINDIR}
+    ? undef
+    : "$ENV{TOP_BUILDDIR}/tools/gdnsd_loadgen";
+
 # extmon_helper works out of the box for "installcheck",
 # but needs some custom paths for "check"
 our $EXTMON_BIN;
@@ -523,6 +529,46 @@ sub test_run_gdnsdctl {
     }
 }
 
+# Runs tools/gdnsd_loadgen against the running daemon and returns its
+#  results as a hashref of the "key: value" lines it outputs.  Args are:
+#    queries => [ "name qtype [rcode]", ... ] - the query list
+#    opts => "..." - extra loadgen options, e.g. "-T -c 2 -n 1000"
+#  The responses received are added to the accumulated stats, so that later
+#  stats checks in the same test still line up.
+sub run_loadgen {
+    my ($class, %args) = @_;
+
+    die "Test Bug: no loadgen binary" unless $LOADGEN_BIN && -x $LOADGEN_BIN;
+    my $qfile = $OUTDIR . '/loadgen.queries';
+    open(my $qfh, '>', $qfile)
+        or die "Cannot open '$qfile' for writing: $!";
+    print $qfh "$_\n" foreach @{$args{queries}};
+    close($qfh);
+
+    my $opts = $args{opts} || '';
+    my $lg_out = $OUTDIR . '/loadgen.out';
+    system(qq{$LOADGEN_BIN -s 127.0.0.1:$DNS_PORT -f $qfile $opts >$lg_out 2>&1}) == 0
+        or die "gdnsd_loadgen failed with status $?, see $lg_out";
+
+    my %res;
+    open(my $lg_fh, '<', $lg_out)
+        or die "Cannot open '$lg_out' for reading: $!";
+    while(<$lg_fh>) {
+        $res{$1} = $2 if /^(\w+): (\S+)$/;
+    }
+    close($lg_fh);
+
+    my $xport = $res{transport};
+    $stats_accum{"${xport}_reqs"} += $res{received};
+    $stats_accum{edns} += $res{received} if $opts =~ /(?:^|\s)-e\b/;
+    $stats_accum{$_} += $res{"rcode_$_"} foreach (qw/noerror nxdomain refused formerr notimp/);
+    if($xport eq 'tcp') {
+        $stats_accum{tcp_conns} += $res{connections};
+        $stats_accum{tcp_close_c} += $res{connections};
+    }
+    return \%res;
+}
+
 ##### START RELOAD STUFF
 
 sub test_log_output {
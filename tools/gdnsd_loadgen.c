@@ -0,0 +1,1059 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// This source is for the gdnsd_loadgen binary, a DNS load generator meant for
+//  driving a local gdnsd over loopback harder than the daemon can answer.
+//  Queries come from a list of names or from the UDP DNS queries in a pcap
+//  file, and are sent over UDP with sendmmsg()/recvmmsg(), or over many
+//  pipelined TCP connections.  Every response is matched to its query by
+//  message ID (and connection, for TCP) and question, and the results are
+//  reported as simple "key: value" lines for people and for the testsuite.
+
+#include <config.h>
+
+#include "dnswire.h"
+#include "latency.h"
+
+#include <gdnsd/alloc.h>
+#include <gdnsd/compiler.h>
+#include <gdnsd/dname.h>
+#include <gdnsd/log.h>
+#include <gdnsd/net.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+// Responses larger than this are counted, but only their headers are checked
+#define MAX_RESPONSE 4096U
+
+// Largest query payload we'll take from a pcap
+#define MAX_QUERY 4096U
+
+// The whole message ID space, which is per-thread
+#define ID_SPACE 65536U
+
+// Window limit, leaving some IDs free so that allocation never searches far
+#define MAX_WINDOW 60000U
+
+// Responses in rcode_* output beyond these are counted as rcode_other
+#define RCODE_COUNT 6U
+static const char* const rcode_names[RCODE_COUNT] = {
+    "noerror", "formerr", "servfail", "nxdomain", "notimp", "refused",
+};
+
+static const struct {
+    const char* name;
+    unsigned qtype;
+} qtype_names[] = {
+    { "A",      DNS_TYPE_A },
+    { "NS",     DNS_TYPE_NS },
+    { "CNAME",  DNS_TYPE_CNAME },
+    { "SOA",    DNS_TYPE_SOA },
+    { "PTR",    DNS_TYPE_PTR },
+    { "MX",     DNS_TYPE_MX },
+    { "TXT",    DNS_TYPE_TXT },
+    { "AAAA",   DNS_TYPE_AAAA },
+    { "SRV",    DNS_TYPE_SRV },
+    { "NAPTR",  DNS_TYPE_NAPTR },
+    { "DS",     DNS_TYPE_DS },
+    { "DNSKEY", DNS_TYPE_DNSKEY },
+    { "SVCB",   DNS_TYPE_SVCB },
+    { "HTTPS",  DNS_TYPE_HTTPS },
+    { "CAA",    DNS_TYPE_CAA },
+    { "ANY",    DNS_TYPE_ANY },
+};
+
+typedef struct {
+    uint8_t* data;
+    unsigned len;
+    unsigned qlen; // bytes of question section following the header
+    int rcode; // expected response rcode, or -1 for any
+} lg_query_t;
+
+// State of one message ID
+typedef struct {
+    uint64_t sent_ns;
+    uint32_t seq;
+    uint32_t qidx;
+    unsigned conn;
+    bool busy;
+} lg_slot_t;
+
+// Entries of the expiry FIFO, in order of sending
+typedef struct {
+    uint32_t seq;
+    uint16_t id;
+} lg_expiry_t;
+
+typedef struct {
+    int fd;
+    unsigned outstanding;
+    uint8_t* wbuf;
+    size_t wlen;
+    size_t woff;
+    uint8_t* rbuf;
+    size_t rlen;
+} lg_conn_t;
+
+typedef struct {
+    uint64_t sent;
+    uint64_t received;
+    uint64_t lost;
+    uint64_t bad;
+    uint64_t mismatch;
+    uint64_t tc;
+    uint64_t senderr;
+    uint64_t connections;
+    uint64_t rcodes[RCODE_COUNT + 1U];
+} lg_counts_t;
+
+typedef struct {
+    pthread_t threadid;
+    unsigned idx;
+    uint64_t to_send;
+    lg_counts_t c;
+    latency_hist_t hist;
+    lg_slot_t* slots;
+    lg_expiry_t* expiry;
+    uint32_t exp_head;
+    uint32_t exp_tail;
+    unsigned outstanding;
+    uint16_t next_id;
+    uint32_t next_seq;
+    size_t qpos;
+    int udp_fd;
+    lg_conn_t* conns;
+} lg_thread_t;
+
+static struct {
+    const char* server;
+    const char* list_file;
+    const char* pcap_file;
+    uint64_t count;
+    unsigned duration;
+    double rate;
+    unsigned window;
+    unsigned threads;
+    unsigned conns;
+    unsigned batch;
+    unsigned timeout_ms;
+    bool tcp;
+    bool edns;
+    bool histogram;
+} opts = {
+    .server = "127.0.0.1:53",
+    .count = 0,
+    .duration = 0,
+    .rate = 0,
+    .window = 0,
+    .threads = 1U,
+    .conns = 1U,
+    .batch = 32U,
+    .timeout_ms = 2000U,
+};
+
+static gdnsd_anysin_t server;
+static lg_query_t* queries = NULL;
+static size_t num_queries = 0;
+static uint64_t start_ns;
+static uint64_t deadline_ns;
+static pthread_barrier_t start_barrier;
+
+F_NONNULL F_NORETURN
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+            PACKAGE_NAME " version " PACKAGE_VERSION "\n"
+            "Usage: %s (-f list_file | -p pcap_file) [-s server] [-T] [-c conns]\n"
+            "         [-t threads] [-n count | -l seconds] [-r qps] [-w window]\n"
+            "         [-b batch] [-W timeout_ms] [-e] [-H]\n"
+            "  -f - Query list, one 'name qtype [rcode]' per line, where the\n"
+            "       optional rcode is the one the response must have\n"
+            "  -p - Replay the UDP DNS queries in a pcap file\n"
+            "  -s - Server address and port, default '127.0.0.1:53'\n"
+            "  -T - Use TCP instead of UDP\n"
+            "  -c - TCP connections per thread, default 1\n"
+            "  -t - Number of threads, default 1\n"
+            "  -n - Total queries to send, default one pass over the input\n"
+            "  -l - Send for this many seconds instead of -n\n"
+            "  -r - Target total queries/sec, default unlimited\n"
+            "  -w - Outstanding queries per thread for UDP, or per connection\n"
+            "       for TCP, default 100 for UDP and 10 for TCP\n"
+            "  -b - UDP sendmmsg()/recvmmsg() batch size, default 32\n"
+            "  -W - Milliseconds until a query is counted as lost, default 2000\n"
+            "  -e - Add an EDNS OPT RR to queries from -f\n"
+            "  -H - Also output the non-empty latency histogram buckets\n",
+            argv0);
+    exit(2);
+}
+
+F_NONNULL
+static unsigned long long parse_num(const char* argv0, const char* arg, const unsigned long long min, const unsigned long long max)
+{
+    char* endptr;
+    errno = 0;
+    const unsigned long long rv = strtoull(arg, &endptr, 10);
+    if (errno || !*arg || *endptr || rv < min || rv > max)
+        usage(argv0);
+    return rv;
+}
+
+static uint64_t now_ns(void)
+{
+    return latency_now(CLOCK_MONOTONIC);
+}
+
+/***************
+ * Query input *
+ ***************/
+
+F_NONNULL
+static void add_query(const uint8_t* data, const unsigned len, const int rcode)
+{
+    // Must have a header and one complete question
+    if (len < sizeof(wire_dns_header_t) + 5U || len > MAX_QUERY)
+        return;
+    const wire_dns_header_t* hdr = (const wire_dns_header_t*)(const void*)data;
+    if (hdr->flags1 & 0x80U || ntohs(hdr->qdcount) != 1U)
+        return;
+    unsigned pos = sizeof(wire_dns_header_t);
+    while (pos < len && data[pos]) {
+        if (data[pos] & 0xC0U)
+            return;
+        pos += data[pos] + 1U;
+    }
+    pos += 5U;
+    if (pos > len)
+        return;
+
+    queries = xrealloc_n(queries, num_queries + 1U, sizeof(*queries));
+    lg_query_t* q = &queries[num_queries++];
+    q->data = xmalloc(len);
+    memcpy(q->data, data, len);
+    q->len = len;
+    q->qlen = pos - sizeof(wire_dns_header_t);
+    q->rcode = rcode;
+}
+
+F_NONNULL
+static unsigned parse_qtype(const char* str)
+{
+    for (unsigned i = 0; i < ARRAY_SIZE(qtype_names); i++)
+        if (!strcasecmp(str, qtype_names[i].name))
+            return qtype_names[i].qtype;
+    if (!strncasecmp(str, "TYPE", 4U)) {
+        char* endptr;
+        const unsigned long v = strtoul(&str[4], &endptr, 10);
+        if (!*endptr && v && v < 65536U)
+            return (unsigned)v;
+    }
+    return 0;
+}
+
+F_NONNULL
+static int parse_rcode(const char* str)
+{
+    for (unsigned i = 0; i < RCODE_COUNT; i++)
+        if (!strcasecmp(str, rcode_names[i]))
+            return (int)i;
+    return -1;
+}
+
+F_NONNULL
+static void load_list(const char* fn)
+{
+    FILE* fp = fopen(fn, "r");
+    if (!fp)
+        log_fatal("Cannot open query list '%s': %s", fn, logf_errno());
+
+    char linebuf[1024];
+    unsigned lnum = 0;
+    while (fgets(linebuf, sizeof(linebuf), fp)) {
+        lnum++;
+        char name[512], qtype_str[32], rcode_str[32];
+        const int fields = sscanf(linebuf, "%511s %31s %31s", name, qtype_str, rcode_str);
+        if (fields < 1 || name[0] == '#')
+            continue;
+        if (fields < 2)
+            log_fatal("%s:%u: expected 'name qtype [rcode]'", fn, lnum);
+        const unsigned qtype = parse_qtype(qtype_str);
+        if (!qtype)
+            log_fatal("%s:%u: unknown qtype '%s'", fn, lnum, qtype_str);
+        int rcode = -1;
+        if (fields == 3) {
+            rcode = parse_rcode(rcode_str);
+            if (rcode < 0)
+                log_fatal("%s:%u: unknown rcode '%s'", fn, lnum, rcode_str);
+        }
+
+        const size_t nlen = strlen(name);
+        if (name[nlen - 1U] != '.' && nlen < sizeof(name) - 1U) {
+            name[nlen] = '.';
+            name[nlen + 1U] = '\0';
+        }
+        uint8_t dname[256];
+        if (gdnsd_dname_from_string(dname, name, (unsigned)strlen(name)) != DNAME_VALID)
+            log_fatal("%s:%u: invalid name '%s'", fn, lnum, name);
+
+        uint8_t pkt[512];
+        memset(pkt, 0, sizeof(wire_dns_header_t));
+        wire_dns_header_t* hdr = (wire_dns_header_t*)(void*)pkt;
+        hdr->qdcount = htons(1);
+        unsigned len = sizeof(wire_dns_header_t);
+        memcpy(&pkt[len], &dname[1], dname[0]);
+        len += dname[0];
+        gdnsd_put_una16(htons((uint16_t)qtype), &pkt[len]);
+        gdnsd_put_una16(htons(DNS_CLASS_IN), &pkt[len + 2U]);
+        len += 4U;
+        if (opts.edns) {
+            hdr->arcount = htons(1);
+            pkt[len++] = 0;
+            gdnsd_put_una16(htons(DNS_TYPE_OPT), &pkt[len]);
+            gdnsd_put_una16(htons(1232U), &pkt[len + 2U]);
+            gdnsd_put_una32(0, &pkt[len + 4U]);
+            gdnsd_put_una16(0, &pkt[len + 8U]);
+            len += 10U;
+        }
+        add_query(pkt, len, rcode);
+    }
+    if (ferror(fp))
+        log_fatal("Error reading query list '%s'", fn);
+    fclose(fp);
+}
+
+// Classic libpcap format only (not pcapng), in either byte order, with the
+// link types commonly seen from tcpdump on Linux
+#define PCAP_MAGIC_US 0xA1B2C3D4U
+#define PCAP_MAGIC_NS 0xA1B23C4DU
+#define DLT_NULL_ 0U
+#define DLT_EN10MB_ 1U
+#define DLT_RAW_ 101U
+#define DLT_LOOP_ 108U
+#define DLT_LINUX_SLL_ 113U
+
+static uint32_t pcap_u32(const uint8_t* p, const bool swap)
+{
+    uint32_t v;
+    memcpy(&v, p, 4U);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+// Returns the offset of the IP header in a link-layer frame, or -1 if the
+// frame isn't IPv4 or IPv6
+F_NONNULL
+static int pcap_ip_offset(const uint32_t linktype, const uint8_t* frame, const unsigned len)
+{
+    unsigned off;
+    unsigned etype;
+    switch (linktype) {
+    case DLT_RAW_:
+        return 0;
+    case DLT_NULL_:
+    case DLT_LOOP_:
+        return len >= 4U ? 4 : -1;
+    case DLT_LINUX_SLL_:
+        if (len < 16U)
+            return -1;
+        etype = ((unsigned)frame[14] << 8) | frame[15];
+        off = 16U;
+        break;
+    case DLT_EN10MB_:
+        if (len < 14U)
+            return -1;
+        etype = ((unsigned)frame[12] << 8) | frame[13];
+        off = 14U;
+        if (etype == 0x8100U && len >= 18U) {
+            etype = ((unsigned)frame[16] << 8) | frame[17];
+            off = 18U;
+        }
+        break;
+    default:
+        return -1;
+    }
+    return (etype == 0x0800U || etype == 0x86DDU) ? (int)off : -1;
+}
+
+// Adds the payload of a UDP datagram to port 53, if there is one
+F_NONNULL
+static void pcap_packet(const uint8_t* ip, const unsigned len)
+{
+    unsigned off;
+    if (len < 1U)
+        return;
+    if ((ip[0] >> 4) == 4U) {
+        if (len < 20U)
+            return;
+        const unsigned ihl = (ip[0] & 0xFU) * 4U;
+        const unsigned frag = ((unsigned)ip[6] << 8) | ip[7];
+        if (ip[9] != 17U || (frag & 0x3FFFU) || ihl < 20U)
+            return;
+        off = ihl;
+    } else if ((ip[0] >> 4) == 6U) {
+        if (len < 40U || ip[6] != 17U)
+            return;
+        off = 40U;
+    } else {
+        return;
+    }
+    if (len < off + 8U)
+        return;
+    const unsigned dport = ((unsigned)ip[off + 2U] << 8) | ip[off + 3U];
+    const unsigned ulen = ((unsigned)ip[off + 4U] << 8) | ip[off + 5U];
+    if (dport != 53U || ulen < 8U || off + ulen > len)
+        return;
+    add_query(&ip[off + 8U], ulen - 8U, -1);
+}
+
+F_NONNULL
+static void load_pcap(const char* fn)
+{
+    FILE* fp = fopen(fn, "rb");
+    if (!fp)
+        log_fatal("Cannot open pcap file '%s': %s", fn, logf_errno());
+
+    uint8_t ghdr[24];
+    if (fread(ghdr, 1U, sizeof(ghdr), fp) != sizeof(ghdr))
+        log_fatal("pcap file '%s' is truncated", fn);
+    const uint32_t magic = pcap_u32(ghdr, false);
+    bool swap;
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS)
+        swap = false;
+    else if (__builtin_bswap32(magic) == PCAP_MAGIC_US || __builtin_bswap32(magic) == PCAP_MAGIC_NS)
+        swap = true;
+    else
+        log_fatal("'%s' is not a pcap file (pcapng is not supported)", fn);
+    const uint32_t linktype = pcap_u32(&ghdr[20], swap);
+
+    uint8_t* frame = xmalloc(65536U);
+    uint8_t rhdr[16];
+    while (fread(rhdr, 1U, sizeof(rhdr), fp) == sizeof(rhdr)) {
+        const uint32_t incl = pcap_u32(&rhdr[8], swap);
+        if (incl > 65536U)
+            log_fatal("pcap file '%s' has an invalid record length", fn);
+        if (fread(frame, 1U, incl, fp) != incl)
+            break;
+        const int ip_off = pcap_ip_offset(linktype, frame, incl);
+        if (ip_off >= 0)
+            pcap_packet(&frame[ip_off], incl - (unsigned)ip_off);
+    }
+    free(frame);
+    fclose(fp);
+}
+
+/**************************
+ * Common per-thread core *
+ **************************/
+
+// How many more queries this thread may send right now
+F_NONNULL
+static uint64_t send_allowance(const lg_thread_t* t, const uint64_t now, const unsigned window)
+{
+    if (deadline_ns) {
+        if (now >= deadline_ns)
+            return 0;
+    } else if (t->c.sent >= t->to_send) {
+        return 0;
+    }
+    uint64_t allow = deadline_ns ? UINT64_MAX : t->to_send - t->c.sent;
+    if (opts.rate > 0) {
+        const double per_thread = opts.rate / opts.threads;
+        const uint64_t due = (uint64_t)(per_thread * (double)(now - start_ns) / 1e9) + 1U;
+        allow = due > t->c.sent ? due - t->c.sent : 0;
+    }
+    const uint64_t room = window > t->outstanding ? window - t->outstanding : 0;
+    return allow < room ? allow : room;
+}
+
+// Claims a free message ID for the next query, returning it
+F_NONNULL
+static uint16_t slot_claim(lg_thread_t* t, const uint32_t qidx, const unsigned conn, const uint64_t now)
+{
+    while (t->slots[t->next_id].busy)
+        t->next_id++;
+    const uint16_t id = t->next_id++;
+    lg_slot_t* s = &t->slots[id];
+    s->busy = true;
+    s->sent_ns = now;
+    s->seq = t->next_seq++;
+    s->qidx = qidx;
+    s->conn = conn;
+    t->outstanding++;
+    return id;
+}
+
+// Un-claims an ID which wasn't actually sent after all
+F_NONNULL
+static void slot_unclaim(lg_thread_t* t, const uint16_t id)
+{
+    t->slots[id].busy = false;
+    t->outstanding--;
+}
+
+// Commits a claimed ID as sent, and queues it for expiry
+F_NONNULL
+static void slot_sent(lg_thread_t* t, const uint16_t id)
+{
+    lg_expiry_t* e = &t->expiry[t->exp_head++ & (ID_SPACE - 1U)];
+    e->id = id;
+    e->seq = t->slots[id].seq;
+    t->c.sent++;
+}
+
+F_NONNULL
+static uint32_t next_qidx(lg_thread_t* t)
+{
+    const uint32_t qidx = (uint32_t)t->qpos;
+    if (++t->qpos == num_queries)
+        t->qpos = 0;
+    return qidx;
+}
+
+F_NONNULL
+static void handle_response(lg_thread_t* t, const uint8_t* buf, const size_t len, const unsigned conn, const uint64_t now)
+{
+    if (len < sizeof(wire_dns_header_t)) {
+        t->c.bad++;
+        return;
+    }
+    const wire_dns_header_t* hdr = (const wire_dns_header_t*)(const void*)buf;
+    lg_slot_t* s = &t->slots[hdr->id];
+    if (!s->busy || s->conn != conn || !(hdr->flags1 & 0x80U)) {
+        t->c.bad++;
+        return;
+    }
+
+    const lg_query_t* q = &queries[s->qidx];
+    const unsigned rcode = hdr->flags2 & 0xFU;
+    const bool tc = hdr->flags1 & 0x02U;
+    s->busy = false;
+    t->outstanding--;
+    if (t->conns)
+        t->conns[conn].outstanding--;
+
+    // Formerr and notimp responses aren't required to echo the question
+    if (rcode != DNS_RCODE_FORMERR && rcode != DNS_RCODE_NOTIMP
+            && (len < sizeof(wire_dns_header_t) + q->qlen
+                || ntohs(hdr->qdcount) != 1U
+                || memcmp(&buf[sizeof(wire_dns_header_t)], &q->data[sizeof(wire_dns_header_t)], q->qlen))) {
+        t->c.bad++;
+        return;
+    }
+
+    t->c.received++;
+    latency_record(&t->hist, now - s->sent_ns);
+    t->c.rcodes[rcode < RCODE_COUNT ? rcode : RCODE_COUNT]++;
+    if (tc)
+        t->c.tc++;
+    if (q->rcode >= 0 && (unsigned)q->rcode != rcode)
+        t->c.mismatch++;
+}
+
+// Expires outstanding queries older than the timeout as lost
+F_NONNULL
+static void expire(lg_thread_t* t, const uint64_t now)
+{
+    const uint64_t timeout_ns = (uint64_t)opts.timeout_ms * 1000000U;
+    while (t->exp_tail != t->exp_head) {
+        const lg_expiry_t* e = &t->expiry[t->exp_tail & (ID_SPACE - 1U)];
+        lg_slot_t* s = &t->slots[e->id];
+        if (s->busy && s->seq == e->seq) {
+            if (now - s->sent_ns < timeout_ns)
+                break;
+            s->busy = false;
+            t->outstanding--;
+            if (t->conns)
+                t->conns[s->conn].outstanding--;
+            t->c.lost++;
+        }
+        t->exp_tail++;
+    }
+}
+
+// Whether the thread is still sending, or waiting on responses
+F_NONNULL
+static bool thread_active(const lg_thread_t* t, const uint64_t now)
+{
+    if (t->outstanding)
+        return true;
+    if (deadline_ns)
+        return now < deadline_ns;
+    return t->c.sent < t->to_send;
+}
+
+/*******
+ * UDP *
+ *******/
+
+F_NONNULL
+static void udp_run(lg_thread_t* t)
+{
+    t->udp_fd = socket(server.sa.sa_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (t->udp_fd < 0)
+        log_fatal("socket() failed: %s", logf_errno());
+    const int bufsize = 4 * 1024 * 1024;
+    setsockopt(t->udp_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(t->udp_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    if (connect(t->udp_fd, &server.sa, server.len))
+        log_fatal("connect() to %s failed: %s", logf_anysin(&server), logf_errno());
+
+    const unsigned batch = opts.batch;
+    struct mmsghdr* smsgs = xcalloc_n(batch, sizeof(*smsgs));
+    struct iovec* siovs = xcalloc_n(batch * 2U, sizeof(*siovs));
+    uint16_t* sids = xcalloc_n(batch, sizeof(*sids));
+    struct mmsghdr* rmsgs = xcalloc_n(batch, sizeof(*rmsgs));
+    struct iovec* riovs = xcalloc_n(batch, sizeof(*riovs));
+    uint8_t* rbufs = xmalloc_n(batch, MAX_RESPONSE);
+    for (unsigned i = 0; i < batch; i++) {
+        smsgs[i].msg_hdr.msg_iov = &siovs[i * 2U];
+        smsgs[i].msg_hdr.msg_iovlen = 2U;
+        riovs[i].iov_base = &rbufs[i * MAX_RESPONSE];
+        riovs[i].iov_len = MAX_RESPONSE;
+        rmsgs[i].msg_hdr.msg_iov = &riovs[i];
+        rmsgs[i].msg_hdr.msg_iovlen = 1U;
+    }
+
+    bool blocked = false;
+    uint64_t now = now_ns();
+    while (thread_active(t, now)) {
+        bool progress = false;
+
+        // The ID goes out from its own little buffer, and the rest of the
+        // query straight from the shared copy
+        uint64_t allow = blocked ? 0 : send_allowance(t, now, opts.window);
+        while (allow) {
+            const unsigned n = allow < batch ? (unsigned)allow : batch;
+            for (unsigned i = 0; i < n; i++) {
+                const uint32_t qidx = next_qidx(t);
+                const lg_query_t* q = &queries[qidx];
+                sids[i] = slot_claim(t, qidx, 0, now);
+                siovs[i * 2U].iov_base = &sids[i];
+                siovs[i * 2U].iov_len = 2U;
+                siovs[i * 2U + 1U].iov_base = &q->data[2];
+                siovs[i * 2U + 1U].iov_len = q->len - 2U;
+            }
+            int sent = sendmmsg(t->udp_fd, smsgs, n, 0);
+            if (sent < 0) {
+                if (ERRNO_WOULDBLOCK || errno == ENOBUFS)
+                    blocked = true;
+                else
+                    t->c.senderr += n;
+                sent = 0;
+            }
+            for (unsigned i = 0; i < (unsigned)sent; i++)
+                slot_sent(t, sids[i]);
+            for (unsigned i = (unsigned)sent; i < n; i++)
+                slot_unclaim(t, sids[i]);
+            if (sent)
+                progress = true;
+            if ((unsigned)sent < n)
+                break;
+            allow -= n;
+        }
+
+        while (1) {
+            const int got = recvmmsg(t->udp_fd, rmsgs, batch, MSG_DONTWAIT, NULL);
+            if (got <= 0)
+                break;
+            now = now_ns();
+            for (int i = 0; i < got; i++)
+                handle_response(t, &rbufs[(unsigned)i * MAX_RESPONSE], rmsgs[i].msg_len, 0, now);
+            progress = true;
+            blocked = false;
+        }
+
+        now = now_ns();
+        expire(t, now);
+
+        if (!progress) {
+            struct pollfd pfd = {
+                .fd = t->udp_fd,
+                .events = POLLIN | (blocked ? POLLOUT : 0),
+            };
+            if (poll(&pfd, 1, 1) > 0 && (pfd.revents & POLLOUT))
+                blocked = false;
+            now = now_ns();
+        }
+    }
+
+    close(t->udp_fd);
+    free(rbufs);
+    free(riovs);
+    free(rmsgs);
+    free(sids);
+    free(siovs);
+    free(smsgs);
+}
+
+/*******
+ * TCP *
+ *******/
+
+F_NONNULL
+static void tcp_connect(lg_thread_t* t, lg_conn_t* c)
+{
+    c->fd = socket(server.sa.sa_family, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (c->fd < 0)
+        log_fatal("socket() failed: %s", logf_errno());
+    const int opt_one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &opt_one, sizeof(opt_one));
+    if (connect(c->fd, &server.sa, server.len))
+        log_fatal("connect() to %s failed: %s", logf_anysin(&server), logf_errno());
+    if (fcntl(c->fd, F_SETFL, O_NONBLOCK))
+        log_fatal("fcntl(O_NONBLOCK) failed: %s", logf_errno());
+    c->wlen = c->woff = c->rlen = 0;
+    t->c.connections++;
+}
+
+// Lost connections are re-established, and their outstanding queries are
+// left to expire as lost
+F_NONNULL
+static void tcp_close(lg_conn_t* c)
+{
+    close(c->fd);
+    c->fd = -1;
+}
+
+F_NONNULL
+static void tcp_fill(lg_thread_t* t, lg_conn_t* c, const unsigned ci, const uint64_t now)
+{
+    const unsigned room = opts.window > c->outstanding ? opts.window - c->outstanding : 0;
+    uint64_t allow = send_allowance(t, now, opts.window * opts.conns);
+    if (allow > room)
+        allow = room;
+    for (uint64_t i = 0; i < allow; i++) {
+        const uint32_t qidx = next_qidx(t);
+        const lg_query_t* q = &queries[qidx];
+        const uint16_t id = slot_claim(t, qidx, ci, now);
+        uint8_t* w = &c->wbuf[c->wlen];
+        gdnsd_put_una16(htons((uint16_t)q->len), w);
+        memcpy(&w[2], q->data, q->len);
+        gdnsd_put_una16(id, &w[2]);
+        c->wlen += q->len + 2U;
+        c->outstanding++;
+        slot_sent(t, id);
+    }
+}
+
+// Returns false if the connection was lost
+F_NONNULL
+static bool tcp_write(lg_thread_t* t, lg_conn_t* c)
+{
+    while (c->woff < c->wlen) {
+        const ssize_t rv = send(c->fd, &c->wbuf[c->woff], c->wlen - c->woff, MSG_NOSIGNAL);
+        if (rv < 0) {
+            if (ERRNO_WOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+            t->c.senderr++;
+            return false;
+        }
+        c->woff += (size_t)rv;
+    }
+    c->woff = c->wlen = 0;
+    return true;
+}
+
+// Returns false if the connection was lost
+F_NONNULL
+static bool tcp_read(lg_thread_t* t, lg_conn_t* c, const unsigned ci)
+{
+    while (1) {
+        const ssize_t rv = recv(c->fd, &c->rbuf[c->rlen], 65537U - c->rlen, 0);
+        if (rv == 0)
+            return false;
+        if (rv < 0) {
+            if (ERRNO_WOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        c->rlen += (size_t)rv;
+        const uint64_t now = now_ns();
+        size_t off = 0;
+        while (c->rlen - off >= 2U) {
+            const size_t flen = ntohs(gdnsd_get_una16(&c->rbuf[off]));
+            if (c->rlen - off < flen + 2U)
+                break;
+            handle_response(t, &c->rbuf[off + 2U], flen, ci, now);
+            off += flen + 2U;
+        }
+        if (off) {
+            memmove(c->rbuf, &c->rbuf[off], c->rlen - off);
+            c->rlen -= off;
+        }
+    }
+}
+
+F_NONNULL
+static void tcp_run(lg_thread_t* t)
+{
+    const unsigned nconns = opts.conns;
+    t->conns = xcalloc_n(nconns, sizeof(*t->conns));
+    struct pollfd* pfds = xcalloc_n(nconns, sizeof(*pfds));
+    size_t max_qlen = 0;
+    for (size_t i = 0; i < num_queries; i++)
+        if (queries[i].len > max_qlen)
+            max_qlen = queries[i].len;
+    for (unsigned i = 0; i < nconns; i++) {
+        lg_conn_t* c = &t->conns[i];
+        c->wbuf = xmalloc_n(opts.window, max_qlen + 2U);
+        c->rbuf = xmalloc(65537U);
+        tcp_connect(t, c);
+    }
+
+    uint64_t now = now_ns();
+    while (thread_active(t, now)) {
+        for (unsigned i = 0; i < nconns; i++) {
+            lg_conn_t* c = &t->conns[i];
+            if (c->fd < 0) {
+                if (c->outstanding)
+                    continue; // wait for these to expire first
+                tcp_connect(t, c);
+            }
+            if (!c->wlen)
+                tcp_fill(t, c, i, now);
+            if (c->wlen && !tcp_write(t, c))
+                tcp_close(c);
+            pfds[i].fd = c->fd;
+            pfds[i].events = POLLIN | (c->wlen ? POLLOUT : 0);
+            pfds[i].revents = 0;
+        }
+
+        if (poll(pfds, nconns, 1) > 0) {
+            for (unsigned i = 0; i < nconns; i++) {
+                lg_conn_t* c = &t->conns[i];
+                if (c->fd >= 0 && (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !tcp_read(t, c, i))
+                    tcp_close(c);
+            }
+        }
+
+        now = now_ns();
+        expire(t, now);
+    }
+
+    for (unsigned i = 0; i < nconns; i++) {
+        if (t->conns[i].fd >= 0)
+            tcp_close(&t->conns[i]);
+        free(t->conns[i].wbuf);
+        free(t->conns[i].rbuf);
+    }
+    free(pfds);
+}
+
+F_NONNULL
+static void* lg_thread(void* t_asvoid)
+{
+    lg_thread_t* t = t_asvoid;
+    t->slots = xcalloc_n(ID_SPACE, sizeof(*t->slots));
+    t->expiry = xcalloc_n(ID_SPACE, sizeof(*t->expiry));
+    t->qpos = (num_queries * t->idx) / opts.threads;
+    pthread_barrier_wait(&start_barrier);
+    if (opts.tcp)
+        tcp_run(t);
+    else
+        udp_run(t);
+    free(t->expiry);
+    free(t->slots);
+    return NULL;
+}
+
+/**********
+ * Report *
+ **********/
+
+static uint64_t hist_pctl(const uint64_t* buckets, const uint64_t count, const unsigned pctl_thou)
+{
+    const uint64_t rank = ((count * pctl_thou) + 999U) / 1000U;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen && seen >= rank)
+            return latency_bucket_upper(i);
+    }
+    return 0;
+}
+
+F_NONNULL
+static void report(const lg_thread_t* threads, const uint64_t elapsed_ns)
+{
+    lg_counts_t tot;
+    memset(&tot, 0, sizeof(tot));
+    uint64_t* buckets = xcalloc_n(LATENCY_BUCKETS, sizeof(*buckets));
+    for (unsigned i = 0; i < opts.threads; i++) {
+        const lg_counts_t* c = &threads[i].c;
+        tot.sent += c->sent;
+        tot.received += c->received;
+        tot.lost += c->lost;
+        tot.bad += c->bad;
+        tot.mismatch += c->mismatch;
+        tot.tc += c->tc;
+        tot.senderr += c->senderr;
+        tot.connections += c->connections;
+        for (unsigned j = 0; j <= RCODE_COUNT; j++)
+            tot.rcodes[j] += c->rcodes[j];
+        for (unsigned j = 0; j < LATENCY_BUCKETS; j++)
+            buckets[j] += stats_get(&threads[i].hist.b[j]);
+    }
+
+    const double secs = (double)elapsed_ns / 1e9;
+    printf("transport: %s\n", opts.tcp ? "tcp" : "udp");
+    printf("elapsed: %.3f\n", secs);
+    printf("sent: %" PRIu64 "\n", tot.sent);
+    printf("received: %" PRIu64 "\n", tot.received);
+    printf("lost: %" PRIu64 "\n", tot.lost);
+    printf("loss_pct: %.3f\n", tot.sent ? (100.0 * (double)tot.lost / (double)tot.sent) : 0.0);
+    printf("bad: %" PRIu64 "\n", tot.bad);
+    printf("rcode_mismatch: %" PRIu64 "\n", tot.mismatch);
+    printf("tc: %" PRIu64 "\n", tot.tc);
+    printf("send_errors: %" PRIu64 "\n", tot.senderr);
+    if (opts.tcp)
+        printf("connections: %" PRIu64 "\n", tot.connections);
+    for (unsigned i = 0; i < RCODE_COUNT; i++)
+        printf("rcode_%s: %" PRIu64 "\n", rcode_names[i], tot.rcodes[i]);
+    printf("rcode_other: %" PRIu64 "\n", tot.rcodes[RCODE_COUNT]);
+    printf("qps: %.0f\n", secs > 0 ? (double)tot.received / secs : 0.0);
+    printf("latency_p50_ns: %" PRIu64 "\n", hist_pctl(buckets, tot.received, 500U));
+    printf("latency_p90_ns: %" PRIu64 "\n", hist_pctl(buckets, tot.received, 900U));
+    printf("latency_p99_ns: %" PRIu64 "\n", hist_pctl(buckets, tot.received, 990U));
+    printf("latency_p999_ns: %" PRIu64 "\n", hist_pctl(buckets, tot.received, 999U));
+    printf("latency_max_ns: %" PRIu64 "\n", hist_pctl(buckets, tot.received, 1000U));
+    if (opts.histogram)
+        for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+            if (buckets[i])
+                printf("hist: %" PRIu64 " %" PRIu64 "\n", latency_bucket_lower(i), buckets[i]);
+    free(buckets);
+}
+
+int main(int argc, char** argv)
+{
+    int optchar;
+    while ((optchar = getopt(argc, argv, "f:p:s:Tc:t:n:l:r:w:b:W:eH")) != -1) {
+        switch (optchar) {
+        case 'f':
+            opts.list_file = optarg;
+            break;
+        case 'p':
+            opts.pcap_file = optarg;
+            break;
+        case 's':
+            opts.server = optarg;
+            break;
+        case 'T':
+            opts.tcp = true;
+            break;
+        case 'c':
+            opts.conns = (unsigned)parse_num(argv[0], optarg, 1LLU, 4096LLU);
+            break;
+        case 't':
+            opts.threads = (unsigned)parse_num(argv[0], optarg, 1LLU, 1024LLU);
+            break;
+        case 'n':
+            opts.count = parse_num(argv[0], optarg, 1LLU, UINT64_MAX);
+            break;
+        case 'l':
+            opts.duration = (unsigned)parse_num(argv[0], optarg, 1LLU, 86400LLU);
+            break;
+        case 'r':
+            opts.rate = (double)parse_num(argv[0], optarg, 1LLU, 100000000LLU);
+            break;
+        case 'w':
+            opts.window = (unsigned)parse_num(argv[0], optarg, 1LLU, MAX_WINDOW);
+            break;
+        case 'b':
+            opts.batch = (unsigned)parse_num(argv[0], optarg, 1LLU, 1024LLU);
+            break;
+        case 'W':
+            opts.timeout_ms = (unsigned)parse_num(argv[0], optarg, 1LLU, 600000LLU);
+            break;
+        case 'e':
+            opts.edns = true;
+            break;
+        case 'H':
+            opts.histogram = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || !opts.list_file == !opts.pcap_file || (opts.count && opts.duration))
+        usage(argv[0]);
+
+    if (!opts.window)
+        opts.window = opts.tcp ? 10U : 100U;
+    if (opts.tcp && opts.window * opts.conns > MAX_WINDOW)
+        log_fatal("TCP window times connections must not exceed %u", MAX_WINDOW);
+
+    const int addr_err = gdnsd_anysin_fromstr(opts.server, 53U, &server);
+    if (addr_err)
+        log_fatal("Could not parse server address '%s': %s", opts.server, gai_strerror(addr_err));
+
+    if (opts.list_file)
+        load_list(opts.list_file);
+    else
+        load_pcap(opts.pcap_file);
+    if (!num_queries)
+        log_fatal("No usable queries in the input");
+    if (!opts.count)
+        opts.count = num_queries;
+
+    lg_thread_t* threads = xcalloc_n(opts.threads, sizeof(*threads));
+    for (unsigned i = 0; i < opts.threads; i++) {
+        threads[i].idx = i;
+        threads[i].to_send = (opts.count / opts.threads) + (i < (opts.count % opts.threads) ? 1U : 0);
+    }
+
+    if (pthread_barrier_init(&start_barrier, NULL, opts.threads + 1U))
+        log_fatal("pthread_barrier_init() failed");
+    for (unsigned i = 0; i < opts.threads; i++) {
+        const int pthread_err = pthread_create(&threads[i].threadid, NULL, lg_thread, &threads[i]);
+        if (pthread_err)
+            log_fatal("pthread_create() failed: %s", logf_strerror(pthread_err));
+    }
+
+    start_ns = now_ns();
+    if (opts.duration)
+        deadline_ns = start_ns + ((uint64_t)opts.duration * UINT64_C(1000000000));
+    pthread_barrier_wait(&start_barrier);
+    for (unsigned i = 0; i < opts.threads; i++) {
+        const int pthread_err = pthread_join(threads[i].threadid, NULL);
+        if (pthread_err)
+            log_fatal("pthread_join() failed: %s", logf_strerror(pthread_err));
+    }
+
+    report(threads, now_ns() - start_ns);
+    return 0;
+}
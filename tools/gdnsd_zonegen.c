@@ -0,0 +1,313 @@
+/* Copyright © 2024 Brandon L Black <blblack@gmail.com>
+ *
+ * This file is part of gdnsd.
+ *
+ * gdnsd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gdnsd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gdnsd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// This source is for the gdnsd_zonegen binary, which writes out a synthetic
+//  configuration directory of arbitrarily-large zone data for load-time and
+//  memory benchmarking (e.g. with "gdnsd_bench -L").  The shape of the data
+//  is controlled by the number of zones and records, the depth of the names,
+//  the size of the address RRsets, and the fractions of wildcards and
+//  delegations, and the records can be spread over $INCLUDE files.  The
+//  output depends only on the options, so runs are comparable across builds.
+
+#include <config.h>
+
+#include <gdnsd/alloc.h>
+#include <gdnsd/compiler.h>
+#include <gdnsd/log.h>
+#include <gdnsd/misc.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Zone names are z<N>.example, and each record's owner name is built from its
+// index within its zone, so no two records ever share an owner
+#define ZONE_SUFFIX ".example"
+
+// Longest owner name we'll generate, in presentation format
+#define MAX_OWNER 256U
+
+typedef struct {
+    const char* outdir;
+    unsigned zones;
+    unsigned long records;
+    unsigned depth;
+    unsigned rrset_size;
+    unsigned wild_pct;
+    unsigned deleg_pct;
+    unsigned includes;
+} zonegen_opts_t;
+
+static zonegen_opts_t opts = {
+    .outdir = NULL,
+    .zones = 1U,
+    .records = 100000LU,
+    .depth = 1U,
+    .rrset_size = 1U,
+    .wild_pct = 0U,
+    .deleg_pct = 0U,
+    .includes = 0U,
+};
+
+F_NONNULL F_NORETURN
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+            PACKAGE_NAME " version " PACKAGE_VERSION "\n"
+            "Usage: %s -o outdir [-z zones] [-r records] [-d depth] [-s rrset_size]\n"
+            "         [-w wildcard_pct] [-g delegation_pct] [-i includes]\n"
+            "  -o - Output directory, which gets zones/, a names file, and a\n"
+            "       minimal config if it does not already have one\n"
+            "  -z - Number of zones, default 1\n"
+            "  -r - Records per zone, default 100000\n"
+            "  -d - Labels per owner name below the zone, default 1\n"
+            "  -s - Addresses per A/AAAA RRset, default 1\n"
+            "  -w - Percentage of records which are wildcards, default 0\n"
+            "  -g - Percentage of records which are delegations with glue,\n"
+            "       default 0\n"
+            "  -i - Spread each zone's records over this many $INCLUDE files,\n"
+            "       default 0 (none)\n"
+            "The rest of the records are a fixed mix of 60%% A, 20%% AAAA,\n"
+            "10%% CNAME, 5%% MX, and 5%% TXT.  The names file lists every A\n"
+            "owner name, for use with gdnsd_bench -f.\n",
+            argv0);
+    exit(2);
+}
+
+F_NONNULL
+static unsigned long parse_num(const char* argv0, const char* arg, const unsigned long min, const unsigned long max)
+{
+    char* endptr;
+    errno = 0;
+    const unsigned long rv = strtoul(arg, &endptr, 10);
+    if (errno || !*arg || *endptr || rv < min || rv > max)
+        usage(argv0);
+    return rv;
+}
+
+F_NONNULL
+static void parse_args(const int argc, char** argv)
+{
+    int optchar;
+    while ((optchar = getopt(argc, argv, "o:z:r:d:s:w:g:i:")) != -1) {
+        switch (optchar) {
+        case 'o':
+            opts.outdir = optarg;
+            break;
+        case 'z':
+            opts.zones = (unsigned)parse_num(argv[0], optarg, 1LU, 10000000LU);
+            break;
+        case 'r':
+            opts.records = parse_num(argv[0], optarg, 0LU, 1000000000LU);
+            break;
+        case 'd':
+            opts.depth = (unsigned)parse_num(argv[0], optarg, 1LU, 40LU);
+            break;
+        case 's':
+            opts.rrset_size = (unsigned)parse_num(argv[0], optarg, 1LU, 256LU);
+            break;
+        case 'w':
+            opts.wild_pct = (unsigned)parse_num(argv[0], optarg, 0LU, 100LU);
+            break;
+        case 'g':
+            opts.deleg_pct = (unsigned)parse_num(argv[0], optarg, 0LU, 100LU);
+            break;
+        case 'i':
+            opts.includes = (unsigned)parse_num(argv[0], optarg, 0LU, 100000LU);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || !opts.outdir || opts.wild_pct + opts.deleg_pct > 100U)
+        usage(argv[0]);
+}
+
+F_NONNULL
+static void make_dir(const char* path)
+{
+    if (mkdir(path, 0755) && errno != EEXIST)
+        log_fatal("mkdir('%s') failed: %s", path, logf_errno());
+}
+
+F_NONNULL
+static FILE* open_out(const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+        log_fatal("Cannot open '%s' for writing: %s", path, logf_errno());
+    return fp;
+}
+
+F_NONNULL
+static void close_out(FILE* fp, const char* path)
+{
+    if (ferror(fp) || fclose(fp))
+        log_fatal("Error writing '%s': %s", path, logf_errno());
+}
+
+// Writes the relative owner name for record idx, with the given leading label
+// character: the record's own label, then depth-1 intermediate labels which
+// group the records 16 ways per level, so that deeper names share ancestors
+F_NONNULL
+static void owner_name(char* out, const char lchar, const unsigned long idx)
+{
+    size_t len = (size_t)snprintf(out, MAX_OWNER, "%c%lu", lchar, idx);
+    for (unsigned lvl = 1; lvl < opts.depth; lvl++)
+        len += (size_t)snprintf(&out[len], MAX_OWNER - len, ".p%lu",
+                                (idx >> (4U * (lvl < 16U ? lvl : 15U))) & 15LU);
+}
+
+// Writes one record (or RRset, or delegation with its glue), and adds the
+// owner name to the names file if it's an A RRset
+F_NONNULL
+static void write_record(FILE* fp, FILE* names, const char* zname, const unsigned long idx)
+{
+    char owner[MAX_OWNER];
+    const unsigned pct = (unsigned)(idx % 100LU);
+
+    if (pct < opts.wild_pct) {
+        owner_name(owner, 'w', idx);
+        fprintf(fp, "*.%s A 10.%lu.%lu.%lu\n", owner,
+                (idx >> 16) & 0xFFLU, (idx >> 8) & 0xFFLU, idx & 0xFFLU);
+        return;
+    }
+
+    if (pct < opts.wild_pct + opts.deleg_pct) {
+        owner_name(owner, 'd', idx);
+        fprintf(fp, "%s NS ns1.%s\n%s NS ns2.%s\n", owner, owner, owner, owner);
+        fprintf(fp, "ns1.%s A 172.16.%lu.%lu\nns2.%s AAAA 2001:db8:ffff::%lx\n",
+                owner, (idx >> 8) & 0xFFLU, idx & 0xFFLU, owner, idx & 0xFFFFLU);
+        return;
+    }
+
+    // Offset by the hundreds, so that the type mix isn't skewed by which
+    // percentiles went to wildcards and delegations above
+    owner_name(owner, 'h', idx);
+    const unsigned mix = (unsigned)((idx + idx / 100LU) % 20LU);
+    if (mix < 12U) {
+        for (unsigned k = 0; k < opts.rrset_size; k++)
+            fprintf(fp, "%s A 10.%lu.%lu.%u\n", owner,
+                    (idx >> 8) & 0xFFLU, idx & 0xFFLU, k);
+        fprintf(names, "%s.%s\n", owner, zname);
+    } else if (mix < 16U) {
+        for (unsigned k = 0; k < opts.rrset_size; k++)
+            fprintf(fp, "%s AAAA 2001:db8:%lx:%lx::%x\n", owner,
+                    (idx >> 16) & 0xFFFFLU, idx & 0xFFFFLU, k);
+    } else if (mix < 18U) {
+        fprintf(fp, "%s CNAME ns1\n", owner);
+    } else if (mix < 19U) {
+        fprintf(fp, "%s MX 10 ns1\n%s MX 20 ns2\n", owner, owner);
+    } else {
+        fprintf(fp, "%s TXT \"synthetic record %lu\"\n", owner, idx);
+    }
+}
+
+F_NONNULL
+static void write_zone(const char* zones_dir, FILE* names, const unsigned zidx)
+{
+    char zname[32];
+    snprintf(zname, sizeof(zname), "z%u" ZONE_SUFFIX, zidx);
+    char* path = gdnsd_str_combine_n(3, zones_dir, "/", zname);
+    FILE* fp = open_out(path);
+
+    fprintf(fp,
+            "$TTL 3600\n"
+            "@ SOA ns1 hostmaster 1 7200 1800 259200 900\n"
+            "@ NS ns1\n"
+            "@ NS ns2\n"
+            "ns1 A 192.0.2.1\n"
+            "ns2 A 192.0.2.2\n");
+
+    if (!opts.includes) {
+        for (unsigned long i = 0; i < opts.records; i++)
+            write_record(fp, names, zname, i);
+    } else {
+        // Contiguous chunks of the records, one per file, in zones/inc/
+        // (which the zones directory scan skips, as a subdirectory)
+        const unsigned long per = (opts.records + opts.includes - 1LU) / opts.includes;
+        for (unsigned k = 0; k < opts.includes; k++) {
+            char incname[48];
+            snprintf(incname, sizeof(incname), "inc/%s.%u", zname, k);
+            fprintf(fp, "$INCLUDE %s\n", incname);
+            char* incpath = gdnsd_str_combine_n(3, zones_dir, "/", incname);
+            FILE* incfp = open_out(incpath);
+            const unsigned long first = k * per;
+            const unsigned long last = first + per < opts.records ? first + per : opts.records;
+            for (unsigned long i = first; i < last; i++)
+                write_record(incfp, names, zname, i);
+            close_out(incfp, incpath);
+            free(incpath);
+        }
+    }
+
+    close_out(fp, path);
+    free(path);
+}
+
+// Writes a config keeping the daemon's runtime paths inside outdir, unless
+// one already exists
+static void write_config(void)
+{
+    char* path = gdnsd_str_combine_n(2, opts.outdir, "/config");
+    struct stat st;
+    if (stat(path, &st)) {
+        if (errno != ENOENT)
+            log_fatal("Cannot stat '%s': %s", path, logf_errno());
+        char* absdir = realpath(opts.outdir, NULL);
+        if (!absdir)
+            log_fatal("realpath('%s') failed: %s", opts.outdir, logf_errno());
+        FILE* fp = open_out(path);
+        fprintf(fp, "options => {\n  run_dir = %s/run\n  state_dir = %s/state\n}\n",
+                absdir, absdir);
+        close_out(fp, path);
+        free(absdir);
+    }
+    free(path);
+}
+
+int main(int argc, char** argv)
+{
+    umask(022);
+    parse_args(argc, argv);
+
+    make_dir(opts.outdir);
+    write_config();
+    char* zones_dir = gdnsd_str_combine_n(2, opts.outdir, "/zones");
+    make_dir(zones_dir);
+    if (opts.includes) {
+        char* inc_dir = gdnsd_str_combine_n(2, zones_dir, "/inc");
+        make_dir(inc_dir);
+        free(inc_dir);
+    }
+
+    char* names_path = gdnsd_str_combine_n(2, opts.outdir, "/names");
+    FILE* names = open_out(names_path);
+    for (unsigned z = 0; z < opts.zones; z++)
+        write_zone(zones_dir, names, z);
+    close_out(names, names_path);
+
+    free(names_path);
+    free(zones_dir);
+    return 0;
+}